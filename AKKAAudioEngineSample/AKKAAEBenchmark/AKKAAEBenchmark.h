@@ -0,0 +1,64 @@
+//
+//  AKKAAEBenchmark.h
+//  AKKAAEBenchmark
+//
+//  Created by 张一鸣 on 2016/12/6.
+//  Copyright (c) 2016 AKKA. All rights reserved.
+//
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "AKKAAEDSPKernels.h"
+
+//! Frame counts every sweep covers, from a small IO buffer to the largest slice
+extern const UInt32 kBenchmarkFrameCounts[];
+extern const int kBenchmarkFrameCountsCount;
+
+//! Channel counts the multichannel sweeps cover
+extern const int kBenchmarkChannelCounts[];
+extern const int kBenchmarkChannelCountsCount;
+
+//! The work to time: called repeatedly with the context given to AKKAAEBenchmarkRecord
+typedef void (*AKKAAEBenchmarkFunction)(void * _Nonnull context);
+
+/*!
+ * Time a function and add the result to the run's results
+ *
+ *  The iteration count is doubled until a run takes 20 ms; the best of three such runs is kept,
+ *  as the XCTest microbenchmark suite does. Results are matched between runs by name, backend,
+ *  frames, channels and depth.
+ *
+ * @param name Benchmark name, as the XCTest microbenchmark suite names it
+ * @param backend The kernel backend the work ran on, or "none"
+ * @param frames The frame count swept, or 0
+ * @param channels The channel count swept, or 0
+ * @param depth The stack depth or item count swept, or 0
+ * @param processed Frames processed by one call, for the throughput figure, or 0 if it doesn't process audio
+ * @param function The work to time
+ * @param context Passed to the function
+ */
+void AKKAAEBenchmarkRecord(const char * _Nonnull name, const char * _Nonnull backend, UInt32 frames, int channels,
+                           int depth, UInt32 processed, AKKAAEBenchmarkFunction _Nonnull function, void * _Nullable context);
+
+/*!
+ * Fill a buffer with white noise between -1 and 1
+ *
+ * @param buffer The samples
+ * @param frames Number of samples
+ */
+void AKKAAEBenchmarkFillNoise(float * _Nonnull buffer, UInt32 frames);
+
+#if AKKAAE_BENCHMARK_ENGINE
+/*!
+ * Run the engine benchmarks: buffer stack, DSP utilities, managed values and arrays
+ *
+ *  These need AudioToolbox and the Objective-C runtime, so are built on Apple platforms only.
+ */
+void AKKAAEBenchmarkRunEngine(void);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,304 @@
+//
+//  AKKAAEBenchmarkEngine.m
+//  AKKAAEBenchmark
+//
+//  Created by 张一鸣 on 2016/12/6.
+//  Copyright (c) 2016 AKKA. All rights reserved.
+//
+//  The engine half of the headless benchmark: the same sweeps, under the same names, as the XCTest
+//  microbenchmark suite, so results from either can be read side by side.
+//
+
+#import <Foundation/Foundation.h>
+#import "AKKAAEBenchmark.h"
+#import "AKKAAETypes.h"
+#import "AKKAAEBufferStack.h"
+#import "AKKAAEDSPUtilties.h"
+#import "AKKAAEAudioBufferListUtilities.h"
+#import "AKKAAEManagedValue.h"
+#import "AKKAAEArray.h"
+
+static const int kDepths[] = { 1, 8, 32 };
+static const int kDepthsCount = sizeof(kDepths) / sizeof(int);
+static const int kReadsPerCall = 1024;
+#define kMixInputCount 8
+
+// Gains applied in place shrink the samples call after call; restoring them this often keeps them far
+// from denormal range, where the arithmetic slows down, at a small cost that's the same for every run
+static const int kRefillInterval = 32;
+
+typedef struct {
+    AKKAAEBufferStack * stack;
+    int depth;
+    int channels;
+    float volume;
+    float balance;
+    const float * noise;
+    int calls;
+} AKKAAEBufferStackBenchmarkContext;
+
+typedef enum {
+    AKKAAEDSPBenchmarkApplyGain,
+    AKKAAEDSPBenchmarkApplyRamp,
+    AKKAAEDSPBenchmarkApplyEqualPowerRamp,
+    AKKAAEDSPBenchmarkApplyGainSmoothed,
+    AKKAAEDSPBenchmarkApplyGainWithRamp,
+    AKKAAEDSPBenchmarkApplyVolumeAndBalance,
+    AKKAAEDSPBenchmarkMix,
+    AKKAAEDSPBenchmarkMixMultiple,
+    AKKAAEDSPBenchmarkSilence,
+    AKKAAEDSPBenchmarkApplyGainSmoothedMono,
+    AKKAAEDSPBenchmarkMixMono,
+    AKKAAEDSPBenchmarkGenerateOscillator,
+    AKKAAEDSPBenchmarkCount,
+} AKKAAEDSPBenchmark;
+
+static const char * kDSPBenchmarkNames[AKKAAEDSPBenchmarkCount] = {
+    "dsp.applyGain", "dsp.applyRamp", "dsp.applyEqualPowerRamp", "dsp.applyGainSmoothed", "dsp.applyGainWithRamp",
+    "dsp.applyVolumeAndBalance", "dsp.mix", "dsp.mixMultiple", "dsp.silence", "dsp.applyGainSmoothedMono",
+    "dsp.mixMono", "dsp.generateOscillator",
+};
+
+typedef struct {
+    AKKAAEDSPBenchmark benchmark;
+    UInt32 frames;
+    AudioBufferList * inputs[kMixInputCount];
+    AudioBufferList * buffer;
+    AudioBufferList * output;
+    float gains[kMixInputCount];
+    float * scratch;
+    float * mono1;
+    float * mono2;
+    int calls;
+} AKKAAEDSPBenchmarkContext;
+
+typedef struct {
+    __unsafe_unretained AKKAAEManagedValue * value;
+    __unsafe_unretained AKKAAEArray * array;
+    uintptr_t sink;
+} AKKAAEManagedValueBenchmarkContext;
+
+#pragma mark - Buffer stack
+
+static void AKKAAEBufferStackBenchmarkPushPop(void * userInfo) {
+    AKKAAEBufferStackBenchmarkContext * context = (AKKAAEBufferStackBenchmarkContext *)userInfo;
+    AKKAAEBufferStackPushWithChannels(context->stack, context->depth, context->channels);
+    AKKAAEBufferStackPop(context->stack, context->depth);
+}
+
+static void AKKAAEBufferStackBenchmarkDuplicatePop(void * userInfo) {
+    AKKAAEBufferStackBenchmarkContext * context = (AKKAAEBufferStackBenchmarkContext *)userInfo;
+    AKKAAEBufferStackDuplicate(context->stack);
+    AKKAAEBufferStackPop(context->stack, 1);
+}
+
+static void AKKAAEBufferStackBenchmarkApplyFaders(void * userInfo) {
+    AKKAAEBufferStackBenchmarkContext * context = (AKKAAEBufferStackBenchmarkContext *)userInfo;
+    if ( context->calls++ % kRefillInterval == 0 ) {
+        const AudioBufferList * abl = AKKAAEBufferStackGetMutable(context->stack, 0);
+        for ( int i=0; i<abl->mNumberBuffers; i++ ) memcpy(abl->mBuffers[i].mData, context->noise, abl->mBuffers[i].mDataByteSize);
+    }
+    context->volume = 1.0f; // Always ramping, the expensive path
+    AKKAAEBufferStackApplyFaders(context->stack, 0.5f, &context->volume, 0.0f, &context->balance);
+}
+
+static void AKKAAEBufferStackBenchmarkPushMixPop(void * userInfo) {
+    // Mixing consumes the buffers, so each call pushes them again
+    AKKAAEBufferStackBenchmarkContext * context = (AKKAAEBufferStackBenchmarkContext *)userInfo;
+    AKKAAEBufferStackPushWithChannels(context->stack, context->depth, context->channels);
+    AKKAAEBufferStackMix(context->stack, context->depth);
+    AKKAAEBufferStackPop(context->stack, 1);
+}
+
+static void AKKAAEBenchmarkRunBufferStack(const char * backend) {
+    const UInt32 maxFrames = kBenchmarkFrameCounts[kBenchmarkFrameCountsCount-1];
+    float * noise = malloc(sizeof(float) * maxFrames);
+    AKKAAEBenchmarkFillNoise(noise, maxFrames);
+    for ( int d=0; d<kDepthsCount; d++ ) {
+        for ( int c=0; c<kBenchmarkChannelCountsCount; c++ ) {
+            for ( int f=0; f<kBenchmarkFrameCountsCount; f++ ) {
+                int depth = kDepths[d], channels = kBenchmarkChannelCounts[c];
+                UInt32 frames = kBenchmarkFrameCounts[f];
+                AKKAAEBufferStackBenchmarkContext context = {
+                    .stack = AKKAAEBufferStackNewWithOptions(depth + 1, channels, 0),
+                    .depth = depth,
+                    .channels = channels,
+                    .volume = 1.0f,
+                    .noise = noise,
+                };
+                AKKAAEBufferStackSetFrameCount(context.stack, frames);
+
+                AKKAAEBenchmarkRecord("bufferStack.pushPop", backend, frames, channels, depth, 0,
+                                      AKKAAEBufferStackBenchmarkPushPop, &context);
+
+                AKKAAEBufferStackPushWithChannels(context.stack, depth, channels);
+                for ( int i=0; i<depth; i++ ) {
+                    const AudioBufferList * abl = AKKAAEBufferStackGetMutable(context.stack, i);
+                    for ( int j=0; j<abl->mNumberBuffers; j++ ) memcpy(abl->mBuffers[j].mData, noise, sizeof(float) * frames);
+                }
+                AKKAAEBenchmarkRecord("bufferStack.duplicatePop", backend, frames, channels, depth, frames,
+                                      AKKAAEBufferStackBenchmarkDuplicatePop, &context);
+                AKKAAEBenchmarkRecord("bufferStack.applyFaders", backend, frames, channels, depth, frames,
+                                      AKKAAEBufferStackBenchmarkApplyFaders, &context);
+                AKKAAEBufferStackPop(context.stack, depth);
+
+                if ( depth > 1 ) {
+                    AKKAAEBenchmarkRecord("bufferStack.pushMixPop", backend, frames, channels, depth, frames * depth,
+                                          AKKAAEBufferStackBenchmarkPushMixPop, &context);
+                }
+
+                AKKAAEBufferStackFree(context.stack);
+            }
+        }
+    }
+    free(noise);
+}
+
+#pragma mark - DSP utilities
+
+static void AKKAAEDSPBenchmarkCall(void * userInfo) {
+    AKKAAEDSPBenchmarkContext * context = (AKKAAEDSPBenchmarkContext *)userInfo;
+    UInt32 frames = context->frames;
+    float start = 1.0f, current = 1.0f, volume = 1.0f, balance = 0.0f, position = 0.0f;
+    if ( context->calls++ % kRefillInterval == 0 ) {
+        // The mix inputs are only ever read, so they keep the original noise
+        for ( int i=0; i<context->buffer->mNumberBuffers; i++ ) {
+            memcpy(context->buffer->mBuffers[i].mData, context->inputs[0]->mBuffers[i].mData, sizeof(float) * frames);
+        }
+        memcpy(context->scratch, context->mono1, sizeof(float) * frames);
+    }
+    switch ( context->benchmark ) {
+        case AKKAAEDSPBenchmarkApplyGain:
+            AKKAAEDSPApplyGain(context->buffer, 0.999f, frames);
+            break;
+        case AKKAAEDSPBenchmarkApplyRamp:
+            AKKAAEDSPApplyRamp(context->buffer, &start, -0.5f / frames, frames);
+            break;
+        case AKKAAEDSPBenchmarkApplyEqualPowerRamp:
+            AKKAAEDSPApplyEqualPowerRamp(context->buffer, &start, -0.5f / frames, frames, context->scratch);
+            break;
+        case AKKAAEDSPBenchmarkApplyGainSmoothed:
+            AKKAAEDSPApplyGainSmoothed(context->buffer, 0.5f, &current, frames);
+            break;
+        case AKKAAEDSPBenchmarkApplyGainWithRamp:
+            AKKAAEDSPApplyGainWithRamp(context->buffer, 0.5f, &current, frames, frames);
+            break;
+        case AKKAAEDSPBenchmarkApplyVolumeAndBalance:
+            AKKAAEDSPApplyVolumeAndBalance(context->buffer, 0.5f, &volume, 0.0f, &balance, frames);
+            break;
+        case AKKAAEDSPBenchmarkMix:
+            AKKAAEDSPMix(context->inputs[0], context->inputs[1], 0.5f, 0.5f, NO, frames, context->output);
+            break;
+        case AKKAAEDSPBenchmarkMixMultiple:
+            AKKAAEDSPMixMultiple((const AudioBufferList * const *)context->inputs, context->gains, kMixInputCount,
+                                 NO, frames, context->output);
+            break;
+        case AKKAAEDSPBenchmarkSilence:
+            AKKAAEDSPSilence(context->output, 0, frames);
+            break;
+        case AKKAAEDSPBenchmarkApplyGainSmoothedMono:
+            AKKAAEDSPApplyGainSmoothedMono(context->scratch, 0.5f, &current, frames);
+            break;
+        case AKKAAEDSPBenchmarkMixMono:
+            AKKAAEDSPMixMono(context->mono1, context->mono2, 0.5f, 0.5f, frames, context->scratch);
+            break;
+        case AKKAAEDSPBenchmarkGenerateOscillator:
+            for ( UInt32 i=0; i<frames; i++ ) context->scratch[i] = AKKAAEDSPGenerateOscillator(440.0f / 44100.0f, &position);
+            break;
+        default:
+            break;
+    }
+}
+
+static void AKKAAEBenchmarkRunDSPUtilities(const char * backend) {
+    const UInt32 maxFrames = kBenchmarkFrameCounts[kBenchmarkFrameCountsCount-1];
+    AKKAAEDSPBenchmarkContext context = {
+        .scratch = malloc(sizeof(float) * maxFrames),
+        .mono1 = malloc(sizeof(float) * maxFrames),
+        .mono2 = malloc(sizeof(float) * maxFrames),
+    };
+    AKKAAEBenchmarkFillNoise(context.mono1, maxFrames);
+    AKKAAEBenchmarkFillNoise(context.mono2, maxFrames);
+    for ( int i=0; i<kMixInputCount; i++ ) context.gains[i] = 1.0f / kMixInputCount;
+
+    for ( int c=0; c<kBenchmarkChannelCountsCount; c++ ) {
+        int channels = kBenchmarkChannelCounts[c];
+        AudioStreamBasicDescription format = AKKAAEAudioDescriptionWithChannelsAndRate(channels, 44100.0);
+        for ( int i=0; i<kMixInputCount; i++ ) {
+            context.inputs[i] = AKKAAEAudioBufferListCreateWithFormat(format, maxFrames);
+            for ( int j=0; j<context.inputs[i]->mNumberBuffers; j++ ) {
+                AKKAAEBenchmarkFillNoise(context.inputs[i]->mBuffers[j].mData, maxFrames);
+            }
+        }
+        context.buffer = AKKAAEAudioBufferListCreateWithFormat(format, maxFrames);
+        context.output = AKKAAEAudioBufferListCreateWithFormat(format, maxFrames);
+
+        for ( int f=0; f<kBenchmarkFrameCountsCount; f++ ) {
+            context.frames = kBenchmarkFrameCounts[f];
+            for ( int b=0; b<AKKAAEDSPBenchmarkCount; b++ ) {
+                // The mono variants only make sense once
+                if ( b >= AKKAAEDSPBenchmarkApplyGainSmoothedMono && channels != 1 ) continue;
+                context.benchmark = (AKKAAEDSPBenchmark)b;
+                context.calls = 0;
+                BOOL multiple = b == AKKAAEDSPBenchmarkMixMultiple;
+                AKKAAEBenchmarkRecord(kDSPBenchmarkNames[b], backend, context.frames, channels, multiple ? kMixInputCount : 0,
+                                      context.frames * (multiple ? kMixInputCount : 1), AKKAAEDSPBenchmarkCall, &context);
+            }
+        }
+
+        for ( int i=0; i<kMixInputCount; i++ ) AKKAAEAudioBufferListFree(context.inputs[i]);
+        AKKAAEAudioBufferListFree(context.buffer);
+        AKKAAEAudioBufferListFree(context.output);
+    }
+    free(context.scratch);
+    free(context.mono1);
+    free(context.mono2);
+}
+
+#pragma mark - Managed values and arrays
+
+static void AKKAAEManagedValueBenchmarkGetValue(void * userInfo) {
+    AKKAAEManagedValueBenchmarkContext * context = (AKKAAEManagedValueBenchmarkContext *)userInfo;
+    for ( int i=0; i<kReadsPerCall; i++ ) context->sink += (uintptr_t)AKKAAEManagedValueGetValue(context->value);
+}
+
+static void AKKAAEArrayBenchmarkGetTokenAndIterate(void * userInfo) {
+    AKKAAEManagedValueBenchmarkContext * context = (AKKAAEManagedValueBenchmarkContext *)userInfo;
+    AKKAAEArrayToken token = AKKAAEArrayGetToken(context->array);
+    int count = AKKAAEArrayGetCount(token);
+    for ( int i=0; i<count; i++ ) context->sink += (uintptr_t)AKKAAEArrayGetItem(token, i);
+}
+
+static void AKKAAEBenchmarkRunManagedValues(void) {
+    // Read as the render thread reads them
+    @autoreleasepool {
+        AKKAAEManagedValue * value = [AKKAAEManagedValue new];
+        value.pointerValue = calloc(1, sizeof(int));
+        AKKAAEManagedValueCommitPendingUpdates();
+        AKKAAEManagedValueBenchmarkContext context = { .value = value };
+        AKKAAEBenchmarkRecord("managedValue.getValue", "none", 0, 0, kReadsPerCall, 0,
+                              AKKAAEManagedValueBenchmarkGetValue, &context);
+
+        for ( int d=0; d<kDepthsCount; d++ ) {
+            NSMutableArray * objects = [NSMutableArray array];
+            for ( int i=0; i<kDepths[d]; i++ ) [objects addObject:[NSObject new]];
+            AKKAAEArray * array = [AKKAAEArray new];
+            [array updateWithContentsOfArray:objects];
+            AKKAAEManagedValueCommitPendingUpdates();
+            context.array = array;
+            AKKAAEBenchmarkRecord("array.getTokenAndIterate", "none", 0, 0, kDepths[d], 0,
+                                  AKKAAEArrayBenchmarkGetTokenAndIterate, &context);
+        }
+        if ( context.sink == 0 ) fprintf(stderr, "Managed values read back empty\n");
+    }
+}
+
+#pragma mark -
+
+void AKKAAEBenchmarkRunEngine(void) {
+    // The buffer stack and DSP utilities run on the active kernel backend
+    const char * backend = AKKAAEDSPKernelsGet()->name;
+    AKKAAEBenchmarkRunBufferStack(backend);
+    AKKAAEBenchmarkRunDSPUtilities(backend);
+    AKKAAEBenchmarkRunManagedValues();
+}
@@ -0,0 +1,311 @@
+//
+//  main.c
+//  AKKAAEBenchmark
+//
+//  Created by 张一鸣 on 2016/12/6.
+//  Copyright (c) 2016 AKKA. All rights reserved.
+//
+//  Headless microbenchmark, outside Xcode and off iOS: build and run it with run.sh.
+//
+//  Times every kernel of every DSP kernel backend built for this machine, over a sweep of frame and
+//  channel counts. On Apple platforms it also runs the engine benchmarks of the XCTest microbenchmark
+//  suite: the buffer stack, the DSP utilities, managed values and arrays (see AKKAAEBenchmarkEngine.m).
+//
+//  Results are written as JSON to $AKKAAE_BENCHMARK_OUTPUT, or AKKAAEBenchmark.json in the temporary
+//  directory. If $AKKAAE_BENCHMARK_BASELINE names the results of an earlier run, each result is compared
+//  with it, and the exit status is 1 if anything is 20% slower.
+//
+
+#include "AKKAAEBenchmark.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+const UInt32 kBenchmarkFrameCounts[] = { 64, 256, 1024, 4096 };
+const int kBenchmarkFrameCountsCount = sizeof(kBenchmarkFrameCounts) / sizeof(UInt32);
+const int kBenchmarkChannelCounts[] = { 1, 2, 8 };
+const int kBenchmarkChannelCountsCount = sizeof(kBenchmarkChannelCounts) / sizeof(int);
+
+static const AKKAAEDSPKernelBackend kBackends[] = {
+    AKKAAEDSPKernelBackendScalar,
+    AKKAAEDSPKernelBackendSSE2,
+    AKKAAEDSPKernelBackendAVX2,
+    AKKAAEDSPKernelBackendNEON,
+    AKKAAEDSPKernelBackendAccelerate,
+};
+static const int kBackendsCount = sizeof(kBackends) / sizeof(AKKAAEDSPKernelBackend);
+static const double kRegressionThreshold = 1.2;
+
+typedef enum {
+    AKKAAEKernelClear,
+    AKKAAEKernelScale,
+    AKKAAEKernelAdd,
+    AKKAAEKernelScaleAdd,
+    AKKAAEKernelRampMul,
+    AKKAAEKernelRampMulAdd,
+    AKKAAEKernelRampMul2,
+    AKKAAEKernelRampMulN,
+    AKKAAEKernelEqualPowerRampMulN,
+    AKKAAEKernelInterpolatedDot,
+    AKKAAEKernelIsSilent,
+    AKKAAEKernelCount,
+} AKKAAEKernel;
+
+static const char * kKernelNames[AKKAAEKernelCount] = {
+    "kernel.clear", "kernel.scale", "kernel.add", "kernel.scaleAdd", "kernel.rampMul", "kernel.rampMulAdd",
+    "kernel.rampMul2", "kernel.rampMulN", "kernel.equalPowerRampMulN", "kernel.interpolatedDot", "kernel.isSilent",
+};
+
+typedef struct {
+    char name[64];
+    char backend[32];
+    UInt32 frames;
+    int channels;
+    int depth;
+    double nsPerCall;
+    UInt32 processed;
+} AKKAAEBenchmarkResult;
+
+#define kMaxChannels 8
+
+typedef struct {
+    const AKKAAEDSPKernels * kernels;
+    AKKAAEKernel kernel;
+    UInt32 frames;
+    int channels;
+    float * input1;
+    float * input2;
+    float * output;
+    float * silence;
+    float * channelBuffers[kMaxChannels];
+    unsigned long long calls;
+    volatile float sink;
+} AKKAAEKernelBenchmarkContext;
+
+static AKKAAEBenchmarkResult * __results = NULL;
+static int __resultCount = 0;
+static int __resultCapacity = 0;
+
+static double AKKAAEBenchmarkNow(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1.0e-9;
+}
+
+void AKKAAEBenchmarkFillNoise(float * buffer, UInt32 frames) {
+    for ( UInt32 i=0; i<frames; i++ ) buffer[i] = ((float)rand() / RAND_MAX) * 2.0f - 1.0f;
+}
+
+void AKKAAEBenchmarkRecord(const char * name, const char * backend, UInt32 frames, int channels,
+                           int depth, UInt32 processed, AKKAAEBenchmarkFunction function, void * context) {
+    const double minimumRun = 0.02;
+    unsigned long long iterations = 1;
+    double best = 0;
+    for ( int run=0; run<3; ) {
+        double start = AKKAAEBenchmarkNow();
+        for ( unsigned long long i=0; i<iterations; i++ ) function(context);
+        double elapsed = AKKAAEBenchmarkNow() - start;
+        if ( elapsed < minimumRun && run == 0 ) {
+            iterations *= 2;
+            continue;
+        }
+        best = run == 0 ? elapsed : MIN(best, elapsed);
+        run++;
+    }
+
+    if ( __resultCount == __resultCapacity ) {
+        __resultCapacity = MAX(256, __resultCapacity * 2);
+        __results = realloc(__results, sizeof(AKKAAEBenchmarkResult) * __resultCapacity);
+    }
+    AKKAAEBenchmarkResult * result = &__results[__resultCount++];
+    snprintf(result->name, sizeof(result->name), "%s", name);
+    snprintf(result->backend, sizeof(result->backend), "%s", backend);
+    result->frames = frames;
+    result->channels = channels;
+    result->depth = depth;
+    result->processed = processed;
+    result->nsPerCall = best * 1.0e9 / iterations;
+    printf("bench %-32s %-10s frames=%-5u channels=%-2d depth=%-3d %12.1f ns/call\n",
+           name, backend, (unsigned int)frames, channels, depth, result->nsPerCall);
+}
+
+static void AKKAAEKernelBenchmarkCall(void * userInfo) {
+    AKKAAEKernelBenchmarkContext * context = (AKKAAEKernelBenchmarkContext *)userInfo;
+    const AKKAAEDSPKernels * kernels = context->kernels;
+    UInt32 frames = context->frames;
+
+    // Ramps restart at unity on every call. Those applied in place are kept shallow and alternate in
+    // direction, so the buffers don't decay towards denormals however often they're run
+    float start = 1.0f;
+    float step = -0.5f / frames;
+    float inPlaceStep = (context->calls++ & 1 ? 1.0e-3f : -1.0e-3f) / frames;
+    switch ( context->kernel ) {
+        case AKKAAEKernelClear:
+            kernels->clear(context->output, frames);
+            break;
+        case AKKAAEKernelScale:
+            kernels->scale(context->input1, 0.5f, context->output, frames);
+            break;
+        case AKKAAEKernelAdd:
+            kernels->add(context->input1, context->input2, context->output, frames);
+            break;
+        case AKKAAEKernelScaleAdd:
+            kernels->scaleAdd(context->input1, 0.5f, context->input2, context->output, frames);
+            break;
+        case AKKAAEKernelRampMul:
+            kernels->rampMul(context->input1, &start, step, context->output, frames);
+            break;
+        case AKKAAEKernelRampMulAdd:
+            kernels->rampMulAdd(context->input1, &start, step, context->output, frames);
+            break;
+        case AKKAAEKernelRampMul2:
+            kernels->rampMul2(context->channelBuffers[0], context->channelBuffers[1], &start, inPlaceStep, frames);
+            break;
+        case AKKAAEKernelRampMulN:
+            kernels->rampMulN(context->channelBuffers, context->channels, &start, inPlaceStep, frames);
+            break;
+        case AKKAAEKernelEqualPowerRampMulN:
+            kernels->equalPowerRampMulN(context->channelBuffers, context->channels, &start, inPlaceStep, frames);
+            break;
+        case AKKAAEKernelInterpolatedDot:
+            context->sink += kernels->interpolatedDot(context->input1, context->input2, context->output, 0.5f, frames);
+            break;
+        case AKKAAEKernelIsSilent:
+            // A silent buffer is the worst case: every sample is checked
+            context->sink += kernels->isSilent(context->silence, frames);
+            break;
+        default:
+            break;
+    }
+}
+
+static void AKKAAEBenchmarkRunKernels(void) {
+    const UInt32 maxFrames = kBenchmarkFrameCounts[kBenchmarkFrameCountsCount-1];
+    AKKAAEKernelBenchmarkContext context = { .kernels = NULL };
+    context.input1 = malloc(sizeof(float) * maxFrames);
+    context.input2 = malloc(sizeof(float) * maxFrames);
+    context.output = malloc(sizeof(float) * maxFrames);
+    context.silence = calloc(maxFrames, sizeof(float));
+    AKKAAEBenchmarkFillNoise(context.input1, maxFrames);
+    AKKAAEBenchmarkFillNoise(context.input2, maxFrames);
+    for ( int i=0; i<kMaxChannels; i++ ) context.channelBuffers[i] = malloc(sizeof(float) * maxFrames);
+
+    for ( int b=0; b<kBackendsCount; b++ ) {
+        context.kernels = AKKAAEDSPKernelsGetForBackend(kBackends[b]);
+        if ( !context.kernels ) continue;
+        for ( int k=0; k<AKKAAEKernelCount; k++ ) {
+            // Only the multichannel kernels are swept over channel counts
+            BOOL multichannel = k == AKKAAEKernelRampMulN || k == AKKAAEKernelEqualPowerRampMulN;
+            for ( int c=0; c<(multichannel ? kBenchmarkChannelCountsCount : 1); c++ ) {
+                context.kernel = (AKKAAEKernel)k;
+                context.channels = multichannel ? kBenchmarkChannelCounts[c] : (k == AKKAAEKernelRampMul2 ? 2 : 1);
+                for ( int f=0; f<kBenchmarkFrameCountsCount; f++ ) {
+                    context.frames = kBenchmarkFrameCounts[f];
+                    AKKAAEBenchmarkFillNoise(context.output, context.frames);
+                    for ( int i=0; i<kMaxChannels; i++ ) AKKAAEBenchmarkFillNoise(context.channelBuffers[i], context.frames);
+                    AKKAAEBenchmarkRecord(kKernelNames[k], context.kernels->name, context.frames, context.channels, 0,
+                                          context.frames * context.channels, AKKAAEKernelBenchmarkCall, &context);
+                }
+            }
+        }
+    }
+
+    free(context.input1);
+    free(context.input2);
+    free(context.output);
+    free(context.silence);
+    for ( int i=0; i<kMaxChannels; i++ ) free(context.channelBuffers[i]);
+}
+
+static BOOL AKKAAEBenchmarkSameKey(const AKKAAEBenchmarkResult * a, const AKKAAEBenchmarkResult * b) {
+    return strcmp(a->name, b->name) == 0 && strcmp(a->backend, b->backend) == 0
+        && a->frames == b->frames && a->channels == b->channels && a->depth == b->depth;
+}
+
+static BOOL AKKAAEBenchmarkWrite(const char * path) {
+    FILE * file = fopen(path, "w");
+    if ( !file ) return NO;
+    fprintf(file, "{\n  \"date\": %ld,\n  \"dspBackend\": \"%s\",\n  \"results\": [\n",
+            (long)time(NULL), AKKAAEDSPKernelsGet()->name);
+    for ( int i=0; i<__resultCount; i++ ) {
+        const AKKAAEBenchmarkResult * result = &__results[i];
+        fprintf(file, "    {\"name\": \"%s\", \"backend\": \"%s\", \"frames\": %u, \"channels\": %d, \"depth\": %d, "
+                "\"nsPerCall\": %.2f", result->name, result->backend, (unsigned int)result->frames, result->channels,
+                result->depth, result->nsPerCall);
+        if ( result->processed > 0 ) {
+            fprintf(file, ", \"framesPerSecond\": %.0f", result->processed / (result->nsPerCall * 1.0e-9));
+        }
+        fprintf(file, "}%s\n", i < __resultCount-1 ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    fclose(file);
+    return YES;
+}
+
+static int AKKAAEBenchmarkCompare(const char * baselinePath) {
+    FILE * file = fopen(baselinePath, "r");
+    if ( !file ) {
+        fprintf(stderr, "Couldn't read the baseline at %s\n", baselinePath);
+        return 1;
+    }
+
+    // Results are written one to a line, so the baseline is read back line by line
+    int regressions = 0;
+    char line[512];
+    while ( fgets(line, sizeof(line), file) ) {
+        AKKAAEBenchmarkResult before;
+        if ( sscanf(line, " {\"name\": \"%63[^\"]\", \"backend\": \"%31[^\"]\", \"frames\": %u, \"channels\": %d, "
+                    "\"depth\": %d, \"nsPerCall\": %lf", before.name, before.backend, &before.frames, &before.channels,
+                    &before.depth, &before.nsPerCall) != 6 ) continue;
+        if ( before.nsPerCall <= 0 ) continue;
+        for ( int i=0; i<__resultCount; i++ ) {
+            if ( !AKKAAEBenchmarkSameKey(&__results[i], &before) ) continue;
+            double after = __results[i].nsPerCall;
+            BOOL regressed = after > before.nsPerCall * kRegressionThreshold;
+            printf("bench %-32s %-10s frames=%-5u channels=%-2d depth=%-3d %+6.1f%%%s\n", before.name, before.backend,
+                   (unsigned int)before.frames, before.channels, before.depth, (after / before.nsPerCall - 1.0) * 100.0,
+                   regressed ? "  REGRESSED" : "");
+            if ( regressed ) regressions++;
+            break;
+        }
+    }
+    fclose(file);
+
+    if ( regressions > 0 ) {
+        fprintf(stderr, "%d results regressed by more than %.0f%%\n", regressions, (kRegressionThreshold - 1.0) * 100.0);
+    }
+    return regressions > 0 ? 1 : 0;
+}
+
+int main(void) {
+    AKKAAEBenchmarkRunKernels();
+#if AKKAAE_BENCHMARK_ENGINE
+    AKKAAEBenchmarkRunEngine();
+#endif
+
+    // Machine-readable results
+    const char * path = getenv("AKKAAE_BENCHMARK_OUTPUT");
+    char defaultPath[1024];
+    if ( !path ) {
+        const char * temporaryDirectory = getenv("TMPDIR");
+        snprintf(defaultPath, sizeof(defaultPath), "%s/AKKAAEBenchmark.json",
+                 temporaryDirectory && *temporaryDirectory ? temporaryDirectory : "/tmp");
+        path = defaultPath;
+    }
+    if ( !AKKAAEBenchmarkWrite(path) ) {
+        fprintf(stderr, "Couldn't write the results to %s\n", path);
+        return 1;
+    }
+    printf("bench %d results written to %s\n", __resultCount, path);
+
+    // Compare with an earlier run
+    int status = 0;
+    const char * baselinePath = getenv("AKKAAE_BENCHMARK_BASELINE");
+    if ( baselinePath ) {
+        status = AKKAAEBenchmarkCompare(baselinePath);
+    }
+
+    free(__results);
+    return status;
+}
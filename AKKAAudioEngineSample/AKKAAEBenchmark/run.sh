@@ -0,0 +1,39 @@
+#!/bin/sh
+#
+#  run.sh
+#  AKKAAEBenchmark
+#
+#  Created by 张一鸣 on 2016/12/6.
+#  Copyright (c) 2016 AKKA. All rights reserved.
+#
+#  Builds the benchmark with the command-line compiler and runs it: no Xcode project, simulator or
+#  device needed. The DSP kernels build everywhere (a Linux CI box, say); on macOS the Accelerate
+#  backend, the buffer stack, the DSP utilities, managed values and arrays are built and timed too.
+#  $CC and $CFLAGS override the compiler and its flags, and the build goes to $AKKAAE_BENCHMARK_BUILD
+#  (default: AKKAAEBenchmark in the temporary directory).
+#
+#  The benchmark reads $AKKAAE_BENCHMARK_OUTPUT and $AKKAAE_BENCHMARK_BASELINE: see main.c.
+#
+
+set -e
+
+cd "$(dirname "$0")"
+ENGINE=../AKKAAudioEngineSample/AKKAAudioEngine
+BUILD=${AKKAAE_BENCHMARK_BUILD:-${TMPDIR:-/tmp}/AKKAAEBenchmark}
+
+if [ "$(uname)" = Darwin ]; then
+    SOURCES="-x objective-c -fobjc-arc -DAKKAAE_BENCHMARK_ENGINE=1 main.c AKKAAEBenchmarkEngine.m
+        $ENGINE/AKKAAEDSPKernels.m $ENGINE/AKKAAEDSPUtilties.m $ENGINE/AKKAAEAudioBufferListUtilities.m
+        $ENGINE/AKKAAEUtilities.m $ENGINE/Core/AKKAAETypes.m $ENGINE/Core/AKKAAETime.m
+        $ENGINE/Core/AKKAAEBufferStack.m $ENGINE/Core/AKKAAEManagedValue.m $ENGINE/Core/AKKAAEArray.m"
+    LIBRARIES="-framework Foundation -framework AudioToolbox -framework Accelerate"
+else
+    SOURCES="-x c main.c $ENGINE/AKKAAEDSPKernels.m"
+    LIBRARIES="-lpthread -lm"
+fi
+
+mkdir -p "$BUILD"
+${CC:-cc} ${CFLAGS:--O3} -std=gnu11 -I. -I"$ENGINE" -I"$ENGINE/Core" $SOURCES -x none \
+    $LIBRARIES -o "$BUILD/AKKAAEBenchmark"
+
+exec "$BUILD/AKKAAEBenchmark"
@@ -26,7 +26,7 @@ extern "C" {
 * @return The allocated and initialised audio buffer list
 */
 
-AudioBufferList * AKKAAudioBufferListCreate(int frameCount);
+AudioBufferList * AKKAAEAudioBufferListCreate(int frameCount);
 
 /*!
 * Allocate an audio buffer list and the associated mData pointers, with a custom audio format.
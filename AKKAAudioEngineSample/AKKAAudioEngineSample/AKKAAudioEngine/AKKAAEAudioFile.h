@@ -0,0 +1,138 @@
+//
+//  AKKAAEAudioFile.h
+//  AKKAAudioEngineSample
+//
+//  Created by 张一鸣 on 2016/12/16.
+//  Copyright © 2016年 AKKA. All rights reserved.
+//
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#import <Foundation/Foundation.h>
+#import <AudioToolbox/AudioToolbox.h>
+#import "AKKAAETypes.h"
+
+typedef struct AKKAAEAudioFile AKKAAEAudioFile;
+
+/*!
+ * Create a PCM audio file for writing
+ *
+ *  A self-contained WAV/AIFF/AIFC writer for the PCM file types, without ExtAudioFile, so it
+ *  also works off Apple platforms. Audio is given in the engine's non-interleaved float format
+ *  (AKKAAEAudioDescription) and converted with AKKAAEAudioFormatConverter into a large buffer,
+ *  which is written out sequentially whenever it fills.
+ *
+ *  不依赖 ExtAudioFile 的 WAV/AIFF 写入；先转换到一块大缓冲区，满了再顺序写入磁盘。
+ *
+ *  AKKAAEAudioFileTypeWAVInt16 writes 16-bit little-endian WAV, AKKAAEAudioFileTypeAIFFInt16
+ *  16-bit big-endian AIFF, and AKKAAEAudioFileTypeAIFFFloat32 32-bit float AIFC.
+ *  AKKAAEAudioFileTypeM4A isn't supported; use AKKAAEExtAudioFileCreate for that.
+ *
+ *  The header is completed by AKKAAEAudioFileClose. Use this function only on the main thread,
+ *  or a background thread; never on the audio thread.
+ *
+ * @param url URL of the file to write (any existing file will be overwritten)
+ * @param fileType The type of the file to write
+ * @param sampleRate Sample rate
+ * @param channelCount Number of channels
+ * @param error If not NULL, the error on output
+ * @return The new file, or NULL on error
+ */
+AKKAAEAudioFile * _Nullable AKKAAEAudioFileCreate(NSURL * _Nonnull url,
+                                                  AKKAAEAudioFileType fileType,
+                                                  double sampleRate,
+                                                  int channelCount,
+                                                  NSError * _Nullable * _Nullable error);
+
+/*!
+ * Open a PCM audio file for reading
+ *
+ *  Reads WAV (PCM, float and extensible), AIFF and AIFC (NONE, twos, sowt, fl32, fl64) files
+ *  in 16, 24 or 32-bit integer or 32 or 64-bit float, in large sequential reads, converting
+ *  to the engine's non-interleaved float format.
+ *
+ * @param url URL of the file to read
+ * @param outAudioDescription On output, the format audio is read in: AKKAAEAudioDescription with
+ *  the file's channel count and sample rate
+ * @param outLengthInFrames On output, the total length in frames
+ * @param error If not NULL, the error on output
+ * @return The opened file, or NULL on error
+ */
+AKKAAEAudioFile * _Nullable AKKAAEAudioFileOpen(NSURL * _Nonnull url,
+                                                AudioStreamBasicDescription * _Nullable outAudioDescription,
+                                                UInt64 * _Nullable outLengthInFrames,
+                                                NSError * _Nullable * _Nullable error);
+
+/*!
+ * Read audio
+ *
+ * @param file A file opened with AKKAAEAudioFileOpen
+ * @param bufferList Buffer list in the format returned on open, with room for the given number of frames
+ * @param frames Number of frames to read
+ * @return Number of frames read: fewer than requested at the end of the file, or on error
+ */
+UInt32 AKKAAEAudioFileRead(AKKAAEAudioFile * _Nonnull file, const AudioBufferList * _Nonnull bufferList, UInt32 frames);
+
+/*!
+ * Move the read position
+ *
+ * @param file A file opened with AKKAAEAudioFileOpen
+ * @param frame The frame to read from next
+ * @return YES on success, NO if the frame is past the end of the file
+ */
+BOOL AKKAAEAudioFileSeek(AKKAAEAudioFile * _Nonnull file, UInt64 frame);
+
+/*!
+ * Write audio
+ *
+ * @param file A file created with AKKAAEAudioFileCreate
+ * @param bufferList Audio in AKKAAEAudioDescription format, with the file's channel count
+ * @param frames Number of frames to write
+ * @return YES on success, NO on a write error
+ */
+BOOL AKKAAEAudioFileWrite(AKKAAEAudioFile * _Nonnull file, const AudioBufferList * _Nonnull bufferList, UInt32 frames);
+
+/*!
+ * Set the size of the buffer audio is converted through
+ *
+ *  This is also the size of each read from or write to disk: 1 MB by default. Use a smaller
+ *  buffer when many files are open at once, such as for streaming.
+ *
+ * @param file The file
+ * @param bytes Buffer size, in bytes
+ * @return YES on success, NO if buffered audio couldn't be written or the buffer couldn't be allocated
+ */
+BOOL AKKAAEAudioFileSetBufferSize(AKKAAEAudioFile * _Nonnull file, size_t bytes);
+
+/*!
+ * Get the format the audio is stored in
+ *
+ * @param file The file
+ * @return The file's data format
+ */
+AudioStreamBasicDescription AKKAAEAudioFileGetFileFormat(const AKKAAEAudioFile * _Nonnull file);
+
+/*!
+ * Get the length of the file
+ *
+ * @param file The file
+ * @return Number of frames in the file, or written so far
+ */
+UInt64 AKKAAEAudioFileGetLength(const AKKAAEAudioFile * _Nonnull file);
+
+/*!
+ * Close and free a file
+ *
+ *  For a file being written, this writes out any buffered audio and completes the header.
+ *
+ * @param file The file
+ * @param error If not NULL, the error on output
+ * @return YES on success, NO if the buffered audio or header couldn't be written
+ */
+BOOL AKKAAEAudioFileClose(AKKAAEAudioFile * _Nonnull file, NSError * _Nullable * _Nullable error);
+
+#ifdef __cplusplus
+}
+#endif
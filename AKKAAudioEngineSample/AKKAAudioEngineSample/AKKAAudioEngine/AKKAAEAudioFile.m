@@ -0,0 +1,485 @@
+//
+//  AKKAAEAudioFile.m
+//  AKKAAudioEngineSample
+//
+//  Created by 张一鸣 on 2016/12/16.
+//  Copyright © 2016年 AKKA. All rights reserved.
+//
+
+#import "AKKAAEAudioFile.h"
+#import "AKKAAEAudioFormatConverter.h"
+#import "AKKAAEAudioBufferListUtilities.h"
+#import <fcntl.h>
+#import <unistd.h>
+#import <sys/stat.h>
+#import <errno.h>
+
+// Size of the conversion buffer, and so of each read or write
+static const size_t kIOBufferSize = 1024 * 1024;
+static const size_t kMaximumHeaderSize = 128;
+static const char * const kAIFCFloat32Name = "\x15" "32-bit floating point";
+
+struct AKKAAEAudioFile {
+    int fd;
+    BOOL writing;
+    AKKAAEAudioFileType fileType;           // When writing
+    AudioStreamBasicDescription fileFormat;
+    AKKAAEAudioFormatConverter * converter; // File to client format when reading, client to file when writing
+    off_t dataOffset;                       // Where the sample data starts
+    UInt64 length;                          // Frames in the file, or written so far
+    UInt64 position;                        // Next frame to read
+    uint8_t * buffer;
+    size_t bufferCapacity;                  // In bytes, a whole number of frames
+    size_t bufferFill;
+    size_t bufferPosition;                  // Bytes already converted, when reading
+};
+
+#pragma mark - Helpers
+
+static void AKKAAEAudioFileSetError(NSError ** error, int code, NSString * description) {
+    if ( error ) {
+        *error = [NSError errorWithDomain:NSPOSIXErrorDomain code:code
+                                 userInfo:@{ NSLocalizedDescriptionKey: description }];
+    }
+}
+
+static inline void AKKAAEAudioFilePutLE(uint8_t * bytes, uint32_t value, int size) {
+    for ( int i=0; i<size; i++ ) bytes[i] = (value >> (8 * i)) & 0xFF;
+}
+
+static inline void AKKAAEAudioFilePutBE(uint8_t * bytes, uint32_t value, int size) {
+    for ( int i=0; i<size; i++ ) bytes[i] = (value >> (8 * (size - i - 1))) & 0xFF;
+}
+
+static inline uint32_t AKKAAEAudioFileGetLE(const uint8_t * bytes, int size) {
+    uint32_t value = 0;
+    for ( int i=0; i<size; i++ ) value |= (uint32_t)bytes[i] << (8 * i);
+    return value;
+}
+
+static inline uint32_t AKKAAEAudioFileGetBE(const uint8_t * bytes, int size) {
+    uint32_t value = 0;
+    for ( int i=0; i<size; i++ ) value = (value << 8) | bytes[i];
+    return value;
+}
+
+// AIFF stores the sample rate as an 80-bit IEEE extended float
+static void AKKAAEAudioFilePutExtended(uint8_t * bytes, double value) {
+    memset(bytes, 0, 10);
+    if ( value <= 0 ) return;
+    int exponent;
+    double mantissa = frexp(value, &exponent);
+    uint64_t bits = (uint64_t)ldexp(mantissa, 64);
+    AKKAAEAudioFilePutBE(bytes, (uint32_t)(exponent - 1 + 16383), 2);
+    AKKAAEAudioFilePutBE(bytes + 2, (uint32_t)(bits >> 32), 4);
+    AKKAAEAudioFilePutBE(bytes + 6, (uint32_t)bits, 4);
+}
+
+static double AKKAAEAudioFileGetExtended(const uint8_t * bytes) {
+    int exponent = (int)(AKKAAEAudioFileGetBE(bytes, 2) & 0x7FFF);
+    uint64_t bits = ((uint64_t)AKKAAEAudioFileGetBE(bytes + 2, 4) << 32) | AKKAAEAudioFileGetBE(bytes + 6, 4);
+    double value = ldexp((double)bits, exponent - 16383 - 63);
+    return (bytes[0] & 0x80) ? -value : value;
+}
+
+static AudioStreamBasicDescription AKKAAEAudioFilePCMFormat(int bits, BOOL isFloat, BOOL bigEndian, int channels, double sampleRate) {
+    AudioStreamBasicDescription format = {
+        .mFormatID = kAudioFormatLinearPCM,
+        .mFormatFlags = (isFloat ? kAudioFormatFlagIsFloat : kAudioFormatFlagIsSignedInteger) | kAudioFormatFlagIsPacked
+            | (bigEndian ? kAudioFormatFlagIsBigEndian : 0),
+        .mChannelsPerFrame = (UInt32)channels,
+        .mBytesPerPacket = (UInt32)((bits / 8) * channels),
+        .mFramesPerPacket = 1,
+        .mBytesPerFrame = (UInt32)((bits / 8) * channels),
+        .mBitsPerChannel = (UInt32)bits,
+        .mSampleRate = sampleRate,
+    };
+    return format;
+}
+
+static BOOL AKKAAEAudioFilePrepareBuffer(AKKAAEAudioFile * file, size_t bytes) {
+    size_t capacity = MAX(bytes - (bytes % file->fileFormat.mBytesPerFrame), (size_t)file->fileFormat.mBytesPerFrame);
+    uint8_t * buffer = (uint8_t *)malloc(capacity);
+    if ( !buffer ) return NO;
+    free(file->buffer);
+    file->buffer = buffer;
+    file->bufferCapacity = capacity;
+    file->bufferFill = file->bufferPosition = 0;
+    return YES;
+}
+
+static void AKKAAEAudioFileFree(AKKAAEAudioFile * file) {
+    if ( file->fd >= 0 ) close(file->fd);
+    if ( file->converter ) AKKAAEAudioFormatConverterFree(file->converter);
+    free(file->buffer);
+    free(file);
+}
+
+#pragma mark - Writing
+
+/*!
+ * Build the header for a file being written, for the current length
+ *
+ *  The header's size depends only on the file type, so the final header overwrites the initial one.
+ */
+static size_t AKKAAEAudioFileMakeHeader(const AKKAAEAudioFile * file, uint8_t * header) {
+    const AudioStreamBasicDescription * format = &file->fileFormat;
+    UInt64 dataBytes64 = file->length * format->mBytesPerFrame;
+    uint32_t dataBytes = (uint32_t)MIN(dataBytes64, (UInt64)(UINT32_MAX - kMaximumHeaderSize));
+    uint32_t frames = (uint32_t)(dataBytes / format->mBytesPerFrame);
+
+    if ( file->fileType == AKKAAEAudioFileTypeWAVInt16 ) {
+        memcpy(header, "RIFF", 4);
+        AKKAAEAudioFilePutLE(header + 4, 36 + dataBytes, 4);
+        memcpy(header + 8, "WAVEfmt ", 8);
+        AKKAAEAudioFilePutLE(header + 16, 16, 4);                                      // fmt chunk size
+        AKKAAEAudioFilePutLE(header + 20, 1, 2);                                       // PCM
+        AKKAAEAudioFilePutLE(header + 22, format->mChannelsPerFrame, 2);
+        AKKAAEAudioFilePutLE(header + 24, (uint32_t)format->mSampleRate, 4);
+        AKKAAEAudioFilePutLE(header + 28, (uint32_t)format->mSampleRate * format->mBytesPerFrame, 4);
+        AKKAAEAudioFilePutLE(header + 32, format->mBytesPerFrame, 2);                  // block align
+        AKKAAEAudioFilePutLE(header + 34, format->mBitsPerChannel, 2);
+        memcpy(header + 36, "data", 4);
+        AKKAAEAudioFilePutLE(header + 40, dataBytes, 4);
+        return 44;
+    }
+
+    // AIFF, or AIFC for float, which adds a format version chunk and the compression type
+    BOOL aifc = file->fileType == AKKAAEAudioFileTypeAIFFFloat32;
+    size_t nameLength = aifc ? strlen(kAIFCFloat32Name) : 0;
+    uint32_t commSize = 18 + (aifc ? 4 + (uint32_t)nameLength : 0);
+    uint8_t * bytes = header;
+
+    memcpy(bytes, "FORM", 4);
+    memcpy(bytes + 8, aifc ? "AIFC" : "AIFF", 4);
+    bytes += 12;
+    if ( aifc ) {
+        memcpy(bytes, "FVER", 4);
+        AKKAAEAudioFilePutBE(bytes + 4, 4, 4);
+        AKKAAEAudioFilePutBE(bytes + 8, 0xA2805140, 4);                                // AIFC version 1
+        bytes += 12;
+    }
+    memcpy(bytes, "COMM", 4);
+    AKKAAEAudioFilePutBE(bytes + 4, commSize, 4);
+    AKKAAEAudioFilePutBE(bytes + 8, format->mChannelsPerFrame, 2);
+    AKKAAEAudioFilePutBE(bytes + 10, frames, 4);
+    AKKAAEAudioFilePutBE(bytes + 14, format->mBitsPerChannel, 2);
+    AKKAAEAudioFilePutExtended(bytes + 16, format->mSampleRate);
+    if ( aifc ) {
+        memcpy(bytes + 26, "fl32", 4);
+        memcpy(bytes + 30, kAIFCFloat32Name, nameLength);                              // Even length: no pad byte
+    }
+    bytes += 8 + commSize;
+    memcpy(bytes, "SSND", 4);
+    AKKAAEAudioFilePutBE(bytes + 4, 8 + dataBytes, 4);
+    AKKAAEAudioFilePutBE(bytes + 8, 0, 4);                                             // offset
+    AKKAAEAudioFilePutBE(bytes + 12, 0, 4);                                            // block size
+    bytes += 16;
+
+    size_t headerSize = bytes - header;
+    AKKAAEAudioFilePutBE(header + 4, (uint32_t)(headerSize - 8) + dataBytes, 4);
+    return headerSize;
+}
+
+static BOOL AKKAAEAudioFileWriteAll(int fd, const uint8_t * bytes, size_t length, off_t offset, BOOL positioned) {
+    while ( length > 0 ) {
+        ssize_t result = positioned ? pwrite(fd, bytes, length, offset) : write(fd, bytes, length);
+        if ( result < 0 && errno == EINTR ) continue;
+        if ( result <= 0 ) return NO;
+        bytes += result;
+        offset += result;
+        length -= result;
+    }
+    return YES;
+}
+
+static BOOL AKKAAEAudioFileFlush(AKKAAEAudioFile * file) {
+    if ( !AKKAAEAudioFileWriteAll(file->fd, file->buffer, file->bufferFill, 0, NO) ) return NO;
+    file->bufferFill = 0;
+    return YES;
+}
+
+AKKAAEAudioFile * AKKAAEAudioFileCreate(NSURL * url, AKKAAEAudioFileType fileType, double sampleRate, int channelCount,
+                                        NSError ** error) {
+    AudioStreamBasicDescription fileFormat;
+    switch ( fileType ) {
+        case AKKAAEAudioFileTypeWAVInt16:
+            fileFormat = AKKAAEAudioFilePCMFormat(16, NO, NO, channelCount, sampleRate);
+            break;
+        case AKKAAEAudioFileTypeAIFFInt16:
+            fileFormat = AKKAAEAudioFilePCMFormat(16, NO, YES, channelCount, sampleRate);
+            break;
+        case AKKAAEAudioFileTypeAIFFFloat32:
+            fileFormat = AKKAAEAudioFilePCMFormat(32, YES, YES, channelCount, sampleRate);
+            break;
+        default:
+            AKKAAEAudioFileSetError(error, ENOTSUP, @"Only PCM file types can be written");
+            return NULL;
+    }
+
+    AKKAAEAudioFile * file = (AKKAAEAudioFile *)calloc(1, sizeof(AKKAAEAudioFile));
+    file->writing = YES;
+    file->fileType = fileType;
+    file->fileFormat = fileFormat;
+    file->converter = AKKAAEAudioFormatConverterNew(AKKAAEAudioDescriptionWithChannelsAndRate(channelCount, sampleRate), fileFormat);
+    file->fd = open(url.fileSystemRepresentation, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if ( file->fd < 0 || !file->converter || !AKKAAEAudioFilePrepareBuffer(file, kIOBufferSize) ) {
+        AKKAAEAudioFileSetError(error, file->fd < 0 ? errno : EINVAL, @"Couldn't open the output file");
+        AKKAAEAudioFileFree(file);
+        return NULL;
+    }
+
+    // A placeholder header; the sizes are filled in on close
+    uint8_t header[kMaximumHeaderSize];
+    size_t headerSize = AKKAAEAudioFileMakeHeader(file, header);
+    if ( !AKKAAEAudioFileWriteAll(file->fd, header, headerSize, 0, NO) ) {
+        AKKAAEAudioFileSetError(error, errno, @"Couldn't write to the output file");
+        AKKAAEAudioFileFree(file);
+        return NULL;
+    }
+    file->dataOffset = headerSize;
+
+    return file;
+}
+
+BOOL AKKAAEAudioFileWrite(AKKAAEAudioFile * file, const AudioBufferList * bufferList, UInt32 frames) {
+    assert(file->writing);
+    UInt32 bytesPerFrame = file->fileFormat.mBytesPerFrame;
+    UInt32 done = 0;
+    while ( done < frames ) {
+        if ( file->bufferFill == file->bufferCapacity && !AKKAAEAudioFileFlush(file) ) return NO;
+
+        UInt32 count = MIN(frames - done, (UInt32)((file->bufferCapacity - file->bufferFill) / bytesPerFrame));
+        AKKAAEAudioBufferListCopyOnStack(source, bufferList, done);
+        AudioBufferList target = {
+            .mNumberBuffers = 1,
+            .mBuffers = { { file->fileFormat.mChannelsPerFrame, count * bytesPerFrame, file->buffer + file->bufferFill } },
+        };
+        AKKAAEAudioFormatConverterConvert(file->converter, source, &target, count);
+
+        file->bufferFill += count * bytesPerFrame;
+        file->length += count;
+        done += count;
+    }
+    return YES;
+}
+
+#pragma mark - Reading
+
+/*!
+ * Find the format and sample data in a WAV, AIFF or AIFC file
+ */
+static BOOL AKKAAEAudioFileReadHeader(AKKAAEAudioFile * file, NSString ** problem) {
+    struct stat status;
+    uint8_t bytes[64];
+    if ( fstat(file->fd, &status) != 0 || pread(file->fd, bytes, 12, 0) != 12 ) {
+        *problem = @"Couldn't read source file";
+        return NO;
+    }
+    off_t fileSize = status.st_size;
+
+    BOOL wav = !memcmp(bytes, "RIFF", 4) && !memcmp(bytes + 8, "WAVE", 4);
+    BOOL aifc = !memcmp(bytes, "FORM", 4) && !memcmp(bytes + 8, "AIFC", 4);
+    BOOL aiff = !memcmp(bytes, "FORM", 4) && !memcmp(bytes + 8, "AIFF", 4);
+    if ( !wav && !aiff && !aifc ) {
+        *problem = @"Not a WAV or AIFF file";
+        return NO;
+    }
+
+    BOOL haveFormat = NO, haveData = NO;
+    int bits = 0, channels = 0;
+    BOOL isFloat = NO, bigEndian = !wav;
+    double sampleRate = 0;
+    UInt64 dataBytes = 0, commonFrames = UINT64_MAX;
+
+    // 逐个 chunk 查找格式和音频数据；不认识的 chunk 直接跳过
+    for ( off_t offset = 12; offset + 8 <= fileSize; ) {
+        if ( pread(file->fd, bytes, 8, offset) != 8 ) break;
+        UInt64 size = wav ? AKKAAEAudioFileGetLE(bytes + 4, 4) : AKKAAEAudioFileGetBE(bytes + 4, 4);
+        off_t body = offset + 8;
+        ssize_t available = MIN((ssize_t)sizeof(bytes), (ssize_t)MIN(size, (UInt64)(fileSize - body)));
+
+        if ( wav && !memcmp(bytes, "fmt ", 4) ) {
+            if ( available < 16 || pread(file->fd, bytes, available, body) != available ) break;
+            int tag = AKKAAEAudioFileGetLE(bytes, 2);
+            if ( tag == 0xFFFE && available >= 26 ) tag = AKKAAEAudioFileGetLE(bytes + 24, 2); // Extensible: the sub-format
+            channels = AKKAAEAudioFileGetLE(bytes + 2, 2);
+            sampleRate = AKKAAEAudioFileGetLE(bytes + 4, 4);
+            // Samples are left-justified in their container, so the container size is what matters
+            bits = channels ? (AKKAAEAudioFileGetLE(bytes + 12, 2) / channels) * 8 : 0;
+            if ( tag == 3 ) {
+                isFloat = YES;
+            } else if ( tag != 1 ) {
+                *problem = @"Unsupported WAV encoding";
+                return NO;
+            }
+            haveFormat = YES;
+        } else if ( !wav && !memcmp(bytes, "COMM", 4) ) {
+            if ( available < 18 || pread(file->fd, bytes, available, body) != available ) break;
+            channels = AKKAAEAudioFileGetBE(bytes, 2);
+            commonFrames = AKKAAEAudioFileGetBE(bytes + 2, 4);
+            bits = ((AKKAAEAudioFileGetBE(bytes + 6, 2) + 7) / 8) * 8;
+            sampleRate = AKKAAEAudioFileGetExtended(bytes + 8);
+            if ( aifc && available >= 22 ) {
+                if ( !memcmp(bytes + 18, "sowt", 4) ) {
+                    bigEndian = NO;
+                } else if ( !memcmp(bytes + 18, "fl32", 4) || !memcmp(bytes + 18, "FL32", 4) ) {
+                    isFloat = YES;
+                    bits = 32;
+                } else if ( !memcmp(bytes + 18, "fl64", 4) || !memcmp(bytes + 18, "FL64", 4) ) {
+                    isFloat = YES;
+                    bits = 64;
+                } else if ( memcmp(bytes + 18, "NONE", 4) && memcmp(bytes + 18, "twos", 4) ) {
+                    *problem = @"Unsupported AIFC compression";
+                    return NO;
+                }
+            }
+            haveFormat = YES;
+        } else if ( wav && !memcmp(bytes, "data", 4) ) {
+            file->dataOffset = body;
+            dataBytes = size;
+            haveData = YES;
+        } else if ( !wav && !memcmp(bytes, "SSND", 4) ) {
+            if ( pread(file->fd, bytes, 8, body) != 8 ) break;
+            file->dataOffset = body + 8 + AKKAAEAudioFileGetBE(bytes, 4);
+            dataBytes = size - MIN(size, (UInt64)(8 + AKKAAEAudioFileGetBE(bytes, 4)));
+            haveData = YES;
+        }
+
+        if ( haveFormat && haveData ) break;
+        offset = body + size + (size & 1);
+    }
+
+    if ( !haveFormat || !haveData || channels < 1 || sampleRate <= 0 ) {
+        *problem = @"Couldn't read source file";
+        return NO;
+    }
+
+    // Recorders that were interrupted leave the data size unset or too large
+    if ( file->dataOffset + dataBytes > (UInt64)fileSize ) dataBytes = fileSize - MIN(file->dataOffset, fileSize);
+
+    file->fileFormat = AKKAAEAudioFilePCMFormat(bits, isFloat, bigEndian, channels, sampleRate);
+    if ( !AKKAAEAudioFormatConverterSupportsFormat(file->fileFormat) ) {
+        *problem = @"Unsupported sample format";
+        return NO;
+    }
+    file->length = MIN(dataBytes / file->fileFormat.mBytesPerFrame, commonFrames);
+    return YES;
+}
+
+/*!
+ * Read the next run of sample data into the buffer
+ */
+static BOOL AKKAAEAudioFileFill(AKKAAEAudioFile * file) {
+    UInt32 bytesPerFrame = file->fileFormat.mBytesPerFrame;
+    size_t bytes = (size_t)MIN((UInt64)file->bufferCapacity, (file->length - file->position) * bytesPerFrame);
+    off_t offset = file->dataOffset + (off_t)(file->position * bytesPerFrame);
+
+    file->bufferFill = file->bufferPosition = 0;
+    while ( file->bufferFill < bytes ) {
+        ssize_t result = pread(file->fd, file->buffer + file->bufferFill, bytes - file->bufferFill, offset + file->bufferFill);
+        if ( result < 0 && errno == EINTR ) continue;
+        if ( result <= 0 ) break;
+        file->bufferFill += result;
+    }
+    file->bufferFill -= file->bufferFill % bytesPerFrame;
+    return file->bufferFill > 0;
+}
+
+AKKAAEAudioFile * AKKAAEAudioFileOpen(NSURL * url, AudioStreamBasicDescription * outAudioDescription,
+                                      UInt64 * outLengthInFrames, NSError ** error) {
+    AKKAAEAudioFile * file = (AKKAAEAudioFile *)calloc(1, sizeof(AKKAAEAudioFile));
+    file->fd = open(url.fileSystemRepresentation, O_RDONLY);
+    if ( file->fd < 0 ) {
+        AKKAAEAudioFileSetError(error, errno, @"Couldn't open source file");
+        AKKAAEAudioFileFree(file);
+        return NULL;
+    }
+
+    NSString * problem = nil;
+    if ( !AKKAAEAudioFileReadHeader(file, &problem) ) {
+        AKKAAEAudioFileSetError(error, EINVAL, problem);
+        AKKAAEAudioFileFree(file);
+        return NULL;
+    }
+
+    AudioStreamBasicDescription clientFormat =
+        AKKAAEAudioDescriptionWithChannelsAndRate(file->fileFormat.mChannelsPerFrame, file->fileFormat.mSampleRate);
+    file->converter = AKKAAEAudioFormatConverterNew(file->fileFormat, clientFormat);
+    if ( !file->converter || !AKKAAEAudioFilePrepareBuffer(file, kIOBufferSize) ) {
+        AKKAAEAudioFileSetError(error, ENOMEM, @"Couldn't configure file for reading");
+        AKKAAEAudioFileFree(file);
+        return NULL;
+    }
+
+    // Reads are strictly sequential: ask for aggressive read-ahead
+#if defined(F_RDAHEAD)
+    fcntl(file->fd, F_RDAHEAD, 1);
+#elif defined(POSIX_FADV_SEQUENTIAL)
+    posix_fadvise(file->fd, file->dataOffset, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    if ( outAudioDescription ) *outAudioDescription = clientFormat;
+    if ( outLengthInFrames ) *outLengthInFrames = file->length;
+    return file;
+}
+
+UInt32 AKKAAEAudioFileRead(AKKAAEAudioFile * file, const AudioBufferList * bufferList, UInt32 frames) {
+    assert(!file->writing);
+    UInt32 bytesPerFrame = file->fileFormat.mBytesPerFrame;
+    UInt32 done = 0;
+    while ( done < frames ) {
+        if ( file->bufferPosition == file->bufferFill && !AKKAAEAudioFileFill(file) ) break;
+
+        UInt32 count = MIN(frames - done, (UInt32)((file->bufferFill - file->bufferPosition) / bytesPerFrame));
+        AudioBufferList source = {
+            .mNumberBuffers = 1,
+            .mBuffers = { { file->fileFormat.mChannelsPerFrame, count * bytesPerFrame, file->buffer + file->bufferPosition } },
+        };
+        AKKAAEAudioBufferListCopyOnStack(target, bufferList, done);
+        AKKAAEAudioFormatConverterConvert(file->converter, &source, target, count);
+
+        file->bufferPosition += count * bytesPerFrame;
+        file->position += count;
+        done += count;
+    }
+    return done;
+}
+
+BOOL AKKAAEAudioFileSeek(AKKAAEAudioFile * file, UInt64 frame) {
+    assert(!file->writing);
+    if ( frame > file->length ) return NO;
+    file->position = frame;
+    file->bufferFill = file->bufferPosition = 0;
+    return YES;
+}
+
+#pragma mark -
+
+BOOL AKKAAEAudioFileSetBufferSize(AKKAAEAudioFile * file, size_t bytes) {
+    // Buffered audio is written out first; when reading, it's simply read again from the current position
+    if ( file->writing && !AKKAAEAudioFileFlush(file) ) return NO;
+    return AKKAAEAudioFilePrepareBuffer(file, bytes);
+}
+
+AudioStreamBasicDescription AKKAAEAudioFileGetFileFormat(const AKKAAEAudioFile * file) {
+    return file->fileFormat;
+}
+
+UInt64 AKKAAEAudioFileGetLength(const AKKAAEAudioFile * file) {
+    return file->length;
+}
+
+BOOL AKKAAEAudioFileClose(AKKAAEAudioFile * file, NSError ** error) {
+    BOOL success = YES;
+    if ( file->writing ) {
+        uint8_t header[kMaximumHeaderSize];
+        size_t headerSize = AKKAAEAudioFileMakeHeader(file, header);
+        success = AKKAAEAudioFileFlush(file) && AKKAAEAudioFileWriteAll(file->fd, header, headerSize, 0, YES);
+        if ( close(file->fd) != 0 ) success = NO;
+        file->fd = -1;
+        if ( !success ) AKKAAEAudioFileSetError(error, errno, @"Couldn't write to the output file");
+    }
+    AKKAAEAudioFileFree(file);
+    return success;
+}
@@ -0,0 +1,85 @@
+//
+//  AKKAAEAudioFormatConverter.h
+//  AKKAAudioEngineSample
+//
+//  Created by 张一鸣 on 2016/12/16.
+//  Copyright © 2016年 AKKA. All rights reserved.
+//
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#import <Foundation/Foundation.h>
+#import <AudioToolbox/AudioToolbox.h>
+
+typedef struct AKKAAEAudioFormatConverter AKKAAEAudioFormatConverter;
+
+/*!
+ * Determine whether a format is supported by the converter
+ *
+ *  Supported formats are linear PCM with one frame per packet, in any of: 16, 24 (packed in 3
+ *  bytes, or high-aligned in 4) or 32-bit signed integer, or 32 or 64-bit float; interleaved or
+ *  non-interleaved; big or little endian.
+ *
+ * @param format The format
+ * @return YES if the format can be converted to or from
+ */
+BOOL AKKAAEAudioFormatConverterSupportsFormat(AudioStreamBasicDescription format);
+
+/*!
+ * Create a format converter
+ *
+ *  A converter is a plan for converting between one pair of PCM formats, without AudioConverter
+ *  or ExtAudioFile: the decoder, layout change and encoder are chosen once, here, with SIMD
+ *  (SSE2/NEON) versions of the common sample conversions. Conversion goes through float in small
+ *  tiles on the stack, so it allocates nothing and is realtime safe, and a converter may be used
+ *  from several threads at once.
+ *
+ *  在任意两种 PCM 格式之间转换（采样格式、字节序、交错/非交错），不依赖 AudioConverter。
+ *  创建时就选好转换方案，转换过程不分配内存，可以在实时线程使用。
+ *
+ *  Integer samples map to float with a scale of 2^(bits-1), so integer to float to integer is
+ *  lossless; float to integer rounds to nearest and clips. If the channel counts differ, the
+ *  extra source channels are dropped and the extra destination channels are silenced.
+ *
+ * @param sourceFormat The format to convert from
+ * @param destinationFormat The format to convert to
+ * @return The new converter, or NULL if either format isn't supported
+ */
+AKKAAEAudioFormatConverter * _Nullable AKKAAEAudioFormatConverterNew(AudioStreamBasicDescription sourceFormat,
+                                                                     AudioStreamBasicDescription destinationFormat);
+
+/*!
+ * Free a format converter
+ *
+ * @param converter The converter
+ */
+void AKKAAEAudioFormatConverterFree(AKKAAEAudioFormatConverter * _Nonnull converter);
+
+/*!
+ * Convert audio
+ *
+ *  Source and destination must not overlap.
+ *
+ * @param converter The converter
+ * @param source Audio in the source format, with at least the given number of frames
+ * @param destination Buffer list in the destination format, with room for the given number of frames
+ * @param frames Number of frames to convert
+ */
+void AKKAAEAudioFormatConverterConvert(const AKKAAEAudioFormatConverter * _Nonnull converter,
+                                       const AudioBufferList * _Nonnull source,
+                                       const AudioBufferList * _Nonnull destination,
+                                       UInt32 frames);
+
+/*!
+ * Describe the converter's plan, for logging
+ *
+ * @param converter The converter
+ * @return A description, such as "int16le/i2 -> float32/n2"
+ */
+const char * _Nonnull AKKAAEAudioFormatConverterGetDescription(const AKKAAEAudioFormatConverter * _Nonnull converter);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,537 @@
+//
+//  AKKAAEAudioFormatConverter.m
+//  AKKAAudioEngineSample
+//
+//  Created by 张一鸣 on 2016/12/16.
+//  Copyright © 2016年 AKKA. All rights reserved.
+//
+
+#import "AKKAAEAudioFormatConverter.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define AKKAAE_CONVERTER_SSE2 1
+#import <emmintrin.h>
+#elif defined(__aarch64__)
+#define AKKAAE_CONVERTER_NEON 1
+#import <arm_neon.h>
+#endif
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define AKKAAE_CONVERTER_BIG_ENDIAN 1
+#else
+#define AKKAAE_CONVERTER_BIG_ENDIAN 0
+#endif
+
+// Samples per stack tile; conversion runs through two of these
+#define kTileSamples 2048
+static const int kMaximumChannels = 256;
+
+typedef enum {
+    AKKAAESampleTypeInt16,
+    AKKAAESampleTypeInt24,
+    AKKAAESampleTypeInt32,
+    AKKAAESampleTypeFloat32,
+    AKKAAESampleTypeFloat64,
+    AKKAAESampleTypeCount,
+} AKKAAESampleType;
+
+//! Converts a contiguous run of samples to float
+typedef void (*AKKAAESampleDecoder)(const void * input, float * output, UInt32 count);
+
+//! Converts a contiguous run of float samples
+typedef void (*AKKAAESampleEncoder)(const float * input, void * output, UInt32 count);
+
+typedef struct {
+    AKKAAESampleType type;
+    BOOL swapped;           // Opposite to the native byte order
+    BOOL bigEndian;
+    BOOL interleaved;
+    int channels;
+    int bytesPerSample;
+    int bytesPerFrame;      // Per buffer
+} AKKAAEPCMLayout;
+
+struct AKKAAEAudioFormatConverter {
+    AKKAAEPCMLayout source;
+    AKKAAEPCMLayout destination;
+    AKKAAESampleDecoder decode;
+    AKKAAESampleEncoder encode;
+    BOOL copy;              // Same layout both sides: just copy bytes
+    char description[64];
+};
+
+static const float kInt16Scale = 32768.0f;
+static const float kInt24Scale = 8388608.0f;
+static const float kInt32Scale = 2147483648.0f;
+
+#pragma mark - Scalar
+
+static inline int32_t AKKAAEConverterClip(float sample, float scale, int32_t minimum, int32_t maximum) {
+    float scaled = sample * scale;
+    if ( scaled >= (float)maximum ) return maximum;
+    if ( scaled <= (float)minimum ) return minimum;
+    return (int32_t)lrintf(scaled);
+}
+
+static inline uint32_t AKKAAEConverterSwap32(uint32_t value) { return __builtin_bswap32(value); }
+
+static void AKKAAEDecodeInt16(const void * input, float * output, UInt32 count) {
+    const int16_t * samples = (const int16_t *)input;
+    for ( UInt32 i=0; i<count; i++ ) output[i] = samples[i] * (1.0f / kInt16Scale);
+}
+
+static void AKKAAEDecodeInt16Swapped(const void * input, float * output, UInt32 count) {
+    const uint16_t * samples = (const uint16_t *)input;
+    for ( UInt32 i=0; i<count; i++ ) output[i] = (int16_t)__builtin_bswap16(samples[i]) * (1.0f / kInt16Scale);
+}
+
+static void AKKAAEDecodeInt24LE(const void * input, float * output, UInt32 count) {
+    const uint8_t * bytes = (const uint8_t *)input;
+    for ( UInt32 i=0; i<count; i++, bytes += 3 ) {
+        int32_t value = (int32_t)(((uint32_t)bytes[0] << 8) | ((uint32_t)bytes[1] << 16) | ((uint32_t)bytes[2] << 24)) >> 8;
+        output[i] = value * (1.0f / kInt24Scale);
+    }
+}
+
+static void AKKAAEDecodeInt24BE(const void * input, float * output, UInt32 count) {
+    const uint8_t * bytes = (const uint8_t *)input;
+    for ( UInt32 i=0; i<count; i++, bytes += 3 ) {
+        int32_t value = (int32_t)(((uint32_t)bytes[2] << 8) | ((uint32_t)bytes[1] << 16) | ((uint32_t)bytes[0] << 24)) >> 8;
+        output[i] = value * (1.0f / kInt24Scale);
+    }
+}
+
+static void AKKAAEDecodeInt32(const void * input, float * output, UInt32 count) {
+    const int32_t * samples = (const int32_t *)input;
+    for ( UInt32 i=0; i<count; i++ ) output[i] = samples[i] * (1.0f / kInt32Scale);
+}
+
+static void AKKAAEDecodeInt32Swapped(const void * input, float * output, UInt32 count) {
+    const uint32_t * samples = (const uint32_t *)input;
+    for ( UInt32 i=0; i<count; i++ ) output[i] = (int32_t)AKKAAEConverterSwap32(samples[i]) * (1.0f / kInt32Scale);
+}
+
+static void AKKAAEDecodeFloat32(const void * input, float * output, UInt32 count) {
+    memcpy(output, input, count * sizeof(float));
+}
+
+static void AKKAAEDecodeFloat32Swapped(const void * input, float * output, UInt32 count) {
+    const uint32_t * samples = (const uint32_t *)input;
+    uint32_t * words = (uint32_t *)output;
+    for ( UInt32 i=0; i<count; i++ ) words[i] = AKKAAEConverterSwap32(samples[i]);
+}
+
+static void AKKAAEDecodeFloat64(const void * input, float * output, UInt32 count) {
+    const double * samples = (const double *)input;
+    for ( UInt32 i=0; i<count; i++ ) output[i] = (float)samples[i];
+}
+
+static void AKKAAEDecodeFloat64Swapped(const void * input, float * output, UInt32 count) {
+    const uint64_t * samples = (const uint64_t *)input;
+    for ( UInt32 i=0; i<count; i++ ) {
+        uint64_t word = __builtin_bswap64(samples[i]);
+        double sample;
+        memcpy(&sample, &word, sizeof(sample));
+        output[i] = (float)sample;
+    }
+}
+
+static void AKKAAEEncodeInt16(const float * input, void * output, UInt32 count) {
+    int16_t * samples = (int16_t *)output;
+    for ( UInt32 i=0; i<count; i++ ) samples[i] = (int16_t)AKKAAEConverterClip(input[i], kInt16Scale, INT16_MIN, INT16_MAX);
+}
+
+static void AKKAAEEncodeInt16Swapped(const float * input, void * output, UInt32 count) {
+    uint16_t * samples = (uint16_t *)output;
+    for ( UInt32 i=0; i<count; i++ ) {
+        samples[i] = __builtin_bswap16((uint16_t)AKKAAEConverterClip(input[i], kInt16Scale, INT16_MIN, INT16_MAX));
+    }
+}
+
+static void AKKAAEEncodeInt24LE(const float * input, void * output, UInt32 count) {
+    uint8_t * bytes = (uint8_t *)output;
+    for ( UInt32 i=0; i<count; i++, bytes += 3 ) {
+        uint32_t value = (uint32_t)AKKAAEConverterClip(input[i], kInt24Scale, -8388608, 8388607);
+        bytes[0] = value & 0xFF;
+        bytes[1] = (value >> 8) & 0xFF;
+        bytes[2] = (value >> 16) & 0xFF;
+    }
+}
+
+static void AKKAAEEncodeInt24BE(const float * input, void * output, UInt32 count) {
+    uint8_t * bytes = (uint8_t *)output;
+    for ( UInt32 i=0; i<count; i++, bytes += 3 ) {
+        uint32_t value = (uint32_t)AKKAAEConverterClip(input[i], kInt24Scale, -8388608, 8388607);
+        bytes[0] = (value >> 16) & 0xFF;
+        bytes[1] = (value >> 8) & 0xFF;
+        bytes[2] = value & 0xFF;
+    }
+}
+
+static void AKKAAEEncodeInt32(const float * input, void * output, UInt32 count) {
+    int32_t * samples = (int32_t *)output;
+    for ( UInt32 i=0; i<count; i++ ) samples[i] = AKKAAEConverterClip(input[i], kInt32Scale, INT32_MIN, INT32_MAX);
+}
+
+static void AKKAAEEncodeInt32Swapped(const float * input, void * output, UInt32 count) {
+    uint32_t * samples = (uint32_t *)output;
+    for ( UInt32 i=0; i<count; i++ ) {
+        samples[i] = AKKAAEConverterSwap32((uint32_t)AKKAAEConverterClip(input[i], kInt32Scale, INT32_MIN, INT32_MAX));
+    }
+}
+
+static void AKKAAEEncodeFloat32(const float * input, void * output, UInt32 count) {
+    memcpy(output, input, count * sizeof(float));
+}
+
+static void AKKAAEEncodeFloat32Swapped(const float * input, void * output, UInt32 count) {
+    const uint32_t * words = (const uint32_t *)input;
+    uint32_t * samples = (uint32_t *)output;
+    for ( UInt32 i=0; i<count; i++ ) samples[i] = AKKAAEConverterSwap32(words[i]);
+}
+
+static void AKKAAEEncodeFloat64(const float * input, void * output, UInt32 count) {
+    double * samples = (double *)output;
+    for ( UInt32 i=0; i<count; i++ ) samples[i] = input[i];
+}
+
+static void AKKAAEEncodeFloat64Swapped(const float * input, void * output, UInt32 count) {
+    uint64_t * samples = (uint64_t *)output;
+    for ( UInt32 i=0; i<count; i++ ) {
+        double sample = input[i];
+        uint64_t word;
+        memcpy(&word, &sample, sizeof(word));
+        samples[i] = __builtin_bswap64(word);
+    }
+}
+
+#pragma mark - SSE2
+
+#if AKKAAE_CONVERTER_SSE2
+
+static void AKKAAEDecodeInt16SSE2(const void * input, float * output, UInt32 count) {
+    const int16_t * samples = (const int16_t *)input;
+    const __m128 scale = _mm_set1_ps(1.0f / kInt16Scale);
+    UInt32 i = 0;
+    for ( ; i+8 <= count; i+=8 ) {
+        __m128i words = _mm_loadu_si128((const __m128i *)(samples + i));
+        // Unpack each sample into the top half of a 32-bit lane, then shift down to sign-extend
+        __m128i low = _mm_srai_epi32(_mm_unpacklo_epi16(words, words), 16);
+        __m128i high = _mm_srai_epi32(_mm_unpackhi_epi16(words, words), 16);
+        _mm_storeu_ps(output + i, _mm_mul_ps(_mm_cvtepi32_ps(low), scale));
+        _mm_storeu_ps(output + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(high), scale));
+    }
+    AKKAAEDecodeInt16(samples + i, output + i, count - i);
+}
+
+static void AKKAAEEncodeInt16SSE2(const float * input, void * output, UInt32 count) {
+    int16_t * samples = (int16_t *)output;
+    const __m128 scale = _mm_set1_ps(kInt16Scale);
+    const __m128 maximum = _mm_set1_ps(INT16_MAX);
+    const __m128 minimum = _mm_set1_ps(INT16_MIN);
+    UInt32 i = 0;
+    for ( ; i+8 <= count; i+=8 ) {
+        __m128 low = _mm_max_ps(_mm_min_ps(_mm_mul_ps(_mm_loadu_ps(input + i), scale), maximum), minimum);
+        __m128 high = _mm_max_ps(_mm_min_ps(_mm_mul_ps(_mm_loadu_ps(input + i + 4), scale), maximum), minimum);
+        _mm_storeu_si128((__m128i *)(samples + i), _mm_packs_epi32(_mm_cvtps_epi32(low), _mm_cvtps_epi32(high)));
+    }
+    AKKAAEEncodeInt16(input + i, samples + i, count - i);
+}
+
+static void AKKAAEDecodeInt32SSE2(const void * input, float * output, UInt32 count) {
+    const int32_t * samples = (const int32_t *)input;
+    const __m128 scale = _mm_set1_ps(1.0f / kInt32Scale);
+    UInt32 i = 0;
+    for ( ; i+4 <= count; i+=4 ) {
+        __m128i words = _mm_loadu_si128((const __m128i *)(samples + i));
+        _mm_storeu_ps(output + i, _mm_mul_ps(_mm_cvtepi32_ps(words), scale));
+    }
+    AKKAAEDecodeInt32(samples + i, output + i, count - i);
+}
+
+static void AKKAAEEncodeInt32SSE2(const float * input, void * output, UInt32 count) {
+    int32_t * samples = (int32_t *)output;
+    const __m128 scale = _mm_set1_ps(kInt32Scale);
+    UInt32 i = 0;
+    for ( ; i+4 <= count; i+=4 ) {
+        __m128 scaled = _mm_mul_ps(_mm_loadu_ps(input + i), scale);
+        // Out-of-range conversions give INT32_MIN; flipping every bit where we overflowed upwards gives INT32_MAX
+        __m128i overflow = _mm_castps_si128(_mm_cmpge_ps(scaled, scale));
+        _mm_storeu_si128((__m128i *)(samples + i), _mm_xor_si128(_mm_cvtps_epi32(scaled), overflow));
+    }
+    AKKAAEEncodeInt32(input + i, samples + i, count - i);
+}
+
+#endif
+
+#pragma mark - NEON
+
+#if AKKAAE_CONVERTER_NEON
+
+static void AKKAAEDecodeInt16NEON(const void * input, float * output, UInt32 count) {
+    const int16_t * samples = (const int16_t *)input;
+    UInt32 i = 0;
+    for ( ; i+8 <= count; i+=8 ) {
+        int16x8_t words = vld1q_s16(samples + i);
+        vst1q_f32(output + i, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(words))), 1.0f / kInt16Scale));
+        vst1q_f32(output + i + 4, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(words))), 1.0f / kInt16Scale));
+    }
+    AKKAAEDecodeInt16(samples + i, output + i, count - i);
+}
+
+static void AKKAAEEncodeInt16NEON(const float * input, void * output, UInt32 count) {
+    int16_t * samples = (int16_t *)output;
+    UInt32 i = 0;
+    for ( ; i+8 <= count; i+=8 ) {
+        // Both conversions saturate, so no explicit clipping is needed
+        int32x4_t low = vcvtnq_s32_f32(vmulq_n_f32(vld1q_f32(input + i), kInt16Scale));
+        int32x4_t high = vcvtnq_s32_f32(vmulq_n_f32(vld1q_f32(input + i + 4), kInt16Scale));
+        vst1q_s16(samples + i, vcombine_s16(vqmovn_s32(low), vqmovn_s32(high)));
+    }
+    AKKAAEEncodeInt16(input + i, samples + i, count - i);
+}
+
+static void AKKAAEDecodeInt32NEON(const void * input, float * output, UInt32 count) {
+    const int32_t * samples = (const int32_t *)input;
+    UInt32 i = 0;
+    for ( ; i+4 <= count; i+=4 ) {
+        vst1q_f32(output + i, vmulq_n_f32(vcvtq_f32_s32(vld1q_s32(samples + i)), 1.0f / kInt32Scale));
+    }
+    AKKAAEDecodeInt32(samples + i, output + i, count - i);
+}
+
+static void AKKAAEEncodeInt32NEON(const float * input, void * output, UInt32 count) {
+    int32_t * samples = (int32_t *)output;
+    UInt32 i = 0;
+    for ( ; i+4 <= count; i+=4 ) {
+        vst1q_s32(samples + i, vcvtnq_s32_f32(vmulq_n_f32(vld1q_f32(input + i), kInt32Scale)));
+    }
+    AKKAAEEncodeInt32(input + i, samples + i, count - i);
+}
+
+#endif
+
+#pragma mark - Plans
+
+// Codecs by sample type, for [native byte order, swapped]
+#if AKKAAE_CONVERTER_SSE2
+#define AKKAAEDecodeInt16Native AKKAAEDecodeInt16SSE2
+#define AKKAAEEncodeInt16Native AKKAAEEncodeInt16SSE2
+#define AKKAAEDecodeInt32Native AKKAAEDecodeInt32SSE2
+#define AKKAAEEncodeInt32Native AKKAAEEncodeInt32SSE2
+#elif AKKAAE_CONVERTER_NEON
+#define AKKAAEDecodeInt16Native AKKAAEDecodeInt16NEON
+#define AKKAAEEncodeInt16Native AKKAAEEncodeInt16NEON
+#define AKKAAEDecodeInt32Native AKKAAEDecodeInt32NEON
+#define AKKAAEEncodeInt32Native AKKAAEEncodeInt32NEON
+#else
+#define AKKAAEDecodeInt16Native AKKAAEDecodeInt16
+#define AKKAAEEncodeInt16Native AKKAAEEncodeInt16
+#define AKKAAEDecodeInt32Native AKKAAEDecodeInt32
+#define AKKAAEEncodeInt32Native AKKAAEEncodeInt32
+#endif
+
+#if AKKAAE_CONVERTER_BIG_ENDIAN
+#define AKKAAEDecodeInt24Native AKKAAEDecodeInt24BE
+#define AKKAAEDecodeInt24Swapped AKKAAEDecodeInt24LE
+#define AKKAAEEncodeInt24Native AKKAAEEncodeInt24BE
+#define AKKAAEEncodeInt24Swapped AKKAAEEncodeInt24LE
+#else
+#define AKKAAEDecodeInt24Native AKKAAEDecodeInt24LE
+#define AKKAAEDecodeInt24Swapped AKKAAEDecodeInt24BE
+#define AKKAAEEncodeInt24Native AKKAAEEncodeInt24LE
+#define AKKAAEEncodeInt24Swapped AKKAAEEncodeInt24BE
+#endif
+
+static const AKKAAESampleDecoder kDecoders[AKKAAESampleTypeCount][2] = {
+    [AKKAAESampleTypeInt16] = { AKKAAEDecodeInt16Native, AKKAAEDecodeInt16Swapped },
+    [AKKAAESampleTypeInt24] = { AKKAAEDecodeInt24Native, AKKAAEDecodeInt24Swapped },
+    [AKKAAESampleTypeInt32] = { AKKAAEDecodeInt32Native, AKKAAEDecodeInt32Swapped },
+    [AKKAAESampleTypeFloat32] = { AKKAAEDecodeFloat32, AKKAAEDecodeFloat32Swapped },
+    [AKKAAESampleTypeFloat64] = { AKKAAEDecodeFloat64, AKKAAEDecodeFloat64Swapped },
+};
+
+static const AKKAAESampleEncoder kEncoders[AKKAAESampleTypeCount][2] = {
+    [AKKAAESampleTypeInt16] = { AKKAAEEncodeInt16Native, AKKAAEEncodeInt16Swapped },
+    [AKKAAESampleTypeInt24] = { AKKAAEEncodeInt24Native, AKKAAEEncodeInt24Swapped },
+    [AKKAAESampleTypeInt32] = { AKKAAEEncodeInt32Native, AKKAAEEncodeInt32Swapped },
+    [AKKAAESampleTypeFloat32] = { AKKAAEEncodeFloat32, AKKAAEEncodeFloat32Swapped },
+    [AKKAAESampleTypeFloat64] = { AKKAAEEncodeFloat64, AKKAAEEncodeFloat64Swapped },
+};
+
+static const char * const kSampleTypeNames[AKKAAESampleTypeCount] = { "int16", "int24", "int32", "float32", "float64" };
+
+static BOOL AKKAAEPCMLayoutFromFormat(AudioStreamBasicDescription format, AKKAAEPCMLayout * layout) {
+    if ( format.mFormatID != kAudioFormatLinearPCM || format.mFramesPerPacket != 1
+            || format.mChannelsPerFrame < 1 || format.mChannelsPerFrame > kMaximumChannels ) {
+        return NO;
+    }
+
+    AKKAAEPCMLayout result = {
+        .interleaved = !(format.mFormatFlags & kAudioFormatFlagIsNonInterleaved),
+        .bigEndian = (format.mFormatFlags & kAudioFormatFlagIsBigEndian) != 0,
+        .channels = (int)format.mChannelsPerFrame,
+        .bytesPerFrame = (int)format.mBytesPerFrame,
+    };
+    result.swapped = result.bigEndian != AKKAAE_CONVERTER_BIG_ENDIAN;
+    result.bytesPerSample = result.interleaved ? result.bytesPerFrame / result.channels : result.bytesPerFrame;
+    if ( result.bytesPerSample * (result.interleaved ? result.channels : 1) != result.bytesPerFrame ) return NO;
+
+    if ( format.mFormatFlags & kAudioFormatFlagIsFloat ) {
+        if ( format.mBitsPerChannel == 32 && result.bytesPerSample == 4 ) {
+            result.type = AKKAAESampleTypeFloat32;
+        } else if ( format.mBitsPerChannel == 64 && result.bytesPerSample == 8 ) {
+            result.type = AKKAAESampleTypeFloat64;
+        } else {
+            return NO;
+        }
+    } else {
+        if ( !(format.mFormatFlags & kAudioFormatFlagIsSignedInteger) ) return NO;
+        if ( format.mBitsPerChannel == 16 && result.bytesPerSample == 2 ) {
+            result.type = AKKAAESampleTypeInt16;
+        } else if ( format.mBitsPerChannel == 24 && result.bytesPerSample == 3 ) {
+            result.type = AKKAAESampleTypeInt24;
+        } else if ( format.mBitsPerChannel == 24 && result.bytesPerSample == 4
+                   && (format.mFormatFlags & kAudioFormatFlagIsAlignedHigh) ) {
+            // 24 bits in the top of a 32-bit word reads as 32-bit
+            result.type = AKKAAESampleTypeInt32;
+        } else if ( format.mBitsPerChannel == 32 && result.bytesPerSample == 4 ) {
+            result.type = AKKAAESampleTypeInt32;
+        } else {
+            return NO;
+        }
+    }
+
+    *layout = result;
+    return YES;
+}
+
+static int AKKAAEPCMLayoutDescribe(const AKKAAEPCMLayout * layout, char * string, size_t size) {
+    return snprintf(string, size, "%s%s/%c%d", kSampleTypeNames[layout->type],
+                    layout->type == AKKAAESampleTypeFloat32 || layout->type == AKKAAESampleTypeFloat64
+                        ? (layout->bigEndian ? "be" : "") : (layout->bigEndian ? "be" : "le"),
+                    layout->interleaved ? 'i' : 'n', layout->channels);
+}
+
+BOOL AKKAAEAudioFormatConverterSupportsFormat(AudioStreamBasicDescription format) {
+    AKKAAEPCMLayout layout;
+    return AKKAAEPCMLayoutFromFormat(format, &layout);
+}
+
+AKKAAEAudioFormatConverter * AKKAAEAudioFormatConverterNew(AudioStreamBasicDescription sourceFormat,
+                                                           AudioStreamBasicDescription destinationFormat) {
+    AKKAAEPCMLayout source, destination;
+    if ( !AKKAAEPCMLayoutFromFormat(sourceFormat, &source) || !AKKAAEPCMLayoutFromFormat(destinationFormat, &destination) ) {
+        return NULL;
+    }
+
+    AKKAAEAudioFormatConverter * converter = (AKKAAEAudioFormatConverter *)calloc(1, sizeof(AKKAAEAudioFormatConverter));
+    converter->source = source;
+    converter->destination = destination;
+    converter->decode = kDecoders[source.type][source.swapped];
+    converter->encode = kEncoders[destination.type][destination.swapped];
+    converter->copy = source.type == destination.type && source.swapped == destination.swapped
+        && source.interleaved == destination.interleaved && source.channels == destination.channels;
+
+    int length = AKKAAEPCMLayoutDescribe(&source, converter->description, sizeof(converter->description));
+    length += snprintf(converter->description + length, sizeof(converter->description) - length, " -> ");
+    AKKAAEPCMLayoutDescribe(&destination, converter->description + length, sizeof(converter->description) - length);
+
+    return converter;
+}
+
+void AKKAAEAudioFormatConverterFree(AKKAAEAudioFormatConverter * converter) {
+    free(converter);
+}
+
+const char * AKKAAEAudioFormatConverterGetDescription(const AKKAAEAudioFormatConverter * converter) {
+    return converter->description;
+}
+
+/*!
+ * Move float samples from the source layout to the destination layout
+ *
+ *  In a tile, sample n of channel c is at n * channels + c when interleaved, or c * tileFrames + n when not.
+ */
+static void AKKAAEAudioFormatConverterArrange(const float * input, const AKKAAEPCMLayout * from,
+                                              float * output, const AKKAAEPCMLayout * to,
+                                              UInt32 frames, UInt32 tileFrames) {
+    int channels = MIN(from->channels, to->channels);
+    UInt32 inputFrameStride = from->interleaved ? from->channels : 1;
+    UInt32 inputChannelStride = from->interleaved ? 1 : tileFrames;
+    UInt32 outputFrameStride = to->interleaved ? to->channels : 1;
+    UInt32 outputChannelStride = to->interleaved ? 1 : tileFrames;
+
+    if ( channels == 2 && to->channels == 2 && from->interleaved != to->interleaved ) {
+        // Stereo is the common case: do both channels in one pass
+        const float * left = input, * right = input + inputChannelStride;
+        float * leftOutput = output, * rightOutput = output + outputChannelStride;
+        for ( UInt32 n=0; n<frames; n++ ) {
+            leftOutput[n * outputFrameStride] = left[n * inputFrameStride];
+            rightOutput[n * outputFrameStride] = right[n * inputFrameStride];
+        }
+        return;
+    }
+
+    for ( int c=0; c<to->channels; c++ ) {
+        float * channelOutput = output + (c * outputChannelStride);
+        if ( c < channels ) {
+            const float * channelInput = input + (c * inputChannelStride);
+            for ( UInt32 n=0; n<frames; n++ ) channelOutput[n * outputFrameStride] = channelInput[n * inputFrameStride];
+        } else {
+            for ( UInt32 n=0; n<frames; n++ ) channelOutput[n * outputFrameStride] = 0.0f;
+        }
+    }
+}
+
+void AKKAAEAudioFormatConverterConvert(const AKKAAEAudioFormatConverter * converter,
+                                       const AudioBufferList * source,
+                                       const AudioBufferList * destination,
+                                       UInt32 frames) {
+    const AKKAAEPCMLayout * from = &converter->source;
+    const AKKAAEPCMLayout * to = &converter->destination;
+
+    if ( converter->copy ) {
+        for ( int i=0; i<MIN(source->mNumberBuffers, destination->mNumberBuffers); i++ ) {
+            memcpy(destination->mBuffers[i].mData, source->mBuffers[i].mData, (size_t)frames * from->bytesPerFrame);
+        }
+        return;
+    }
+
+    // 先解码成 float（保持源的排列），需要的话重新排列，再编码成目标格式；都在栈上的小块里完成
+    int channels = MIN(from->channels, to->channels);
+    UInt32 tileFrames = kTileSamples / MAX(from->channels, to->channels);
+    BOOL arrange = from->interleaved != to->interleaved || from->channels != to->channels;
+    float decoded[kTileSamples];
+    float arranged[kTileSamples];
+
+    for ( UInt32 offset = 0; offset < frames; offset += tileFrames ) {
+        UInt32 count = MIN(tileFrames, frames - offset);
+
+        if ( from->interleaved ) {
+            converter->decode((const char *)source->mBuffers[0].mData + ((size_t)offset * from->bytesPerFrame),
+                              decoded, count * from->channels);
+        } else {
+            for ( int c=0; c<channels; c++ ) {
+                converter->decode((const char *)source->mBuffers[c].mData + ((size_t)offset * from->bytesPerFrame),
+                                  decoded + (c * tileFrames), count);
+            }
+        }
+
+        const float * ready = decoded;
+        if ( arrange ) {
+            AKKAAEAudioFormatConverterArrange(decoded, from, arranged, to, count, tileFrames);
+            ready = arranged;
+        }
+
+        if ( to->interleaved ) {
+            converter->encode(ready, (char *)destination->mBuffers[0].mData + ((size_t)offset * to->bytesPerFrame),
+                              count * to->channels);
+        } else {
+            for ( int c=0; c<to->channels; c++ ) {
+                converter->encode(ready + (c * tileFrames),
+                                  (char *)destination->mBuffers[c].mData + ((size_t)offset * to->bytesPerFrame), count);
+            }
+        }
+    }
+}
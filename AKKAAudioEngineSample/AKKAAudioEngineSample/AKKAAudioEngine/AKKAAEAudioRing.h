@@ -0,0 +1,149 @@
+//
+//  AKKAAEAudioRing.h
+//  AKKAAudioEngineSample
+//
+//  Created by 张一鸣 on 2016/12/16.
+//  Copyright © 2016年 AKKA. All rights reserved.
+//
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#import <Foundation/Foundation.h>
+#import <AudioToolbox/AudioToolbox.h>
+
+typedef struct AKKAAEAudioRing AKKAAEAudioRing;
+
+/*!
+ * Create an audio ring buffer
+ *
+ *  A lock-free ring of non-interleaved float audio, for one producer thread and one consumer
+ *  thread. Storage is allocated here, once; reads and writes never lock or allocate, so either
+ *  side may be the render thread.
+ *
+ *  单生产者/单消费者的无锁环形缓冲区，非交错 float 格式；读写都不加锁、不分配内存。
+ *
+ *  Besides copying with AKKAAEAudioRingWrite and AKKAAEAudioRingRead, either side can work in
+ *  place: get a buffer list pointing into the ring, fill or consume it, then commit.
+ *
+ * @param channels Number of channels
+ * @param capacity Capacity, in frames
+ * @return The new ring
+ */
+AKKAAEAudioRing * _Nonnull AKKAAEAudioRingNew(int channels, UInt32 capacity);
+
+/*!
+ * Free a ring
+ *
+ * @param ring The ring
+ */
+void AKKAAEAudioRingFree(AKKAAEAudioRing * _Nonnull ring);
+
+/*!
+ * Get the ring's capacity
+ *
+ * @param ring The ring
+ * @return Capacity, in frames
+ */
+UInt32 AKKAAEAudioRingGetCapacity(const AKKAAEAudioRing * _Nonnull ring);
+
+/*!
+ * Get the number of frames waiting to be read
+ *
+ * @param ring The ring
+ * @return Frames available to the consumer
+ */
+UInt32 AKKAAEAudioRingGetFillCount(const AKKAAEAudioRing * _Nonnull ring);
+
+/*!
+ * Get the total number of frames ever written and read
+ *
+ *  These only increase, so they identify positions in the stream: a producer can record where
+ *  something starts, and the consumer can skip to it with AKKAAEAudioRingDiscard.
+ *
+ * @param ring The ring
+ * @param outWritten On output, if not NULL, frames committed by the producer
+ * @param outRead On output, if not NULL, frames consumed
+ */
+void AKKAAEAudioRingGetCounts(const AKKAAEAudioRing * _Nonnull ring, UInt64 * _Nullable outWritten, UInt64 * _Nullable outRead);
+
+/*!
+ * Get the space to write into, in place
+ *
+ *  Points the buffer list at the next contiguous free region of the ring. Fill it, then call
+ *  AKKAAEAudioRingCommitWrite. Producer only.
+ *
+ * @param ring The ring
+ * @param bufferList Buffer list with one buffer per channel
+ * @param frames Maximum frames wanted
+ * @return Number of contiguous frames available (may be fewer than free space, at the wrap point)
+ */
+UInt32 AKKAAEAudioRingGetWriteBuffer(AKKAAEAudioRing * _Nonnull ring, AudioBufferList * _Nonnull bufferList, UInt32 frames);
+
+/*!
+ * Make written frames available to the consumer
+ *
+ * @param ring The ring
+ * @param frames Number of frames written to the buffer from AKKAAEAudioRingGetWriteBuffer
+ */
+void AKKAAEAudioRingCommitWrite(AKKAAEAudioRing * _Nonnull ring, UInt32 frames);
+
+/*!
+ * Get the audio to read, in place
+ *
+ *  Points the buffer list at the next contiguous filled region of the ring. Consume it, then call
+ *  AKKAAEAudioRingCommitRead. Consumer only.
+ *
+ * @param ring The ring
+ * @param bufferList Buffer list with one buffer per channel
+ * @param frames Maximum frames wanted
+ * @return Number of contiguous frames available (may be fewer than the fill count, at the wrap point)
+ */
+UInt32 AKKAAEAudioRingGetReadBuffer(AKKAAEAudioRing * _Nonnull ring, AudioBufferList * _Nonnull bufferList, UInt32 frames);
+
+/*!
+ * Release read frames back to the producer
+ *
+ * @param ring The ring
+ * @param frames Number of frames consumed from the buffer from AKKAAEAudioRingGetReadBuffer
+ */
+void AKKAAEAudioRingCommitRead(AKKAAEAudioRing * _Nonnull ring, UInt32 frames);
+
+/*!
+ * Copy audio into the ring
+ *
+ *  Producer only.
+ *
+ * @param ring The ring
+ * @param bufferList Audio to write, non-interleaved float with the ring's channel count
+ * @param frames Number of frames to write
+ * @return Number of frames written, fewer than requested if the ring fills
+ */
+UInt32 AKKAAEAudioRingWrite(AKKAAEAudioRing * _Nonnull ring, const AudioBufferList * _Nonnull bufferList, UInt32 frames);
+
+/*!
+ * Copy audio out of the ring
+ *
+ *  Consumer only.
+ *
+ * @param ring The ring
+ * @param bufferList Buffer list to read into, non-interleaved float with the ring's channel count
+ * @param frames Number of frames to read
+ * @return Number of frames read, fewer than requested if the ring empties
+ */
+UInt32 AKKAAEAudioRingRead(AKKAAEAudioRing * _Nonnull ring, const AudioBufferList * _Nonnull bufferList, UInt32 frames);
+
+/*!
+ * Drop frames without reading them
+ *
+ *  Consumer only.
+ *
+ * @param ring The ring
+ * @param frames Number of frames to drop, up to the fill count
+ */
+void AKKAAEAudioRingDiscard(AKKAAEAudioRing * _Nonnull ring, UInt32 frames);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,133 @@
+//
+//  AKKAAEAudioRing.m
+//  AKKAAudioEngineSample
+//
+//  Created by 张一鸣 on 2016/12/16.
+//  Copyright © 2016年 AKKA. All rights reserved.
+//
+
+#import "AKKAAEAudioRing.h"
+#import "AKKAAEAudioBufferListUtilities.h"
+#import "AKKAAETypes.h"
+#import <stdatomic.h>
+
+#define kCacheLineSize 64
+
+// 读写计数只增不减，位置是计数对容量取模；两边各自只写自己的计数
+struct AKKAAEAudioRing {
+    _Alignas(kCacheLineSize) _Atomic(UInt64) written;   // Producer's
+    _Alignas(kCacheLineSize) _Atomic(UInt64) read;      // Consumer's
+    _Alignas(kCacheLineSize) float * storage;           // One run of `capacity` frames per channel
+    int channels;
+    UInt32 capacity;
+    AudioStreamBasicDescription format;
+};
+
+AKKAAEAudioRing * AKKAAEAudioRingNew(int channels, UInt32 capacity) {
+    assert(channels > 0 && capacity > 0);
+
+    // The counters sit on their own cache lines so the two sides don't false-share
+    void * memory = NULL;
+    posix_memalign(&memory, kCacheLineSize, sizeof(AKKAAEAudioRing));
+    AKKAAEAudioRing * ring = (AKKAAEAudioRing *)memory;
+    memset(ring, 0, sizeof(AKKAAEAudioRing));
+    atomic_init(&ring->written, 0);
+    atomic_init(&ring->read, 0);
+    ring->channels = channels;
+    ring->capacity = capacity;
+    ring->format = AKKAAEAudioDescriptionWithChannelsAndRate(channels, 0);
+    ring->storage = (float *)calloc((size_t)channels * capacity, sizeof(float));
+    return ring;
+}
+
+void AKKAAEAudioRingFree(AKKAAEAudioRing * ring) {
+    free(ring->storage);
+    free(ring);
+}
+
+UInt32 AKKAAEAudioRingGetCapacity(const AKKAAEAudioRing * ring) {
+    return ring->capacity;
+}
+
+UInt32 AKKAAEAudioRingGetFillCount(const AKKAAEAudioRing * ring) {
+    UInt64 read = atomic_load_explicit(&ring->read, memory_order_acquire);
+    UInt64 written = atomic_load_explicit(&ring->written, memory_order_acquire);
+    return (UInt32)(written - read);
+}
+
+void AKKAAEAudioRingGetCounts(const AKKAAEAudioRing * ring, UInt64 * outWritten, UInt64 * outRead) {
+    if ( outRead ) *outRead = atomic_load_explicit(&ring->read, memory_order_acquire);
+    if ( outWritten ) *outWritten = atomic_load_explicit(&ring->written, memory_order_acquire);
+}
+
+static inline void AKKAAEAudioRingPointBufferList(const AKKAAEAudioRing * ring, AudioBufferList * bufferList,
+                                                  UInt32 index, UInt32 frames) {
+    for ( int c=0; c<MIN((int)bufferList->mNumberBuffers, ring->channels); c++ ) {
+        bufferList->mBuffers[c].mData = ring->storage + ((size_t)c * ring->capacity) + index;
+        bufferList->mBuffers[c].mDataByteSize = frames * sizeof(float);
+        bufferList->mBuffers[c].mNumberChannels = 1;
+    }
+}
+
+UInt32 AKKAAEAudioRingGetWriteBuffer(AKKAAEAudioRing * ring, AudioBufferList * bufferList, UInt32 frames) {
+    UInt64 written = atomic_load_explicit(&ring->written, memory_order_relaxed);
+    UInt64 read = atomic_load_explicit(&ring->read, memory_order_acquire);
+    UInt32 index = (UInt32)(written % ring->capacity);
+    UInt32 count = MIN(MIN(frames, ring->capacity - (UInt32)(written - read)), ring->capacity - index);
+    AKKAAEAudioRingPointBufferList(ring, bufferList, index, count);
+    return count;
+}
+
+void AKKAAEAudioRingCommitWrite(AKKAAEAudioRing * ring, UInt32 frames) {
+    UInt64 written = atomic_load_explicit(&ring->written, memory_order_relaxed);
+    atomic_store_explicit(&ring->written, written + frames, memory_order_release);
+}
+
+UInt32 AKKAAEAudioRingGetReadBuffer(AKKAAEAudioRing * ring, AudioBufferList * bufferList, UInt32 frames) {
+    UInt64 read = atomic_load_explicit(&ring->read, memory_order_relaxed);
+    UInt64 written = atomic_load_explicit(&ring->written, memory_order_acquire);
+    UInt32 index = (UInt32)(read % ring->capacity);
+    UInt32 count = MIN(MIN(frames, (UInt32)(written - read)), ring->capacity - index);
+    AKKAAEAudioRingPointBufferList(ring, bufferList, index, count);
+    return count;
+}
+
+void AKKAAEAudioRingCommitRead(AKKAAEAudioRing * ring, UInt32 frames) {
+    UInt64 read = atomic_load_explicit(&ring->read, memory_order_relaxed);
+    atomic_store_explicit(&ring->read, read + frames, memory_order_release);
+}
+
+UInt32 AKKAAEAudioRingWrite(AKKAAEAudioRing * ring, const AudioBufferList * bufferList, UInt32 frames) {
+    UInt32 done = 0;
+    // At most two runs: up to the wrap point, then from the start
+    for ( int run=0; run<2 && done < frames; run++ ) {
+        AKKAAEAudioBufferListCreateOnStackWithFormat(target, ring->format);
+        UInt32 count = AKKAAEAudioRingGetWriteBuffer(ring, target, frames - done);
+        if ( count == 0 ) break;
+        for ( int c=0; c<MIN((int)bufferList->mNumberBuffers, ring->channels); c++ ) {
+            memcpy(target->mBuffers[c].mData, (const float *)bufferList->mBuffers[c].mData + done, count * sizeof(float));
+        }
+        AKKAAEAudioRingCommitWrite(ring, count);
+        done += count;
+    }
+    return done;
+}
+
+UInt32 AKKAAEAudioRingRead(AKKAAEAudioRing * ring, const AudioBufferList * bufferList, UInt32 frames) {
+    UInt32 done = 0;
+    for ( int run=0; run<2 && done < frames; run++ ) {
+        AKKAAEAudioBufferListCreateOnStackWithFormat(source, ring->format);
+        UInt32 count = AKKAAEAudioRingGetReadBuffer(ring, source, frames - done);
+        if ( count == 0 ) break;
+        for ( int c=0; c<MIN((int)bufferList->mNumberBuffers, ring->channels); c++ ) {
+            memcpy((float *)bufferList->mBuffers[c].mData + done, source->mBuffers[c].mData, count * sizeof(float));
+        }
+        AKKAAEAudioRingCommitRead(ring, count);
+        done += count;
+    }
+    return done;
+}
+
+void AKKAAEAudioRingDiscard(AKKAAEAudioRing * ring, UInt32 frames) {
+    AKKAAEAudioRingCommitRead(ring, MIN(frames, AKKAAEAudioRingGetFillCount(ring)));
+}
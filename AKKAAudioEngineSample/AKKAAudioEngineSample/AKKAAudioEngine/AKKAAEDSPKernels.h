@@ -0,0 +1,156 @@
+//
+//  AKKAAEDSPKernels.h
+//  AKKAAudioEngineSample
+//
+//  Created by 张一鸣 on 2016/12/16.
+//  Copyright © 2016年 AKKA. All rights reserved.
+//
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(__APPLE__)
+#import <Foundation/Foundation.h>
+#import <AudioToolbox/AudioToolbox.h>
+#else
+// The kernels are plain C: off Apple platforms (such as a headless benchmark on a Linux CI box) they build
+// on their own, and only need these few Foundation types
+#include <stdint.h>
+#include <string.h>
+typedef uint32_t UInt32;
+typedef signed char BOOL;
+typedef long NSInteger;
+#define YES ((BOOL)1)
+#define NO ((BOOL)0)
+#define NS_ENUM(_type, _name) _type _name; enum
+#ifndef MIN
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#endif
+#ifndef MAX
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#endif
+#if !defined(__clang__)
+#define _Nonnull
+#define _Nullable
+#endif
+#endif
+
+/*!
+ * Whether to build the Accelerate (vDSP) kernel backend
+ *
+ *  Defaults to 1 on Apple platforms. Define as 0 to build the engine without Accelerate; the
+ *  portable SSE2/AVX2/NEON/scalar backends are always available.
+ */
+#ifndef AKKAAE_DSP_USE_ACCELERATE
+#if defined(__APPLE__)
+#define AKKAAE_DSP_USE_ACCELERATE 1
+#else
+#define AKKAAE_DSP_USE_ACCELERATE 0
+#endif
+#endif
+
+/*!
+ * Kernel backends
+ */
+typedef NS_ENUM(NSInteger, AKKAAEDSPKernelBackend) {
+    AKKAAEDSPKernelBackendAutomatic,    //!< Pick the best backend for this CPU
+    AKKAAEDSPKernelBackendScalar,       //!< Portable C, no vector instructions
+    AKKAAEDSPKernelBackendSSE2,         //!< x86 SSE2
+    AKKAAEDSPKernelBackendAVX2,         //!< x86 AVX2 (selected only if the CPU supports it)
+    AKKAAEDSPKernelBackendNEON,         //!< ARM NEON
+    AKKAAEDSPKernelBackendAccelerate,   //!< Apple vDSP
+};
+
+/*!
+ * Kernel table
+ *
+ *  The low-level vector operations that the AKKAAEDSP* utilities are built on. All buffers are
+ *  contiguous float arrays; input and output may be the same buffer, but may not otherwise overlap.
+ *
+ *  All backends produce the same results as the Accelerate backend to within 1e-5 of full scale
+ *  (the ramp kernels compute each gain as start + n*step rather than by running summation, so
+ *  they differ from vDSP by accumulated rounding only).
+ */
+typedef struct {
+    AKKAAEDSPKernelBackend backend; //!< The backend implementing this table
+    const char * _Nonnull name;     //!< Backend name, for logging
+
+    //! output[n] = 0
+    void (* _Nonnull clear)(float * _Nonnull output, UInt32 frames);
+
+    //! output[n] = input[n] * gain
+    void (* _Nonnull scale)(const float * _Nonnull input, float gain, float * _Nonnull output, UInt32 frames);
+
+    //! output[n] = input1[n] + input2[n]
+    void (* _Nonnull add)(const float * _Nonnull input1, const float * _Nonnull input2, float * _Nonnull output, UInt32 frames);
+
+    //! output[n] = input1[n] * gain + input2[n]
+    void (* _Nonnull scaleAdd)(const float * _Nonnull input1, float gain, const float * _Nonnull input2,
+                               float * _Nonnull output, UInt32 frames);
+
+    //! output[n] = input[n] * (*start + n*step); *start advanced by frames*step on output
+    void (* _Nonnull rampMul)(const float * _Nonnull input, float * _Nonnull start, float step,
+                              float * _Nonnull output, UInt32 frames);
+
+    //! output[n] += input[n] * (*start + n*step): a ramped gain fused into a mix; *start advanced by frames*step on output
+    void (* _Nonnull rampMulAdd)(const float * _Nonnull input, float * _Nonnull start, float step,
+                                 float * _Nonnull output, UInt32 frames);
+
+    //! Applies the same ramp as rampMul, in place, to two buffers at once
+    void (* _Nonnull rampMul2)(float * _Nonnull left, float * _Nonnull right, float * _Nonnull start, float step,
+                               UInt32 frames);
+
+    //! Applies the same ramp as rampMul, in place, to any number of buffers in one pass: each block of
+    //! gains is computed once and applied to every channel before moving on
+    void (* _Nonnull rampMulN)(float * _Nonnull const * _Nonnull channels, int channelCount, float * _Nonnull start,
+                               float step, UInt32 frames);
+
+    //! Multiplies any number of buffers in place, in one pass, by the equal-power envelope
+    //! sin(pi/2 * x[n]), where x[n] = *start + n*step is limited to 0...1; *start advanced by frames*step on output
+    void (* _Nonnull equalPowerRampMulN)(float * _Nonnull const * _Nonnull channels, int channelCount,
+                                         float * _Nonnull start, float step, UInt32 frames);
+
+    //! Returns the sum of input[n] * (coefficients[n] + fraction * deltas[n]): a dot product with a filter
+    //! interpolated between two sets of coefficients, as a polyphase resampler needs
+    float (* _Nonnull interpolatedDot)(const float * _Nonnull input, const float * _Nonnull coefficients,
+                                       const float * _Nonnull deltas, float fraction, UInt32 frames);
+
+    //! Returns YES if every input[n] is zero (of either sign). Stops at the first block with a non-zero
+    //! sample, so audible buffers are rejected almost at once
+    BOOL (* _Nonnull isSilent)(const float * _Nonnull input, UInt32 frames);
+} AKKAAEDSPKernels;
+
+/*!
+ * Get the active kernel table
+ *
+ *  On first use, this selects a backend by CPU dispatch: Accelerate where built, otherwise AVX2 if
+ *  the CPU supports it, then SSE2 or NEON, then scalar. Safe to call on the realtime thread.
+ *
+ * @return The active kernel table
+ */
+const AKKAAEDSPKernels * _Nonnull AKKAAEDSPKernelsGet(void);
+
+/*!
+ * Get the kernel table for a specific backend
+ *
+ *  Useful for comparing backends against one another.
+ *
+ * @param backend The backend
+ * @return The kernel table, or NULL if the backend is not built or not supported by this CPU
+ */
+const AKKAAEDSPKernels * _Nullable AKKAAEDSPKernelsGetForBackend(AKKAAEDSPKernelBackend backend);
+
+/*!
+ * Select the active backend
+ *
+ *  Use this on the main thread, before rendering begins.
+ *
+ * @param backend The backend to use, or AKKAAEDSPKernelBackendAutomatic for CPU dispatch
+ * @return YES if the backend is available and now active, NO otherwise
+ */
+BOOL AKKAAEDSPKernelsSetBackend(AKKAAEDSPKernelBackend backend);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,849 @@
+//
+//  AKKAAEDSPKernels.m
+//  AKKAAudioEngineSample
+//
+//  Created by 张一鸣 on 2016/12/16.
+//  Copyright © 2016年 AKKA. All rights reserved.
+//
+
+#import "AKKAAEDSPKernels.h"
+#import <pthread.h>
+#import <stdatomic.h>
+
+#if AKKAAE_DSP_USE_ACCELERATE
+#import <Accelerate/Accelerate.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#define AKKAAE_DSP_X86 1
+#import <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define AKKAAE_DSP_NEON 1
+#import <arm_neon.h>
+#endif
+
+// sin(pi/2 * x) on 0...1 as x * (c1 + c3 x^2 + c5 x^4 + c7 x^6): minimax to 8e-7, exactly 0 and 1 at the ends.
+// 四分之一正弦包络用多项式在寄存器里直接算，不需要查表或临时缓冲
+static const float kQuarterSineC1 = 1.57079029083f;
+static const float kQuarterSineC3 = -0.645885944366f;
+static const float kQuarterSineC5 = 0.0794181376696f;
+static const float kQuarterSineC7 = -0.00432247668505f;
+
+// isSilent checks for a non-zero sample once per block of this many frames
+static const UInt32 kSilenceBlockFrames = 32;
+
+#pragma mark - Scalar
+
+static void AKKAAEDSPScalarClear(float * output, UInt32 frames) {
+    memset(output, 0, frames * sizeof(float));
+}
+
+static void AKKAAEDSPScalarScale(const float * input, float gain, float * output, UInt32 frames) {
+    for ( UInt32 i=0; i<frames; i++ ) output[i] = input[i] * gain;
+}
+
+static void AKKAAEDSPScalarAdd(const float * input1, const float * input2, float * output, UInt32 frames) {
+    for ( UInt32 i=0; i<frames; i++ ) output[i] = input1[i] + input2[i];
+}
+
+static void AKKAAEDSPScalarScaleAdd(const float * input1, float gain, const float * input2, float * output, UInt32 frames) {
+    for ( UInt32 i=0; i<frames; i++ ) output[i] = input1[i] * gain + input2[i];
+}
+
+static void AKKAAEDSPScalarRampMul(const float * input, float * start, float step, float * output, UInt32 frames) {
+    float s = *start;
+    for ( UInt32 i=0; i<frames; i++ ) output[i] = input[i] * (s + (float)i * step);
+    *start = s + (float)frames * step;
+}
+
+static void AKKAAEDSPScalarRampMulAdd(const float * input, float * start, float step, float * output, UInt32 frames) {
+    float s = *start;
+    for ( UInt32 i=0; i<frames; i++ ) output[i] += input[i] * (s + (float)i * step);
+    *start = s + (float)frames * step;
+}
+
+static void AKKAAEDSPScalarRampMul2(float * left, float * right, float * start, float step, UInt32 frames) {
+    float s = *start;
+    for ( UInt32 i=0; i<frames; i++ ) {
+        float g = s + (float)i * step;
+        left[i] *= g;
+        right[i] *= g;
+    }
+    *start = s + (float)frames * step;
+}
+
+static void AKKAAEDSPScalarRampMulN(float * const * channels, int channelCount, float * start, float step, UInt32 frames) {
+    float s = *start;
+    for ( UInt32 i=0; i<frames; i++ ) {
+        float g = s + (float)i * step;
+        for ( int c=0; c<channelCount; c++ ) channels[c][i] *= g;
+    }
+    *start = s + (float)frames * step;
+}
+
+static inline float AKKAAEDSPScalarQuarterSine(float x) {
+    x = MIN(MAX(x, 0.0f), 1.0f);
+    float x2 = x * x;
+    return x * (kQuarterSineC1 + x2 * (kQuarterSineC3 + x2 * (kQuarterSineC5 + x2 * kQuarterSineC7)));
+}
+
+static void AKKAAEDSPScalarEqualPowerRampMulN(float * const * channels, int channelCount, float * start, float step, UInt32 frames) {
+    float s = *start;
+    for ( UInt32 i=0; i<frames; i++ ) {
+        float g = AKKAAEDSPScalarQuarterSine(s + (float)i * step);
+        for ( int c=0; c<channelCount; c++ ) channels[c][i] *= g;
+    }
+    *start = s + (float)frames * step;
+}
+
+static float AKKAAEDSPScalarInterpolatedDot(const float * input, const float * coefficients, const float * deltas,
+                                            float fraction, UInt32 frames) {
+    float sum = 0.0f, deltaSum = 0.0f;
+    for ( UInt32 i=0; i<frames; i++ ) {
+        sum += input[i] * coefficients[i];
+        deltaSum += input[i] * deltas[i];
+    }
+    return sum + fraction * deltaSum;
+}
+
+static BOOL AKKAAEDSPScalarIsSilent(const float * input, UInt32 frames) {
+    for ( UInt32 i=0; i<frames; i++ ) {
+        if ( input[i] != 0.0f ) return NO;
+    }
+    return YES;
+}
+
+static const AKKAAEDSPKernels AKKAAEDSPScalarKernels = {
+    .backend    = AKKAAEDSPKernelBackendScalar,
+    .name       = "scalar",
+    .clear      = AKKAAEDSPScalarClear,
+    .scale      = AKKAAEDSPScalarScale,
+    .add        = AKKAAEDSPScalarAdd,
+    .scaleAdd   = AKKAAEDSPScalarScaleAdd,
+    .rampMul    = AKKAAEDSPScalarRampMul,
+    .rampMulAdd = AKKAAEDSPScalarRampMulAdd,
+    .rampMul2   = AKKAAEDSPScalarRampMul2,
+    .rampMulN   = AKKAAEDSPScalarRampMulN,
+    .equalPowerRampMulN = AKKAAEDSPScalarEqualPowerRampMulN,
+    .interpolatedDot = AKKAAEDSPScalarInterpolatedDot,
+    .isSilent   = AKKAAEDSPScalarIsSilent,
+};
+
+#pragma mark - SSE2 / AVX2
+
+#if AKKAAE_DSP_X86
+
+static void AKKAAEDSPSSE2Scale(const float * input, float gain, float * output, UInt32 frames) {
+    __m128 g = _mm_set1_ps(gain);
+    UInt32 i = 0;
+    for ( ; i+8 <= frames; i += 8 ) {
+        __m128 a = _mm_loadu_ps(input+i);
+        __m128 b = _mm_loadu_ps(input+i+4);
+        _mm_storeu_ps(output+i, _mm_mul_ps(a, g));
+        _mm_storeu_ps(output+i+4, _mm_mul_ps(b, g));
+    }
+    for ( ; i<frames; i++ ) output[i] = input[i] * gain;
+}
+
+static void AKKAAEDSPSSE2Add(const float * input1, const float * input2, float * output, UInt32 frames) {
+    UInt32 i = 0;
+    for ( ; i+8 <= frames; i += 8 ) {
+        __m128 a = _mm_add_ps(_mm_loadu_ps(input1+i), _mm_loadu_ps(input2+i));
+        __m128 b = _mm_add_ps(_mm_loadu_ps(input1+i+4), _mm_loadu_ps(input2+i+4));
+        _mm_storeu_ps(output+i, a);
+        _mm_storeu_ps(output+i+4, b);
+    }
+    for ( ; i<frames; i++ ) output[i] = input1[i] + input2[i];
+}
+
+static void AKKAAEDSPSSE2ScaleAdd(const float * input1, float gain, const float * input2, float * output, UInt32 frames) {
+    __m128 g = _mm_set1_ps(gain);
+    UInt32 i = 0;
+    for ( ; i+8 <= frames; i += 8 ) {
+        __m128 a = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(input1+i), g), _mm_loadu_ps(input2+i));
+        __m128 b = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(input1+i+4), g), _mm_loadu_ps(input2+i+4));
+        _mm_storeu_ps(output+i, a);
+        _mm_storeu_ps(output+i+4, b);
+    }
+    for ( ; i<frames; i++ ) output[i] = input1[i] * gain + input2[i];
+}
+
+static void AKKAAEDSPSSE2RampMul(const float * input, float * start, float step, float * output, UInt32 frames) {
+    float s = *start;
+    __m128 base = _mm_set1_ps(s);
+    __m128 stepv = _mm_set1_ps(step);
+    __m128 lane = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+    UInt32 i = 0;
+    for ( ; i+4 <= frames; i += 4 ) {
+        __m128 n = _mm_add_ps(_mm_set1_ps((float)i), lane);
+        __m128 g = _mm_add_ps(base, _mm_mul_ps(n, stepv));
+        _mm_storeu_ps(output+i, _mm_mul_ps(_mm_loadu_ps(input+i), g));
+    }
+    for ( ; i<frames; i++ ) output[i] = input[i] * (s + (float)i * step);
+    *start = s + (float)frames * step;
+}
+
+static void AKKAAEDSPSSE2RampMulAdd(const float * input, float * start, float step, float * output, UInt32 frames) {
+    float s = *start;
+    __m128 base = _mm_set1_ps(s);
+    __m128 stepv = _mm_set1_ps(step);
+    __m128 lane = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+    UInt32 i = 0;
+    for ( ; i+4 <= frames; i += 4 ) {
+        __m128 n = _mm_add_ps(_mm_set1_ps((float)i), lane);
+        __m128 g = _mm_add_ps(base, _mm_mul_ps(n, stepv));
+        _mm_storeu_ps(output+i, _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(input+i), g), _mm_loadu_ps(output+i)));
+    }
+    for ( ; i<frames; i++ ) output[i] += input[i] * (s + (float)i * step);
+    *start = s + (float)frames * step;
+}
+
+static void AKKAAEDSPSSE2RampMul2(float * left, float * right, float * start, float step, UInt32 frames) {
+    float s = *start;
+    __m128 base = _mm_set1_ps(s);
+    __m128 stepv = _mm_set1_ps(step);
+    __m128 lane = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+    UInt32 i = 0;
+    for ( ; i+4 <= frames; i += 4 ) {
+        __m128 n = _mm_add_ps(_mm_set1_ps((float)i), lane);
+        __m128 g = _mm_add_ps(base, _mm_mul_ps(n, stepv));
+        _mm_storeu_ps(left+i, _mm_mul_ps(_mm_loadu_ps(left+i), g));
+        _mm_storeu_ps(right+i, _mm_mul_ps(_mm_loadu_ps(right+i), g));
+    }
+    for ( ; i<frames; i++ ) {
+        float g = s + (float)i * step;
+        left[i] *= g;
+        right[i] *= g;
+    }
+    *start = s + (float)frames * step;
+}
+
+static void AKKAAEDSPSSE2RampMulN(float * const * channels, int channelCount, float * start, float step, UInt32 frames) {
+    float s = *start;
+    __m128 base = _mm_set1_ps(s);
+    __m128 stepv = _mm_set1_ps(step);
+    __m128 lane = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+    UInt32 i = 0;
+    for ( ; i+4 <= frames; i += 4 ) {
+        __m128 n = _mm_add_ps(_mm_set1_ps((float)i), lane);
+        __m128 g = _mm_add_ps(base, _mm_mul_ps(n, stepv));
+        for ( int c=0; c<channelCount; c++ ) {
+            _mm_storeu_ps(channels[c]+i, _mm_mul_ps(_mm_loadu_ps(channels[c]+i), g));
+        }
+    }
+    for ( ; i<frames; i++ ) {
+        float g = s + (float)i * step;
+        for ( int c=0; c<channelCount; c++ ) channels[c][i] *= g;
+    }
+    *start = s + (float)frames * step;
+}
+
+static inline __m128 AKKAAEDSPSSE2QuarterSine(__m128 x) {
+    x = _mm_min_ps(_mm_max_ps(x, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+    __m128 x2 = _mm_mul_ps(x, x);
+    __m128 p = _mm_add_ps(_mm_set1_ps(kQuarterSineC5), _mm_mul_ps(x2, _mm_set1_ps(kQuarterSineC7)));
+    p = _mm_add_ps(_mm_set1_ps(kQuarterSineC3), _mm_mul_ps(x2, p));
+    p = _mm_add_ps(_mm_set1_ps(kQuarterSineC1), _mm_mul_ps(x2, p));
+    return _mm_mul_ps(x, p);
+}
+
+static void AKKAAEDSPSSE2EqualPowerRampMulN(float * const * channels, int channelCount, float * start, float step, UInt32 frames) {
+    float s = *start;
+    __m128 base = _mm_set1_ps(s);
+    __m128 stepv = _mm_set1_ps(step);
+    __m128 lane = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+    UInt32 i = 0;
+    for ( ; i+4 <= frames; i += 4 ) {
+        __m128 n = _mm_add_ps(_mm_set1_ps((float)i), lane);
+        __m128 g = AKKAAEDSPSSE2QuarterSine(_mm_add_ps(base, _mm_mul_ps(n, stepv)));
+        for ( int c=0; c<channelCount; c++ ) {
+            _mm_storeu_ps(channels[c]+i, _mm_mul_ps(_mm_loadu_ps(channels[c]+i), g));
+        }
+    }
+    for ( ; i<frames; i++ ) {
+        float g = AKKAAEDSPScalarQuarterSine(s + (float)i * step);
+        for ( int c=0; c<channelCount; c++ ) channels[c][i] *= g;
+    }
+    *start = s + (float)frames * step;
+}
+
+static inline float AKKAAEDSPSSE2HorizontalSum(__m128 v) {
+    __m128 shuffled = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1));
+    __m128 sums = _mm_add_ps(v, shuffled);
+    shuffled = _mm_movehl_ps(shuffled, sums);
+    return _mm_cvtss_f32(_mm_add_ss(sums, shuffled));
+}
+
+static float AKKAAEDSPSSE2InterpolatedDot(const float * input, const float * coefficients, const float * deltas,
+                                          float fraction, UInt32 frames) {
+    __m128 sum = _mm_setzero_ps();
+    __m128 deltaSum = _mm_setzero_ps();
+    UInt32 i = 0;
+    for ( ; i+4 <= frames; i += 4 ) {
+        __m128 x = _mm_loadu_ps(input+i);
+        sum = _mm_add_ps(sum, _mm_mul_ps(x, _mm_loadu_ps(coefficients+i)));
+        deltaSum = _mm_add_ps(deltaSum, _mm_mul_ps(x, _mm_loadu_ps(deltas+i)));
+    }
+    float result = AKKAAEDSPSSE2HorizontalSum(sum), deltaResult = AKKAAEDSPSSE2HorizontalSum(deltaSum);
+    for ( ; i<frames; i++ ) {
+        result += input[i] * coefficients[i];
+        deltaResult += input[i] * deltas[i];
+    }
+    return result + fraction * deltaResult;
+}
+
+static BOOL AKKAAEDSPSSE2IsSilent(const float * input, UInt32 frames) {
+    // Compare a block at a time, and check the accumulated mask once per block
+    const __m128 zero = _mm_setzero_ps();
+    UInt32 i = 0;
+    for ( ; i+kSilenceBlockFrames <= frames; i += kSilenceBlockFrames ) {
+        __m128 nonZero = zero;
+        for ( UInt32 j=0; j<kSilenceBlockFrames; j += 4 ) {
+            nonZero = _mm_or_ps(nonZero, _mm_cmpneq_ps(_mm_loadu_ps(input+i+j), zero));
+        }
+        if ( _mm_movemask_ps(nonZero) ) return NO;
+    }
+    return AKKAAEDSPScalarIsSilent(input+i, frames-i);
+}
+
+static const AKKAAEDSPKernels AKKAAEDSPSSE2Kernels = {
+    .backend    = AKKAAEDSPKernelBackendSSE2,
+    .name       = "sse2",
+    .clear      = AKKAAEDSPScalarClear,
+    .scale      = AKKAAEDSPSSE2Scale,
+    .add        = AKKAAEDSPSSE2Add,
+    .scaleAdd   = AKKAAEDSPSSE2ScaleAdd,
+    .rampMul    = AKKAAEDSPSSE2RampMul,
+    .rampMulAdd = AKKAAEDSPSSE2RampMulAdd,
+    .rampMul2   = AKKAAEDSPSSE2RampMul2,
+    .rampMulN   = AKKAAEDSPSSE2RampMulN,
+    .equalPowerRampMulN = AKKAAEDSPSSE2EqualPowerRampMulN,
+    .interpolatedDot = AKKAAEDSPSSE2InterpolatedDot,
+    .isSilent   = AKKAAEDSPSSE2IsSilent,
+};
+
+#define AKKAAE_AVX2 __attribute__((target("avx2")))
+
+AKKAAE_AVX2 static void AKKAAEDSPAVX2Scale(const float * input, float gain, float * output, UInt32 frames) {
+    __m256 g = _mm256_set1_ps(gain);
+    UInt32 i = 0;
+    for ( ; i+16 <= frames; i += 16 ) {
+        __m256 a = _mm256_loadu_ps(input+i);
+        __m256 b = _mm256_loadu_ps(input+i+8);
+        _mm256_storeu_ps(output+i, _mm256_mul_ps(a, g));
+        _mm256_storeu_ps(output+i+8, _mm256_mul_ps(b, g));
+    }
+    for ( ; i<frames; i++ ) output[i] = input[i] * gain;
+}
+
+AKKAAE_AVX2 static void AKKAAEDSPAVX2Add(const float * input1, const float * input2, float * output, UInt32 frames) {
+    UInt32 i = 0;
+    for ( ; i+16 <= frames; i += 16 ) {
+        __m256 a = _mm256_add_ps(_mm256_loadu_ps(input1+i), _mm256_loadu_ps(input2+i));
+        __m256 b = _mm256_add_ps(_mm256_loadu_ps(input1+i+8), _mm256_loadu_ps(input2+i+8));
+        _mm256_storeu_ps(output+i, a);
+        _mm256_storeu_ps(output+i+8, b);
+    }
+    for ( ; i<frames; i++ ) output[i] = input1[i] + input2[i];
+}
+
+AKKAAE_AVX2 static void AKKAAEDSPAVX2ScaleAdd(const float * input1, float gain, const float * input2, float * output, UInt32 frames) {
+    __m256 g = _mm256_set1_ps(gain);
+    UInt32 i = 0;
+    for ( ; i+16 <= frames; i += 16 ) {
+        __m256 a = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(input1+i), g), _mm256_loadu_ps(input2+i));
+        __m256 b = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(input1+i+8), g), _mm256_loadu_ps(input2+i+8));
+        _mm256_storeu_ps(output+i, a);
+        _mm256_storeu_ps(output+i+8, b);
+    }
+    for ( ; i<frames; i++ ) output[i] = input1[i] * gain + input2[i];
+}
+
+AKKAAE_AVX2 static void AKKAAEDSPAVX2RampMul(const float * input, float * start, float step, float * output, UInt32 frames) {
+    float s = *start;
+    __m256 base = _mm256_set1_ps(s);
+    __m256 stepv = _mm256_set1_ps(step);
+    __m256 lane = _mm256_set_ps(7.0f, 6.0f, 5.0f, 4.0f, 3.0f, 2.0f, 1.0f, 0.0f);
+    UInt32 i = 0;
+    for ( ; i+8 <= frames; i += 8 ) {
+        __m256 n = _mm256_add_ps(_mm256_set1_ps((float)i), lane);
+        __m256 g = _mm256_add_ps(base, _mm256_mul_ps(n, stepv));
+        _mm256_storeu_ps(output+i, _mm256_mul_ps(_mm256_loadu_ps(input+i), g));
+    }
+    for ( ; i<frames; i++ ) output[i] = input[i] * (s + (float)i * step);
+    *start = s + (float)frames * step;
+}
+
+AKKAAE_AVX2 static void AKKAAEDSPAVX2RampMulAdd(const float * input, float * start, float step, float * output, UInt32 frames) {
+    float s = *start;
+    __m256 base = _mm256_set1_ps(s);
+    __m256 stepv = _mm256_set1_ps(step);
+    __m256 lane = _mm256_set_ps(7.0f, 6.0f, 5.0f, 4.0f, 3.0f, 2.0f, 1.0f, 0.0f);
+    UInt32 i = 0;
+    for ( ; i+8 <= frames; i += 8 ) {
+        __m256 n = _mm256_add_ps(_mm256_set1_ps((float)i), lane);
+        __m256 g = _mm256_add_ps(base, _mm256_mul_ps(n, stepv));
+        _mm256_storeu_ps(output+i, _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(input+i), g), _mm256_loadu_ps(output+i)));
+    }
+    for ( ; i<frames; i++ ) output[i] += input[i] * (s + (float)i * step);
+    *start = s + (float)frames * step;
+}
+
+AKKAAE_AVX2 static void AKKAAEDSPAVX2RampMul2(float * left, float * right, float * start, float step, UInt32 frames) {
+    float s = *start;
+    __m256 base = _mm256_set1_ps(s);
+    __m256 stepv = _mm256_set1_ps(step);
+    __m256 lane = _mm256_set_ps(7.0f, 6.0f, 5.0f, 4.0f, 3.0f, 2.0f, 1.0f, 0.0f);
+    UInt32 i = 0;
+    for ( ; i+8 <= frames; i += 8 ) {
+        __m256 n = _mm256_add_ps(_mm256_set1_ps((float)i), lane);
+        __m256 g = _mm256_add_ps(base, _mm256_mul_ps(n, stepv));
+        _mm256_storeu_ps(left+i, _mm256_mul_ps(_mm256_loadu_ps(left+i), g));
+        _mm256_storeu_ps(right+i, _mm256_mul_ps(_mm256_loadu_ps(right+i), g));
+    }
+    for ( ; i<frames; i++ ) {
+        float g = s + (float)i * step;
+        left[i] *= g;
+        right[i] *= g;
+    }
+    *start = s + (float)frames * step;
+}
+
+AKKAAE_AVX2 static void AKKAAEDSPAVX2RampMulN(float * const * channels, int channelCount, float * start, float step, UInt32 frames) {
+    float s = *start;
+    __m256 base = _mm256_set1_ps(s);
+    __m256 stepv = _mm256_set1_ps(step);
+    __m256 lane = _mm256_set_ps(7.0f, 6.0f, 5.0f, 4.0f, 3.0f, 2.0f, 1.0f, 0.0f);
+    UInt32 i = 0;
+    for ( ; i+8 <= frames; i += 8 ) {
+        __m256 n = _mm256_add_ps(_mm256_set1_ps((float)i), lane);
+        __m256 g = _mm256_add_ps(base, _mm256_mul_ps(n, stepv));
+        for ( int c=0; c<channelCount; c++ ) {
+            _mm256_storeu_ps(channels[c]+i, _mm256_mul_ps(_mm256_loadu_ps(channels[c]+i), g));
+        }
+    }
+    for ( ; i<frames; i++ ) {
+        float g = s + (float)i * step;
+        for ( int c=0; c<channelCount; c++ ) channels[c][i] *= g;
+    }
+    *start = s + (float)frames * step;
+}
+
+AKKAAE_AVX2 static inline __m256 AKKAAEDSPAVX2QuarterSine(__m256 x) {
+    x = _mm256_min_ps(_mm256_max_ps(x, _mm256_setzero_ps()), _mm256_set1_ps(1.0f));
+    __m256 x2 = _mm256_mul_ps(x, x);
+    __m256 p = _mm256_add_ps(_mm256_set1_ps(kQuarterSineC5), _mm256_mul_ps(x2, _mm256_set1_ps(kQuarterSineC7)));
+    p = _mm256_add_ps(_mm256_set1_ps(kQuarterSineC3), _mm256_mul_ps(x2, p));
+    p = _mm256_add_ps(_mm256_set1_ps(kQuarterSineC1), _mm256_mul_ps(x2, p));
+    return _mm256_mul_ps(x, p);
+}
+
+AKKAAE_AVX2 static void AKKAAEDSPAVX2EqualPowerRampMulN(float * const * channels, int channelCount, float * start, float step, UInt32 frames) {
+    float s = *start;
+    __m256 base = _mm256_set1_ps(s);
+    __m256 stepv = _mm256_set1_ps(step);
+    __m256 lane = _mm256_set_ps(7.0f, 6.0f, 5.0f, 4.0f, 3.0f, 2.0f, 1.0f, 0.0f);
+    UInt32 i = 0;
+    for ( ; i+8 <= frames; i += 8 ) {
+        __m256 n = _mm256_add_ps(_mm256_set1_ps((float)i), lane);
+        __m256 g = AKKAAEDSPAVX2QuarterSine(_mm256_add_ps(base, _mm256_mul_ps(n, stepv)));
+        for ( int c=0; c<channelCount; c++ ) {
+            _mm256_storeu_ps(channels[c]+i, _mm256_mul_ps(_mm256_loadu_ps(channels[c]+i), g));
+        }
+    }
+    for ( ; i<frames; i++ ) {
+        float g = AKKAAEDSPScalarQuarterSine(s + (float)i * step);
+        for ( int c=0; c<channelCount; c++ ) channels[c][i] *= g;
+    }
+    *start = s + (float)frames * step;
+}
+
+AKKAAE_AVX2 static float AKKAAEDSPAVX2InterpolatedDot(const float * input, const float * coefficients, const float * deltas,
+                                                      float fraction, UInt32 frames) {
+    __m256 sum = _mm256_setzero_ps();
+    __m256 deltaSum = _mm256_setzero_ps();
+    UInt32 i = 0;
+    for ( ; i+8 <= frames; i += 8 ) {
+        __m256 x = _mm256_loadu_ps(input+i);
+        sum = _mm256_add_ps(sum, _mm256_mul_ps(x, _mm256_loadu_ps(coefficients+i)));
+        deltaSum = _mm256_add_ps(deltaSum, _mm256_mul_ps(x, _mm256_loadu_ps(deltas+i)));
+    }
+    // Fold in the fraction first, then one horizontal sum
+    __m256 total = _mm256_add_ps(sum, _mm256_mul_ps(deltaSum, _mm256_set1_ps(fraction)));
+    __m128 half = _mm_add_ps(_mm256_castps256_ps128(total), _mm256_extractf128_ps(total, 1));
+    float result = AKKAAEDSPSSE2HorizontalSum(half);
+    for ( ; i<frames; i++ ) result += input[i] * (coefficients[i] + fraction * deltas[i]);
+    return result;
+}
+
+AKKAAE_AVX2 static BOOL AKKAAEDSPAVX2IsSilent(const float * input, UInt32 frames) {
+    const __m256 zero = _mm256_setzero_ps();
+    UInt32 i = 0;
+    for ( ; i+kSilenceBlockFrames <= frames; i += kSilenceBlockFrames ) {
+        __m256 nonZero = zero;
+        for ( UInt32 j=0; j<kSilenceBlockFrames; j += 8 ) {
+            nonZero = _mm256_or_ps(nonZero, _mm256_cmp_ps(_mm256_loadu_ps(input+i+j), zero, _CMP_NEQ_UQ));
+        }
+        if ( _mm256_movemask_ps(nonZero) ) return NO;
+    }
+    return AKKAAEDSPScalarIsSilent(input+i, frames-i);
+}
+
+static const AKKAAEDSPKernels AKKAAEDSPAVX2Kernels = {
+    .backend    = AKKAAEDSPKernelBackendAVX2,
+    .name       = "avx2",
+    .clear      = AKKAAEDSPScalarClear,
+    .scale      = AKKAAEDSPAVX2Scale,
+    .add        = AKKAAEDSPAVX2Add,
+    .scaleAdd   = AKKAAEDSPAVX2ScaleAdd,
+    .rampMul    = AKKAAEDSPAVX2RampMul,
+    .rampMulAdd = AKKAAEDSPAVX2RampMulAdd,
+    .rampMul2   = AKKAAEDSPAVX2RampMul2,
+    .rampMulN   = AKKAAEDSPAVX2RampMulN,
+    .equalPowerRampMulN = AKKAAEDSPAVX2EqualPowerRampMulN,
+    .interpolatedDot = AKKAAEDSPAVX2InterpolatedDot,
+    .isSilent   = AKKAAEDSPAVX2IsSilent,
+};
+
+#endif
+
+#pragma mark - NEON
+
+#if AKKAAE_DSP_NEON
+
+static void AKKAAEDSPNEONScale(const float * input, float gain, float * output, UInt32 frames) {
+    float32x4_t g = vdupq_n_f32(gain);
+    UInt32 i = 0;
+    for ( ; i+8 <= frames; i += 8 ) {
+        float32x4_t a = vld1q_f32(input+i);
+        float32x4_t b = vld1q_f32(input+i+4);
+        vst1q_f32(output+i, vmulq_f32(a, g));
+        vst1q_f32(output+i+4, vmulq_f32(b, g));
+    }
+    for ( ; i<frames; i++ ) output[i] = input[i] * gain;
+}
+
+static void AKKAAEDSPNEONAdd(const float * input1, const float * input2, float * output, UInt32 frames) {
+    UInt32 i = 0;
+    for ( ; i+8 <= frames; i += 8 ) {
+        float32x4_t a = vaddq_f32(vld1q_f32(input1+i), vld1q_f32(input2+i));
+        float32x4_t b = vaddq_f32(vld1q_f32(input1+i+4), vld1q_f32(input2+i+4));
+        vst1q_f32(output+i, a);
+        vst1q_f32(output+i+4, b);
+    }
+    for ( ; i<frames; i++ ) output[i] = input1[i] + input2[i];
+}
+
+static void AKKAAEDSPNEONScaleAdd(const float * input1, float gain, const float * input2, float * output, UInt32 frames) {
+    float32x4_t g = vdupq_n_f32(gain);
+    UInt32 i = 0;
+    for ( ; i+8 <= frames; i += 8 ) {
+        float32x4_t a = vmlaq_f32(vld1q_f32(input2+i), vld1q_f32(input1+i), g);
+        float32x4_t b = vmlaq_f32(vld1q_f32(input2+i+4), vld1q_f32(input1+i+4), g);
+        vst1q_f32(output+i, a);
+        vst1q_f32(output+i+4, b);
+    }
+    for ( ; i<frames; i++ ) output[i] = input1[i] * gain + input2[i];
+}
+
+static void AKKAAEDSPNEONRampMul(const float * input, float * start, float step, float * output, UInt32 frames) {
+    float s = *start;
+    const float lanes[4] = { 0.0f, 1.0f, 2.0f, 3.0f };
+    float32x4_t base = vdupq_n_f32(s);
+    float32x4_t lane = vld1q_f32(lanes);
+    UInt32 i = 0;
+    for ( ; i+4 <= frames; i += 4 ) {
+        float32x4_t n = vaddq_f32(vdupq_n_f32((float)i), lane);
+        float32x4_t g = vmlaq_n_f32(base, n, step);
+        vst1q_f32(output+i, vmulq_f32(vld1q_f32(input+i), g));
+    }
+    for ( ; i<frames; i++ ) output[i] = input[i] * (s + (float)i * step);
+    *start = s + (float)frames * step;
+}
+
+static void AKKAAEDSPNEONRampMulAdd(const float * input, float * start, float step, float * output, UInt32 frames) {
+    float s = *start;
+    const float lanes[4] = { 0.0f, 1.0f, 2.0f, 3.0f };
+    float32x4_t base = vdupq_n_f32(s);
+    float32x4_t lane = vld1q_f32(lanes);
+    UInt32 i = 0;
+    for ( ; i+4 <= frames; i += 4 ) {
+        float32x4_t n = vaddq_f32(vdupq_n_f32((float)i), lane);
+        float32x4_t g = vmlaq_n_f32(base, n, step);
+        vst1q_f32(output+i, vmlaq_f32(vld1q_f32(output+i), vld1q_f32(input+i), g));
+    }
+    for ( ; i<frames; i++ ) output[i] += input[i] * (s + (float)i * step);
+    *start = s + (float)frames * step;
+}
+
+static void AKKAAEDSPNEONRampMul2(float * left, float * right, float * start, float step, UInt32 frames) {
+    float s = *start;
+    const float lanes[4] = { 0.0f, 1.0f, 2.0f, 3.0f };
+    float32x4_t base = vdupq_n_f32(s);
+    float32x4_t lane = vld1q_f32(lanes);
+    UInt32 i = 0;
+    for ( ; i+4 <= frames; i += 4 ) {
+        float32x4_t n = vaddq_f32(vdupq_n_f32((float)i), lane);
+        float32x4_t g = vmlaq_n_f32(base, n, step);
+        vst1q_f32(left+i, vmulq_f32(vld1q_f32(left+i), g));
+        vst1q_f32(right+i, vmulq_f32(vld1q_f32(right+i), g));
+    }
+    for ( ; i<frames; i++ ) {
+        float g = s + (float)i * step;
+        left[i] *= g;
+        right[i] *= g;
+    }
+    *start = s + (float)frames * step;
+}
+
+static void AKKAAEDSPNEONRampMulN(float * const * channels, int channelCount, float * start, float step, UInt32 frames) {
+    float s = *start;
+    const float lanes[4] = { 0.0f, 1.0f, 2.0f, 3.0f };
+    float32x4_t base = vdupq_n_f32(s);
+    float32x4_t lane = vld1q_f32(lanes);
+    UInt32 i = 0;
+    for ( ; i+4 <= frames; i += 4 ) {
+        float32x4_t n = vaddq_f32(vdupq_n_f32((float)i), lane);
+        float32x4_t g = vmlaq_n_f32(base, n, step);
+        for ( int c=0; c<channelCount; c++ ) {
+            vst1q_f32(channels[c]+i, vmulq_f32(vld1q_f32(channels[c]+i), g));
+        }
+    }
+    for ( ; i<frames; i++ ) {
+        float g = s + (float)i * step;
+        for ( int c=0; c<channelCount; c++ ) channels[c][i] *= g;
+    }
+    *start = s + (float)frames * step;
+}
+
+static inline float32x4_t AKKAAEDSPNEONQuarterSine(float32x4_t x) {
+    x = vminq_f32(vmaxq_f32(x, vdupq_n_f32(0.0f)), vdupq_n_f32(1.0f));
+    float32x4_t x2 = vmulq_f32(x, x);
+    float32x4_t p = vmlaq_n_f32(vdupq_n_f32(kQuarterSineC5), x2, kQuarterSineC7);
+    p = vmlaq_f32(vdupq_n_f32(kQuarterSineC3), x2, p);
+    p = vmlaq_f32(vdupq_n_f32(kQuarterSineC1), x2, p);
+    return vmulq_f32(x, p);
+}
+
+static void AKKAAEDSPNEONEqualPowerRampMulN(float * const * channels, int channelCount, float * start, float step, UInt32 frames) {
+    float s = *start;
+    const float lanes[4] = { 0.0f, 1.0f, 2.0f, 3.0f };
+    float32x4_t base = vdupq_n_f32(s);
+    float32x4_t lane = vld1q_f32(lanes);
+    UInt32 i = 0;
+    for ( ; i+4 <= frames; i += 4 ) {
+        float32x4_t n = vaddq_f32(vdupq_n_f32((float)i), lane);
+        float32x4_t g = AKKAAEDSPNEONQuarterSine(vmlaq_n_f32(base, n, step));
+        for ( int c=0; c<channelCount; c++ ) {
+            vst1q_f32(channels[c]+i, vmulq_f32(vld1q_f32(channels[c]+i), g));
+        }
+    }
+    for ( ; i<frames; i++ ) {
+        float g = AKKAAEDSPScalarQuarterSine(s + (float)i * step);
+        for ( int c=0; c<channelCount; c++ ) channels[c][i] *= g;
+    }
+    *start = s + (float)frames * step;
+}
+
+static float AKKAAEDSPNEONInterpolatedDot(const float * input, const float * coefficients, const float * deltas,
+                                          float fraction, UInt32 frames) {
+    float32x4_t sum = vdupq_n_f32(0.0f);
+    float32x4_t deltaSum = vdupq_n_f32(0.0f);
+    UInt32 i = 0;
+    for ( ; i+4 <= frames; i += 4 ) {
+        float32x4_t x = vld1q_f32(input+i);
+        sum = vmlaq_f32(sum, x, vld1q_f32(coefficients+i));
+        deltaSum = vmlaq_f32(deltaSum, x, vld1q_f32(deltas+i));
+    }
+    float32x4_t total = vmlaq_n_f32(sum, deltaSum, fraction);
+    float32x2_t pair = vadd_f32(vget_low_f32(total), vget_high_f32(total));
+    float result = vget_lane_f32(vpadd_f32(pair, pair), 0);
+    for ( ; i<frames; i++ ) result += input[i] * (coefficients[i] + fraction * deltas[i]);
+    return result;
+}
+
+static BOOL AKKAAEDSPNEONIsSilent(const float * input, UInt32 frames) {
+    const float32x4_t zero = vdupq_n_f32(0.0f);
+    UInt32 i = 0;
+    for ( ; i+kSilenceBlockFrames <= frames; i += kSilenceBlockFrames ) {
+        uint32x4_t nonZero = vdupq_n_u32(0);
+        for ( UInt32 j=0; j<kSilenceBlockFrames; j += 4 ) {
+            nonZero = vorrq_u32(nonZero, vmvnq_u32(vceqq_f32(vld1q_f32(input+i+j), zero)));
+        }
+        uint32x2_t pair = vorr_u32(vget_low_u32(nonZero), vget_high_u32(nonZero));
+        if ( vget_lane_u32(vpmax_u32(pair, pair), 0) ) return NO;
+    }
+    return AKKAAEDSPScalarIsSilent(input+i, frames-i);
+}
+
+static const AKKAAEDSPKernels AKKAAEDSPNEONKernels = {
+    .backend    = AKKAAEDSPKernelBackendNEON,
+    .name       = "neon",
+    .clear      = AKKAAEDSPScalarClear,
+    .scale      = AKKAAEDSPNEONScale,
+    .add        = AKKAAEDSPNEONAdd,
+    .scaleAdd   = AKKAAEDSPNEONScaleAdd,
+    .rampMul    = AKKAAEDSPNEONRampMul,
+    .rampMulAdd = AKKAAEDSPNEONRampMulAdd,
+    .rampMul2   = AKKAAEDSPNEONRampMul2,
+    .rampMulN   = AKKAAEDSPNEONRampMulN,
+    .equalPowerRampMulN = AKKAAEDSPNEONEqualPowerRampMulN,
+    .interpolatedDot = AKKAAEDSPNEONInterpolatedDot,
+    .isSilent   = AKKAAEDSPNEONIsSilent,
+};
+
+#endif
+
+#pragma mark - Accelerate
+
+#if AKKAAE_DSP_USE_ACCELERATE
+
+static const UInt32 kAccelerateRampTileFrames = 256;
+
+static void AKKAAEDSPAccelerateClear(float * output, UInt32 frames) {
+    vDSP_vclr(output, 1, frames);
+}
+
+static void AKKAAEDSPAccelerateScale(const float * input, float gain, float * output, UInt32 frames) {
+    vDSP_vsmul(input, 1, &gain, output, 1, frames);
+}
+
+static void AKKAAEDSPAccelerateAdd(const float * input1, const float * input2, float * output, UInt32 frames) {
+    vDSP_vadd(input1, 1, input2, 1, output, 1, frames);
+}
+
+static void AKKAAEDSPAccelerateScaleAdd(const float * input1, float gain, const float * input2, float * output, UInt32 frames) {
+    vDSP_vsma(input1, 1, &gain, input2, 1, output, 1, frames);
+}
+
+static void AKKAAEDSPAccelerateRampMul(const float * input, float * start, float step, float * output, UInt32 frames) {
+    vDSP_vrampmul(input, 1, start, &step, output, 1, frames);
+}
+
+static void AKKAAEDSPAccelerateRampMulAdd(const float * input, float * start, float step, float * output, UInt32 frames) {
+    vDSP_vrampmuladd(input, 1, start, &step, output, 1, frames);
+}
+
+static void AKKAAEDSPAccelerateRampMul2(float * left, float * right, float * start, float step, UInt32 frames) {
+    vDSP_vrampmul2(left, right, 1, start, &step, left, right, 1, frames);
+}
+
+static void AKKAAEDSPAccelerateRampMulN(float * const * channels, int channelCount, float * start, float step, UInt32 frames) {
+    // 每块只生成一次增益曲线，块小到留在 L1 里，再逐声道相乘
+    float gains[kAccelerateRampTileFrames];
+    float s = *start;
+    for ( UInt32 offset=0; offset<frames; offset += kAccelerateRampTileFrames ) {
+        UInt32 length = MIN(kAccelerateRampTileFrames, frames - offset);
+        float tileStart = s + (float)offset * step;
+        vDSP_vramp(&tileStart, &step, gains, 1, length);
+        for ( int c=0; c<channelCount; c++ ) {
+            vDSP_vmul(channels[c] + offset, 1, gains, 1, channels[c] + offset, 1, length);
+        }
+    }
+    *start = s + (float)frames * step;
+}
+
+// vvsinf 比寄存器里的多项式包络慢，还要一块暂存区：等功率斜坡直接用同平台的向量内核
+#if AKKAAE_DSP_NEON
+#define AKKAAEDSPAccelerateEqualPowerRampMulN AKKAAEDSPNEONEqualPowerRampMulN
+#elif AKKAAE_DSP_X86
+#define AKKAAEDSPAccelerateEqualPowerRampMulN AKKAAEDSPSSE2EqualPowerRampMulN
+#else
+#define AKKAAEDSPAccelerateEqualPowerRampMulN AKKAAEDSPScalarEqualPowerRampMulN
+#endif
+
+static float AKKAAEDSPAccelerateInterpolatedDot(const float * input, const float * coefficients, const float * deltas,
+                                                float fraction, UInt32 frames) {
+    float sum, deltaSum;
+    vDSP_dotpr(input, 1, coefficients, 1, &sum, frames);
+    vDSP_dotpr(input, 1, deltas, 1, &deltaSum, frames);
+    return sum + fraction * deltaSum;
+}
+
+static BOOL AKKAAEDSPAccelerateIsSilent(const float * input, UInt32 frames) {
+    // vDSP_maxmgv has no early exit, so go a tile at a time
+    for ( UInt32 offset=0; offset<frames; offset += kAccelerateRampTileFrames ) {
+        float peak;
+        vDSP_maxmgv(input + offset, 1, &peak, MIN(kAccelerateRampTileFrames, frames - offset));
+        if ( peak != 0.0f ) return NO;
+    }
+    return YES;
+}
+
+static const AKKAAEDSPKernels AKKAAEDSPAccelerateKernels = {
+    .backend    = AKKAAEDSPKernelBackendAccelerate,
+    .name       = "accelerate",
+    .clear      = AKKAAEDSPAccelerateClear,
+    .scale      = AKKAAEDSPAccelerateScale,
+    .add        = AKKAAEDSPAccelerateAdd,
+    .scaleAdd   = AKKAAEDSPAccelerateScaleAdd,
+    .rampMul    = AKKAAEDSPAccelerateRampMul,
+    .rampMulAdd = AKKAAEDSPAccelerateRampMulAdd,
+    .rampMul2   = AKKAAEDSPAccelerateRampMul2,
+    .rampMulN   = AKKAAEDSPAccelerateRampMulN,
+    .equalPowerRampMulN = AKKAAEDSPAccelerateEqualPowerRampMulN,
+    .interpolatedDot = AKKAAEDSPAccelerateInterpolatedDot,
+    .isSilent   = AKKAAEDSPAccelerateIsSilent,
+};
+
+#endif
+
+#pragma mark - Dispatch
+
+// Read on the render thread, swapped from the main thread: release on store, acquire on load
+static _Atomic(const AKKAAEDSPKernels *) __activeKernels = NULL;
+static pthread_once_t __activeKernelsOnce = PTHREAD_ONCE_INIT;
+
+static void AKKAAEDSPKernelsSelectAutomatic(void) {
+    atomic_store_explicit(&__activeKernels, AKKAAEDSPKernelsGetForBackend(AKKAAEDSPKernelBackendAutomatic),
+                          memory_order_release);
+}
+
+const AKKAAEDSPKernels * AKKAAEDSPKernelsGet(void) {
+    const AKKAAEDSPKernels * kernels = atomic_load_explicit(&__activeKernels, memory_order_acquire);
+    if ( kernels ) return kernels;
+    pthread_once(&__activeKernelsOnce, AKKAAEDSPKernelsSelectAutomatic);
+    return atomic_load_explicit(&__activeKernels, memory_order_acquire);
+}
+
+const AKKAAEDSPKernels * AKKAAEDSPKernelsGetForBackend(AKKAAEDSPKernelBackend backend) {
+    switch ( backend ) {
+        case AKKAAEDSPKernelBackendAutomatic:
+#if AKKAAE_DSP_USE_ACCELERATE
+            return &AKKAAEDSPAccelerateKernels;
+#elif AKKAAE_DSP_X86
+            if ( __builtin_cpu_supports("avx2") ) return &AKKAAEDSPAVX2Kernels;
+            return &AKKAAEDSPSSE2Kernels;
+#elif AKKAAE_DSP_NEON
+            return &AKKAAEDSPNEONKernels;
+#else
+            return &AKKAAEDSPScalarKernels;
+#endif
+        case AKKAAEDSPKernelBackendScalar:
+            return &AKKAAEDSPScalarKernels;
+#if AKKAAE_DSP_X86
+        case AKKAAEDSPKernelBackendSSE2:
+            return &AKKAAEDSPSSE2Kernels;
+        case AKKAAEDSPKernelBackendAVX2:
+            return __builtin_cpu_supports("avx2") ? &AKKAAEDSPAVX2Kernels : NULL;
+#endif
+#if AKKAAE_DSP_NEON
+        case AKKAAEDSPKernelBackendNEON:
+            return &AKKAAEDSPNEONKernels;
+#endif
+#if AKKAAE_DSP_USE_ACCELERATE
+        case AKKAAEDSPKernelBackendAccelerate:
+            return &AKKAAEDSPAccelerateKernels;
+#endif
+        default:
+            return NULL;
+    }
+}
+
+BOOL AKKAAEDSPKernelsSetBackend(AKKAAEDSPKernelBackend backend) {
+    const AKKAAEDSPKernels * kernels = AKKAAEDSPKernelsGetForBackend(backend);
+    if ( !kernels ) return NO;
+    AKKAAEDSPKernelsGet();
+    atomic_store_explicit(&__activeKernels, kernels, memory_order_release);
+    return YES;
+}
@@ -14,6 +14,21 @@ extern "C" {
 #import <AudioToolbox/AudioToolbox.h>
 #import "AKKAAEAudioBufferListUtilities.h"
 
+/*!
+ * A gain ramp
+ *
+ *  The gain for frame n is start + n*step for the first rampFrames frames, and gain after that:
+ *  the shape every smoothed gain change in these utilities takes. Describing it, rather than
+ *  applying it straight away, lets it be applied later, inside a mix.
+ *  增益变化的描述：先线性 ramp，再保持常量；可以推迟到混音时一起算。
+ */
+typedef struct {
+    float start;        //!< Gain at frame 0
+    float step;         //!< Change in gain per frame, during the ramp
+    UInt32 rampFrames;  //!< Length of the ramp
+    float gain;         //!< Gain from the end of the ramp on
+} AKKAAEDSPGainRamp;
+
 // gain 是声音强度，和爆音有关
 /*!
  * Scale values in a buffer list by some gain value
@@ -29,6 +44,8 @@ void AKKAAEDSPApplyGain(const AudioBufferList * bufferList, float gain, UInt32 f
  * Apply a ramp to values in a buffer list
  * 对缓冲区列表中的值应用衰减
  *
+ *  Any number of channels is processed in one pass, with the ramp computed once per block for all of them.
+ *
  * @param bufferList Audio buffer list, in non-interleaved float format
  * @param start Starting gain (power ratio) on input; final gain value on output
  * @param step Amount per frame to advance gain
@@ -44,11 +61,16 @@ void AKKAAEDSPApplyRamp(const AudioBufferList * bufferList, float * start, float
  *  crossfading two signals without causing a bump in gain in the middle of the fade.
  *  使用1/4余弦波来保持gonglv， 对两个淡入淡出的信号间的切换有帮助
  *
+ *  The gain at each frame is sin(pi/2 * x), where x is the ramp position, from 0 (silent) to
+ *  1 (full level): a fade in and a fade out with opposite steps sum to constant power. The envelope
+ *  is computed in registers by a polynomial, in one pass over all channels, with no scratch buffer
+ *  or static state, so this function is thread-safe and realtime safe.
+ *
  * @param bufferList Audio buffer list, in non-interleaved float format
- * @param start Starting gain (power ratio) on input; final gain value on output
- * @param step Amount per frame to advance gain
+ * @param start Starting ramp position, limited to 0-1, on input; final position on output
+ * @param step Amount per frame to advance the ramp position
  * @param frames Length of buffer in frames
- * @param scratch A scratch buffer to use, or NULL to use an internal buffer. Not thread-safe if the latter is used.
+ * @param scratch Unused; kept for compatibility. Pass NULL
  */
 void AKKAAEDSPApplyEqualPowerRamp(const AudioBufferList * bufferList, float * start, float step, UInt32 frames, float * scratch);
 
@@ -104,6 +126,46 @@ void AKKAAEDSPApplyGainSmoothedMono(float * buffer, float targetGain, float * cu
 void AKKAAEDSPApplyVolumeAndBalance(const AudioBufferList * bufferList, float targetVolume, float * currentVolume,
                                 float targetBalance, float * currentBalance, UInt32 frames);
 
+/*!
+ * Get the gain ramps for volume and balance controls, without applying them
+ *
+ *  Works out, per channel, the gains AKKAAEDSPApplyVolumeAndBalance would apply, and advances the
+ *  current volume and balance the same way, so the ramps can be applied later with
+ *  AKKAAEDSPApplyGainRamps or inside AKKAAEDSPMixMultipleWithGainRamps.
+ *
+ * @param channelCount Number of channels
+ * @param targetVolume The target volume (power ratio)
+ * @param currentVolume On input, the current volume; on output, the new volume, or NULL for no smoothing
+ * @param targetBalance The target balance
+ * @param currentBalance On input, the current balance; on output, the new balance, or NULL for no smoothing
+ * @param frames Length of buffer in frames
+ * @param ramps On output, a ramp for each channel
+ */
+void AKKAAEDSPGetVolumeAndBalanceRamps(int channelCount, float targetVolume, float * currentVolume,
+                                       float targetBalance, float * currentBalance, UInt32 frames,
+                                       AKKAAEDSPGainRamp * ramps);
+
+/*!
+ * Apply gain ramps to a buffer list
+ *
+ *  Channels sharing one ramp are processed in one pass.
+ *
+ * @param bufferList Audio buffer list, in non-interleaved float format
+ * @param ramps A ramp for each channel
+ * @param frames Length of buffer in frames
+ */
+void AKKAAEDSPApplyGainRamps(const AudioBufferList * bufferList, const AKKAAEDSPGainRamp * ramps, UInt32 frames);
+
+/*!
+ * Whether a gain ramp leaves audio unchanged
+ *
+ * @param ramp The ramp
+ * @return YES if the ramp is a constant gain of 1
+ */
+static inline BOOL AKKAAEDSPGainRampIsUnity(const AKKAAEDSPGainRamp * ramp) {
+    return ramp->rampFrames == 0 && fabsf(ramp->gain - 1.0f) <= FLT_EPSILON;
+}
+
 
 /*!
  * Mix two buffer lists
@@ -131,6 +193,64 @@ void AKKAAEDSPApplyVolumeAndBalance(const AudioBufferList * bufferList, float ta
 void AKKAAEDSPMix(const AudioBufferList * bufferList1, const AudioBufferList * bufferList2, float gain1, float gain2,
               BOOL monoToStereo, UInt32 frames, const AudioBufferList * output);
 
+/*!
+ * Mix any number of buffer lists in a single pass
+ *
+ *  Sums each input, scaled by its gain, into the output. Channels are mapped the same way as
+ *  AKKAAEDSPMix: mono inputs are doubled to a stereo output if monoToStereo is YES, and inputs with
+ *  more channels are mixed down into a mono output. Output channels that no input feeds are silenced.
+ *  将所有输入按各自的增益一次性累加到输出中，声道的处理和 AKKAAEDSPMix 一样
+ *
+ *  The work is done in small blocks, so that the output stays in cache while every input is added to
+ *  it, rather than writing the whole output once per input as repeated AKKAAEDSPMix calls do.
+ *
+ *  The output may be one of the inputs; no other overlap is permitted.
+ *
+ * @param inputs Input buffer lists, in non-interleaved float format
+ * @param gains Gain factor for each input (power ratio), or NULL for unity gain
+ * @param count Number of inputs
+ * @param monoToStereo Whether to double mono inputs to stereo, if output is stereo
+ * @param frames Length of buffer in frames, or 0 for entire buffer (based on mDataByteSize fields)
+ * @param output Output buffer list
+ */
+void AKKAAEDSPMixMultiple(const AudioBufferList * const * inputs, const float * gains, int count,
+                          BOOL monoToStereo, UInt32 frames, const AudioBufferList * output);
+
+/*!
+ * Mix any number of buffer lists in a single pass, applying pending gain ramps and skipping silence
+ *
+ *  The same as AKKAAEDSPMixMultiple, with two additions. Each input channel can carry a gain ramp,
+ *  which is applied as it's read, in the same pass as the mix: a fader followed by a mix reads and
+ *  writes each sample once. And input channels flagged as silent are not read; an output channel
+ *  that ends up silent, and is already zero, is not cleared again.
+ *  推子的增益在混音的同一遍里算；标记为静音的输入声道直接跳过。
+ *
+ * @param inputs Input buffer lists, in non-interleaved float format
+ * @param gains Gain factor for each input (power ratio), or NULL for unity gain
+ * @param ramps For each input, a ramp per channel, or NULL for none; or NULL if no input has ramps
+ * @param silentChannels For each input, bit n set if channel n is all zeros; or NULL if none are known silent
+ * @param count Number of inputs
+ * @param monoToStereo Whether to double mono inputs to stereo, if output is stereo
+ * @param frames Length of buffer in frames, or 0 for entire buffer (based on mDataByteSize fields)
+ * @param output Output buffer list. If it is one of the inputs, that input's ramps are applied in place
+ * @return The output's silent channels: bit n set if output channel n is all zeros
+ */
+UInt32 AKKAAEDSPMixMultipleWithGainRamps(const AudioBufferList * const * inputs, const float * gains,
+                                         const AKKAAEDSPGainRamp * const * ramps, const UInt32 * silentChannels,
+                                         int count, BOOL monoToStereo, UInt32 frames, const AudioBufferList * output);
+
+/*!
+ * Mix two single mono buffers
+ *
+ * @param buffer1 First buffer
+ * @param buffer2 Second buffer
+ * @param gain1 Gain factor for first buffer (power ratio)
+ * @param gain2 Gain factor for second buffer
+ * @param frames Number of frames
+ * @param output Output buffer (may be same as buffer1 or buffer2)
+ */
+void AKKAAEDSPMixMono(const float * buffer1, const float * buffer2, float gain1, float gain2, UInt32 frames, float * output);
+
 /*!
  * Silence an audio buffer list (zero out frames)
  *
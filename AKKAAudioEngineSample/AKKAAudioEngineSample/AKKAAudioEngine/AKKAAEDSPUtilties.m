@@ -7,7 +7,7 @@
 //
 
 #import "AKKAAEDSPUtilties.h"
-#import <Accelerate/Accelerate.h>
+#import "AKKAAEDSPKernels.h"
 
 static const UInt32 kMaxFramesPerSlice = 4096;
 static const UInt32 kGainSmoothingRampDuration = 128;
@@ -15,36 +15,53 @@ static const float kGainSmoothingRampStep = 1.0 / kGainSmoothingRampDuration;
 static const float kSmoothGainThreshold = kGainSmoothingRampStep;
 static const UInt32 kMinRampDurationForPowerCurve = 8192;
 static const float  kPowerCurvePower = 3.0;
+static const UInt32 kMixTileFrames = 256; // 一块累加器的大小，保证在 L1 里
+
+// 多声道的 ramp：收集各声道指针（带偏移）交给 rampMulN，一遍处理完所有声道
+static inline void AKKAAEDSPApplyRampToChannels(const AudioBufferList * bufferList, const AKKAAEDSPKernels * kernels,
+                                                float * start, float step, UInt32 offset, UInt32 frames) {
+    if ( bufferList->mNumberBuffers == 0 ) return;
+    float * channels[bufferList->mNumberBuffers];
+    for (int i = 0; i < bufferList->mNumberBuffers; i++) {
+        channels[i] = (float *)bufferList->mBuffers[i].mData + offset;
+    }
+    kernels->rampMulN(channels, bufferList->mNumberBuffers, start, step, frames);
+}
 
 void AKKAAEDSPApplyGain(const AudioBufferList * bufferList , float gain, UInt32 frames) {
+    const AKKAAEDSPKernels * kernels = AKKAAEDSPKernelsGet();
     for (int i = 0; i < bufferList->mNumberBuffers ; i++) {
         if (gain < FLT_EPSILON) {// 说明gain是0，就是清除声音
-            vDSP_vclr(bufferList->mBuffers[i].mData,1 ,frames);
+            kernels->clear(bufferList->mBuffers[i].mData, frames);
         } else {
-            vDSP_vsmul(bufferList->mBuffers[i].mData,1,&gain,bufferList->mBuffers[i].mData,1,frames);
+            kernels->scale(bufferList->mBuffers[i].mData, gain, bufferList->mBuffers[i].mData, frames);
         }
     }
 }
 
 void AKKAAEDSPApplyRamp(const AudioBufferList * bufferList, float * start, float step,UInt32 frames) {
-    if ( bufferList->mNumberBuffers == 2) {
+    const AKKAAEDSPKernels * kernels = AKKAAEDSPKernelsGet();
+    if ( bufferList->mNumberBuffers == 1 ) {
+        kernels->rampMul(bufferList->mBuffers[0].mData, start, step, bufferList->mBuffers[0].mData, frames);
+    } else if ( bufferList->mNumberBuffers == 2) {
         // Stereo buffer: use stereo utility
         // 这里其实就是只减少一次
-        vDSP_vrampmul2(bufferList->mBuffers[0].mData , bufferList->mBuffers[1].mData, 1,
-                start, &step,
-                bufferList->mBuffers[0].mData, bufferList->mBuffers[1].mData, 1,
-                frames);
+        kernels->rampMul2(bufferList->mBuffers[0].mData, bufferList->mBuffers[1].mData, start, step, frames);
     } else {
-        // Mono or multi-channel buffer: treat channel by channel
-        float s = * start;
-        for (int i = 0; i < bufferList->mNumberBuffers; i++) {
-            s = * start;
-            vDSP_vrampmul(bufferList->mBuffers[i].mData, 1, &s, &step, bufferList->mBuffers[i].mData, 1, frames);
-        }
-        *start = s;
+        // Multi-channel buffer: one pass, with each block of the ramp computed once for all channels
+        AKKAAEDSPApplyRampToChannels(bufferList, kernels, start, step, 0, frames);
     }
 }
 
+void AKKAAEDSPApplyEqualPowerRamp(const AudioBufferList * bufferList, float * start, float step, UInt32 frames, float * scratch) {
+    if ( bufferList->mNumberBuffers == 0 ) return;
+    float * channels[bufferList->mNumberBuffers];
+    for (int i = 0; i < bufferList->mNumberBuffers; i++) {
+        channels[i] = (float *)bufferList->mBuffers[i].mData;
+    }
+    AKKAAEDSPKernelsGet()->equalPowerRampMulN(channels, bufferList->mNumberBuffers, start, step, frames);
+}
+
 void AKKAAEDSPApplyGainSmoothed(const AudioBufferList * bufferList, float targetGain, float * currentGain,UInt32 frames) {
     AKKAAEDSPApplyGainWithRamp(bufferList, targetGain, currentGain, frames, 0);
 }
@@ -71,13 +88,12 @@ void AKKAAEDSPApplyGainWithRamp(const AudioBufferList * bufferList, float target
         AKKAAEDSPApplyRamp(bufferList, currentGain, step, duration);
         
         if (duration < frames && fabsf(targetGain - 1.0f) > FLT_EPSILON) {
-            // Apply constant gain, now, with offset
+            // Apply constant gain, now, with offset: a flat ramp, so all channels still go in one pass
             *currentGain = targetGain;
             
-            for (int i = 0; i < bufferList->mNumberBuffers; i++) {
-                vDSP_vsmul((float *)bufferList->mBuffers[i].mData + duration, 1, &targetGain,
-                           (float *)bufferList->mBuffers[i].mData + duration, 1, frames - duration);
-            }
+            const AKKAAEDSPKernels * kernels = AKKAAEDSPKernelsGet();
+            float gain = targetGain;
+            AKKAAEDSPApplyRampToChannels(bufferList, kernels, &gain, 0.0f, duration, frames - duration);
         }
     } else {
         * currentGain = targetGain;
@@ -89,70 +105,135 @@ void AKKAAEDSPApplyGainWithRamp(const AudioBufferList * bufferList, float target
 }
 
 void AKKAAEDSPApplyGainSmoothedMono(float * buffer , float targetGain, float * currentGain,UInt32 frames) {
+    const AKKAAEDSPKernels * kernels = AKKAAEDSPKernelsGet();
     float diff = fabsf(targetGain - *currentGain);
     if ( diff > kSmoothGainThreshold ) {
         // Need to apply ramp
         UInt32 rampDuration = MIN(diff * kGainSmoothingRampDuration, frames);
         float step = targetGain > *currentGain ? kGainSmoothingRampStep : -kGainSmoothingRampStep;
-        vDSP_vrampmul(buffer, 1, currentGain, &step, buffer, 1, rampDuration);
+        kernels->rampMul(buffer, currentGain, step, buffer, rampDuration);
         
         if ( rampDuration < frames && fabsf(targetGain - 1.0f) > FLT_EPSILON ) {
             // Apply constant gain, now, with offset
-            vDSP_vsmul(buffer + rampDuration, 1, &targetGain, buffer + rampDuration, 1, frames - rampDuration);
+            kernels->scale(buffer + rampDuration, targetGain, buffer + rampDuration, frames - rampDuration);
         }
     } else if ( targetGain < FLT_EPSILON ) {
         // Zero
-        vDSP_vclr(buffer, 1, frames);
+        kernels->clear(buffer, frames);
     } else if ( fabsf(targetGain - 1.0f) > FLT_EPSILON ) {
         // Just apply gain
-        vDSP_vsmul(buffer, 1, &targetGain, buffer, 1, frames);
+        kernels->scale(buffer, targetGain, buffer, frames);
     }
 }
 
-void AKKAAEDSPApplyVolumeAndBalance(const AudioBufferList * bufferList, float targetVolume, float * currentVolume,
-                                float targetBalance, float * currentBalance, UInt32 frames) {
+// The ramp AKKAAEDSPApplyGainSmoothed would apply, advancing the current gain the same way
+static void AKKAAEDSPGetSmoothedGainRamp(float targetGain, float * currentGain, UInt32 frames, AKKAAEDSPGainRamp * ramp) {
+    float diff = fabsf(targetGain - *currentGain);
+    if ( diff > kSmoothGainThreshold ) {
+        UInt32 duration = MIN(diff * kGainSmoothingRampDuration, frames);
+        float step = targetGain > *currentGain ? kGainSmoothingRampStep : -kGainSmoothingRampStep;
+        *ramp = (AKKAAEDSPGainRamp){ .start = *currentGain, .step = step, .rampFrames = duration, .gain = targetGain };
+        *currentGain += (float)duration * step;
+        if ( duration < frames && fabsf(targetGain - 1.0f) > FLT_EPSILON ) *currentGain = targetGain;
+    } else {
+        *currentGain = targetGain;
+        *ramp = (AKKAAEDSPGainRamp){ .start = targetGain, .step = 0.0f, .rampFrames = 0, .gain = targetGain };
+    }
+}
+
+void AKKAAEDSPGetVolumeAndBalanceRamps(int channelCount, float targetVolume, float * currentVolume,
+                                       float targetBalance, float * currentBalance, UInt32 frames,
+                                       AKKAAEDSPGainRamp * ramps) {
     BOOL hasCurrentVol = currentVolume != NULL;
     BOOL hasCurrentBal = currentBalance != NULL;
     if ( !hasCurrentVol ) currentVolume = &targetVolume;
     if ( !hasCurrentBal ) currentBalance = &targetBalance;
     
-    if ( bufferList->mNumberBuffers == 2 ) {
-        if ( fabsf(targetBalance) < FLT_EPSILON && fabsf(*currentBalance) < FLT_EPSILON ) {
-            // Balance is centered, can treat both channels the same
-            AKKAAEDSPApplyGainSmoothed(bufferList, targetVolume, currentVolume, frames);
-        } else {
-            // Balance non-centered, need to apply different gains to each channel
-            float targetGains[] = {
-                targetVolume * (targetBalance <= 0.0 ? 1.0 : 1.0-targetBalance),
-                targetVolume * (targetBalance >= 0.0 ? 1.0 : 1.0+targetBalance) };
-            float currentGains[] = {
-                *currentVolume * (*currentBalance <= 0.0 ? 1.0 : 1.0-*currentBalance),
-                *currentVolume * (*currentBalance >= 0.0 ? 1.0 : 1.0+*currentBalance) };
-            
-            AKKAAEDSPApplyGainSmoothedMono(bufferList->mBuffers[0].mData, targetGains[0], &currentGains[0], frames);
-            AKKAAEDSPApplyGainSmoothedMono(bufferList->mBuffers[1].mData, targetGains[1], &currentGains[1], frames);
-            
-            if ( hasCurrentVol ) {
-                *currentVolume = fabsf(*currentVolume-targetVolume) < FLT_EPSILON ? targetVolume :
-                *currentVolume < targetVolume ? MIN(targetVolume, *currentVolume + kGainSmoothingRampStep*frames) :
-                /* *currentVolume > targetVolume */ MAX(targetVolume, *currentVolume - kGainSmoothingRampStep*frames);
-            }
-            if ( hasCurrentBal ) {
-                *currentBalance = fabsf(*currentBalance-targetBalance) < FLT_EPSILON ? targetBalance :
-                *currentBalance < targetBalance ? MIN(targetBalance, *currentBalance + 2*kGainSmoothingRampStep*frames) :
-                /* *currentBalance > targetBalance */ MAX(targetBalance, *currentBalance - 2*kGainSmoothingRampStep*frames);
-            }
+    if ( channelCount == 2 && !(fabsf(targetBalance) < FLT_EPSILON && fabsf(*currentBalance) < FLT_EPSILON) ) {
+        // Balance non-centered, need to apply different gains to each channel
+        float targetGains[] = {
+            targetVolume * (targetBalance <= 0.0 ? 1.0 : 1.0-targetBalance),
+            targetVolume * (targetBalance >= 0.0 ? 1.0 : 1.0+targetBalance) };
+        float currentGains[] = {
+            *currentVolume * (*currentBalance <= 0.0 ? 1.0 : 1.0-*currentBalance),
+            *currentVolume * (*currentBalance >= 0.0 ? 1.0 : 1.0+*currentBalance) };
+
+        AKKAAEDSPGetSmoothedGainRamp(targetGains[0], &currentGains[0], frames, &ramps[0]);
+        AKKAAEDSPGetSmoothedGainRamp(targetGains[1], &currentGains[1], frames, &ramps[1]);
+
+        if ( hasCurrentVol ) {
+            *currentVolume = fabsf(*currentVolume-targetVolume) < FLT_EPSILON ? targetVolume :
+            *currentVolume < targetVolume ? MIN(targetVolume, *currentVolume + kGainSmoothingRampStep*frames) :
+            /* *currentVolume > targetVolume */ MAX(targetVolume, *currentVolume - kGainSmoothingRampStep*frames);
+        }
+        if ( hasCurrentBal ) {
+            *currentBalance = fabsf(*currentBalance-targetBalance) < FLT_EPSILON ? targetBalance :
+            *currentBalance < targetBalance ? MIN(targetBalance, *currentBalance + 2*kGainSmoothingRampStep*frames) :
+            /* *currentBalance > targetBalance */ MAX(targetBalance, *currentBalance - 2*kGainSmoothingRampStep*frames);
+        }
+    } else if ( channelCount > 0 ) {
+        // Balance is centered, or not stereo: all channels get the volume
+        AKKAAEDSPGetSmoothedGainRamp(targetVolume, currentVolume, frames, &ramps[0]);
+        for ( int i=1; i<channelCount; i++ ) ramps[i] = ramps[0];
+    }
+}
+
+// 一个 ramp 作用到一组声道上：ramp 部分和常量部分各一遍
+static void AKKAAEDSPApplyGainRampToChannels(const AKKAAEDSPKernels * kernels, float * const * channels, int count,
+                                             const AKKAAEDSPGainRamp * ramp, UInt32 frames) {
+    UInt32 rampFrames = MIN(ramp->rampFrames, frames);
+    if ( rampFrames > 0 ) {
+        float start = ramp->start;
+        kernels->rampMulN(channels, count, &start, ramp->step, rampFrames);
+    }
+    if ( rampFrames == frames ) return;
+    float * tails[count];
+    for ( int i=0; i<count; i++ ) tails[i] = channels[i] + rampFrames;
+    if ( ramp->gain < FLT_EPSILON ) {
+        for ( int i=0; i<count; i++ ) kernels->clear(tails[i], frames - rampFrames);
+    } else if ( fabsf(ramp->gain - 1.0f) > FLT_EPSILON ) {
+        float gain = ramp->gain;
+        kernels->rampMulN(tails, count, &gain, 0.0f, frames - rampFrames);
+    }
+}
+
+void AKKAAEDSPApplyGainRamps(const AudioBufferList * bufferList, const AKKAAEDSPGainRamp * ramps, UInt32 frames) {
+    int count = bufferList->mNumberBuffers;
+    if ( count == 0 ) return;
+    const AKKAAEDSPKernels * kernels = AKKAAEDSPKernelsGet();
+    float * channels[count];
+    BOOL shared = YES;
+    for ( int i=0; i<count; i++ ) {
+        channels[i] = (float *)bufferList->mBuffers[i].mData;
+        if ( memcmp(&ramps[i], &ramps[0], sizeof(AKKAAEDSPGainRamp)) != 0 ) shared = NO;
+    }
+    if ( shared ) {
+        if ( !AKKAAEDSPGainRampIsUnity(&ramps[0]) ) {
+            AKKAAEDSPApplyGainRampToChannels(kernels, channels, count, &ramps[0], frames);
         }
     } else {
-        // Mono or non-stereo buffer only - just apply volume
-        AKKAAEDSPApplyGainSmoothed(bufferList, targetVolume, currentVolume, frames);
+        for ( int i=0; i<count; i++ ) {
+            if ( !AKKAAEDSPGainRampIsUnity(&ramps[i]) ) {
+                AKKAAEDSPApplyGainRampToChannels(kernels, &channels[i], 1, &ramps[i], frames);
+            }
+        }
     }
 }
 
+void AKKAAEDSPApplyVolumeAndBalance(const AudioBufferList * bufferList, float targetVolume, float * currentVolume,
+                                float targetBalance, float * currentBalance, UInt32 frames) {
+    if ( bufferList->mNumberBuffers == 0 ) return;
+    AKKAAEDSPGainRamp ramps[bufferList->mNumberBuffers];
+    AKKAAEDSPGetVolumeAndBalanceRamps(bufferList->mNumberBuffers, targetVolume, currentVolume, targetBalance,
+                                      currentBalance, frames, ramps);
+    AKKAAEDSPApplyGainRamps(bufferList, ramps, frames);
+}
+
 void AKKAAEDSPMix(const AudioBufferList * abl1, const AudioBufferList * abl2, float gain1, float gain2,
               BOOL monoToStereo, UInt32 frames, const AudioBufferList * output) {
     
     if ( !frames ) frames = output->mBuffers[0].mDataByteSize / sizeof(float);
+    const AKKAAEDSPKernels * kernels = AKKAAEDSPKernelsGet();
     
     if ( gain2 != 1.0f && gain1 == 1.0f ) {
         // Swap around, for efficiency
@@ -183,27 +264,27 @@ void AKKAAEDSPMix(const AudioBufferList * abl1, const AudioBufferList * abl2, fl
         if ( abl1Buffer != -1 && abl2Buffer != -1 ) {
             // Mix channels in common
             if ( gain1 != 1.0 ) {
-                vDSP_vsma(abl1->mBuffers[abl1Buffer].mData, 1, &gain1,
-                          abl2->mBuffers[abl2Buffer].mData, 1,
-                          output->mBuffers[i].mData, 1, frames);
+                kernels->scaleAdd(abl1->mBuffers[abl1Buffer].mData, gain1,
+                                  abl2->mBuffers[abl2Buffer].mData,
+                                  output->mBuffers[i].mData, frames);
             } else {
-                vDSP_vadd(abl1->mBuffers[abl1Buffer].mData, 1,
-                          abl2->mBuffers[abl2Buffer].mData, 1,
-                          output->mBuffers[i].mData, 1, frames);
+                kernels->add(abl1->mBuffers[abl1Buffer].mData,
+                             abl2->mBuffers[abl2Buffer].mData,
+                             output->mBuffers[i].mData, frames);
             }
         } else if ( abl1Buffer != -1 && (output != abl1 || gain1 != 1.0) ) {
             if ( gain1 == 1.0 ) {
                 memcpy(output->mBuffers[i].mData, abl1->mBuffers[abl1Buffer].mData, output->mBuffers[i].mDataByteSize);
             } else {
-                vDSP_vsmul(abl1->mBuffers[abl1Buffer].mData, 1, &gain1,
-                           output->mBuffers[i].mData, 1, frames);
+                kernels->scale(abl1->mBuffers[abl1Buffer].mData, gain1,
+                               output->mBuffers[i].mData, frames);
             }
         } else if ( abl2Buffer != -1 && (output != abl2 || gain2 != 1.0) ) {
             if ( gain2 == 1.0 ) {
                 memcpy(output->mBuffers[i].mData, abl2->mBuffers[abl2Buffer].mData, output->mBuffers[i].mDataByteSize);
             } else {
-                vDSP_vsmul(abl2->mBuffers[abl2Buffer].mData, 1, &gain2,
-                           output->mBuffers[i].mData, 1, frames);
+                kernels->scale(abl2->mBuffers[abl2Buffer].mData, gain2,
+                               output->mBuffers[i].mData, frames);
             }
         }
     }
@@ -213,13 +294,13 @@ void AKKAAEDSPMix(const AudioBufferList * abl1, const AudioBufferList * abl2, fl
         if ( abl1->mNumberBuffers > 1 ) {
             for ( int i=1; i<abl1->mNumberBuffers; i++ ) {
                 if ( gain1 != 1.0 ) {
-                    vDSP_vsma((float*)abl1->mBuffers[i].mData, 1, &gain1,
-                              (float*)output->mBuffers[0].mData, 1,
-                              (float*)output->mBuffers[0].mData, 1, frames);
+                    kernels->scaleAdd((float*)abl1->mBuffers[i].mData, gain1,
+                                      (float*)output->mBuffers[0].mData,
+                                      (float*)output->mBuffers[0].mData, frames);
                 } else {
-                    vDSP_vadd((float*)abl1->mBuffers[i].mData, 1,
-                              (float*)output->mBuffers[0].mData, 1,
-                              (float*)output->mBuffers[0].mData, 1, frames);
+                    kernels->add((float*)abl1->mBuffers[i].mData,
+                                 (float*)output->mBuffers[0].mData,
+                                 (float*)output->mBuffers[0].mData, frames);
                 }
             }
         }
@@ -227,15 +308,161 @@ void AKKAAEDSPMix(const AudioBufferList * abl1, const AudioBufferList * abl2, fl
         // If output is mono and abl2 has more channels, mix them all in
         if ( abl2->mNumberBuffers > 1 ) {
             for ( int i=1; i<abl2->mNumberBuffers; i++ ) {
-                vDSP_vadd((float*)abl2->mBuffers[i].mData, 1,
-                          (float*)output->mBuffers[0].mData, 1,
-                          (float*)output->mBuffers[0].mData, 1, frames);
+                kernels->add((float*)abl2->mBuffers[i].mData,
+                             (float*)output->mBuffers[0].mData,
+                             (float*)output->mBuffers[0].mData, frames);
             }
         }
     }
 }
 
+// Which channel of the input feeds the given output channel, or -1 if none (same mapping as AKKAAEDSPMix)
+static inline int AKKAAEDSPMixInputChannel(const AudioBufferList * input, int outputChannel, BOOL monoToStereo,
+                                           UInt32 outputChannels) {
+    return outputChannel < input->mNumberBuffers ? outputChannel :
+        monoToStereo && input->mNumberBuffers == 1 && outputChannels == 2 ? 0 :
+        -1;
+}
+
+static inline void AKKAAEDSPMixTileInto(const AKKAAEDSPKernels * kernels, const float * input, float gain,
+                                        float * output, BOOL * started, UInt32 frames) {
+    if ( !*started ) {
+        if ( gain == 1.0f ) {
+            memcpy(output, input, frames * sizeof(float));
+        } else {
+            kernels->scale(input, gain, output, frames);
+        }
+        *started = YES;
+    } else if ( gain == 1.0f ) {
+        kernels->add(input, output, output, frames);
+    } else {
+        kernels->scaleAdd(input, gain, output, output, frames);
+    }
+}
+
+void AKKAAEDSPMixMultiple(const AudioBufferList * const * inputs, const float * gains, int count,
+                          BOOL monoToStereo, UInt32 frames, const AudioBufferList * output) {
+    AKKAAEDSPMixMultipleWithGainRamps(inputs, gains, NULL, NULL, count, monoToStereo, frames, output);
+}
+
+// Whether the given channel of input k is flagged silent
+static inline BOOL AKKAAEDSPMixChannelIsSilent(const UInt32 * silentChannels, int k, int channel) {
+    return silentChannels && channel < 32 && (silentChannels[k] & (1u << channel));
+}
+
+// The pending ramp on the given channel of input k, or NULL
+static inline const AKKAAEDSPGainRamp * AKKAAEDSPMixChannelRamp(const AKKAAEDSPGainRamp * const * ramps, int k, int channel) {
+    return ramps && ramps[k] && !AKKAAEDSPGainRampIsUnity(&ramps[k][channel]) ? &ramps[k][channel] : NULL;
+}
+
+// Mix one tile of an input through its ramp: the ramp's frames, then its constant gain. offset is the tile's
+// position in the buffer, so the ramp picks up where it is at the tile.
+static inline void AKKAAEDSPMixTileWithRamp(const AKKAAEDSPKernels * kernels, const float * input, float gain,
+                                            const AKKAAEDSPGainRamp * ramp, UInt32 offset, float * output,
+                                            BOOL * started, UInt32 frames) {
+    if ( !ramp ) {
+        AKKAAEDSPMixTileInto(kernels, input, gain, output, started, frames);
+        return;
+    }
+    UInt32 rampFrames = offset < ramp->rampFrames ? MIN(ramp->rampFrames - offset, frames) : 0;
+    BOOL tailStarted = *started;
+    if ( rampFrames > 0 ) {
+        float start = (ramp->start + (float)offset * ramp->step) * gain;
+        if ( *started ) {
+            kernels->rampMulAdd(input, &start, ramp->step * gain, output, rampFrames);
+        } else {
+            kernels->rampMul(input, &start, ramp->step * gain, output, rampFrames);
+        }
+    }
+    if ( rampFrames < frames ) {
+        float tailGain = ramp->gain * gain;
+        if ( tailGain == 0.0f ) {
+            if ( !tailStarted ) kernels->clear(output + rampFrames, frames - rampFrames);
+        } else {
+            AKKAAEDSPMixTileInto(kernels, input + rampFrames, tailGain, output + rampFrames, &tailStarted, frames - rampFrames);
+        }
+    }
+    *started = YES;
+}
+
+UInt32 AKKAAEDSPMixMultipleWithGainRamps(const AudioBufferList * const * inputs, const float * gains,
+                                         const AKKAAEDSPGainRamp * const * ramps, const UInt32 * silentChannels,
+                                         int count, BOOL monoToStereo, UInt32 frames, const AudioBufferList * output) {
+    
+    if ( !frames ) frames = output->mBuffers[0].mDataByteSize / sizeof(float);
+    const AKKAAEDSPKernels * kernels = AKKAAEDSPKernelsGet();
+    UInt32 outputSilentChannels = 0;
+    
+    // 按块处理：每一块里把所有输入累加到同一段输出上，累加器一直留在缓存里
+    for ( UInt32 offset=0; offset < frames; offset += kMixTileFrames ) {
+        UInt32 tileFrames = MIN(kMixTileFrames, frames - offset);
+        
+        for ( int i=0; i < output->mNumberBuffers; i++ ) {
+            float * outputData = (float*)output->mBuffers[i].mData;
+            float * tile = outputData + offset;
+            BOOL started = NO;
+            BOOL zeroed = NO;
+            
+            // An input channel that is also this output channel must be accumulated first, before it's overwritten
+            for ( int k=0; k < count; k++ ) {
+                int channel = AKKAAEDSPMixInputChannel(inputs[k], i, monoToStereo, output->mNumberBuffers);
+                if ( channel != -1 && inputs[k]->mBuffers[channel].mData == outputData ) {
+                    if ( AKKAAEDSPMixChannelIsSilent(silentChannels, k, channel) ) {
+                        // Already zero: the first audible input overwrites it
+                        zeroed = YES;
+                        break;
+                    }
+                    float gain = gains ? gains[k] : 1.0f;
+                    const AKKAAEDSPGainRamp * ramp = AKKAAEDSPMixChannelRamp(ramps, k, channel);
+                    if ( ramp ) {
+                        // Apply its pending ramp in place, with the mix gain folded in
+                        AKKAAEDSPGainRamp scaled = {
+                            .start = (ramp->start + (float)offset * ramp->step) * gain,
+                            .step = ramp->step * gain,
+                            .rampFrames = offset < ramp->rampFrames ? ramp->rampFrames - offset : 0,
+                            .gain = ramp->gain * gain };
+                        AKKAAEDSPApplyGainRampToChannels(kernels, &tile, 1, &scaled, tileFrames);
+                    } else if ( gain != 1.0f ) {
+                        kernels->scale(tile, gain, tile, tileFrames);
+                    }
+                    started = YES;
+                    break;
+                }
+            }
+            
+            for ( int k=0; k < count; k++ ) {
+                const AudioBufferList * input = inputs[k];
+                float gain = gains ? gains[k] : 1.0f;
+                
+                int channel = AKKAAEDSPMixInputChannel(input, i, monoToStereo, output->mNumberBuffers);
+                if ( channel != -1 && input->mBuffers[channel].mData != outputData
+                        && !AKKAAEDSPMixChannelIsSilent(silentChannels, k, channel) ) {
+                    AKKAAEDSPMixTileWithRamp(kernels, (const float*)input->mBuffers[channel].mData + offset, gain,
+                                             AKKAAEDSPMixChannelRamp(ramps, k, channel), offset, tile, &started, tileFrames);
+                }
+                
+                if ( output->mNumberBuffers == 1 ) {
+                    // If output is mono and this input has more channels, mix them all in
+                    for ( int j=1; j < input->mNumberBuffers; j++ ) {
+                        if ( AKKAAEDSPMixChannelIsSilent(silentChannels, k, j) ) continue;
+                        AKKAAEDSPMixTileWithRamp(kernels, (const float*)input->mBuffers[j].mData + offset, gain,
+                                                 AKKAAEDSPMixChannelRamp(ramps, k, j), offset, tile, &started, tileFrames);
+                    }
+                }
+            }
+            
+            if ( !started ) {
+                if ( !zeroed ) kernels->clear(tile, tileFrames);
+                if ( i < 32 ) outputSilentChannels |= 1u << i;
+            }
+        }
+    }
+    
+    return outputSilentChannels;
+}
+
 void AKKAAEDSPMixMono(const float * buffer1, const float * buffer2, float gain1, float gain2, UInt32 frames, float * output) {
+    const AKKAAEDSPKernels * kernels = AKKAAEDSPKernelsGet();
     if ( gain2 != 1.0f && gain1 == 1.0f ) {
         // Swap buffers around, for efficiency
         const float * tmpb = buffer2;
@@ -248,15 +475,15 @@ void AKKAAEDSPMixMono(const float * buffer1, const float * buffer2, float gain1,
     
     if ( gain2 != 1.0f) {
         // Pre-apply gain to second buffer
-        vDSP_vsmul(buffer2, 1, &gain2, output, 1, frames);
+        kernels->scale(buffer2, gain2, output, frames);
         buffer2 = output;
     }
     
     // Mix
     if ( gain1 != 1.0f ) {
-        vDSP_vsma(buffer1, 1, &gain1, buffer2, 1, output, 1, frames);
+        kernels->scaleAdd(buffer1, gain1, buffer2, output, frames);
     } else {
-        vDSP_vadd(buffer1, 1, buffer2, 1, output, 1, frames);
+        kernels->add(buffer1, buffer2, output, frames);
     }
 }
 
@@ -47,6 +47,45 @@ extern NSString * const _Nonnull AKKAAEIOAudioUnitDidSetupNotification;
  */
 extern NSString * const _Nonnull AKKAAEIOAudioUnitDidUpdateStreamFormatNotification;
 
+/*!
+ * Virtual device clock
+ */
+typedef NS_ENUM(NSInteger, AKKAAEIOAudioUnitVirtualClock) {
+    //! Cycles are paced to the wall clock, one IO buffer duration apart, as the hardware would run them
+    AKKAAEIOAudioUnitVirtualClockRealtime,
+    //! Each cycle starts as soon as the last one ends. Timestamps still advance by one buffer per cycle,
+    //! as if the time had passed, so the engine sees the same timeline, only faster
+    AKKAAEIOAudioUnitVirtualClockFreeRunning,
+};
+
+/*!
+ * Virtual input generator block
+ *
+ *  Called on the virtual device's thread at the start of each cycle, to fill in the input that
+ *  AKKAAEIOAudioUnitRenderInput will return for that cycle.
+ *
+ * @param buffer The input buffer list, silenced, with numberOfInputChannels channels
+ * @param frames The number of frames
+ * @param timestamp The cycle's timestamp
+ */
+typedef void (^AKKAAEIOAudioUnitInputGeneratorBlock)(const AudioBufferList * _Nonnull buffer,
+                                                     UInt32 frames,
+                                                     const AudioTimeStamp * _Nonnull timestamp);
+
+/*!
+ * Virtual device statistics
+ *
+ *  A cycle's deadline is the start of the next one: rendering past it is a deadline miss, which on
+ *  the hardware would be heard as a glitch.
+ */
+typedef struct {
+    UInt64 cycles;                  //!< Render cycles run
+    UInt64 deadlineMisses;          //!< Cycles whose render finished after their deadline
+    UInt64 skippedFrames;           //!< Frames of whole cycles skipped after falling a full cycle behind the wall clock
+    AKKAAESeconds longestRender;    //!< Longest time spent in the input and render blocks in one cycle
+    AKKAAESeconds maximumLateness;  //!< Furthest a render finished past its deadline
+} AKKAAEIOAudioUnitVirtualDeviceStatistics;
+
 /*!
  * Audio unit interface
  *
@@ -58,6 +97,14 @@ extern NSString * const _Nonnull AKKAAEIOAudioUnitDidUpdateStreamFormatNotificat
  *
  *  Important note: an audio unit with both input and output enabled is only possible on iOS. On
  *  the Mac, you must create two separate audio units.
+ *
+ *  Set virtualDevice to run without audio hardware: a dedicated high-priority thread calls the
+ *  render block every IOBufferDuration, either paced to the wall clock or free-running, with
+ *  input simulated from a file or a generator block. This is for soak tests, load tests and CI
+ *  on machines without a sound card; deadline misses are counted the way the hardware would hit
+ *  them, with AKKAAEIOAudioUnitGetVirtualDeviceStatistics.
+ *
+ *  没有声卡时用虚拟设备驱动渲染：专用高优先级线程按 IOBufferDuration 周期调用 renderBlock。
  */
 @interface AKKAAEIOAudioUnit : NSObject
 
@@ -129,6 +176,21 @@ AudioTimeStamp AKKAAEIOAudioUnitGetInputTimestamp(__unsafe_unretained AKKAAEIOAu
 */
 double AKKAAEIOAudioUnitGetSampleRate(__unsafe_unretained AKKAAEIOAudioUnit * _Nonnull unit);
 
+/*!
+* Get virtual device statistics
+*
+* @param unit The unit instance
+* @return Statistics since setup: or the last call to resetVirtualDeviceStatistics
+*/
+AKKAAEIOAudioUnitVirtualDeviceStatistics AKKAAEIOAudioUnitGetVirtualDeviceStatistics(__unsafe_unretained AKKAAEIOAudioUnit * _Nonnull unit);
+
+/*!
+* Reset virtual device statistics
+*
+*  The device thread clears the statistics at the start of its next cycle.
+*/
+- (void)resetVirtualDeviceStatistics;
+
 #if TARGET_OS_IPHONE
 
 /*!
@@ -195,6 +257,30 @@ AKKAAESeconds AKKAAEIOAudioUnitGetOutputLatency(__unsafe_unretained AKKAAEIOAudi
 //! On iOS, this is fetched from AVAudioSession; on the Mac, this is taken from HAL
 @property (nonatomic) AKKAAESeconds IOBufferDuration;
 
+//! The frames per render cycle at the current IO buffer duration and sample rate.
+//! Buffer stacks and schedulers that render for this unit can be sized to this, with
+//! AKKAAEBufferStackSetMaxFramesPerSlice, on each AKKAAEIOAudioUnitDidSetupNotification
+@property (nonatomic, readonly) UInt32 framesPerSlice;
+
+//! Whether to run on a virtual device instead of the audio hardware. Set this before calling setup:
+@property (nonatomic) BOOL virtualDevice;
+
+//! How the virtual device paces its cycles (default AKKAAEIOAudioUnitVirtualClockRealtime). Takes effect on start:
+@property (nonatomic) AKKAAEIOAudioUnitVirtualClock virtualClock;
+
+//! Number of output channels the virtual device has (default 2)
+@property (nonatomic) int virtualOutputChannels;
+
+//! Number of input channels the virtual device has, when not playing a file (default 2)
+@property (nonatomic) int virtualInputChannels;
+
+//! A file to loop as the virtual device's input, streamed with AKKAAEStreamingFilePlayer at the
+//! device's sample rate. The input then has the file's channel count
+@property (nonatomic, strong) NSURL * _Nullable virtualInputURL;
+
+//! A block to generate the virtual device's input, after the file if there is one. May be changed at any time
+@property (nonatomic, copy) AKKAAEIOAudioUnitInputGeneratorBlock _Nullable virtualInputGenerator;
+
 #if TARGET_OS_IPHONE
 
 //! Whether to automatically perform latency compensation (default YES)
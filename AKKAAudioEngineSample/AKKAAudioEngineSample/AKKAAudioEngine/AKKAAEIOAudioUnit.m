@@ -14,14 +14,56 @@
 #import "AKKAAEManagedValue.h"
 #import "AKKAAEAudioBufferListUtilities.h"
 #import "AKKAAEDSPUtilties.h"
+#import "AKKAAEStreamingFilePlayer.h"
+#import <pthread.h>
+#import <stdatomic.h>
+#ifdef __APPLE__
+#import <mach/mach.h>
+#import <mach/mach_time.h>
+#else
+#import <sched.h>
+#import <time.h>
+#endif
+#if TARGET_OS_IPHONE
 #import <AVFoundation/AVFoundation.h>
+#endif
 
 NSString * const AKKAAEIOAudioUnitDidUpdateStreamFormatNotification = @"AKKAAEIOAudioUnitDidUpdateStreamFormatNotification";
 NSString * const AKKAAEIOAudioUnitDidSetupNotification = @"AKKAAEIOAudioUnitDidSetupNotification";
 
-@interface AKKAAEIOAudioUnit()
+static const double kVirtualDeviceDefaultSampleRate = 44100.0;
+static const UInt32 kVirtualDeviceDefaultFrames = 256;
+
+// 虚拟设备的状态，setup: 时创建；统计计数器只有设备线程写
+typedef struct {
+    pthread_t thread;
+    _Atomic(BOOL) stopRequested;
+    _Atomic(BOOL) resetStatisticsRequested;
+    UInt32 frames;
+    double sampleRate;
+    Float64 sampleTime;
+    AKKAAEIOAudioUnitVirtualClock clock;
+    AudioBufferList * outputBuffer;
+    AudioBufferList * inputBuffer;
+    int inputChannels;
+    AKKAAEStreamingFilePlayer * inputPlayer;
+    AKKAAEBufferStack * inputStack;
+    _Atomic(UInt64) cycles;
+    _Atomic(UInt64) deadlineMisses;
+    _Atomic(UInt64) skippedFrames;
+    _Atomic(UInt64) longestRenderTicks;
+    _Atomic(UInt64) maximumLatenessTicks;
+} AKKAAEIOAudioUnitVirtualDevice;
+
+static void * AKKAAEIOAudioUnitVirtualDeviceThread(void * userInfo);
+
+@interface AKKAAEIOAudioUnit() {
+    AKKAAEIOAudioUnitVirtualDevice * _device;
+}
 
 @property (nonatomic, strong) AKKAAEManagedValue * renderBlockValue;
+@property (nonatomic, strong) AKKAAEManagedValue * inputGeneratorValue;
+@property (nonatomic, readwrite) BOOL running;
 @property (nonatomic, readwrite) double currentSampleRate;
 @property (nonatomic, readwrite) int numberOfOutputChannels;
 @property (nonatomic, readwrite) int numberOfInputChannels;
@@ -42,6 +84,403 @@ NSString * const AKKAAEIOAudioUnitDidSetupNotification = @"AKKAAEIOAudioUnitDidS
 
 @implementation AKKAAEIOAudioUnit
 
+- (instancetype)init {
+    if ( !(self = [super init]) ) return nil;
+
+    self.renderBlockValue = [AKKAAEManagedValue new];
+    self.inputGeneratorValue = [AKKAAEManagedValue new];
+    _outputEnabled = YES;
+    _inputGain = 1.0;
+    _currentInputGain = 1.0;
+    _IOBufferDuration = kVirtualDeviceDefaultFrames / kVirtualDeviceDefaultSampleRate;
+    _virtualClock = AKKAAEIOAudioUnitVirtualClockRealtime;
+    _virtualOutputChannels = 2;
+    _virtualInputChannels = 2;
+#if TARGET_OS_IPHONE
+    _latencyCompensation = YES;
+#endif
+
+    return self;
+}
+
+- (void)dealloc {
+    [self stop];
+    [self teardownVirtualDevice];
+}
+
+- (BOOL)setup:(NSError * __autoreleasing *)error {
+    if ( !_virtualDevice ) {
+        // 这个工程里还没有 RemoteIO 的实现，目前只有虚拟设备
+        if ( error ) {
+            *error = [NSError errorWithDomain:NSOSStatusErrorDomain code:kAudio_UnimplementedError
+                                     userInfo:@{ NSLocalizedDescriptionKey: @"Only the virtual device is available: set virtualDevice to YES" }];
+        }
+        return NO;
+    }
+    return [self setupVirtualDevice:error];
+}
+
+- (BOOL)start:(NSError * __autoreleasing *)error {
+    if ( _running ) return YES;
+    if ( !_device && ![self setup:error] ) return NO;
+
+    _device->clock = _virtualClock;
+    atomic_store(&_device->stopRequested, NO);
+    int result = pthread_create(&_device->thread, NULL, AKKAAEIOAudioUnitVirtualDeviceThread, (__bridge void *)self);
+    if ( result != 0 ) {
+        if ( error ) {
+            *error = [NSError errorWithDomain:NSPOSIXErrorDomain code:result
+                                     userInfo:@{ NSLocalizedDescriptionKey: @"Couldn't start the virtual device thread" }];
+        }
+        return NO;
+    }
+    self.running = YES;
+    return YES;
+}
+
+- (void)stop {
+    if ( !_running ) return;
+    atomic_store(&_device->stopRequested, YES);
+    pthread_join(_device->thread, NULL);
+    self.running = NO;
+}
+
+AudioUnit AKKAAEIOAudioUnitGetAudioUnit(__unsafe_unretained AKKAAEIOAudioUnit * unit) {
+    return unit->_audioUnit;
+}
+
+OSStatus AKKAAEIOAudioUnitRenderInput(__unsafe_unretained AKKAAEIOAudioUnit * THIS,
+                                      const AudioBufferList * buffer, UInt32 frames) {
+    AKKAAEIOAudioUnitVirtualDevice * device = THIS->_device;
+    if ( !device || !device->inputBuffer ) {
+        AKKAAEAudioBufferListSilence(buffer, 0, frames);
+        return kAudioUnitErr_CannotDoInCurrentContext;
+    }
+
+    // 多出来的声道重复最后一个输入声道，比如单声道文件输入到立体声
+    frames = MIN(frames, device->frames);
+    for ( int i=0; i<buffer->mNumberBuffers; i++ ) {
+        int channel = MIN(i, device->inputChannels - 1);
+        memcpy(buffer->mBuffers[i].mData, device->inputBuffer->mBuffers[channel].mData, frames * sizeof(float));
+    }
+
+    if ( THIS->_currentInputGain != 1.0f ) {
+        AKKAAEDSPApplyGain(buffer, THIS->_currentInputGain, frames);
+    }
+    return noErr;
+}
+
+AudioTimeStamp AKKAAEIOAudioUnitGetInputTimestamp(__unsafe_unretained AKKAAEIOAudioUnit * THIS) {
+    return THIS->_inputTimestamp;
+}
+
+double AKKAAEIOAudioUnitGetSampleRate(__unsafe_unretained AKKAAEIOAudioUnit * THIS) {
+    return THIS->_currentSampleRate;
+}
+
+#if TARGET_OS_IPHONE
+
+AKKAAESeconds AKKAAEIOAudioUnitGetInputLatency(__unsafe_unretained AKKAAEIOAudioUnit * THIS) {
+    return THIS->_inputLatency;
+}
+
+AKKAAESeconds AKKAAEIOAudioUnitGetOutputLatency(__unsafe_unretained AKKAAEIOAudioUnit * THIS) {
+    return THIS->_outputLatency;
+}
+
+#endif
+
+AKKAAEIOAudioUnitVirtualDeviceStatistics AKKAAEIOAudioUnitGetVirtualDeviceStatistics(__unsafe_unretained AKKAAEIOAudioUnit * THIS) {
+    AKKAAEIOAudioUnitVirtualDevice * device = THIS->_device;
+    if ( !device ) return (AKKAAEIOAudioUnitVirtualDeviceStatistics){};
+    return (AKKAAEIOAudioUnitVirtualDeviceStatistics) {
+        .cycles = atomic_load_explicit(&device->cycles, memory_order_relaxed),
+        .deadlineMisses = atomic_load_explicit(&device->deadlineMisses, memory_order_relaxed),
+        .skippedFrames = atomic_load_explicit(&device->skippedFrames, memory_order_relaxed),
+        .longestRender = AKKAAESecondsFromHostTicks(atomic_load_explicit(&device->longestRenderTicks, memory_order_relaxed)),
+        .maximumLateness = AKKAAESecondsFromHostTicks(atomic_load_explicit(&device->maximumLatenessTicks, memory_order_relaxed)),
+    };
+}
+
+- (void)resetVirtualDeviceStatistics {
+    if ( _device ) atomic_store(&_device->resetStatisticsRequested, YES);
+}
+
+#pragma mark - Properties
+
+- (AKKAAEIOAudioUnitRenderBlock)renderBlock {
+    return self.renderBlockValue.objectValue;
+}
+
+- (void)setRenderBlock:(AKKAAEIOAudioUnitRenderBlock)renderBlock {
+    self.renderBlockValue.objectValue = [renderBlock copy];
+}
+
+- (AKKAAEIOAudioUnitInputGeneratorBlock)virtualInputGenerator {
+    return self.inputGeneratorValue.objectValue;
+}
+
+- (void)setVirtualInputGenerator:(AKKAAEIOAudioUnitInputGeneratorBlock)virtualInputGenerator {
+    self.inputGeneratorValue.objectValue = [virtualInputGenerator copy];
+}
+
+- (void)setInputGain:(double)inputGain {
+    _inputGain = inputGain;
+    _currentInputGain = inputGain;
+}
+
+- (UInt32)framesPerSlice {
+    // 和虚拟设备 setup 时的算法一致
+    if ( _currentSampleRate <= 0 ) return 0;
+    return (UInt32)MAX(1.0, MIN((double)AKKAAEBufferStackMaxFramesPerSlice, round(_IOBufferDuration * _currentSampleRate)));
+}
+
+// 这些参数变了要重新 setup，和硬件一样会短暂中断渲染
+- (void)setSampleRate:(double)sampleRate {
+    if ( _sampleRate == sampleRate ) return;
+    _sampleRate = sampleRate;
+    [self reloadVirtualDevice];
+}
+
+- (void)setIOBufferDuration:(AKKAAESeconds)IOBufferDuration {
+    if ( _IOBufferDuration == IOBufferDuration ) return;
+    _IOBufferDuration = IOBufferDuration;
+    [self reloadVirtualDevice];
+}
+
+- (void)setOutputEnabled:(BOOL)outputEnabled {
+    if ( _outputEnabled == outputEnabled ) return;
+    _outputEnabled = outputEnabled;
+    [self reloadVirtualDevice];
+}
+
+- (void)setInputEnabled:(BOOL)inputEnabled {
+    if ( _inputEnabled == inputEnabled ) return;
+    _inputEnabled = inputEnabled;
+    [self reloadVirtualDevice];
+}
+
+- (void)setMaximumInputChannels:(int)maximumInputChannels {
+    if ( _maximumInputChannels == maximumInputChannels ) return;
+    _maximumInputChannels = maximumInputChannels;
+    [self reloadVirtualDevice];
+}
+
+#pragma mark - Virtual device
+
+- (BOOL)setupVirtualDevice:(NSError * __autoreleasing *)error {
+    BOOL wasRunning = _running;
+    BOOL wasSetup = _device != NULL;
+    [self stop];
+    [self teardownVirtualDevice];
+
+    double sampleRate = _sampleRate > 0 ? _sampleRate : kVirtualDeviceDefaultSampleRate;
+    UInt32 frames = (UInt32)MAX(1.0, MIN((double)AKKAAEBufferStackMaxFramesPerSlice, round(_IOBufferDuration * sampleRate)));
+
+    AKKAAEIOAudioUnitVirtualDevice * device = (AKKAAEIOAudioUnitVirtualDevice *)calloc(1, sizeof(AKKAAEIOAudioUnitVirtualDevice));
+    device->frames = frames;
+    device->sampleRate = sampleRate;
+
+    if ( _inputEnabled ) {
+        int inputChannels = _virtualInputChannels;
+        if ( _virtualInputURL ) {
+            device->inputPlayer = AKKAAEStreamingFilePlayerNew(_virtualInputURL, 0, error);
+            if ( !device->inputPlayer ) {
+                free(device);
+                return NO;
+            }
+            inputChannels = AKKAAEStreamingFilePlayerGetAudioDescription(device->inputPlayer).mChannelsPerFrame;
+            device->inputStack = AKKAAEBufferStackNewWithMaxFrames(1, inputChannels, 0, frames);
+            AKKAAEStreamingFilePlayerSetLoop(device->inputPlayer, YES, 0, 0);
+            AKKAAEStreamingFilePlayerSetPlaying(device->inputPlayer, YES);
+        }
+        if ( _maximumInputChannels > 0 ) inputChannels = MIN(inputChannels, _maximumInputChannels);
+        device->inputChannels = MAX(1, inputChannels);
+        device->inputBuffer = AKKAAEAudioBufferListCreateWithFormat(
+            AKKAAEAudioDescriptionWithChannelsAndRate(device->inputChannels, sampleRate), frames);
+    }
+
+    if ( _outputEnabled ) {
+        device->outputBuffer = AKKAAEAudioBufferListCreateWithFormat(
+            AKKAAEAudioDescriptionWithChannelsAndRate(MAX(1, _virtualOutputChannels), sampleRate), frames);
+    }
+
+    BOOL sampleRateChanged = wasSetup && sampleRate != _currentSampleRate;
+    _device = device;
+    _IOBufferDuration = frames / sampleRate;
+    self.currentSampleRate = sampleRate;
+    self.numberOfOutputChannels = _outputEnabled ? MAX(1, _virtualOutputChannels) : 0;
+    self.numberOfInputChannels = device->inputBuffer ? device->inputChannels : 0;
+
+    [[NSNotificationCenter defaultCenter] postNotificationName:AKKAAEIOAudioUnitDidSetupNotification object:self];
+    if ( sampleRateChanged ) {
+        [[NSNotificationCenter defaultCenter] postNotificationName:AKKAAEIOAudioUnitDidUpdateStreamFormatNotification object:self];
+    }
+
+    if ( wasRunning ) return [self start:error];
+    return YES;
+}
+
+- (void)reloadVirtualDevice {
+    if ( !_device ) return;
+    NSError * error = nil;
+    if ( ![self setupVirtualDevice:&error] ) {
+        NSLog(@"AKKAAEIOAudioUnit: Couldn't set up the virtual device: %@", error.localizedDescription);
+    }
+}
+
+- (void)teardownVirtualDevice {
+    if ( !_device ) return;
+    if ( _device->inputPlayer ) AKKAAEStreamingFilePlayerFree(_device->inputPlayer);
+    if ( _device->inputStack ) AKKAAEBufferStackFree(_device->inputStack);
+    if ( _device->inputBuffer ) AKKAAEAudioBufferListFree(_device->inputBuffer);
+    if ( _device->outputBuffer ) AKKAAEAudioBufferListFree(_device->outputBuffer);
+    free(_device);
+    _device = NULL;
+}
+
+/*!
+ * Sleep until the given host time
+ */
+static void AKKAAEIOAudioUnitWaitUntil(AKKAAEHostTicks ticks) {
+#ifdef __APPLE__
+    mach_wait_until(ticks);
+#else
+    // Host ticks are nanoseconds on the monotonic clock
+    struct timespec when = { .tv_sec = (time_t)(ticks / 1000000000ull), .tv_nsec = (long)(ticks % 1000000000ull) };
+    while ( clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &when, NULL) == EINTR );
+#endif
+}
+
+/*!
+ * Give the calling thread realtime priority, as the hardware's IO thread has
+ */
+static void AKKAAEIOAudioUnitSetRealtimePriority(AKKAAESeconds period) {
+#ifdef __APPLE__
+    thread_time_constraint_policy_data_t policy = {
+        .period = (uint32_t)AKKAAEHostTicksFromSeconds(period),
+        .computation = (uint32_t)AKKAAEHostTicksFromSeconds(MIN(period * 0.5, 0.05)),
+        .constraint = (uint32_t)AKKAAEHostTicksFromSeconds(period),
+        .preemptible = TRUE,
+    };
+    thread_policy_set(mach_thread_self(), THREAD_TIME_CONSTRAINT_POLICY, (thread_policy_t)&policy,
+                      THREAD_TIME_CONSTRAINT_POLICY_COUNT);
+#else
+    // Needs CAP_SYS_NICE or an rtprio limit; otherwise the thread keeps normal priority
+    struct sched_param parameters = { .sched_priority = sched_get_priority_max(SCHED_FIFO) - 10 };
+    pthread_setschedparam(pthread_self(), SCHED_FIFO, &parameters);
+#endif
+}
+
+static inline void AKKAAEIOAudioUnitCounterAdd(_Atomic(UInt64) * counter, UInt64 value) {
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + value, memory_order_relaxed);
+}
+
+static inline void AKKAAEIOAudioUnitCounterMax(_Atomic(UInt64) * counter, UInt64 value) {
+    if ( value > atomic_load_explicit(counter, memory_order_relaxed) ) {
+        atomic_store_explicit(counter, value, memory_order_relaxed);
+    }
+}
+
+static void * AKKAAEIOAudioUnitVirtualDeviceThread(void * userInfo) {
+    __unsafe_unretained AKKAAEIOAudioUnit * THIS = (__bridge AKKAAEIOAudioUnit *)userInfo;
+    AKKAAEIOAudioUnitVirtualDevice * device = THIS->_device;
+    const UInt32 frames = device->frames;
+    const double sampleRate = device->sampleRate;
+    const BOOL realtime = device->clock == AKKAAEIOAudioUnitVirtualClockRealtime;
+    const AKKAAEHostTicks period = AKKAAEHostTicksFromSeconds(frames / sampleRate);
+
+#ifdef __APPLE__
+    pthread_setname_np("com.akka.audioengine.virtual-device");
+#endif
+    AKKAAEIOAudioUnitSetRealtimePriority(frames / sampleRate);
+
+    // 第 n 个周期的主机时间由 origin 加上 n 个周期的时长算出来，不会累积误差
+    AKKAAEHostTicks origin = AKKAAECurrentTimeInHostTicks();
+    UInt64 cycle = 0;
+
+    while ( !atomic_load_explicit(&device->stopRequested, memory_order_relaxed) ) {
+        AKKAAEHostTicks scheduled = origin + AKKAAEHostTicksFromSeconds((double)cycle * frames / sampleRate);
+        AKKAAEHostTicks start;
+        if ( realtime ) {
+            AKKAAEIOAudioUnitWaitUntil(scheduled);
+            start = AKKAAECurrentTimeInHostTicks();
+            if ( start >= scheduled + period ) {
+                // A whole cycle behind: skip the cycles that were missed, as the hardware moves on without us
+                UInt64 missed = (start - scheduled) / period;
+                cycle += missed;
+                device->sampleTime += (Float64)missed * frames;
+                AKKAAEIOAudioUnitCounterAdd(&device->skippedFrames, missed * frames);
+                scheduled = origin + AKKAAEHostTicksFromSeconds((double)cycle * frames / sampleRate);
+            }
+        } else {
+            start = AKKAAECurrentTimeInHostTicks();
+        }
+        
+        if ( atomic_load_explicit(&device->resetStatisticsRequested, memory_order_relaxed)
+                && atomic_exchange(&device->resetStatisticsRequested, NO) ) {
+            atomic_store_explicit(&device->cycles, 0, memory_order_relaxed);
+            atomic_store_explicit(&device->deadlineMisses, 0, memory_order_relaxed);
+            atomic_store_explicit(&device->skippedFrames, 0, memory_order_relaxed);
+            atomic_store_explicit(&device->longestRenderTicks, 0, memory_order_relaxed);
+            atomic_store_explicit(&device->maximumLatenessTicks, 0, memory_order_relaxed);
+        }
+        
+        // Apply pending updates, and hand last cycle's retired values to the reclaimer
+        AKKAAEManagedValueCommitPendingUpdates();
+
+        AudioTimeStamp timestamp = {
+            .mSampleTime = device->sampleTime,
+            .mHostTime = scheduled,
+            .mRateScalar = 1.0,
+            .mFlags = kAudioTimeStampSampleTimeValid | kAudioTimeStampHostTimeValid | kAudioTimeStampRateScalarValid,
+        };
+        
+        if ( device->inputBuffer ) {
+            AKKAAEAudioBufferListSilence(device->inputBuffer, 0, frames);
+            if ( device->inputPlayer ) {
+                AKKAAEBufferStackReset(device->inputStack);
+                AKKAAEBufferStackSetTimeStamp(device->inputStack, &timestamp);
+                AKKAAERenderContext context = {
+                    .frames = frames,
+                    .sampleRate = sampleRate,
+                    .timestamp = &timestamp,
+                    .stack = device->inputStack,
+                };
+                AKKAAEStreamingFilePlayerRender(device->inputPlayer, &context);
+                const AudioBufferList * fileAudio = AKKAAEBufferStackGet(device->inputStack, 0);
+                for ( int i=0; i<device->inputChannels; i++ ) {
+                    memcpy(device->inputBuffer->mBuffers[i].mData, fileAudio->mBuffers[i].mData, frames * sizeof(float));
+                }
+            }
+            __unsafe_unretained AKKAAEIOAudioUnitInputGeneratorBlock generator
+                = (__bridge AKKAAEIOAudioUnitInputGeneratorBlock)AKKAAEManagedValueGetValue(THIS->_inputGeneratorValue);
+            if ( generator ) generator(device->inputBuffer, frames, &timestamp);
+            THIS->_inputTimestamp = timestamp;
+        }
+        
+        if ( device->outputBuffer ) {
+            AKKAAEAudioBufferListSilence(device->outputBuffer, 0, frames);
+            __unsafe_unretained AKKAAEIOAudioUnitRenderBlock renderBlock
+                = (__bridge AKKAAEIOAudioUnitRenderBlock)AKKAAEManagedValueGetValue(THIS->_renderBlockValue);
+            if ( renderBlock ) renderBlock(device->outputBuffer, frames, &timestamp);
+        }
+        
+        // 截止时间是下一个周期开始的时间；自由运行时从这个周期实际开始时算
+        AKKAAEHostTicks end = AKKAAECurrentTimeInHostTicks();
+        AKKAAEHostTicks deadline = (realtime ? scheduled : start) + period;
+        AKKAAEIOAudioUnitCounterAdd(&device->cycles, 1);
+        AKKAAEIOAudioUnitCounterMax(&device->longestRenderTicks, end - start);
+        if ( end > deadline ) {
+            AKKAAEIOAudioUnitCounterAdd(&device->deadlineMisses, 1);
+            AKKAAEIOAudioUnitCounterMax(&device->maximumLatenessTicks, end - deadline);
+        }
+        
+        device->sampleTime += frames;
+        cycle++;
+    }
 
+    return NULL;
+}
 
 @end
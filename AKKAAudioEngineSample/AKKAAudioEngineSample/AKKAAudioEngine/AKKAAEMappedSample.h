@@ -0,0 +1,162 @@
+//
+//  AKKAAEMappedSample.h
+//  AKKAAudioEngineSample
+//
+//  Created by 张一鸣 on 2016/12/16.
+//  Copyright © 2016年 AKKA. All rights reserved.
+//
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#import <Foundation/Foundation.h>
+#import <AudioToolbox/AudioToolbox.h>
+
+typedef struct AKKAAEMappedSample AKKAAEMappedSample;
+
+/*!
+ * Write a mapped sample cache file
+ *
+ *  Decodes an audio file readable by AKKAAEAudioFileOpen into a cache file that holds the audio
+ *  in the engine's non-interleaved float format, one page-aligned run per channel, ready to be
+ *  mapped by AKKAAEMappedSampleOpen. The audio is decoded straight into a mapping of the new
+ *  file, which is moved into place once complete.
+ *
+ *  Use this function on a background thread; it reads and writes the whole file.
+ *
+ * @param sourceURL The audio file to decode
+ * @param cacheURL Where to write the cache file
+ * @param error If not NULL, the error on output
+ * @return YES on success
+ */
+BOOL AKKAAEMappedSampleWriteCache(NSURL * _Nonnull sourceURL, NSURL * _Nonnull cacheURL, NSError * _Nullable * _Nullable error);
+
+/*!
+ * Map a sample cache file
+ *
+ *  A mapped sample plays straight from the page cache: instead of decoding a whole library into
+ *  heap buffers, each sample costs only the pages actually being played, and opening is
+ *  immediate. AKKAAEMappedSampleGetAudio hands out buffer lists that point into the mapping, with
+ *  no copy, for use with AKKAAEBufferStackPushExternal.
+ *
+ *  把采样 mmap 进来直接播放，不再整个解码到堆上；只有正在播放的页面占内存。
+ *
+ *  To keep the render thread from taking page faults, the pages ahead of the play head are
+ *  prefetched on a background thread as it moves (see AKKAAEMappedSampleSetPlayhead), and
+ *  regions that must always be resident, like the start of a one-shot, can be pinned with
+ *  AKKAAEMappedSamplePin. The first prefetch window is loaded on open.
+ *
+ * @param cacheURL A file written by AKKAAEMappedSampleWriteCache
+ * @param error If not NULL, the error on output
+ * @return The mapped sample, or NULL on error
+ */
+AKKAAEMappedSample * _Nullable AKKAAEMappedSampleOpen(NSURL * _Nonnull cacheURL, NSError * _Nullable * _Nullable error);
+
+/*!
+ * Map a sample, writing its cache file first if needed
+ *
+ *  Uses the cache file if it is valid and newer than the source; otherwise rewrites it.
+ *
+ * @param sourceURL The audio file
+ * @param cacheURL The cache file for it
+ * @param error If not NULL, the error on output
+ * @return The mapped sample, or NULL on error
+ */
+AKKAAEMappedSample * _Nullable AKKAAEMappedSampleOpenWithCache(NSURL * _Nonnull sourceURL, NSURL * _Nonnull cacheURL,
+                                                               NSError * _Nullable * _Nullable error);
+
+/*!
+ * Unmap and free a mapped sample
+ *
+ *  Use this function on the main thread, once the render thread is done with the sample.
+ *
+ * @param sample The sample
+ */
+void AKKAAEMappedSampleFree(AKKAAEMappedSample * _Nonnull sample);
+
+/*!
+ * Get the format of the audio handed out by AKKAAEMappedSampleGetAudio
+ *
+ *  This is AKKAAEAudioDescription with the sample's channel count and rate, suitable for
+ *  AKKAAEAudioBufferListCreateOnStackWithFormat.
+ *
+ * @param sample The sample
+ * @return The audio format
+ */
+AudioStreamBasicDescription AKKAAEMappedSampleGetAudioDescription(const AKKAAEMappedSample * _Nonnull sample);
+
+/*!
+ * Get the length of the sample
+ *
+ * @param sample The sample
+ * @return Length in frames
+ */
+UInt64 AKKAAEMappedSampleGetLength(const AKKAAEMappedSample * _Nonnull sample);
+
+/*!
+ * Point a buffer list at the sample's audio
+ *
+ *  Sets each buffer's mData to the given position in the mapping, without copying. The audio is
+ *  read-only: push it with AKKAAEBufferStackPushExternal, which copies it into the stack's own
+ *  buffers only if something writes to it, such as AKKAAEBufferStackApplyFaders followed by a mix.
+ *
+ *  This function is realtime safe, as long as the range is resident (prefetched or pinned).
+ *
+ * @param sample The sample
+ * @param bufferList Buffer list with one buffer per channel, such as one created with
+ *  AKKAAEAudioBufferListCreateOnStackWithFormat and AKKAAEMappedSampleGetAudioDescription
+ * @param frame The first frame
+ * @param frames Number of frames
+ * @return Number of frames available, fewer than requested at the end of the sample
+ */
+UInt32 AKKAAEMappedSampleGetAudio(const AKKAAEMappedSample * _Nonnull sample, AudioBufferList * _Nonnull bufferList,
+                                  UInt64 frame, UInt32 frames);
+
+/*!
+ * Report the play head position, for prefetching
+ *
+ *  Call this from the render thread as the sample plays. When the play head moves outside, or
+ *  more than halfway through, the current prefetch window, the prefetch thread is woken to
+ *  advise and load the pages for the next window. This function is realtime safe.
+ *
+ * @param sample The sample
+ * @param frame The play head position
+ */
+void AKKAAEMappedSampleSetPlayhead(AKKAAEMappedSample * _Nonnull sample, UInt64 frame);
+
+/*!
+ * Set how far ahead of the play head to prefetch
+ *
+ * @param sample The sample
+ * @param frames Prefetch window, in frames (default two seconds)
+ */
+void AKKAAEMappedSampleSetPrefetchWindow(AKKAAEMappedSample * _Nonnull sample, UInt64 frames);
+
+/*!
+ * Pin a region in memory
+ *
+ *  Loads the region and locks it, so the render thread never faults on it, until unpinned.
+ *  Pinned memory counts against the process's locked memory limit.
+ *
+ *  Use this function on the main thread.
+ *
+ * @param sample The sample
+ * @param frame The first frame of the region
+ * @param frames Length of the region
+ * @return YES on success, NO if the memory couldn't be locked
+ */
+BOOL AKKAAEMappedSamplePin(AKKAAEMappedSample * _Nonnull sample, UInt64 frame, UInt64 frames);
+
+/*!
+ * Unpin a region pinned with AKKAAEMappedSamplePin
+ *
+ * @param sample The sample
+ * @param frame The first frame of the region
+ * @param frames Length of the region
+ */
+void AKKAAEMappedSampleUnpin(AKKAAEMappedSample * _Nonnull sample, UInt64 frame, UInt64 frames);
+
+#ifdef __cplusplus
+}
+#endif
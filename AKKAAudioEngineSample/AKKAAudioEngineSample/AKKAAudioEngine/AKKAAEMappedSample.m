@@ -0,0 +1,366 @@
+//
+//  AKKAAEMappedSample.m
+//  AKKAAudioEngineSample
+//
+//  Created by 张一鸣 on 2016/12/16.
+//  Copyright © 2016年 AKKA. All rights reserved.
+//
+
+#import "AKKAAEMappedSample.h"
+#import "AKKAAEAudioFile.h"
+#import "AKKAAEAudioBufferListUtilities.h"
+#import "AKKAAETypes.h"
+#import <sys/mman.h>
+#import <sys/stat.h>
+#import <fcntl.h>
+#import <unistd.h>
+#import <errno.h>
+#import <pthread.h>
+#import <stdatomic.h>
+#ifdef __APPLE__
+#import <mach/mach.h>
+#else
+#import <semaphore.h>
+#endif
+
+// Channel runs start on this boundary, which is a whole number of pages everywhere
+static const size_t kCacheAlignment = 16384;
+static const uint32_t kCacheVersion = 1;
+static const char kCacheMagic[8] = { 'A', 'K', 'K', 'A', 'A', 'E', 'M', 'S' };
+static const double kDefaultPrefetchSeconds = 2.0;
+static const UInt32 kCacheWriteFrames = 65536;
+
+// Wakes the prefetcher; signalling is realtime-safe (no locks, no allocation)
+#ifdef __APPLE__
+typedef semaphore_t AKKAAEMappedSampleSemaphore;
+#define AKKAAEMappedSampleSemaphoreInit(s) semaphore_create(mach_task_self(), (s), SYNC_POLICY_FIFO, 0)
+#define AKKAAEMappedSampleSemaphoreSignal(s) semaphore_signal(*(s))
+#define AKKAAEMappedSampleSemaphoreWait(s) semaphore_wait(*(s))
+#else
+typedef sem_t AKKAAEMappedSampleSemaphore;
+#define AKKAAEMappedSampleSemaphoreInit(s) sem_init((s), 0, 0)
+#define AKKAAEMappedSampleSemaphoreSignal(s) sem_post(s)
+#define AKKAAEMappedSampleSemaphoreWait(s) while ( sem_wait(s) != 0 )
+#endif
+
+// Cache file header; the file is only ever read on the machine that wrote it, so this is native byte order
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t channels;
+    double sampleRate;
+    uint64_t frames;
+    uint64_t channelStride;     // Bytes from the start of one channel's audio to the next
+} AKKAAEMappedSampleHeader;
+
+struct AKKAAEMappedSample {
+    uint8_t * mapping;
+    size_t mappingSize;
+    const uint8_t * audio;      // First channel's audio
+    size_t channelStride;
+    int channels;
+    double sampleRate;
+    UInt64 length;
+
+    _Atomic(UInt64) playhead;
+    _Atomic(UInt64) prefetchWindow;
+    _Atomic(UInt64) prefetchedFrom;
+    _Atomic(UInt64) prefetchedUntil;
+    _Atomic(BOOL) prefetchRequested;
+
+    struct AKKAAEMappedSample * next; // In the prefetch list, guarded by __prefetchMutex
+};
+
+static pthread_mutex_t __prefetchMutex = PTHREAD_MUTEX_INITIALIZER;
+static AKKAAEMappedSample * __prefetchList = NULL;
+static AKKAAEMappedSampleSemaphore __prefetchSemaphore;
+
+static void AKKAAEMappedSampleStartPrefetcher(void);
+static void AKKAAEMappedSamplePrefetch(AKKAAEMappedSample * sample, UInt64 frame);
+
+#pragma mark - Helpers
+
+static void AKKAAEMappedSampleSetError(NSError ** error, int code, NSString * description) {
+    if ( error ) {
+        *error = [NSError errorWithDomain:NSPOSIXErrorDomain code:code
+                                 userInfo:@{ NSLocalizedDescriptionKey: description }];
+    }
+}
+
+// The page-aligned memory range that holds some frames of one channel
+static void AKKAAEMappedSampleGetRange(const AKKAAEMappedSample * sample, int channel, UInt64 frame, UInt64 frames,
+                                       uint8_t ** start, size_t * length) {
+    uintptr_t pageMask = (uintptr_t)getpagesize() - 1;
+    uintptr_t begin = (uintptr_t)(sample->audio + (channel * sample->channelStride) + (frame * sizeof(float)));
+    uintptr_t end = begin + (uintptr_t)(frames * sizeof(float));
+    *start = (uint8_t *)(begin & ~pageMask);
+    *length = end - (begin & ~pageMask);
+}
+
+#pragma mark - Cache files
+
+BOOL AKKAAEMappedSampleWriteCache(NSURL * sourceURL, NSURL * cacheURL, NSError ** error) {
+    AudioStreamBasicDescription format;
+    UInt64 length;
+    AKKAAEAudioFile * source = AKKAAEAudioFileOpen(sourceURL, &format, &length, error);
+    if ( !source ) return NO;
+
+    size_t channelStride = ((length * sizeof(float)) + kCacheAlignment - 1) & ~(kCacheAlignment - 1);
+    size_t size = kCacheAlignment + (channelStride * format.mChannelsPerFrame);
+
+    // Decode into a temporary file, then move it into place, so a cache file is always complete
+    NSString * temporaryPath = [cacheURL.path stringByAppendingFormat:@".%d.tmp", getpid()];
+    int fd = open(temporaryPath.fileSystemRepresentation, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    uint8_t * mapping = MAP_FAILED;
+    if ( fd < 0 || ftruncate(fd, size) != 0
+            || (mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED ) {
+        AKKAAEMappedSampleSetError(error, errno, @"Couldn't create the cache file");
+        if ( fd >= 0 ) {
+            close(fd);
+            unlink(temporaryPath.fileSystemRepresentation);
+        }
+        AKKAAEAudioFileClose(source, NULL);
+        return NO;
+    }
+
+    // 直接解码到映射内存里，不经过中间缓冲区
+    BOOL success = YES;
+    AKKAAEAudioBufferListCreateOnStackWithFormat(target, format);
+    for ( UInt64 position = 0; position < length && success; ) {
+        UInt32 frames = (UInt32)MIN((UInt64)kCacheWriteFrames, length - position);
+        for ( int c=0; c<target->mNumberBuffers; c++ ) {
+            target->mBuffers[c].mData = mapping + kCacheAlignment + (c * channelStride) + (position * sizeof(float));
+            target->mBuffers[c].mDataByteSize = frames * sizeof(float);
+        }
+        success = AKKAAEAudioFileRead(source, target, frames) == frames;
+        position += frames;
+    }
+    AKKAAEAudioFileClose(source, NULL);
+
+    // The header goes in last
+    AKKAAEMappedSampleHeader header = {
+        .version = kCacheVersion,
+        .channels = format.mChannelsPerFrame,
+        .sampleRate = format.mSampleRate,
+        .frames = length,
+        .channelStride = channelStride,
+    };
+    memcpy(header.magic, kCacheMagic, sizeof(header.magic));
+    memcpy(mapping, &header, sizeof(header));
+
+    int code = success ? 0 : EIO;
+    if ( munmap(mapping, size) != 0 && !code ) code = errno;
+    if ( close(fd) != 0 && !code ) code = errno;
+    if ( !code && rename(temporaryPath.fileSystemRepresentation, cacheURL.fileSystemRepresentation) != 0 ) code = errno;
+    if ( code ) {
+        AKKAAEMappedSampleSetError(error, code, @"Couldn't write the cache file");
+        unlink(temporaryPath.fileSystemRepresentation);
+        return NO;
+    }
+    return YES;
+}
+
+AKKAAEMappedSample * AKKAAEMappedSampleOpen(NSURL * cacheURL, NSError ** error) {
+    int fd = open(cacheURL.fileSystemRepresentation, O_RDONLY);
+    if ( fd < 0 ) {
+        AKKAAEMappedSampleSetError(error, errno, @"Couldn't open the cache file");
+        return NULL;
+    }
+
+    struct stat status;
+    AKKAAEMappedSampleHeader header;
+    if ( fstat(fd, &status) != 0 || pread(fd, &header, sizeof(header), 0) != sizeof(header)
+            || memcmp(header.magic, kCacheMagic, sizeof(header.magic)) != 0 || header.version != kCacheVersion
+            || header.channels < 1 || header.sampleRate <= 0 || header.channelStride < header.frames * sizeof(float)
+            || (UInt64)status.st_size < kCacheAlignment + (header.channelStride * header.channels) ) {
+        AKKAAEMappedSampleSetError(error, EINVAL, @"Not a valid cache file");
+        close(fd);
+        return NULL;
+    }
+
+    size_t size = kCacheAlignment + (header.channelStride * header.channels);
+    uint8_t * mapping = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if ( mapping == MAP_FAILED ) {
+        AKKAAEMappedSampleSetError(error, errno, @"Couldn't map the cache file");
+        return NULL;
+    }
+
+    AKKAAEMappedSample * sample = (AKKAAEMappedSample *)calloc(1, sizeof(AKKAAEMappedSample));
+    sample->mapping = mapping;
+    sample->mappingSize = size;
+    sample->audio = mapping + kCacheAlignment;
+    sample->channelStride = header.channelStride;
+    sample->channels = header.channels;
+    sample->sampleRate = header.sampleRate;
+    sample->length = header.frames;
+    atomic_init(&sample->playhead, 0);
+    atomic_init(&sample->prefetchWindow, (UInt64)(kDefaultPrefetchSeconds * header.sampleRate));
+    atomic_init(&sample->prefetchedFrom, 0);
+    atomic_init(&sample->prefetchedUntil, 0);
+    atomic_init(&sample->prefetchRequested, NO);
+
+    // Load the start now, so the first trigger doesn't fault
+    AKKAAEMappedSamplePrefetch(sample, 0);
+
+    AKKAAEMappedSampleStartPrefetcher();
+    pthread_mutex_lock(&__prefetchMutex);
+    sample->next = __prefetchList;
+    __prefetchList = sample;
+    pthread_mutex_unlock(&__prefetchMutex);
+
+    return sample;
+}
+
+AKKAAEMappedSample * AKKAAEMappedSampleOpenWithCache(NSURL * sourceURL, NSURL * cacheURL, NSError ** error) {
+    struct stat sourceStatus, cacheStatus;
+    if ( stat(sourceURL.fileSystemRepresentation, &sourceStatus) == 0 && stat(cacheURL.fileSystemRepresentation, &cacheStatus) == 0
+            && cacheStatus.st_mtime >= sourceStatus.st_mtime ) {
+        AKKAAEMappedSample * sample = AKKAAEMappedSampleOpen(cacheURL, NULL);
+        if ( sample ) return sample;
+    }
+
+    if ( !AKKAAEMappedSampleWriteCache(sourceURL, cacheURL, error) ) return NULL;
+    return AKKAAEMappedSampleOpen(cacheURL, error);
+}
+
+void AKKAAEMappedSampleFree(AKKAAEMappedSample * sample) {
+    // Once it's off the list the prefetcher can't be touching it
+    pthread_mutex_lock(&__prefetchMutex);
+    for ( AKKAAEMappedSample ** link = &__prefetchList; *link; link = &(*link)->next ) {
+        if ( *link == sample ) {
+            *link = sample->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&__prefetchMutex);
+
+    munmap(sample->mapping, sample->mappingSize);
+    free(sample);
+}
+
+#pragma mark - Audio
+
+AudioStreamBasicDescription AKKAAEMappedSampleGetAudioDescription(const AKKAAEMappedSample * sample) {
+    return AKKAAEAudioDescriptionWithChannelsAndRate(sample->channels, sample->sampleRate);
+}
+
+UInt64 AKKAAEMappedSampleGetLength(const AKKAAEMappedSample * sample) {
+    return sample->length;
+}
+
+UInt32 AKKAAEMappedSampleGetAudio(const AKKAAEMappedSample * sample, AudioBufferList * bufferList, UInt64 frame, UInt32 frames) {
+    if ( frame >= sample->length ) return 0;
+    UInt32 count = (UInt32)MIN((UInt64)frames, sample->length - frame);
+    for ( int c=0; c<MIN((int)bufferList->mNumberBuffers, sample->channels); c++ ) {
+        bufferList->mBuffers[c].mData = (void *)(sample->audio + (c * sample->channelStride) + (frame * sizeof(float)));
+        bufferList->mBuffers[c].mDataByteSize = count * sizeof(float);
+        bufferList->mBuffers[c].mNumberChannels = 1;
+    }
+    return count;
+}
+
+#pragma mark - Prefetching and pinning
+
+void AKKAAEMappedSampleSetPlayhead(AKKAAEMappedSample * sample, UInt64 frame) {
+    atomic_store_explicit(&sample->playhead, frame, memory_order_relaxed);
+
+    UInt64 from = atomic_load_explicit(&sample->prefetchedFrom, memory_order_relaxed);
+    UInt64 until = atomic_load_explicit(&sample->prefetchedUntil, memory_order_relaxed);
+    UInt64 window = atomic_load_explicit(&sample->prefetchWindow, memory_order_relaxed);
+    if ( frame < from || (until < sample->length && frame + (window / 2) > until) ) {
+        // Only one wake-up per request, however many cycles it takes to serve
+        if ( !atomic_exchange_explicit(&sample->prefetchRequested, YES, memory_order_acq_rel) ) {
+            AKKAAEMappedSampleSemaphoreSignal(&__prefetchSemaphore);
+        }
+    }
+}
+
+void AKKAAEMappedSampleSetPrefetchWindow(AKKAAEMappedSample * sample, UInt64 frames) {
+    atomic_store_explicit(&sample->prefetchWindow, MAX(frames, (UInt64)1), memory_order_relaxed);
+}
+
+BOOL AKKAAEMappedSamplePin(AKKAAEMappedSample * sample, UInt64 frame, UInt64 frames) {
+    if ( frame >= sample->length ) return YES;
+    frames = MIN(frames, sample->length - frame);
+    for ( int c=0; c<sample->channels; c++ ) {
+        uint8_t * start;
+        size_t length;
+        AKKAAEMappedSampleGetRange(sample, c, frame, frames, &start, &length);
+        if ( mlock(start, length) != 0 ) {
+            if ( c > 0 ) AKKAAEMappedSampleUnpin(sample, frame, frames);
+            return NO;
+        }
+    }
+    return YES;
+}
+
+void AKKAAEMappedSampleUnpin(AKKAAEMappedSample * sample, UInt64 frame, UInt64 frames) {
+    if ( frame >= sample->length ) return;
+    frames = MIN(frames, sample->length - frame);
+    for ( int c=0; c<sample->channels; c++ ) {
+        uint8_t * start;
+        size_t length;
+        AKKAAEMappedSampleGetRange(sample, c, frame, frames, &start, &length);
+        munlock(start, length);
+    }
+}
+
+/*!
+ * Make the window from a frame resident
+ *
+ *  madvise starts the reads for the whole window at once; touching each page then waits for them,
+ *  so that the render thread finds every page already mapped.
+ */
+static void AKKAAEMappedSamplePrefetch(AKKAAEMappedSample * sample, UInt64 frame) {
+    frame = MIN(frame, sample->length);
+    UInt64 end = MIN(frame + atomic_load_explicit(&sample->prefetchWindow, memory_order_relaxed), sample->length);
+    size_t pageSize = (size_t)getpagesize();
+
+    for ( int c=0; c<sample->channels && end > frame; c++ ) {
+        uint8_t * start;
+        size_t length;
+        AKKAAEMappedSampleGetRange(sample, c, frame, end - frame, &start, &length);
+        madvise(start, length, MADV_WILLNEED);
+    }
+    for ( int c=0; c<sample->channels && end > frame; c++ ) {
+        uint8_t * start;
+        size_t length;
+        AKKAAEMappedSampleGetRange(sample, c, frame, end - frame, &start, &length);
+        for ( size_t offset = 0; offset < length; offset += pageSize ) {
+            (void)*(volatile const uint8_t *)(start + offset);
+        }
+    }
+
+    atomic_store_explicit(&sample->prefetchedFrom, frame, memory_order_relaxed);
+    atomic_store_explicit(&sample->prefetchedUntil, end, memory_order_relaxed);
+}
+
+static void * AKKAAEMappedSamplePrefetchThread(void * userInfo) {
+#ifdef __APPLE__
+    pthread_setname_np("com.akka.audioengine.mapped-sample-prefetcher");
+    pthread_set_qos_class_self_np(QOS_CLASS_USER_INITIATED, 0);
+#endif
+
+    while ( 1 ) {
+        AKKAAEMappedSampleSemaphoreWait(&__prefetchSemaphore);
+        pthread_mutex_lock(&__prefetchMutex);
+        for ( AKKAAEMappedSample * sample = __prefetchList; sample; sample = sample->next ) {
+            if ( atomic_exchange_explicit(&sample->prefetchRequested, NO, memory_order_acq_rel) ) {
+                AKKAAEMappedSamplePrefetch(sample, atomic_load_explicit(&sample->playhead, memory_order_relaxed));
+            }
+        }
+        pthread_mutex_unlock(&__prefetchMutex);
+    }
+    return NULL;
+}
+
+static void AKKAAEMappedSampleStartPrefetcher(void) {
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        AKKAAEMappedSampleSemaphoreInit(&__prefetchSemaphore);
+        pthread_t thread;
+        pthread_create(&thread, NULL, AKKAAEMappedSamplePrefetchThread, NULL);
+        pthread_detach(thread);
+    });
+}
@@ -0,0 +1,170 @@
+//
+//  AKKAAEResampler.h
+//  AKKAAudioEngineSample
+//
+//  Created by 张一鸣 on 2016/12/16.
+//  Copyright © 2016年 AKKA. All rights reserved.
+//
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#import <Foundation/Foundation.h>
+#import <AudioToolbox/AudioToolbox.h>
+#import "AKKARenderContext.h"
+
+/*!
+ * Resampler quality
+ *
+ *  Each tier is a Kaiser-windowed sinc filter with the stopband starting at the lower rate's
+ *  Nyquist frequency, so nothing aliases above the stopband attenuation. More taps give a narrower
+ *  transition band, so a higher passband edge, at proportionally more CPU. When downsampling, the
+ *  filter is widened by the ratio to keep the same quality.
+ */
+typedef NS_ENUM(NSInteger, AKKAAEResamplerQuality) {
+    AKKAAEResamplerQualityLow,          //!< 8 taps, 50 dB stopband, passband to ~63% of Nyquist: previews and varispeed
+    AKKAAEResamplerQualityMedium,       //!< 16 taps, 70 dB stopband, passband to ~73% of Nyquist
+    AKKAAEResamplerQualityHigh,         //!< 32 taps, 90 dB stopband, passband to ~82% of Nyquist: playback
+    AKKAAEResamplerQualityMastering,    //!< 64 taps, 110 dB stopband, passband to ~89% of Nyquist: offline rendering
+};
+
+typedef struct AKKAAEResampler AKKAAEResampler;
+
+/*!
+ * Source function for AKKAAEResamplerRender
+ *
+ *  Push one buffer onto context->stack holding context->frames frames at the resampler's input rate,
+ *  context->sampleRate. The context has no output: don't use AKKAAERenderContextOutput.
+ *
+ * @param userInfo The pointer passed to AKKAAEResamplerRender
+ * @param context The render context, at the input rate
+ */
+typedef void (*AKKAAEResamplerSourceFunction)(void * _Nullable userInfo, const AKKAAERenderContext * _Nonnull context);
+
+/*!
+ * Create a resampler
+ *
+ *  A polyphase windowed-sinc sample-rate converter for any ratio. The filter is tabulated in
+ *  polyphase form, and each output frame's filter is interpolated between the two nearest phases,
+ *  so any ratio, even an irrational one, gets a correctly placed filter. The inner product runs on
+ *  the SIMD kernel layer (AKKAAEDSPKernels interpolatedDot).
+ *
+ *  多相加窗 sinc 重采样，任意比例；每个声道保存自己的历史，可以分块流式处理。
+ *
+ *  The read position is 32.32 fixed point, so the input and output frame counts stay exactly in
+ *  step however long the stream runs. Each channel keeps its own history, so audio can be fed in
+ *  blocks of any size. Output frame n is the input at time n * inputRate / outputRate, but it can
+ *  only be made once the input has run half a filter length past that time;
+ *  AKKAAEResamplerGetLatency gives how far.
+ *
+ *  Use this function on the main thread.
+ *
+ * @param inputRate The input sample rate
+ * @param outputRate The output sample rate
+ * @param channelCount Number of channels
+ * @param quality The quality tier
+ * @return The new resampler
+ */
+AKKAAEResampler * _Nonnull AKKAAEResamplerNew(double inputRate, double outputRate, int channelCount, AKKAAEResamplerQuality quality);
+
+/*!
+ * Free a resampler
+ *
+ * @param resampler The resampler
+ */
+void AKKAAEResamplerFree(AKKAAEResampler * _Nonnull resampler);
+
+/*!
+ * Clear the resampler's history
+ *
+ *  Use this when the input jumps, such as after a seek, so the old audio doesn't ring into the new.
+ *  This function is realtime safe.
+ *
+ * @param resampler The resampler
+ */
+void AKKAAEResamplerReset(AKKAAEResampler * _Nonnull resampler);
+
+/*!
+ * Get the resampler's latency
+ *
+ *  How far the input must run ahead of the output: half the filter length. Fed in step,
+ *  AKKAAEResamplerProcess yields this much less output than the input covers, and
+ *  AKKAAEResamplerRender pulls its source this much ahead of the output.
+ *
+ * @param resampler The resampler
+ * @return The latency, in output frames
+ */
+double AKKAAEResamplerGetLatency(const AKKAAEResampler * _Nonnull resampler);
+
+/*!
+ * Get the number of input frames needed for an amount of output
+ *
+ *  This function is realtime safe.
+ *
+ * @param resampler The resampler
+ * @param outputFrames Number of output frames wanted
+ * @return The number of input frames AKKAAEResamplerProcess needs to produce exactly that many output frames
+ */
+UInt32 AKKAAEResamplerGetInputFramesForOutput(const AKKAAEResampler * _Nonnull resampler, UInt32 outputFrames);
+
+/*!
+ * Get the number of output frames an amount of input will produce
+ *
+ *  This function is realtime safe.
+ *
+ * @param resampler The resampler
+ * @param inputFrames Number of input frames
+ * @return The number of output frames AKKAAEResamplerProcess will produce, given room for them
+ */
+UInt32 AKKAAEResamplerGetOutputFramesForInput(const AKKAAEResampler * _Nonnull resampler, UInt32 inputFrames);
+
+/*!
+ * Resample audio
+ *
+ *  Takes in as much of the input as it can, and produces as much output as that input allows,
+ *  up to outputFrames. Input that can't be used yet stays in the resampler's history for the next
+ *  call. If the input has fewer channels than the resampler, its last channel is used for the rest.
+ *
+ *  This function is realtime safe.
+ *
+ * @param resampler The resampler
+ * @param input Non-interleaved float audio at the input rate
+ * @param ioInputFrames On input, the number of input frames; on output, the number taken in
+ * @param output Non-interleaved float buffer list with the resampler's channel count, and room for outputFrames
+ * @param outputFrames Room in the output, in frames
+ * @return Number of output frames produced
+ */
+UInt32 AKKAAEResamplerProcess(AKKAAEResampler * _Nonnull resampler,
+                              const AudioBufferList * _Nonnull input, UInt32 * _Nonnull ioInputFrames,
+                              const AudioBufferList * _Nonnull output, UInt32 outputFrames);
+
+/*!
+ * Render a source through the resampler, onto the stack
+ *
+ *  Pushes one buffer of context->frames frames at the output rate, with the resampler's channel
+ *  count. To fill it, works out how much input is needed, about context->frames * inputRate /
+ *  outputRate, and calls the source to push that much onto the stack at the input rate, then
+ *  takes it off again. When downsampling, that can be more than the stack's maximum frames per
+ *  slice, so the source is called several times, a slice at a time. If the source doesn't push
+ *  anything, silence is used.
+ *  降采样时需要的输入可能超过一个切片，会分几次调用 source。
+ *
+ *  The source must only push onto the stack, not take off buffers that were there before it.
+ *
+ *  This function is realtime safe.
+ *
+ * @param resampler The resampler
+ * @param context The render context, at the output rate
+ * @param source The function that renders the input
+ * @param userInfo Pointer to pass to the source
+ * @return The resampled buffer, or NULL if the stack is full
+ */
+const AudioBufferList * _Nullable AKKAAEResamplerRender(AKKAAEResampler * _Nonnull resampler,
+                                                        const AKKAAERenderContext * _Nonnull context,
+                                                        AKKAAEResamplerSourceFunction _Nonnull source,
+                                                        void * _Nullable userInfo);
+
+#ifdef __cplusplus
+}
+#endif
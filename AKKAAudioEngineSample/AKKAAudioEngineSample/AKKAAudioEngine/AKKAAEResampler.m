@@ -0,0 +1,290 @@
+//
+//  AKKAAEResampler.m
+//  AKKAAudioEngineSample
+//
+//  Created by 张一鸣 on 2016/12/16.
+//  Copyright © 2016年 AKKA. All rights reserved.
+//
+
+#import "AKKAAEResampler.h"
+#import "AKKAAEDSPKernels.h"
+#import "AKKAAEAudioBufferListUtilities.h"
+
+static const UInt32 kHistoryFrames = 4096;      // Input taken in per refill, beyond the filter length
+static const double kMinimumScale = 1.0 / 16.0; // Widest filter, when downsampling: 16x its taps
+
+typedef struct {
+    int taps;           // Filter length at 1:1
+    double attenuation; // Stopband attenuation, dB
+    int phases;         // Tabulated phases; the interpolation between them is good to ~(1/phases)^2
+} AKKAAEResamplerTier;
+
+static const AKKAAEResamplerTier kTiers[] = {
+    [AKKAAEResamplerQualityLow]         = { 8,  50,  64 },
+    [AKKAAEResamplerQualityMedium]      = { 16, 70,  128 },
+    [AKKAAEResamplerQualityHigh]        = { 32, 90,  256 },
+    [AKKAAEResamplerQualityMastering]   = { 64, 110, 1024 },
+};
+
+// 历史缓冲里 position 的整数部分是当前滤波窗口的起点，小数部分决定相位
+struct AKKAAEResampler {
+    double inputRate;
+    double outputRate;
+    int channelCount;
+    int taps;               // Filter length in input frames, a multiple of 8
+    int phases;
+    float * coefficients;   // phases rows of taps coefficients
+    float * deltas;         // Per row, the step to the next phase's coefficients
+    UInt64 step;            // Input frames per output frame, 32.32 fixed point
+    UInt64 position;        // Read position in the history, 32.32 fixed point
+    UInt32 filled;          // Frames in the history
+    UInt32 capacity;        // History length, per channel
+    float ** history;
+    Float64 inputSampleTime;// Source timeline, for AKKAAEResamplerRender
+};
+
+static double AKKAAEResamplerBesselI0(double x) {
+    // Power series; converges quickly for the betas used here (< 12)
+    double sum = 1.0, term = 1.0, y = x * x / 4.0;
+    for ( int k=1; k<64 && term > sum * 1e-17; k++ ) {
+        term *= y / ((double)k * k);
+        sum += term;
+    }
+    return sum;
+}
+
+static void AKKAAEResamplerBuildFilter(AKKAAEResampler * resampler, const AKKAAEResamplerTier * tier, double scale) {
+    int taps = resampler->taps, phases = resampler->phases;
+    double attenuation = tier->attenuation;
+    double beta = attenuation > 50 ? 0.1102 * (attenuation - 8.7)
+                : 0.5842 * pow(attenuation - 21, 0.4) + 0.07886 * (attenuation - 21);
+
+    // Kaiser's estimate of the transition width for the tier's length, as a fraction of Nyquist;
+    // the cutoff sits half of it below the stopband edge, which is the lower rate's Nyquist
+    double transition = 2.0 * (attenuation - 7.95) / (14.36 * tier->taps);
+    double cutoff = (1.0 - transition / 2.0) * scale;
+    double half = taps / 2.0, i0Beta = AKKAAEResamplerBesselI0(beta);
+
+    // Row p is the filter for fractional position p/phases; one extra row for the deltas
+    double * rows = (double *)malloc(sizeof(double) * (phases + 1) * taps);
+    for ( int p=0; p<=phases; p++ ) {
+        double * row = rows + (size_t)p * taps, sum = 0;
+        for ( int k=0; k<taps; k++ ) {
+            double t = (double)p / phases + half - 1 - k;
+            double x = cutoff * t, r = t / half;
+            double sinc = fabs(x) < 1e-12 ? 1.0 : sin(M_PI * x) / (M_PI * x);
+            double window = fabs(r) < 1.0 ? AKKAAEResamplerBesselI0(beta * sqrt(1.0 - r * r)) / i0Beta : 0.0;
+            row[k] = cutoff * sinc * window;
+            sum += row[k];
+        }
+        // Unity gain at DC for every phase
+        for ( int k=0; k<taps; k++ ) row[k] /= sum;
+    }
+    for ( int p=0; p<phases; p++ ) {
+        const double * row = rows + (size_t)p * taps, * next = row + taps;
+        for ( int k=0; k<taps; k++ ) {
+            resampler->coefficients[(size_t)p * taps + k] = row[k];
+            resampler->deltas[(size_t)p * taps + k] = next[k] - row[k];
+        }
+    }
+    free(rows);
+}
+
+AKKAAEResampler * AKKAAEResamplerNew(double inputRate, double outputRate, int channelCount, AKKAAEResamplerQuality quality) {
+    assert(inputRate > 0 && outputRate > 0 && channelCount > 0);
+    assert(quality >= AKKAAEResamplerQualityLow && quality <= AKKAAEResamplerQualityMastering);
+    const AKKAAEResamplerTier * tier = &kTiers[quality];
+
+    AKKAAEResampler * resampler = (AKKAAEResampler *)calloc(1, sizeof(AKKAAEResampler));
+    resampler->inputRate = inputRate;
+    resampler->outputRate = outputRate;
+    resampler->channelCount = channelCount;
+
+    // Downsampling lowers the cutoff, so the filter is widened by the same ratio
+    double scale = MAX(MIN(1.0, outputRate / inputRate), kMinimumScale);
+    resampler->taps = ((int)ceil(tier->taps / scale) + 7) & ~7;
+    resampler->phases = tier->phases;
+    resampler->coefficients = (float *)malloc(sizeof(float) * resampler->phases * resampler->taps);
+    resampler->deltas = (float *)malloc(sizeof(float) * resampler->phases * resampler->taps);
+    AKKAAEResamplerBuildFilter(resampler, tier, scale);
+
+    resampler->step = (UInt64)llround(inputRate / outputRate * 4294967296.0);
+    resampler->capacity = resampler->taps + kHistoryFrames;
+    resampler->history = (float **)malloc(sizeof(float *) * channelCount);
+    for ( int i=0; i<channelCount; i++ ) {
+        resampler->history[i] = (float *)malloc(sizeof(float) * resampler->capacity);
+    }
+    AKKAAEResamplerReset(resampler);
+    return resampler;
+}
+
+void AKKAAEResamplerFree(AKKAAEResampler * resampler) {
+    for ( int i=0; i<resampler->channelCount; i++ ) {
+        free(resampler->history[i]);
+    }
+    free(resampler->history);
+    free(resampler->coefficients);
+    free(resampler->deltas);
+    free(resampler);
+}
+
+void AKKAAEResamplerReset(AKKAAEResampler * resampler) {
+    // Prime with silence so the first output frame lines up with the first input frame
+    resampler->filled = resampler->taps / 2 - 1;
+    for ( int i=0; i<resampler->channelCount; i++ ) {
+        memset(resampler->history[i], 0, sizeof(float) * resampler->filled);
+    }
+    resampler->position = 0;
+    resampler->inputSampleTime = 0;
+}
+
+double AKKAAEResamplerGetLatency(const AKKAAEResampler * resampler) {
+    return (resampler->taps / 2) * resampler->outputRate / resampler->inputRate;
+}
+
+UInt32 AKKAAEResamplerGetInputFramesForOutput(const AKKAAEResampler * resampler, UInt32 outputFrames) {
+    if ( outputFrames == 0 ) return 0;
+    UInt64 last = (resampler->position + (outputFrames - 1) * resampler->step) >> 32;
+    UInt64 needed = last + resampler->taps;
+    return needed > resampler->filled ? (UInt32)(needed - resampler->filled) : 0;
+}
+
+UInt32 AKKAAEResamplerGetOutputFramesForInput(const AKKAAEResampler * resampler, UInt32 inputFrames) {
+    UInt64 total = (UInt64)resampler->filled + inputFrames;
+    if ( total < (UInt64)resampler->taps ) return 0;
+
+    // Output k is possible while its window start, (position + k * step) >> 32, is at most total - taps
+    UInt64 end = (total - resampler->taps + 1) << 32;
+    if ( end <= resampler->position ) return 0;
+    return (UInt32)((end - resampler->position + resampler->step - 1) / resampler->step);
+}
+
+static UInt32 AKKAAEResamplerRun(AKKAAEResampler * resampler, const AKKAAEDSPKernels * kernels,
+                                 const AudioBufferList * output, UInt32 offset, UInt32 frames) {
+    const int taps = resampler->taps;
+    const UInt64 phases = resampler->phases;
+    UInt32 produced = 0;
+    while ( produced < frames ) {
+        UInt64 start = resampler->position >> 32;
+        if ( start + taps > resampler->filled ) break;
+
+        // Top bits of the fraction pick the phase, the rest interpolate toward the next one
+        UInt64 phasePosition = (resampler->position & 0xFFFFFFFF) * phases;
+        size_t row = (size_t)(phasePosition >> 32) * taps;
+        float fraction = (float)((phasePosition & 0xFFFFFFFF) * (1.0 / 4294967296.0));
+        const float * coefficients = resampler->coefficients + row;
+        const float * deltas = resampler->deltas + row;
+        for ( int i=0; i<resampler->channelCount; i++ ) {
+            ((float *)output->mBuffers[i].mData)[offset + produced] =
+                kernels->interpolatedDot(resampler->history[i] + start, coefficients, deltas, fraction, taps);
+        }
+        resampler->position += resampler->step;
+        produced++;
+    }
+    return produced;
+}
+
+static void AKKAAEResamplerCompact(AKKAAEResampler * resampler) {
+    // Drop the frames before the current window
+    UInt32 start = (UInt32)MIN(resampler->position >> 32, (UInt64)resampler->filled);
+    if ( start == 0 ) return;
+    for ( int i=0; i<resampler->channelCount; i++ ) {
+        memmove(resampler->history[i], resampler->history[i] + start, sizeof(float) * (resampler->filled - start));
+    }
+    resampler->filled -= start;
+    resampler->position -= (UInt64)start << 32;
+}
+
+// AKKAAEResamplerProcess, writing the output from the given frame on
+static UInt32 AKKAAEResamplerProcessAtOffset(AKKAAEResampler * resampler, const AKKAAEDSPKernels * kernels,
+                                             const AudioBufferList * input, UInt32 * ioInputFrames,
+                                             const AudioBufferList * output, UInt32 offset, UInt32 outputFrames) {
+    UInt32 inputFrames = *ioInputFrames, taken = 0, produced = 0;
+    while ( 1 ) {
+        produced += AKKAAEResamplerRun(resampler, kernels, output, offset + produced, outputFrames - produced);
+        if ( produced == outputFrames || taken == inputFrames ) break;
+
+        // Out of history: make room and take in more input. After compacting, less than a filter
+        // length is left, so there's always room
+        AKKAAEResamplerCompact(resampler);
+        UInt32 frames = MIN(resampler->capacity - resampler->filled, inputFrames - taken);
+        for ( int i=0; i<resampler->channelCount; i++ ) {
+            const float * source = (const float *)input->mBuffers[MIN(i, (int)input->mNumberBuffers - 1)].mData;
+            memcpy(resampler->history[i] + resampler->filled, source + taken, sizeof(float) * frames);
+        }
+        resampler->filled += frames;
+        taken += frames;
+    }
+    *ioInputFrames = taken;
+    return produced;
+}
+
+UInt32 AKKAAEResamplerProcess(AKKAAEResampler * resampler,
+                              const AudioBufferList * input, UInt32 * ioInputFrames,
+                              const AudioBufferList * output, UInt32 outputFrames) {
+    assert(output->mNumberBuffers >= resampler->channelCount);
+    return AKKAAEResamplerProcessAtOffset(resampler, AKKAAEDSPKernelsGet(), input, ioInputFrames, output, 0, outputFrames);
+}
+
+const AudioBufferList * AKKAAEResamplerRender(AKKAAEResampler * resampler,
+                                              const AKKAAERenderContext * context,
+                                              AKKAAEResamplerSourceFunction source,
+                                              void * userInfo) {
+    AKKAAEBufferStack * stack = context->stack;
+    const AudioBufferList * output = AKKAAEBufferStackPushWithChannels(stack, 1, resampler->channelCount);
+    if ( !output ) return NULL;
+
+    // Pull the source at the input rate, on its own timeline, a slice at a time until the history covers
+    // the whole output: downsampling needs more input than the stack can hold in one buffer
+    const AKKAAEDSPKernels * kernels = AKKAAEDSPKernelsGet();
+    UInt32 maxFrames = AKKAAEBufferStackGetMaxFramesPerSlice(stack);
+    UInt32 frameCount = AKKAAEBufferStackGetFrameCount(stack);
+    UInt32 produced = 0;
+    while ( produced < context->frames ) {
+        UInt32 needed = AKKAAEResamplerGetInputFramesForOutput(resampler, context->frames - produced);
+        if ( needed > maxFrames ) {
+            // Even slices, rather than full ones and a scrap
+            UInt32 slices = (needed + maxFrames - 1) / maxFrames;
+            needed = (needed + slices - 1) / slices;
+        }
+        if ( needed == 0 ) {
+            produced += AKKAAEResamplerRun(resampler, kernels, output, produced, context->frames - produced);
+            break;
+        }
+
+        int count = AKKAAEBufferStackCount(stack);
+        AKKAAEBufferStackSetFrameCount(stack, needed);
+        AudioTimeStamp timestamp = *context->timestamp;
+        timestamp.mSampleTime = resampler->inputSampleTime;
+        AKKAAERenderContext inputContext = {
+            .output = NULL,
+            .frames = needed,
+            .sampleRate = resampler->inputRate,
+            .timestamp = &timestamp,
+            .offlineRendering = context->offlineRendering,
+            .stack = stack,
+        };
+        source(userInfo, &inputContext);
+        const AudioBufferList * input;
+        if ( AKKAAEBufferStackCount(stack) > count ) {
+            AKKAAEBufferStackMaterialize(stack, 0);
+            input = AKKAAEBufferStackGet(stack, 0);
+        } else {
+            input = AKKAAEBufferStackPushWithChannels(stack, 1, resampler->channelCount);
+            if ( input ) AKKAAEAudioBufferListSilence(input, 0, needed);
+        }
+        AKKAAEBufferStackSetFrameCount(stack, frameCount);
+        if ( !input ) break;
+        resampler->inputSampleTime += needed;
+
+        UInt32 inputFrames = needed;
+        produced += AKKAAEResamplerProcessAtOffset(resampler, kernels, input, &inputFrames, output, produced,
+                                                   context->frames - produced);
+        AKKAAEBufferStackPop(stack, AKKAAEBufferStackCount(stack) - count);
+    }
+    if ( produced < context->frames ) {
+        // Only if the stack filled up
+        AKKAAEAudioBufferListSilence(output, produced, context->frames - produced);
+    }
+    return output;
+}
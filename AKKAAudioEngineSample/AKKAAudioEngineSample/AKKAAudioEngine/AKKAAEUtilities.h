@@ -71,6 +71,9 @@ static inline BOOL _AKKAAECheckOSStatus(OSStatus result, const char * _Nonnull o
  *
  *  Finish writing and close the file by using `ExtAudioFileDispose` once you are done.
  *
+ *  For the PCM file types, AKKAAEAudioFileCreate is faster and doesn't need CoreAudio. To record
+ *  from the render thread, use AKKAAERecorder, which writes with either from a background thread.
+ *
  *  Use this function only on the main thread.
  *
  * @param url URL to the file to write to
@@ -115,6 +118,8 @@ ExtAudioFileRef _Nullable AKKAAEExtAudioFileCreate(NSURL * _Nonnull url,
  *  determined by the file format - this configured format is returned via the outAudioDescription parameter.
  *  Use kExtAudioFileProperty_ClientDataFormat to change this if required.
  *
+ *  For WAV and AIFF files, AKKAAEAudioFileOpen is faster and doesn't need CoreAudio.
+ *
  * @param url URL to the file to read from
  * @param outAudioDescription On output, the AEAudioDescription-derived stream format for reading (the client format)
  * @param outLengthInFrames On output, the total length in frames
@@ -168,6 +168,11 @@ typedef void (^AKKAAEArrayReleaseBlock)(id _Nonnull item, void * _Nonnull bytes)
  *  block will be called for all new values. Values in the new array that are also present in
  *  the prior array value will be maintained, and old values not present in the new array are released.
  *
+ *  Objects are matched by identity (pointer equality), not isEqual:, using a hash map of the current
+ *  objects, so an update takes time proportional to the array's length. An object that appears more
+ *  than once has one pointer value, shared by all its occurrences. To add, remove or replace a single
+ *  item in a large array, the incremental methods below are much cheaper.
+ *
  *  Using this method within an AEManagedValue
  *  @link AEManagedValue::performAtomicBatchUpdate: performAtomicBatchUpdate @endlink block
  *  will cause the update to occur atomically along with any other value updates.
@@ -179,6 +184,7 @@ typedef void (^AKKAAEArrayReleaseBlock)(id _Nonnull item, void * _Nonnull bytes)
          * 将保留新值，并以线程安全的方式释放旧值。
          * 如果在初始化实例时提供了自定义映射，则将为所有新值调用自定义映射块。
          * 新数组中也存在于先前数组值中的值将被保留，并且新数组中不存在的旧值被释放。
+         * 对象按指针（同一个对象）匹配，而不是 isEqual:；每个版本的数组都带一个哈希索引，所以更新是 O(n) 的。
          * @param array
          */
 - (void)updateWithContentsOfArray:(NSArray * _Nonnull)array;
@@ -211,6 +217,45 @@ typedef void (^AKKAAEArrayReleaseBlock)(id _Nonnull item, void * _Nonnull bytes)
 
 - (void)updateWithContentsOfArray:(NSArray * _Nonnull)array customMapping:(AKKAAEArrayIndexedCustomMappingBlock _Nullable)block;
 
+/*!
+ * Insert an object
+ *
+ *  The custom mapping block given when initializing the instance, if any, is called for the object
+ *  unless it's already in the array. Only the part of the array around the index is copied, so this
+ *  is cheap even for very large arrays. Like the update methods, the change is atomic with respect to
+ *  the audio thread, and can be used within an AEManagedValue performAtomicBatchUpdate: block.
+ *
+ *  插入一个对象。只复制插入位置附近的一块，对很大的数组也很快。
+ *
+ * @param object The object
+ * @param index The index to insert at, from 0 to count
+ */
+- (void)insertObject:(id _Nonnull)object atIndex:(int)index;
+
+/*!
+ * Remove the object at an index
+ *
+ *  If that was the object's last occurrence, its pointer value will be released in a thread-safe manner.
+ *  Only the part of the array around the index is copied.
+ *
+ *  删除给定位置的对象
+ *
+ * @param index The index of the object to remove
+ */
+- (void)removeObjectAtIndex:(int)index;
+
+/*!
+ * Replace the object at an index
+ *
+ *  Equivalent to a removal followed by an insertion, in one atomic change.
+ *
+ *  替换给定位置的对象
+ *
+ * @param index The index of the object to replace
+ * @param object The new object
+ */
+- (void)replaceObjectAtIndex:(int)index withObject:(id _Nonnull)object;
+
 /*!
  * Get the pointer value at the given index of the C array, as seen by the audio thread
  *
@@ -238,6 +283,8 @@ typedef void (^AKKAAEArrayReleaseBlock)(id _Nonnull item, void * _Nonnull bytes)
 /*!
  * Get the pointer value associated with the given object, if any
  *
+ *  The object is matched by identity, with a hash lookup.
+ *
  *  This method allows you to access the same values as the audio thread; if you are using
  *  a mapping block to create structures that correspond to objects in the original array,
  *  for instance, then you may access these structures using this method.
@@ -417,7 +464,7 @@ void * _Nullable AKKAAEArrayGetItem(AKKAAEArrayToken _Nonnull token, int index);
 //! Current object values
 @property (nonatomic, strong, readonly) NSArray * _Nonnull allValues;
 
-//! Block to perform when deleting old items, on main thread. If not specified, will simply use
+//! Block to perform when deleting old items, on AKKAAEManagedValue's reclaimer thread. If not specified, will simply use
 //! free() to dispose bytes, if pointer differs from original Objective-C pointer.
 @property (nonatomic, copy) AKKAAEArrayReleaseBlock _Nullable releaseBlock;
 
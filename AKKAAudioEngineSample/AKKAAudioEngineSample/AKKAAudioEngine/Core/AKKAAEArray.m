@@ -8,22 +8,198 @@
 
 #import "AKKAAEArray.h"
 #import "AKKAAEManagedValue.h"
+#import <stdatomic.h>
+
+enum {
+    kChunkCapacity = 64,
+    kChunkMinimumFill = 32,     // Chunks below this merge with a neighbour (unless there's only one)
+    kBucketShift = 5,           // One lookup bucket per 32 indices; no larger than kChunkMinimumFill
+};
 
 typedef struct {
     void * pointer; // 存储allvalues 中每个单个数据
-    int referenceCount;
+    _Atomic(int) referenceCount; // 旧数组在回收线程上释放，所以引用计数要原子操作
 } array_entry_t;
 
+// A run of items. Chunks never change once in a snapshot, so snapshots share them, and a
+// mutation only copies the chunks it touches. Each chunk holds a reference to its entries and objects.
+// 数组按块存储，快照之间共享没有改动的块；插入、删除、替换只复制受影响的块
+typedef struct {
+    _Atomic(int) referenceCount;
+    int count;
+    array_entry_t * entries[kChunkCapacity];
+    CFTypeRef objects[kChunkCapacity];
+} array_chunk_t;
+
+// A snapshot, as seen by the realtime thread. Every chunk but a lone one holds at least
+// kChunkMinimumFill items, so an index's bucket names its chunk or the one before it.
 typedef struct {
     int count;
-    __unsafe_unretained NSArray * objects;
-    array_entry_t * entries[1];
+    int chunkCount;
+    array_chunk_t ** chunks;
+    int * chunkStart;           // chunkCount + 1 values; the last is count
+    int * buckets;              // Chunk holding index (bucket << kBucketShift)
+    CFTypeRef allValues;        // NSArray of the objects, built on demand on the main thread
 }array_t;
 
-@interface AKKAAEArray ()
+// Main thread's map from object (by identity) to its entry; an object appearing more than once shares one entry
+// 主线程上对象到 entry 的哈希表，重复出现的对象共用一个 entry
+typedef struct {
+    CFTypeRef object;
+    array_entry_t * entry;
+    int occurrences;
+    int position;               // Index of an occurrence, when positions are valid
+} array_map_slot_t;
+
+typedef struct {
+    unsigned int mask;
+    int count;
+    array_map_slot_t * slots;
+} array_map_t;
+
+#pragma mark - Chunks and snapshots
+
+static void AKKAAEArrayChunkAppend(array_chunk_t * chunk, CFTypeRef object, array_entry_t * entry) {
+    chunk->objects[chunk->count] = CFRetain(object);
+    chunk->entries[chunk->count] = entry;
+    atomic_fetch_add_explicit(&entry->referenceCount, 1, memory_order_relaxed);
+    chunk->count++;
+}
+
+/*!
+ * Spread items evenly over as few chunks as possible
+ *
+ * @return Number of chunks created, each with no references until a snapshot takes one
+ */
+static int AKKAAEArrayChunksCreate(const CFTypeRef * objects, array_entry_t * const * entries, int count, array_chunk_t ** chunks) {
+    int chunkCount = (count + kChunkCapacity - 1) / kChunkCapacity;
+    for (int i = 0; i < chunkCount; i++) {
+        int start = (int)(((int64_t)count * i) / chunkCount);
+        int end = (int)(((int64_t)count * (i + 1)) / chunkCount);
+        chunks[i] = (array_chunk_t *)calloc(1, sizeof(array_chunk_t));
+        for (int j = start; j < end; j++) AKKAAEArrayChunkAppend(chunks[i], objects[j], entries[j]);
+    }
+    return chunkCount;
+}
+
+static array_t * AKKAAEArraySnapshotCreate(array_chunk_t * const * chunks, int chunkCount) {
+    int count = 0;
+    for (int i = 0; i < chunkCount; i++) count += chunks[i]->count;
+    int bucketCount = (count + (1 << kBucketShift) - 1) >> kBucketShift;
+
+    array_t * array = (array_t *)calloc(1, sizeof(array_t) + (sizeof(array_chunk_t *) * chunkCount)
+                                           + (sizeof(int) * (chunkCount + 1 + bucketCount)));
+    array->count = count;
+    array->chunkCount = chunkCount;
+    array->chunks = (array_chunk_t **)(array + 1);
+    array->chunkStart = (int *)(array->chunks + chunkCount);
+    array->buckets = array->chunkStart + chunkCount + 1;
+
+    int start = 0, bucket = 0;
+    for (int i = 0; i < chunkCount; i++) {
+        array->chunks[i] = chunks[i];
+        atomic_fetch_add_explicit(&chunks[i]->referenceCount, 1, memory_order_relaxed);
+        array->chunkStart[i] = start;
+        start += chunks[i]->count;
+        for (; bucket < bucketCount && (bucket << kBucketShift) < start; bucket++) array->buckets[bucket] = i;
+    }
+    array->chunkStart[chunkCount] = count;
+    return array;
+}
+
+/*!
+ * Create a snapshot with chunks [first, first + removeCount) replaced by the given chunks
+ */
+static array_t * AKKAAEArraySnapshotSplice(const array_t * array, int first, int removeCount,
+                                           array_chunk_t * const * chunks, int chunkCount) {
+    int newChunkCount = array->chunkCount - removeCount + chunkCount;
+    array_chunk_t ** newChunks = (array_chunk_t **)malloc(sizeof(array_chunk_t *) * MAX(newChunkCount, 1));
+    memcpy(newChunks, array->chunks, sizeof(array_chunk_t *) * first);
+    memcpy(newChunks + first, chunks, sizeof(array_chunk_t *) * chunkCount);
+    memcpy(newChunks + first + chunkCount, array->chunks + first + removeCount,
+           sizeof(array_chunk_t *) * (array->chunkCount - first - removeCount));
+    array_t * newArray = AKKAAEArraySnapshotCreate(newChunks, newChunkCount);
+    free(newChunks);
+    return newArray;
+}
+
+static inline int AKKAAEArrayChunkForIndex(const array_t * array, int index) {
+    int chunk = array->buckets[index >> kBucketShift];
+    while (index >= array->chunkStart[chunk + 1]) chunk++;
+    return chunk;
+}
+
+#pragma mark - Object map
+
+static inline unsigned int AKKAAEArrayMapHash(CFTypeRef object, unsigned int mask) {
+    // Fibonacci hashing; the low bits of object pointers are always zero
+    return (unsigned int)((((uintptr_t)object >> 4) * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+}
+
+static void AKKAAEArrayMapInit(array_map_t * map, int capacity) {
+    // At most half full, so probe sequences stay short
+    unsigned int size = 8;
+    while (size < (unsigned int)capacity * 2) size <<= 1;
+    map->mask = size - 1;
+    map->count = 0;
+    map->slots = (array_map_slot_t *)calloc(size, sizeof(array_map_slot_t));
+}
+
+static array_map_slot_t * AKKAAEArrayMapFind(const array_map_t * map, CFTypeRef object) {
+    for (unsigned int slot = AKKAAEArrayMapHash(object, map->mask); map->slots[slot].object; slot = (slot + 1) & map->mask) {
+        if (map->slots[slot].object == object) return &map->slots[slot];
+    }
+    return NULL;
+}
+
+static array_map_slot_t * AKKAAEArrayMapAdd(array_map_t * map, CFTypeRef object, array_entry_t * entry, int position) {
+    if ((unsigned int)(map->count + 1) * 2 > map->mask + 1) {
+        array_map_t larger;
+        AKKAAEArrayMapInit(&larger, map->count + 1);
+        for (unsigned int i = 0; i <= map->mask; i++) {
+            if (!map->slots[i].object) continue;
+            unsigned int slot = AKKAAEArrayMapHash(map->slots[i].object, larger.mask);
+            while (larger.slots[slot].object) slot = (slot + 1) & larger.mask;
+            larger.slots[slot] = map->slots[i];
+        }
+        larger.count = map->count;
+        free(map->slots);
+        *map = larger;
+    }
+
+    unsigned int slot = AKKAAEArrayMapHash(object, map->mask);
+    while (map->slots[slot].object && map->slots[slot].object != object) slot = (slot + 1) & map->mask;
+    if (!map->slots[slot].object) {
+        map->slots[slot] = (array_map_slot_t){ .object = object, .entry = entry, .position = position };
+        map->count++;
+    }
+    map->slots[slot].occurrences++;
+    return &map->slots[slot];
+}
+
+static void AKKAAEArrayMapRemove(array_map_t * map, CFTypeRef object) {
+    array_map_slot_t * found = AKKAAEArrayMapFind(map, object);
+    if (!found || --found->occurrences > 0) return;
+
+    // Backward-shift deletion: pull later members of the probe run into the gap, so no tombstones are needed
+    unsigned int gap = (unsigned int)(found - map->slots);
+    for (unsigned int slot = (gap + 1) & map->mask; map->slots[slot].object; slot = (slot + 1) & map->mask) {
+        unsigned int home = AKKAAEArrayMapHash(map->slots[slot].object, map->mask);
+        if (((slot - home) & map->mask) >= ((slot - gap) & map->mask)) {
+            map->slots[gap] = map->slots[slot];
+            gap = slot;
+        }
+    }
+    map->slots[gap] = (array_map_slot_t){};
+    map->count--;
+}
+
+@interface AKKAAEArray () {
+    array_map_t _map;
+    BOOL _positionsValid;
+}
 
 @property (nonatomic, strong) AKKAAEManagedValue * value;
-@property (nonatomic, strong, readwrite) NSArray * allValues;
 @property (nonatomic, copy) void*(^mappingBlock)(id item);
 
 @end
@@ -41,9 +217,9 @@ typedef struct {
     self.value = [AKKAAEManagedValue new];
     __unsafe_unretained AKKAAEArray *weakSelf = self;
     self.value.releaseBlock = ^(void * value) {[weakSelf releaseOldArray:(array_t *)value];};
-    array_t * array = (array_t *)calloc(1, sizeof(array_t));
-    array->count = 0;
-    self.value.pointerValue = array;
+    AKKAAEArrayMapInit(&_map, 0);
+    _positionsValid = YES;
+    self.value.pointerValue = AKKAAEArraySnapshotCreate(NULL, 0);
     return self;
 }
 
@@ -64,11 +240,19 @@ typedef struct {
         self.value = nil;
     }
 #endif
+    free(_map.slots);
 }
 
 - (NSArray *)allValues {
     array_t * array = (array_t *)_value.pointerValue;
-    return array->objects ? array->objects : @[];
+    if (!array->allValues) {
+        NSMutableArray * objects = [NSMutableArray arrayWithCapacity:array->count];
+        for (int i = 0; i < array->chunkCount; i++) {
+            for (int j = 0; j < array->chunks[i]->count; j++) [objects addObject:(__bridge id)array->chunks[i]->objects[j]];
+        }
+        array->allValues = CFBridgingRetain([objects copy]);
+    }
+    return (__bridge NSArray *)array->allValues;
 }
 
 - (int)count {
@@ -78,45 +262,59 @@ typedef struct {
 
 
 - (NSUInteger)countByEnumeratingWithState:(NSFastEnumerationState *)state objects:(id  _Nullable __unsafe_unretained [])buffer count:(NSUInteger)len {
-    array_t * array = (array_t *)_value.pointerValue;
-    return [array->objects countByEnumeratingWithState:state objects:buffer count:len];
+    return [self.allValues countByEnumeratingWithState:state objects:buffer count:len];
 }
 
 - (id)objectAtIndexedSubscript:(NSUInteger)idx {
     array_t * array = (array_t*)_value.pointerValue;
-    return [array->objects objectAtIndexedSubscript:idx];
+    if (idx >= array->count) {
+        [NSException raise:NSRangeException format:@"Index %lu beyond bounds of array with %d items", (unsigned long)idx, array->count];
+    }
+    int chunk = AKKAAEArrayChunkForIndex(array, (int)idx);
+    return (__bridge id)array->chunks[chunk]->objects[idx - array->chunkStart[chunk]];
 }
 
 - (void *)pointerValueAtIndex:(int)index {
     array_t * array = (array_t *)_value.pointerValue;
-    return index < array->count ? array->entries[index]->pointer : NULL;// entries 有索引的作用
+    return index < array->count ? AKKAAEArrayGetItem(array, index) : NULL;// entries 有索引的作用
 }
 
 - (void *)pointerValueForObject:(id)object {
-    array_t * array = (array_t *)_value.pointerValue;
-    if (!array->objects) return NULL;
-    NSUInteger index = [array->objects indexOfObject:object];
-    if (index == NSNotFound) return NULL;
-    return [self pointerValueAtIndex:(int)index];
+    array_map_slot_t * slot = AKKAAEArrayMapFind(&_map, (__bridge CFTypeRef)object);
+    return slot ? slot->entry->pointer : NULL;
 }
 
 - (void)updatePointerValue:(void *)value forObject:(id)object {
+    array_map_slot_t * slot = AKKAAEArrayMapFind(&_map, (__bridge CFTypeRef)object);
+    if (!slot) return;
     array_t * array = (array_t *)_value.pointerValue;
-    if (!array->objects) return;
-    NSUInteger index = [array->objects indexOfObject:object];
-    if (index == NSNotFound || index >= array->count) return;
-    size_t size = sizeof(array_t) + (sizeof(void *) * array->count - 1);
-    array_t * newArray = (array_t *)malloc(size);
-    memcpy(newArray, array, size);
-    
-    newArray->entries[index] = (array_entry_t *)malloc(sizeof(array_entry_t));
-    newArray->entries[index]->pointer = value;
-    newArray->entries[index]->referenceCount = 1;
-    
-    for (int i = 0; i < newArray->count; i++) {
-        if (i != index)  newArray->entries[i]->referenceCount++;
-    }
-    CFBridgingRetain(newArray->objects);
+    array_entry_t * oldEntry = slot->entry;
+    array_entry_t * newEntry = (array_entry_t *)calloc(1, sizeof(array_entry_t));
+    newEntry->pointer = value;
+    slot->entry = newEntry;
+
+    // A single occurrence only touches one chunk; otherwise find every chunk holding the object
+    int firstChunk = 0, lastChunk = array->chunkCount - 1;
+    if (slot->occurrences == 1) {
+        [self updatePositions];
+        firstChunk = lastChunk = AKKAAEArrayChunkForIndex(array, slot->position);
+    }
+
+    array_t * newArray = array;
+    for (int i = firstChunk; i <= lastChunk; i++) {
+        const array_chunk_t * source = newArray->chunks[i];
+        BOOL present = NO;
+        for (int j = 0; j < source->count && !present; j++) present = source->entries[j] == oldEntry;
+        if (!present) continue;
+
+        array_chunk_t * chunk = (array_chunk_t *)calloc(1, sizeof(array_chunk_t));
+        for (int j = 0; j < source->count; j++) {
+            AKKAAEArrayChunkAppend(chunk, source->objects[j], source->entries[j] == oldEntry ? newEntry : source->entries[j]);
+        }
+        array_t * spliced = AKKAAEArraySnapshotSplice(newArray, i, 1, &chunk, 1);
+        if (newArray != array) [self releaseOldArray:newArray];
+        newArray = spliced;
+    }
     _value.pointerValue = newArray;
 }
 
@@ -126,35 +324,182 @@ typedef struct {
 }
 
 - (void)updateWithContentsOfArray:(NSArray *)array customMapping:(AKKAAEArrayIndexedCustomMappingBlock)block {
-    array_t * currentArray = (array_t *)_value.pointerValue;
-    if (currentArray && currentArray->objects && [currentArray->objects isEqualToArray:array]) {
-        return;
-    }
-    
-    array = [array copy];
-    array_t * newArray = (array_t *)malloc(sizeof(array_t) + (sizeof(void *) * array.count -1));
-    newArray->count = (int)array.count;
-    newArray->objects = array;
-    CFBridgingRetain(array);
-    
     array_t * priorArray = (array_t *)_value.pointerValue;
-    
+    if (priorArray->count == array.count) {
+        // Nothing to do if the objects are the same, in the same order
+        BOOL identical = YES;
+        int i = 0;
+        for (id item in array) {
+            int chunk = AKKAAEArrayChunkForIndex(priorArray, i);
+            if ((__bridge CFTypeRef)item != priorArray->chunks[chunk]->objects[i - priorArray->chunkStart[chunk]]) {
+                identical = NO;
+                break;
+            }
+            i++;
+        }
+        if (identical) return;
+    }
+
+    int count = (int)array.count;
+    CFTypeRef * objects = (CFTypeRef *)malloc(sizeof(CFTypeRef) * MAX(count, 1));
+    array_entry_t ** entries = (array_entry_t **)malloc(sizeof(array_entry_t *) * MAX(count, 1));
+    array_map_t map;
+    AKKAAEArrayMapInit(&map, count);
+
     int i = 0;
     for (id item in array) {
-        NSUInteger priorIndex = priorArray && priorArray->objects ? [priorArray->objects indexOfObject:item] : NSNotFound;
-        if (priorIndex != NSNotFound) {
-            newArray->entries[i] = priorArray->entries[priorIndex];
-            newArray->entries[i]->referenceCount++;
-        } else {
-            newArray->entries[i] = (array_entry_t *)malloc(sizeof(array_entry_t));
-            newArray->entries[i]->pointer = block ? block(item,i) : _mappingBlock ? _mappingBlock(item) : (__bridge void *)item;
-            newArray->entries[i]->referenceCount = 1;
+        CFTypeRef object = (__bridge CFTypeRef)item;
+        array_map_slot_t * slot = AKKAAEArrayMapFind(&map, object);
+        if (!slot) slot = AKKAAEArrayMapFind(&_map, object);
+        array_entry_t * entry = slot ? slot->entry : NULL;
+        if (!entry) {
+            entry = (array_entry_t *)calloc(1, sizeof(array_entry_t));
+            entry->pointer = block ? block(item,i) : _mappingBlock ? _mappingBlock(item) : (__bridge void *)item;
         }
+        AKKAAEArrayMapAdd(&map, object, entry, i);
+        objects[i] = object;
+        entries[i] = entry;
         i++;
     }
+
+    array_chunk_t ** chunks = (array_chunk_t **)malloc(sizeof(array_chunk_t *) * MAX(count / kChunkMinimumFill + 1, 1));
+    int chunkCount = AKKAAEArrayChunksCreate(objects, entries, count, chunks);
+    array_t * newArray = AKKAAEArraySnapshotCreate(chunks, chunkCount);
+    free(chunks);
+    free(objects);
+    free(entries);
+
+    free(_map.slots);
+    _map = map;
+    _positionsValid = YES;
     _value.pointerValue = newArray;
 }
 
+- (void)insertObject:(id)object atIndex:(int)index {
+    array_t * array = (array_t *)_value.pointerValue;
+    NSAssert(index >= 0 && index <= array->count, @"Index %d out of range", index);
+
+    array_map_slot_t * slot = AKKAAEArrayMapFind(&_map, (__bridge CFTypeRef)object);
+    array_entry_t * entry = slot ? slot->entry : NULL;
+    if (!entry) {
+        entry = (array_entry_t *)calloc(1, sizeof(array_entry_t));
+        entry->pointer = _mappingBlock ? _mappingBlock(object) : (__bridge void *)object;
+    }
+    AKKAAEArrayMapAdd(&_map, (__bridge CFTypeRef)object, entry, index);
+    _positionsValid = NO;
+
+    if (array->chunkCount == 0) {
+        array_chunk_t * chunk = (array_chunk_t *)calloc(1, sizeof(array_chunk_t));
+        AKKAAEArrayChunkAppend(chunk, (__bridge CFTypeRef)object, entry);
+        _value.pointerValue = AKKAAEArraySnapshotCreate(&chunk, 1);
+        return;
+    }
+
+    // Rebuild the chunk the item lands in, splitting it in two if it was full
+    int chunkIndex = index == array->count ? array->chunkCount - 1 : AKKAAEArrayChunkForIndex(array, index);
+    const array_chunk_t * source = array->chunks[chunkIndex];
+    int offset = index - array->chunkStart[chunkIndex];
+    CFTypeRef objects[kChunkCapacity + 1];
+    array_entry_t * entries[kChunkCapacity + 1];
+    memcpy(objects, source->objects, sizeof(CFTypeRef) * offset);
+    memcpy(entries, source->entries, sizeof(array_entry_t *) * offset);
+    objects[offset] = (__bridge CFTypeRef)object;
+    entries[offset] = entry;
+    memcpy(objects + offset + 1, source->objects + offset, sizeof(CFTypeRef) * (source->count - offset));
+    memcpy(entries + offset + 1, source->entries + offset, sizeof(array_entry_t *) * (source->count - offset));
+
+    array_chunk_t * chunks[2];
+    int chunkCount = AKKAAEArrayChunksCreate(objects, entries, source->count + 1, chunks);
+    _value.pointerValue = AKKAAEArraySnapshotSplice(array, chunkIndex, 1, chunks, chunkCount);
+}
+
+- (void)removeObjectAtIndex:(int)index {
+    array_t * array = (array_t *)_value.pointerValue;
+    NSAssert(index >= 0 && index < array->count, @"Index %d out of range", index);
+
+    int chunkIndex = AKKAAEArrayChunkForIndex(array, index);
+    const array_chunk_t * source = array->chunks[chunkIndex];
+    int offset = index - array->chunkStart[chunkIndex];
+    AKKAAEArrayMapRemove(&_map, source->objects[offset]);
+    _positionsValid = NO;
+
+    // Rebuild the chunk without the item. If that leaves it under the minimum, rebuild it together
+    // with a neighbour instead, which gives one or two chunks that are at least half full.
+    int first = chunkIndex, removeCount = 1;
+    if (source->count - 1 < kChunkMinimumFill && array->chunkCount > 1) {
+        if (chunkIndex + 1 < array->chunkCount) {
+            removeCount = 2;
+        } else {
+            first = chunkIndex - 1;
+            removeCount = 2;
+        }
+    }
+
+    CFTypeRef objects[kChunkCapacity * 2];
+    array_entry_t * entries[kChunkCapacity * 2];
+    int count = 0;
+    for (int i = first; i < first + removeCount; i++) {
+        for (int j = 0; j < array->chunks[i]->count; j++) {
+            if (i == chunkIndex && j == offset) continue;
+            objects[count] = array->chunks[i]->objects[j];
+            entries[count] = array->chunks[i]->entries[j];
+            count++;
+        }
+    }
+
+    array_chunk_t * chunks[2];
+    int chunkCount = AKKAAEArrayChunksCreate(objects, entries, count, chunks);
+    _value.pointerValue = AKKAAEArraySnapshotSplice(array, first, removeCount, chunks, chunkCount);
+}
+
+- (void)replaceObjectAtIndex:(int)index withObject:(id)object {
+    array_t * array = (array_t *)_value.pointerValue;
+    NSAssert(index >= 0 && index < array->count, @"Index %d out of range", index);
+
+    int chunkIndex = AKKAAEArrayChunkForIndex(array, index);
+    const array_chunk_t * source = array->chunks[chunkIndex];
+    int offset = index - array->chunkStart[chunkIndex];
+    if (source->objects[offset] == (__bridge CFTypeRef)object) return;
+
+    AKKAAEArrayMapRemove(&_map, source->objects[offset]);
+    if (AKKAAEArrayMapFind(&_map, source->objects[offset])) {
+        // The outgoing object appears elsewhere too, and its position may have been this one
+        _positionsValid = NO;
+    }
+    array_map_slot_t * slot = AKKAAEArrayMapFind(&_map, (__bridge CFTypeRef)object);
+    array_entry_t * entry = slot ? slot->entry : NULL;
+    if (!entry) {
+        entry = (array_entry_t *)calloc(1, sizeof(array_entry_t));
+        entry->pointer = _mappingBlock ? _mappingBlock(object) : (__bridge void *)object;
+    }
+    AKKAAEArrayMapAdd(&_map, (__bridge CFTypeRef)object, entry, index);
+
+    array_chunk_t * chunk = (array_chunk_t *)calloc(1, sizeof(array_chunk_t));
+    for (int j = 0; j < source->count; j++) {
+        if (j == offset) {
+            AKKAAEArrayChunkAppend(chunk, (__bridge CFTypeRef)object, entry);
+        } else {
+            AKKAAEArrayChunkAppend(chunk, source->objects[j], source->entries[j]);
+        }
+    }
+    _value.pointerValue = AKKAAEArraySnapshotSplice(array, chunkIndex, 1, &chunk, 1);
+}
+
+/*!
+ * Refresh the map's positions, after inserts or removals have shifted them
+ */
+- (void)updatePositions {
+    if (_positionsValid) return;
+    array_t * array = (array_t *)_value.pointerValue;
+    for (int i = 0; i < array->chunkCount; i++) {
+        const array_chunk_t * chunk = array->chunks[i];
+        for (int j = 0; j < chunk->count; j++) {
+            AKKAAEArrayMapFind(&_map, chunk->objects[j])->position = array->chunkStart[i] + j;
+        }
+    }
+    _positionsValid = YES;
+}
+
 AKKAAEArrayToken AKKAAEArrayGetToken(__unsafe_unretained AKKAAEArray * THIS) {
     return AKKAAEManagedValueGetValue(THIS->_value);
 }
@@ -164,22 +509,30 @@ int AKKAAEArrayGetCount(AKKAAEArrayToken _Nonnull token) {
 }
 
 void * _Nullable AKKAAEArrayGetItem(AKKAAEArrayToken _Nonnull token, int index) {
-    return ((array_t *)token)->entries[index]->pointer;
+    const array_t * array = (const array_t *)token;
+    int chunk = AKKAAEArrayChunkForIndex(array, index);
+    return array->chunks[chunk]->entries[index - array->chunkStart[chunk]]->pointer;
 }
 
 - (void)releaseOldArray:(array_t *)array {
-    for (int i = 0; i < array->count; i++) {
-        array->entries[i]->referenceCount--;
-        if (array->entries[i]->referenceCount == 0) {
-            if (_releaseBlock) {
-                _releaseBlock(array->objects[i],array->entries[i]->pointer);
-            } else if(array->entries[i]->pointer && array->entries[i]->pointer != (__bridge void *)array->objects[i]) {
-                free(array->entries[i]->pointer);// 如果不相同就单独释放，相同就在下面一起释放
+    for (int i = 0; i < array->chunkCount; i++) {
+        array_chunk_t * chunk = array->chunks[i];
+        if (atomic_fetch_sub_explicit(&chunk->referenceCount, 1, memory_order_acq_rel) != 1) continue;
+        for (int j = 0; j < chunk->count; j++) {
+            array_entry_t * entry = chunk->entries[j];
+            if (atomic_fetch_sub_explicit(&entry->referenceCount, 1, memory_order_acq_rel) == 1) {
+                if (_releaseBlock) {
+                    _releaseBlock((__bridge id)chunk->objects[j], entry->pointer);
+                } else if(entry->pointer && entry->pointer != chunk->objects[j]) {
+                    free(entry->pointer);// 如果不相同就单独释放，相同就在下面一起释放
+                }
+                free(entry);
             }
-            free(array->entries[i]);
+            CFRelease(chunk->objects[j]);
         }
+        free(chunk);
     }
-    if (array->objects) CFBridgingRelease((__bridge CFTypeRef)array->objects);
+    if (array->allValues) CFRelease(array->allValues);
     free(array);
 }
 @end
@@ -0,0 +1,174 @@
+//
+//  AKKAAEAutomationLane.h
+//  AKKAAudioEngineSample
+//
+//  Created by 张一鸣 on 2016/12/27.
+//  Copyright © 2016年 AKKA. All rights reserved.
+//
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#import <Foundation/Foundation.h>
+#import <AudioToolbox/AudioToolbox.h>
+
+/*!
+ * Automation curve
+ *
+ *  The shape of the segment leading into a breakpoint, from the breakpoint before it.
+ */
+typedef NS_ENUM(NSInteger, AKKAAEAutomationCurve) {
+    AKKAAEAutomationCurveStep,          //!< Hold the previous value, then jump at the breakpoint
+    AKKAAEAutomationCurveLinear,        //!< Straight line
+    AKKAAEAutomationCurveExponential,   //!< Constant ratio per frame, for frequencies and gains in dB; linear if the values differ in sign or either is zero
+    AKKAAEAutomationCurvePower,         //!< previous + (value - previous) * position^exponent: with exponent 3, a fade that sounds linear
+};
+
+/*!
+ * Automation breakpoint
+ */
+typedef struct {
+    Float64 sampleTime;             //!< When the value is reached, on the render timeline (AudioTimeStamp mSampleTime)
+    float value;                    //!< The value
+    AKKAAEAutomationCurve curve;    //!< The segment shape from the previous breakpoint
+    float exponent;                 //!< For AKKAAEAutomationCurvePower, the exponent (0 for 3)
+} AKKAAEAutomationEvent;
+
+typedef struct AKKAAEAutomationLane AKKAAEAutomationLane;
+
+/*!
+ * Create an automation lane
+ *
+ *  A lane holds one parameter's breakpoints, sorted by time, and renders them sample-accurately:
+ *  each render cycle is split at the breakpoints inside it, and every piece is rendered as a ramp.
+ *  Linear segments are exact; curved segments are evaluated every
+ *  AKKAAEAutomationLaneCurveSubBlockFrames and rendered as ramps between those points.
+ *  自动化曲线按事件的精确采样位置切分渲染周期，每一段用 SIMD ramp 渲染，不再受 IO buffer 大小限制。
+ *
+ *  Breakpoints are scheduled on the main thread, and reach the render thread through a lock-free
+ *  queue, which the render thread drains at the start of each cycle. The render thread keeps them in
+ *  a fixed-size array, and drops each one once it is passed, so nothing is allocated and no locks are
+ *  taken while rendering.
+ *
+ *  The capacity bounds the breakpoints still ahead: those the render thread holds, plus those queued
+ *  for it. A breakpoint stops counting once the render thread has passed it, so a lane of capacity 64
+ *  can play any number of breakpoints, as long as no more than 64 are waiting at any one time.
+ *
+ *  Use this function on the main thread.
+ *
+ * @param capacity The most breakpoints that can be waiting to be reached, scheduled or queued
+ * @param initialValue The value before the first breakpoint
+ * @return The new lane
+ */
+AKKAAEAutomationLane * _Nonnull AKKAAEAutomationLaneNew(int capacity, float initialValue);
+
+/*!
+ * Free a lane
+ *
+ *  Use this function on the main thread, once the render thread is done with the lane.
+ *
+ * @param lane The lane
+ */
+void AKKAAEAutomationLaneFree(AKKAAEAutomationLane * _Nonnull lane);
+
+/*!
+ * Schedule a breakpoint
+ *
+ *  A breakpoint at the same time as an existing one replaces it. A breakpoint in the past takes
+ *  effect straight away: the next cycle continues from its value.
+ *
+ *  A breakpoint that would take the lane past its capacity is refused, and NO returned: the
+ *  breakpoint is never accepted only to be dropped later. Breakpoints count against the capacity from
+ *  when they're scheduled until the render thread passes them; one that replaces an existing
+ *  breakpoint counts until the render thread takes it in.
+ *
+ *  Use this function on the main thread, or any one thread at a time: the queue has one producer.
+ *
+ * @param lane The lane
+ * @param event The breakpoint
+ * @return YES if scheduled, NO if the lane is at capacity
+ */
+BOOL AKKAAEAutomationLaneSchedule(AKKAAEAutomationLane * _Nonnull lane, AKKAAEAutomationEvent event);
+
+/*!
+ * Remove breakpoints
+ *
+ *  Removes every breakpoint at or after the given time, such as before rescheduling after a seek.
+ *  The value then holds at wherever it had got to. Use this function from the scheduling thread.
+ *
+ * @param lane The lane
+ * @param sampleTime The time from which to remove breakpoints; 0 for all
+ * @return YES if queued, NO if the queue is full
+ */
+BOOL AKKAAEAutomationLaneClear(AKKAAEAutomationLane * _Nonnull lane, Float64 sampleTime);
+
+/*!
+ * Get the lane's value
+ *
+ *  Use this function on any thread. The value is the one reached at the end of the last render call.
+ *
+ * @param lane The lane
+ * @return The current value
+ */
+float AKKAAEAutomationLaneGetValue(const AKKAAEAutomationLane * _Nonnull lane);
+
+/*!
+ * Take in scheduled breakpoints
+ *
+ *  Call this once per render cycle before AKKAAEAutomationLaneGetRamp; AKKAAEAutomationLaneApply
+ *  calls it itself. This function is realtime safe.
+ *
+ * @param lane The lane
+ */
+void AKKAAEAutomationLaneUpdate(AKKAAEAutomationLane * _Nonnull lane);
+
+/*!
+ * Get the next ramp
+ *
+ *  Gives the value at sampleTime, and how many frames from there the value follows a straight line.
+ *  The run stops at the next breakpoint, and for curved segments after
+ *  AKKAAEAutomationLaneCurveSubBlockFrames. Call this in a loop to split a cycle for any parameter:
+ *
+ *  @code
+ *  for ( UInt32 offset=0; offset<frames; ) {
+ *      float value, step;
+ *      UInt32 run = AKKAAEAutomationLaneGetRamp(lane, sampleTime + offset, frames - offset, &value, &step);
+ *      // Render frames offset to offset+run with the parameter going from value by step per frame
+ *      offset += run;
+ *  }
+ *  @endcode
+ *
+ *  Calls must move forward in time: breakpoints are dropped once passed. This function is realtime safe.
+ *
+ * @param lane The lane
+ * @param sampleTime The time of the first frame
+ * @param maxFrames The most frames wanted
+ * @param outValue On output, the value at sampleTime
+ * @param outStep On output, the change in value per frame
+ * @return Number of frames, from 1 to maxFrames, or 0 if maxFrames is 0
+ */
+UInt32 AKKAAEAutomationLaneGetRamp(AKKAAEAutomationLane * _Nonnull lane, Float64 sampleTime, UInt32 maxFrames,
+                                   float * _Nonnull outValue, float * _Nonnull outStep);
+
+/*!
+ * Apply the lane as a gain
+ *
+ *  Multiplies every channel of the buffer list by the lane's value, in one pass per ramp with the
+ *  AKKAAEDSPKernels rampMulN kernel. Runs that hold at unity gain are skipped. This function is
+ *  realtime safe.
+ *
+ * @param lane The lane
+ * @param bufferList Non-interleaved float audio
+ * @param sampleTime The time of the first frame, such as context->timestamp->mSampleTime
+ * @param frames Number of frames
+ */
+void AKKAAEAutomationLaneApply(AKKAAEAutomationLane * _Nonnull lane, const AudioBufferList * _Nonnull bufferList,
+                               Float64 sampleTime, UInt32 frames);
+
+//! How often curved segments are evaluated; ramps run between these points
+extern const UInt32 AKKAAEAutomationLaneCurveSubBlockFrames;
+
+#ifdef __cplusplus
+}
+#endif
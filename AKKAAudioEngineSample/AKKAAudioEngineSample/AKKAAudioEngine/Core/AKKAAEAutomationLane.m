@@ -0,0 +1,232 @@
+//
+//  AKKAAEAutomationLane.m
+//  AKKAAudioEngineSample
+//
+//  Created by 张一鸣 on 2016/12/27.
+//  Copyright © 2016年 AKKA. All rights reserved.
+//
+
+#import "AKKAAEAutomationLane.h"
+#import "AKKAAEDSPKernels.h"
+#import <stdatomic.h>
+
+#define kCacheLineSize 64
+
+const UInt32 AKKAAEAutomationLaneCurveSubBlockFrames = 16;
+static const float kDefaultPowerExponent = 3.0f;
+
+typedef enum {
+    AKKAAEAutomationCommandSchedule,
+    AKKAAEAutomationCommandClear,
+} AKKAAEAutomationCommandType;
+
+typedef struct {
+    AKKAAEAutomationCommandType type;
+    AKKAAEAutomationEvent event;    // For clear, only sampleTime is used
+} AKKAAEAutomationCommand;
+
+// 命令队列和 AKKAAEAudioRing 一样：计数只增不减，主线程只写 written，渲染线程只写 read。
+// events 只有渲染线程碰：[first, end) 按时间排好序，过去的事件只是把 first 往后挪。
+// held 是渲染线程公布的 end - first，排期的时候加上队列里还没取走的，保证 events 永远放得下。
+struct AKKAAEAutomationLane {
+    _Alignas(kCacheLineSize) _Atomic(UInt64) written;   // Scheduling thread's
+    _Alignas(kCacheLineSize) _Atomic(UInt64) read;      // Render thread's
+    _Atomic(int) held;                                  // Render thread's: events in [first, end)
+    _Alignas(kCacheLineSize) AKKAAEAutomationCommand * commands;
+    AKKAAEAutomationEvent * events;
+    int capacity;
+    int first;
+    int end;
+    Float64 anchorTime;     // The segment to events[first] starts here...
+    float anchorValue;      // ...from this value
+    Float64 time;           // End of the last ramp given out
+    _Atomic(float) value;   // Value there
+};
+
+AKKAAEAutomationLane * AKKAAEAutomationLaneNew(int capacity, float initialValue) {
+    assert(capacity > 0);
+
+    void * memory = NULL;
+    posix_memalign(&memory, kCacheLineSize, sizeof(AKKAAEAutomationLane));
+    AKKAAEAutomationLane * lane = (AKKAAEAutomationLane *)memory;
+    memset(lane, 0, sizeof(AKKAAEAutomationLane));
+    atomic_init(&lane->written, 0);
+    atomic_init(&lane->read, 0);
+    atomic_init(&lane->held, 0);
+    atomic_init(&lane->value, initialValue);
+    lane->commands = (AKKAAEAutomationCommand *)calloc(capacity, sizeof(AKKAAEAutomationCommand));
+    lane->events = (AKKAAEAutomationEvent *)calloc(capacity, sizeof(AKKAAEAutomationEvent));
+    lane->capacity = capacity;
+    lane->anchorValue = initialValue;
+    return lane;
+}
+
+void AKKAAEAutomationLaneFree(AKKAAEAutomationLane * lane) {
+    free(lane->commands);
+    free(lane->events);
+    free(lane);
+}
+
+static BOOL AKKAAEAutomationLanePush(AKKAAEAutomationLane * lane, AKKAAEAutomationCommand command) {
+    UInt64 written = atomic_load_explicit(&lane->written, memory_order_relaxed);
+    UInt64 read = atomic_load_explicit(&lane->read, memory_order_acquire);
+    UInt64 outstanding = written - read;
+    if ( command.type == AKKAAEAutomationCommandSchedule ) {
+        // Read after read, so commands already taken in are counted here or in the queue, never neither
+        outstanding += atomic_load_explicit(&lane->held, memory_order_relaxed);
+    }
+    if ( outstanding >= (UInt64)lane->capacity ) return NO;
+    lane->commands[written % lane->capacity] = command;
+    atomic_store_explicit(&lane->written, written + 1, memory_order_release);
+    return YES;
+}
+
+BOOL AKKAAEAutomationLaneSchedule(AKKAAEAutomationLane * lane, AKKAAEAutomationEvent event) {
+    return AKKAAEAutomationLanePush(lane, (AKKAAEAutomationCommand){ .type = AKKAAEAutomationCommandSchedule, .event = event });
+}
+
+BOOL AKKAAEAutomationLaneClear(AKKAAEAutomationLane * lane, Float64 sampleTime) {
+    return AKKAAEAutomationLanePush(lane, (AKKAAEAutomationCommand){
+        .type = AKKAAEAutomationCommandClear, .event = { .sampleTime = sampleTime } });
+}
+
+float AKKAAEAutomationLaneGetValue(const AKKAAEAutomationLane * lane) {
+    return atomic_load_explicit(&((AKKAAEAutomationLane *)lane)->value, memory_order_relaxed);
+}
+
+// First index in [first, end) whose time is not before sampleTime
+static int AKKAAEAutomationLaneFind(const AKKAAEAutomationLane * lane, Float64 sampleTime) {
+    int low = lane->first, high = lane->end;
+    while ( low < high ) {
+        int middle = low + (high - low) / 2;
+        if ( lane->events[middle].sampleTime < sampleTime ) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+static void AKKAAEAutomationLaneInsert(AKKAAEAutomationLane * lane, AKKAAEAutomationEvent event) {
+    int index = AKKAAEAutomationLaneFind(lane, event.sampleTime);
+    if ( index < lane->end && lane->events[index].sampleTime == event.sampleTime ) {
+        lane->events[index] = event;
+        return;
+    }
+    // Scheduling counts every event held or queued against the capacity, so there's always room
+    assert(lane->end - lane->first < lane->capacity);
+    if ( lane->end == lane->capacity ) {
+        // Slide the live events back to the start to make room at the end
+        memmove(lane->events, lane->events + lane->first, (lane->end - lane->first) * sizeof(AKKAAEAutomationEvent));
+        index -= lane->first;
+        lane->end -= lane->first;
+        lane->first = 0;
+    }
+    memmove(lane->events + index + 1, lane->events + index, (lane->end - index) * sizeof(AKKAAEAutomationEvent));
+    lane->events[index] = event;
+    lane->end++;
+}
+
+static void AKKAAEAutomationLaneRemoveFrom(AKKAAEAutomationLane * lane, Float64 sampleTime) {
+    int index = AKKAAEAutomationLaneFind(lane, sampleTime);
+    if ( index == lane->first ) {
+        // Losing the event we were heading for: hold where we've got to
+        lane->anchorTime = lane->time;
+        lane->anchorValue = atomic_load_explicit(&lane->value, memory_order_relaxed);
+    }
+    lane->end = index;
+    if ( lane->end == lane->first ) lane->first = lane->end = 0;
+}
+
+void AKKAAEAutomationLaneUpdate(AKKAAEAutomationLane * lane) {
+    UInt64 read = atomic_load_explicit(&lane->read, memory_order_relaxed);
+    UInt64 written = atomic_load_explicit(&lane->written, memory_order_acquire);
+    for ( ; read < written; read++ ) {
+        const AKKAAEAutomationCommand * command = &lane->commands[read % lane->capacity];
+        if ( command->type == AKKAAEAutomationCommandSchedule ) {
+            AKKAAEAutomationLaneInsert(lane, command->event);
+        } else {
+            AKKAAEAutomationLaneRemoveFrom(lane, command->event.sampleTime);
+        }
+    }
+    atomic_store_explicit(&lane->held, lane->end - lane->first, memory_order_relaxed);
+    atomic_store_explicit(&lane->read, read, memory_order_release);
+}
+
+// Value at sampleTime on the segment from the anchor to the event
+static inline float AKKAAEAutomationLaneEvaluate(const AKKAAEAutomationLane * lane, const AKKAAEAutomationEvent * event,
+                                                 Float64 sampleTime) {
+    if ( sampleTime >= event->sampleTime ) return event->value;
+    if ( event->curve == AKKAAEAutomationCurveStep || event->sampleTime <= lane->anchorTime ) return lane->anchorValue;
+    float from = lane->anchorValue;
+    float to = event->value;
+    float position = (float)((sampleTime - lane->anchorTime) / (event->sampleTime - lane->anchorTime));
+    switch ( event->curve ) {
+        case AKKAAEAutomationCurveExponential:
+            if ( from * to > 0.0f ) return from * powf(to / from, position);
+            break;
+        case AKKAAEAutomationCurvePower:
+            return from + (to - from) * powf(position, event->exponent > 0.0f ? event->exponent : kDefaultPowerExponent);
+        default:
+            break;
+    }
+    return from + (to - from) * position;
+}
+
+UInt32 AKKAAEAutomationLaneGetRamp(AKKAAEAutomationLane * lane, Float64 sampleTime, UInt32 maxFrames,
+                                   float * outValue, float * outStep) {
+    if ( maxFrames == 0 ) return 0;
+
+    // Take in every event we've reached
+    while ( lane->first < lane->end && lane->events[lane->first].sampleTime <= sampleTime ) {
+        lane->anchorTime = lane->events[lane->first].sampleTime;
+        lane->anchorValue = lane->events[lane->first].value;
+        lane->first++;
+    }
+    if ( lane->first == lane->end ) lane->first = lane->end = 0;
+    atomic_store_explicit(&lane->held, lane->end - lane->first, memory_order_relaxed);
+
+    UInt32 frames = maxFrames;
+    float start, end;
+    if ( lane->first == lane->end ) {
+        // Nothing ahead: hold. A breakpoint scheduled later ramps from here.
+        lane->anchorTime = sampleTime + maxFrames;
+        start = end = lane->anchorValue;
+    } else {
+        const AKKAAEAutomationEvent * event = &lane->events[lane->first];
+        // Stop on the first frame at or after the event, so the next call starts exactly on it
+        Float64 framesToEvent = ceil(event->sampleTime - sampleTime);
+        if ( framesToEvent < frames ) frames = (UInt32)framesToEvent;
+        if ( event->curve == AKKAAEAutomationCurveExponential || event->curve == AKKAAEAutomationCurvePower ) {
+            frames = MIN(frames, AKKAAEAutomationLaneCurveSubBlockFrames);
+        }
+        start = AKKAAEAutomationLaneEvaluate(lane, event, sampleTime);
+        end = event->curve == AKKAAEAutomationCurveStep ? start : AKKAAEAutomationLaneEvaluate(lane, event, sampleTime + frames);
+    }
+
+    *outValue = start;
+    *outStep = (end - start) / frames;
+    lane->time = sampleTime + frames;
+    atomic_store_explicit(&lane->value, end, memory_order_relaxed);
+    return frames;
+}
+
+void AKKAAEAutomationLaneApply(AKKAAEAutomationLane * lane, const AudioBufferList * bufferList,
+                               Float64 sampleTime, UInt32 frames) {
+    AKKAAEAutomationLaneUpdate(lane);
+    const AKKAAEDSPKernels * kernels = AKKAAEDSPKernelsGet();
+    int channelCount = bufferList->mNumberBuffers;
+    float * channels[MAX(channelCount, 1)];
+    for ( UInt32 offset=0; offset<frames; ) {
+        float value, step;
+        UInt32 run = AKKAAEAutomationLaneGetRamp(lane, sampleTime + offset, frames - offset, &value, &step);
+        if ( channelCount > 0 && !(step == 0.0f && value == 1.0f) ) {
+            for ( int i=0; i<channelCount; i++ ) {
+                channels[i] = (float *)bufferList->mBuffers[i].mData + offset;
+            }
+            kernels->rampMulN(channels, channelCount, &value, step, run);
+        }
+        offset += run;
+    }
+}
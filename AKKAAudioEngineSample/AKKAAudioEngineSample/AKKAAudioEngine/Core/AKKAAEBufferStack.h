@@ -14,6 +14,7 @@ extern "C" {
 #import <AudioToolbox/AudioToolbox.h>
 #import "AKKAAETypes.h"
 
+//! The default, and largest, maximum frames per slice of a buffer stack
 extern const UInt32 AKKAAEBufferStackMaxFramesPerSlice;
 
 typedef struct AKKAAEBufferStack AKKAAEBufferStack;
@@ -36,6 +37,22 @@ AKKAAEBufferStack * AKKAAEBufferStackNew(int poolSize);
  */
 AKKAAEBufferStack * AKKAAEBufferStackNewWithOptions(int poolSize, int maxChannelsPerBuffer, int numberOfSingleChannelBuffers);
 
+/*!
+ * Initialize a new buffer stack, with a maximum slice size
+ *
+ *  Every mono buffer in the pool is sized for the maximum frames per slice, so a stack that only
+ *  ever renders IO-sized slices, such as 128 frames, needs a small fraction of the default's memory.
+ *  每个单声道 buffer 都按最大切片分配；按实际 IO 大小建 stack 能省下大部分内存。
+ *
+ * @param poolSize The number of audio buffer lists to make room for in the buffer pool, or 0 for default value
+ * @param maxChannelsPerBuffer The maximum number of audio channels for each buffer (default 2)
+ * @param numberOfSingleChannelBuffers Number of mono float buffers to allocate (or 0 for default: poolSize*maxChannelsPerBuffer)
+ * @param maxFramesPerSlice The most frames per buffer, up to AKKAAEBufferStackMaxFramesPerSlice (or 0 for that default)
+ * @return The new buffer stack
+ */
+AKKAAEBufferStack * AKKAAEBufferStackNewWithMaxFrames(int poolSize, int maxChannelsPerBuffer, int numberOfSingleChannelBuffers,
+                                                      UInt32 maxFramesPerSlice);
+
 /*!
  * Clean up a buffer stack
  *
@@ -47,7 +64,7 @@ void AKKAAEBufferStackFree(AKKAAEBufferStack * stack);
  * Set current frame count per buffer
  *
  * @param stack The stack
- * @param frameCount The number of frames for newly-pushed buffers
+ * @param frameCount The number of frames for newly-pushed buffers, up to the stack's maximum frames per slice
  */
 void AKKAAEBufferStackSetFrameCount(AKKAAEBufferStack * stack, UInt32 frameCount);
 
@@ -59,6 +76,38 @@ void AKKAAEBufferStackSetFrameCount(AKKAAEBufferStack * stack, UInt32 frameCount
  */
 UInt32 AKKAAEBufferStackGetFrameCount(const AKKAAEBufferStack * stack);
 
+/*!
+ * Get the maximum frames per slice
+ *
+ * @param stack The stack
+ * @return The most frames a buffer on this stack can hold
+ */
+UInt32 AKKAAEBufferStackGetMaxFramesPerSlice(const AKKAAEBufferStack * stack);
+
+/*!
+ * Resize the stack's buffers for a new maximum frames per slice
+ *
+ *  Use this when the IO buffer duration changes, such as on AKKAAEIOAudioUnitDidSetupNotification,
+ *  to keep the pool sized to the slices actually rendered. If the frame count was at the old
+ *  maximum it follows the new one; otherwise it's limited to the new maximum.
+ *
+ *  This reallocates the pool, so it is not realtime safe: use it on the main thread while
+ *  the stack is not rendering.
+ *
+ * @param stack The stack
+ * @param maxFramesPerSlice The most frames per buffer, up to AKKAAEBufferStackMaxFramesPerSlice (or 0 for that default)
+ * @return YES on success, NO if the stack still holds buffers
+ */
+BOOL AKKAAEBufferStackSetMaxFramesPerSlice(AKKAAEBufferStack * stack, UInt32 maxFramesPerSlice);
+
+/*!
+ * Get the memory the stack has allocated
+ *
+ * @param stack The stack
+ * @return Bytes allocated for the stack: its audio buffers, buffer lists and bookkeeping
+ */
+size_t AKKAAEBufferStackGetMemoryUsage(const AKKAAEBufferStack * stack);
+
 /*!
  * Set timestamp for the current interval
  *
@@ -100,7 +149,15 @@ int AKKAAEBufferStackGetMaximumChannelsPerBuffer(const AKKAAEBufferStack * stack
 int AKKAAEBufferStackCount(const AKKAAEBufferStack * stack);
 
 /*!
- * Get a buffer
+ * Get a buffer, to read only
+ *
+ *  The samples must not be written to: they may be shared with a duplicate (see
+ *  AKKAAEBufferStackDuplicate). Use AKKAAEBufferStackGetMutable to write.
+ *
+ *  This doesn't change the stack, so if AKKAAEBufferStackApplyFaders left a gain pending on the
+ *  buffer (see AKKAAEBufferStackHasPendingGain), the samples don't include it yet. Modules that
+ *  read after the faders, such as recorders, should call AKKAAEBufferStackMaterialize first.
+ *  只读，不会复制也不会乘待定的推子增益。
  *
  * @param stack The stack
  * @param index The buffer index
@@ -108,6 +165,31 @@ int AKKAAEBufferStackCount(const AKKAAEBufferStack * stack);
  */
 const AudioBufferList * AKKAAEBufferStackGet(const AKKAAEBufferStack * stack, int index);
 
+/*!
+ * Get a buffer, to read or write
+ *
+ *  The samples may be written to in place. If the buffer shares its samples with a duplicate, it
+ *  is given its own copy first; a buffer was set aside for that when duplicating, so this doesn't
+ *  fail. If AKKAAEBufferStackApplyFaders left a gain pending on the buffer, it is applied too.
+ *  The buffer's silent channel flags are cleared, as whatever is written may be audible.
+ *  要写的时候用这个，共享的 buffer 会先复制一份。
+ *
+ * @param stack The stack
+ * @param index The buffer index
+ * @return The buffer at the given index (0 is the top of the stack: the most recently pushed buffer)
+ */
+const AudioBufferList * AKKAAEBufferStackGetMutable(AKKAAEBufferStack * stack, int index);
+
+/*!
+ * Whether a buffer shares its samples
+ *
+ * @param stack The stack
+ * @param index The buffer index
+ * @return YES if any of the buffer's channels is shared with another buffer on the stack, so writing
+ *  to it through AKKAAEBufferStackGetMutable would copy it first
+ */
+BOOL AKKAAEBufferStackIsShared(const AKKAAEBufferStack * stack, int index);
+
 /*!
  * Push one or more new buffers onto the stack
  *
@@ -147,7 +229,12 @@ const AudioBufferList * AKKAAEBufferStackPushWithChannels(AKKAAEBufferStack * st
  *  to the original structure will not be reflected in the copy on the stack.
  *
  *  It is the responsibility of the caller to ensure that it does not modify the audio data until
- *  the end of the current render cycle. Note that successive audio modules may modify the contents.
+ *  the end of the current render cycle. The stack never writes to it, so it may be read-only, such
+ *  as a mapped file: a module that writes to the buffer (through AKKAAEBufferStackGetMutable,
+ *  AKKAAEBufferStackMix, AKKAAEBufferStackSilence or a pending fader) is given a copy in one of the
+ *  stack's own buffers first. One is set aside for each channel now, so this fails if the stack's
+ *  audio pool is full.
+ *  外部的音频只读，谁要写就先复制到栈自己的 buffer 里。
  *
  * @param stack The stack
  * @param buffer The buffer list to copy onto the stack
@@ -160,6 +247,19 @@ const AudioBufferList * AKKAAEBufferStackPushExternal(AKKAAEBufferStack * stack,
  *
  *  Pushes a new buffer onto the stack which is a copy of the prior buffer.
  *
+ *  The copy is made lazily: the new buffer shares the prior buffer's samples, with a reference count
+ *  per channel in the stack's audio pool, and whichever of the two is written to first gets its own
+ *  copy (through AKKAAEBufferStackGetMutable, AKKAAEBufferStackMix, AKKAAEBufferStackSilence, or a pending
+ *  fader being applied). A duplicate that is only read, or faded and mixed, such as for a send,
+ *  is never copied. Channels pushed with AKKAAEBufferStackPushExternal are shared in the same way.
+ *  复制是延迟的：两个 buffer 先共用同一块内存，谁先写谁复制。
+ *
+ *  Pointers to the samples obtained before duplicating may now be shared: get the buffer again
+ *  with AKKAAEBufferStackGetMutable before writing to it.
+ *
+ *  Fails if the stack's audio pool couldn't also provide a buffer for each channel, as every
+ *  channel may need its own copy later and that mustn't fail mid-render.
+ *
  * @param stack The stack
  * @return The duplicated buffer
  */
@@ -202,6 +302,7 @@ void AKKAAEBufferStackRemove(AKKAAEBufferStack * stack, int index);
  *  Pops the given number of buffers from the stack, and pushes a buffer with these mixed together.
  *
  *  When mixing a mono buffer and a stereo buffer, the mono buffer's channels will be duplicated.
+ *  The result keeps the mix's silent channel flags: to write to it, get it with AKKAAEBufferStackGetMutable.
  *
  * @param stack The stack
  * @param count Number of buffers to mix
@@ -229,6 +330,12 @@ const AudioBufferList * AKKAAEBufferStackMixWithGain(AKKAAEBufferStack * stack,
  *
  *  此函数将增益应用于给定缓冲区以影响音量和平衡，应用平滑斜坡以避免不连续。 如果缓冲区是单声道，并且天平非零，则缓冲区将变为立体声。
  *
+ *  The gain isn't multiplied in straight away: it is recorded on the buffer as one ramp per channel,
+ *  and applied in the same pass as the next mix (AKKAAEBufferStackMixWithGain, AKKAAEBufferStackMixToBufferList),
+ *  so a faded track is read and written once instead of twice. A second fader before then is folded
+ *  into the first. AKKAAEBufferStackGetMutable and AKKAAEBufferStackMaterialize apply it on demand.
+ *  增益先记在 buffer 上，混音时顺便乘上去，省掉一次完整的读写。
+ *
  * @param stack The stack
  * @param targetVolume The target volume (power ratio)
  * @param currentVolume On input, the current volume; on output, the new volume. Store this and pass it
@@ -244,12 +351,78 @@ void AKKAAEBufferStackApplyFaders(AKKAAEBufferStack * stack,
 /*!
  * Silence the top buffer
  *
- *  This function zereos out all samples in the topmost buffer.
+ *  This function zereos out all samples in the topmost buffer, and flags all its channels as
+ *  silent, so mixes and faders further down skip it.
  *
  * @param stack The stack
  */
 void AKKAAEBufferStackSilence(AKKAAEBufferStack * stack);
 
+/*!
+ * Apply a buffer's pending gain
+ *
+ *  Multiplies in the gain AKKAAEBufferStackApplyFaders left pending on the buffer, if any.
+ *  AKKAAEBufferStackGetMutable does this itself; call it directly before reading a faded buffer
+ *  with AKKAAEBufferStackGet, or writing to a buffer's samples obtained earlier.
+ *
+ * @param stack The stack
+ * @param index The buffer index
+ */
+void AKKAAEBufferStackMaterialize(AKKAAEBufferStack * stack, int index);
+
+/*!
+ * Whether a buffer has a pending gain
+ *
+ * @param stack The stack
+ * @param index The buffer index
+ * @return YES if AKKAAEBufferStackApplyFaders left a gain that hasn't been applied yet
+ */
+BOOL AKKAAEBufferStackHasPendingGain(const AKKAAEBufferStack * stack, int index);
+
+/*!
+ * Get the channels of a buffer known to be silent
+ *
+ *  Each buffer carries a flag per channel, set when the stack knows the channel is all zeros:
+ *  after AKKAAEBufferStackSilence or AKKAAEBufferStackDetectSilence, and carried through
+ *  AKKAAEBufferStackDuplicate, AKKAAEBufferStackMix and AKKAAEBufferStackApplyFaders. Mixes skip
+ *  silent channels, and faders skip buffers that are silent throughout.
+ *  AKKAAEBufferStackGetMutable clears them, as the caller may then write audio.
+ *  每个 buffer 的每个声道都有一个"已知静音"标记，混音和推子会跳过静音的部分。
+ *
+ *  Pushed buffers start with no flags, as their contents are undefined. Flags cover the first
+ *  32 channels.
+ *
+ * @param stack The stack
+ * @param index The buffer index
+ * @return Bit n set if channel n is known to be silent
+ */
+UInt32 AKKAAEBufferStackGetSilentChannels(const AKKAAEBufferStack * stack, int index);
+
+/*!
+ * Set the channels of a buffer known to be silent
+ *
+ *  Getting a buffer to write to with AKKAAEBufferStackGetMutable clears its flags. A module that
+ *  knows it rendered silence can set them afterwards.
+ *
+ * @param stack The stack
+ * @param index The buffer index
+ * @param silentChannels Bit n set if channel n is all zeros
+ */
+void AKKAAEBufferStackSetSilentChannels(AKKAAEBufferStack * stack, int index, UInt32 silentChannels);
+
+/*!
+ * Find silent channels in a buffer
+ *
+ *  Checks each channel not already flagged, with the AKKAAEDSPKernels isSilent kernel, and flags
+ *  those that are all zeros. Audible channels are rejected within the first few samples, so this
+ *  is cheap to run on generator output that is often silent, such as a sampler with no voices.
+ *
+ * @param stack The stack
+ * @param index The buffer index
+ * @return Bit n set if channel n is silent
+ */
+UInt32 AKKAAEBufferStackDetectSilence(AKKAAEBufferStack * stack, int index);
+
 /*!
  * Mix stack items onto an AudioBufferList
  *
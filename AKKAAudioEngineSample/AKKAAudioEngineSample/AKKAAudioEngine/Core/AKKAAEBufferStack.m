@@ -10,64 +10,99 @@
 #import "AKKAAETypes.h"
 #import "AKKAAEDSPUtilties.h"
 #import "AKKAAEUtilities.h"
+#import "AKKAAEDSPKernels.h"
+#import <float.h>
 
 const UInt32 AKKAAEBufferStackMaxFramesPerSlice = 4096;
 static const int kDefaultPoolSize = 16;
 
-typedef struct _AKKAAEBufferStackBufferLinkedList {
-    void * buffer;
-    struct _AKKAAEBufferStackBufferLinkedList * next;
-} AKKAAEBufferStackPoolEntry;
-
+// 所有的 entry、两个索引数组和引用计数都在 pool->bytes 这一块内存里，不再单独 calloc 链表节点
 typedef struct {
     void * bytes;
-    AKKAAEBufferStackPoolEntry * free;//在bufferlistpool中，这个是空的，在audiopool中，这个指的是没有用过的数据
-    AKKAAEBufferStackPoolEntry * used;// 在bufferlistpool中，这个是有刚转化好的数据的意思，在audiopool中，这个指的是用过的数据
+    size_t bytesPerEntry;
+    int entries;
+    void ** free;   // free[freeCount-1] 是下一个要分配出去的 entry
+    int freeCount;
+    void ** used;   // used[usedCount-1] 是栈顶，也就是 index 0
+    int usedCount;
+    int * references; // 每个 entry 被几个 buffer 共享，到 0 才真正回到 free
 } AKKAAEBufferStackPool;
 
+// 每个 entry 在 audioBufferList 之后还放着每个声道一个 AKKAAEDSPGainRamp，是还没乘上去的推子增益
 typedef struct {
     AudioTimeStamp timestamp;
+    UInt32 silentChannels;  // 第 n 位表示第 n 个声道全是 0
+    BOOL gainPending;       // The ramps after the buffer list still have to be applied
     AudioBufferList audioBufferList;
 } AKKAAEBufferStackBuffer;
 
+// All of a buffer list's channels, as silent channel flags
+static inline UInt32 AKKAAEBufferStackAllChannels(const AudioBufferList * bufferList) {
+    return bufferList->mNumberBuffers >= 32 ? 0xFFFFFFFF : (1u << bufferList->mNumberBuffers) - 1;
+}
+
 struct AKKAAEBufferStack {
     int                         poolSize;
     int                         maxChannelsPerBuffer;
-    UInt32                      frameCount; // 每一个声道一次切成的片数，默认为4096
+    UInt32                      maxFramesPerSlice; // 每个单声道 buffer 的容量
+    UInt32                      frameCount; // 每一个声道一次切成的片数，默认等于 maxFramesPerSlice
     AudioTimeStamp              timeStamp;
     int                         stackCount;
     AKKAAEBufferStackPool       audioPool; /// 就是个结构存储要释放的和在用的两个链表
     AKKAAEBufferStackPool       bufferListPool;
+    size_t                      rampsOffset; // Where each entry's pending gain ramps start
+    int                         reservedAudioBuffers; // 共享的声道写的时候要复制，提前留好的 buffer 数
 };
 
 static void AKKAAEBufferStackPoolInit(AKKAAEBufferStackPool * pool, int entries, size_t bytesPerEntry);
 static void AKKAAEBufferStackPoolCleanup(AKKAAEBufferStackPool * pool);
 static void AKKAAEBufferStackPoolReset(AKKAAEBufferStackPool * pool);
+static size_t AKKAAEBufferStackPoolGetMemoryUsage(const AKKAAEBufferStackPool * pool);
 static void * AKKAAEBufferStackPoolGetNextFreeBuffer(AKKAAEBufferStackPool * pool);
 static BOOL AKKAAEBufferStackPoolFreeBuffer(AKKAAEBufferStackPool * pool, void * buffer);
 static void * AKKAAEBufferStackPoolGetUsedBufferAtIndex(const AKKAAEBufferStackPool * pool, int index);
+static void * AKKAAEBufferStackPoolFreeUsedBufferAtIndex(AKKAAEBufferStackPool * pool, int index);
 static void AKKAAEBufferStackSwapTopTwoUsedBuffers(AKKAAEBufferStackPool * pool);
+static int * AKKAAEBufferStackPoolGetReferences(const AKKAAEBufferStackPool * pool, void * buffer);
+
+static inline AKKAAEBufferStackBuffer * AKKAAEBufferStackGetEntry(const AKKAAEBufferStack * stack, int index) {
+    if ( index >= stack->stackCount ) return NULL;
+    return (AKKAAEBufferStackBuffer *)AKKAAEBufferStackPoolGetUsedBufferAtIndex(&stack->bufferListPool, index);
+}
+
+static inline AKKAAEDSPGainRamp * AKKAAEBufferStackGetEntryRamps(const AKKAAEBufferStack * stack, AKKAAEBufferStackBuffer * entry) {
+    return (AKKAAEDSPGainRamp *)((char *)entry + stack->rampsOffset);
+}
 
 AKKAAEBufferStack * AKKAAEBufferStackNew(int poolSize) {
     return AKKAAEBufferStackNewWithOptions(poolSize, 2, 0);
 }
 
-// numberOfSingleChannelsBuffer 是将每一个声道的音频传入 所以就是声道数 * poolsize
 AKKAAEBufferStack * AKKAAEBufferStackNewWithOptions(int poolSize, int maxChannelsPerBuffer, int numberOfSingleChannelBuffers) {
+    return AKKAAEBufferStackNewWithMaxFrames(poolSize, maxChannelsPerBuffer, numberOfSingleChannelBuffers, 0);
+}
+
+// numberOfSingleChannelsBuffer 是将每一个声道的音频传入 所以就是声道数 * poolsize
+AKKAAEBufferStack * AKKAAEBufferStackNewWithMaxFrames(int poolSize, int maxChannelsPerBuffer, int numberOfSingleChannelBuffers,
+                                                      UInt32 maxFramesPerSlice) {
     if ( !poolSize) poolSize = kDefaultPoolSize;
     if ( !numberOfSingleChannelBuffers) numberOfSingleChannelBuffers = poolSize * maxChannelsPerBuffer;
+    if ( !maxFramesPerSlice ) maxFramesPerSlice = AKKAAEBufferStackMaxFramesPerSlice;
+    assert(maxFramesPerSlice <= AKKAAEBufferStackMaxFramesPerSlice);
     AKKAAEBufferStack * stack = (AKKAAEBufferStack *)calloc(1, sizeof(AKKAAEBufferStack));
     stack->poolSize = poolSize;
     stack->maxChannelsPerBuffer = maxChannelsPerBuffer;
-    stack->frameCount = AKKAAEBufferStackMaxFramesPerSlice;
-    //bytesPerBufferChannel = 4096 * sizeof(float) 一个声道所有切片的所有bytes
+    stack->maxFramesPerSlice = maxFramesPerSlice;
+    stack->frameCount = maxFramesPerSlice;
+    //bytesPerBufferChannel = maxFramesPerSlice * sizeof(float) 一个声道所有切片的所有bytes
     //numberOfSingleChannelBuffers 有多少个片数据
     //bytesPerBufferChannel 一片数据多少byte
-    size_t bytesPerBufferChannel = AKKAAEBufferStackMaxFramesPerSlice * AKKAAEAudioDescription.mBytesPerFrame;
+    size_t bytesPerBufferChannel = maxFramesPerSlice * AKKAAEAudioDescription.mBytesPerFrame;
     AKKAAEBufferStackPoolInit(&stack->audioPool, numberOfSingleChannelBuffers, bytesPerBufferChannel);
     
-    // 以audiobufferlist 形式存储下来的链表
-    size_t bytesPerBufferListEntry = sizeof(AKKAAEBufferStackBuffer) +((maxChannelsPerBuffer - 1) * sizeof(AudioBuffer));
+    // 以audiobufferlist 形式存储下来的链表，每个 entry 后面跟着每个声道的待定增益
+    stack->rampsOffset = sizeof(AKKAAEBufferStackBuffer) +((maxChannelsPerBuffer - 1) * sizeof(AudioBuffer));
+    size_t bytesPerBufferListEntry = stack->rampsOffset + (maxChannelsPerBuffer * sizeof(AKKAAEDSPGainRamp));
     AKKAAEBufferStackPoolInit(&stack->bufferListPool, poolSize, bytesPerBufferListEntry);
     
     return stack;
@@ -80,19 +115,46 @@ void AKKAAEBufferStackFree(AKKAAEBufferStack * stack) {
 }
 
 void AKKAAEBufferStackSetFrameCount(AKKAAEBufferStack * stack,UInt32 frameCount) {
-    assert(frameCount <= AKKAAEBufferStackMaxFramesPerSlice);
-    stack->frameCount = frameCount;
+    assert(frameCount <= stack->maxFramesPerSlice);
+    stack->frameCount = MIN(frameCount, stack->maxFramesPerSlice);
 }
 
 UInt32 AKKAAEBufferStackGetFrameCount(const AKKAAEBufferStack * stack) {
     return stack->frameCount;
 }
 
+UInt32 AKKAAEBufferStackGetMaxFramesPerSlice(const AKKAAEBufferStack * stack) {
+    return stack->maxFramesPerSlice;
+}
+
+BOOL AKKAAEBufferStackSetMaxFramesPerSlice(AKKAAEBufferStack * stack, UInt32 maxFramesPerSlice) {
+    if ( !maxFramesPerSlice ) maxFramesPerSlice = AKKAAEBufferStackMaxFramesPerSlice;
+    assert(maxFramesPerSlice <= AKKAAEBufferStackMaxFramesPerSlice);
+    if ( stack->stackCount > 0 ) return NO;
+    if ( maxFramesPerSlice == stack->maxFramesPerSlice ) return YES;
+
+    // 只有音频 pool 和切片大小有关，buffer list pool 不用动
+    int entries = stack->audioPool.entries;
+    AKKAAEBufferStackPoolCleanup(&stack->audioPool);
+    AKKAAEBufferStackPoolInit(&stack->audioPool, entries, maxFramesPerSlice * AKKAAEAudioDescription.mBytesPerFrame);
+    if ( stack->frameCount == stack->maxFramesPerSlice || stack->frameCount > maxFramesPerSlice ) {
+        stack->frameCount = maxFramesPerSlice;
+    }
+    stack->maxFramesPerSlice = maxFramesPerSlice;
+    return YES;
+}
+
+size_t AKKAAEBufferStackGetMemoryUsage(const AKKAAEBufferStack * stack) {
+    return sizeof(AKKAAEBufferStack)
+        + AKKAAEBufferStackPoolGetMemoryUsage(&stack->audioPool)
+        + AKKAAEBufferStackPoolGetMemoryUsage(&stack->bufferListPool);
+}
+
 void AKKAAEBufferStackSetTimeStamp(AKKAAEBufferStack * stack, const AudioTimeStamp * timestamp) {
     stack->timeStamp = *timestamp;
 }
 
-const AudioTimeStamp * AKKAAKKAAEBufferStackGetAEBufferStackGetTimeStamp(const AKKAAEBufferStack * stack) {
+const AudioTimeStamp * AKKAAEBufferStackGetTimeStamp(const AKKAAEBufferStack * stack) {
     return &stack->timeStamp;
 }
 
@@ -100,7 +162,7 @@ int AKKAAEBufferStackGetPoolSize(const AKKAAEBufferStack * stack) {
     return stack->poolSize;
 }
 
-int AKKKAAEBufferStackGetMaximumChannelsPerBuffer(const AKKAAEBufferStack * stack) {
+int AKKAAEBufferStackGetMaximumChannelsPerBuffer(const AKKAAEBufferStack * stack) {
     return stack->maxChannelsPerBuffer;
 }
 
@@ -108,10 +170,78 @@ int AKKAAEBufferStackCount(const AKKAAEBufferStack * stack) {
     return stack->stackCount;
 }
 
-// 因为用过了才知道，没用过不能有任何操作
+// Audio buffers that can be handed out without breaking a promise made to a shared channel
+static inline int AKKAAEBufferStackAvailableAudioBuffers(const AKKAAEBufferStack * stack) {
+    return stack->audioPool.freeCount - stack->reservedAudioBuffers;
+}
+
+// 写之前调用：和别的 buffer 共享的声道、外部的声道（可能是只读的，比如映射的文件）换成自己的一份。
+// copy 为 NO 时不复制内容，给马上要整个覆盖的情况用
+// 这些声道在 Duplicate/PushExternal 的时候已经留好了一个 buffer，所以这里不会失败
+static void AKKAAEBufferStackMakeWritable(AKKAAEBufferStack * stack, AKKAAEBufferStackBuffer * entry, BOOL copy) {
+    AudioBufferList * abl = &entry->audioBufferList;
+    UInt32 capacity = stack->maxFramesPerSlice * AKKAAEAudioDescription.mBytesPerFrame;
+    for (int i = 0; i < abl->mNumberBuffers; i++) {
+        int * references = AKKAAEBufferStackPoolGetReferences(&stack->audioPool, abl->mBuffers[i].mData);
+        if (references && *references == 1) continue;
+        assert(stack->reservedAudioBuffers > 0);
+        stack->reservedAudioBuffers--;
+        void * data = AKKAAEBufferStackPoolGetNextFreeBuffer(&stack->audioPool);
+        UInt32 bytes = MIN(abl->mBuffers[i].mDataByteSize, capacity);
+        if (copy) memcpy(data, abl->mBuffers[i].mData, bytes);
+        if (references) (*references)--;
+        abl->mBuffers[i].mData = data;
+        abl->mBuffers[i].mDataByteSize = bytes;
+    }
+}
+
 const AudioBufferList * AKKAAEBufferStackGet(const AKKAAEBufferStack * stack, int index) {
-    if ( index >= stack->stackCount ) return NULL;
-    return &((const AKKAAEBufferStackBuffer*)AKKAAEBufferStackPoolGetUsedBufferAtIndex(&stack->bufferListPool, index))->audioBufferList;
+    AKKAAEBufferStackBuffer * entry = AKKAAEBufferStackGetEntry(stack, index);
+    if ( !entry ) return NULL;
+    return &entry->audioBufferList;
+}
+
+// Own samples with the pending gain applied, silent channel flags kept: for callers here that know what they write
+static AKKAAEBufferStackBuffer * AKKAAEBufferStackGetWritable(AKKAAEBufferStack * stack, int index) {
+    AKKAAEBufferStackBuffer * entry = AKKAAEBufferStackGetEntry(stack, index);
+    if ( !entry ) return NULL;
+    // The caller will write to it, so it can't share its samples with a duplicate any more
+    AKKAAEBufferStackMakeWritable(stack, entry, YES);
+    // Writes go on top of the faded samples
+    if ( entry->gainPending ) AKKAAEBufferStackMaterialize(stack, index);
+    return entry;
+}
+
+const AudioBufferList * AKKAAEBufferStackGetMutable(AKKAAEBufferStack * stack, int index) {
+    AKKAAEBufferStackBuffer * entry = AKKAAEBufferStackGetWritable(stack, index);
+    if ( !entry ) return NULL;
+    // Whatever the caller writes may be audible, so no channel can be skipped as silent any more
+    entry->silentChannels = 0;
+    return &entry->audioBufferList;
+}
+
+BOOL AKKAAEBufferStackIsShared(const AKKAAEBufferStack * stack, int index) {
+    AKKAAEBufferStackBuffer * entry = AKKAAEBufferStackGetEntry(stack, index);
+    if ( !entry ) return NO;
+    for (int i = 0; i < entry->audioBufferList.mNumberBuffers; i++) {
+        int * references = AKKAAEBufferStackPoolGetReferences(&stack->audioPool, entry->audioBufferList.mBuffers[i].mData);
+        if (references && *references > 1) return YES;
+    }
+    return NO;
+}
+
+void AKKAAEBufferStackMaterialize(AKKAAEBufferStack * stack, int index) {
+    AKKAAEBufferStackBuffer * entry = AKKAAEBufferStackGetEntry(stack, index);
+    if ( !entry || !entry->gainPending ) return;
+    AKKAAEBufferStackMakeWritable(stack, entry, YES);
+    AKKAAEDSPApplyGainRamps(&entry->audioBufferList, AKKAAEBufferStackGetEntryRamps(stack, entry),
+                            entry->audioBufferList.mBuffers[0].mDataByteSize / sizeof(float));
+    entry->gainPending = NO;
+}
+
+BOOL AKKAAEBufferStackHasPendingGain(const AKKAAEBufferStack * stack, int index) {
+    AKKAAEBufferStackBuffer * entry = AKKAAEBufferStackGetEntry(stack, index);
+    return entry && entry->gainPending;
 }
 
 const AudioBufferList * AKKAAEBufferStackPush(AKKAAEBufferStack * stack, int count) {
@@ -134,6 +264,15 @@ const AudioBufferList * AKKAAEBufferStackPushWithChannels(AKKAAEBufferStack * st
         
     }
     
+    if ( count * channelCount > AKKAAEBufferStackAvailableAudioBuffers(stack) ) {
+#ifdef DEBUG
+        if ( AKKAAERateLimit() )
+            printf("Couldn't push a buffer: the audio pool is full. Add a breakpoint on AEBufferStackPushFailed to debug.\n");
+        AKKAAEBufferStackPushFailed();
+#endif
+        return NULL;
+    }
+    
     if ( channelCount > stack->maxChannelsPerBuffer ) {
 #ifdef DEBUG
         if ( AKKAAERateLimit() )
@@ -153,6 +292,8 @@ const AudioBufferList * AKKAAEBufferStackPushWithChannels(AKKAAEBufferStack * st
         assert(buffer);
         if (!first) first = buffer;
         buffer->timestamp = stack->timeStamp;
+        buffer->silentChannels = 0;
+        buffer->gainPending = NO;
         // 双声道就是两个buffer
         buffer->audioBufferList.mNumberBuffers = channelCount;
         for (int i = 0; i < channelCount; i++) {
@@ -170,18 +311,89 @@ const AudioBufferList * AKKAAEBufferStackPushWithChannels(AKKAAEBufferStack * st
     return &first->audioBufferList;
 }
 
+const AudioBufferList * AKKAAEBufferStackPushExternal(AKKAAEBufferStack * stack, const AudioBufferList * buffer) {
+    assert(buffer->mNumberBuffers > 0);
+    if (stack->stackCount + 1 > stack->poolSize) {
+#ifdef DEBUG
+        if ( AKKAAERateLimit() )
+            printf("Couldn't push a buffer. Add a breakpoint on AEBufferStackPushFailed to debug.\n");
+        AKKAAEBufferStackPushFailed();
+#endif
+        return NULL;
+    }
+    
+    if ( buffer->mNumberBuffers > stack->maxChannelsPerBuffer ) {
+#ifdef DEBUG
+        if ( AKKAAERateLimit() )
+            printf("Tried to push a buffer with too many channels. Add a breakpoint on AEBufferStackPushFailed to debug.\n");
+        AKKAAEBufferStackPushFailed();
+#endif
+        return NULL;
+    }
+    
+    // External audio is never written to: whoever writes first gets a copy, from buffers set aside now
+    if ( buffer->mNumberBuffers > AKKAAEBufferStackAvailableAudioBuffers(stack) ) {
+#ifdef DEBUG
+        if ( AKKAAERateLimit() )
+            printf("Couldn't push a buffer: the audio pool is full. Add a breakpoint on AEBufferStackPushFailed to debug.\n");
+        AKKAAEBufferStackPushFailed();
+#endif
+        return NULL;
+    }
+    stack->reservedAudioBuffers += buffer->mNumberBuffers;
+    
+    // 只复制 AudioBufferList 结构，mData 还是指向外部的内存；移除时 audioPool 会忽略这些外部指针
+    AKKAAEBufferStackBuffer * entry = (AKKAAEBufferStackBuffer *)AKKAAEBufferStackPoolGetNextFreeBuffer(&stack->bufferListPool);
+    assert(entry);
+    entry->timestamp = stack->timeStamp;
+    entry->silentChannels = 0;
+    entry->gainPending = NO;
+    memcpy(&entry->audioBufferList, buffer, AEAudioBufferListGetStructSize(buffer));
+    stack->stackCount++;
+    return &entry->audioBufferList;
+}
+
 const AudioBufferList * AKKAAEBufferStackDuplicate(AKKAAEBufferStack * stack) {
     if (stack->stackCount == 0) return NULL;
-    const AKKAAEBufferStackBuffer * top = (const AKKAAEBufferStackBuffer *)AKKAAEBufferStackPoolGetUsedBufferAtIndex(&stack->bufferListPool, 0);
-    if (!top) return NULL;
-    if ( !AKKAAEBufferStackPushWithChannels(stack, 1, top->audioBufferList.mNumberBuffers)) return NULL;
-    AKKAAEBufferStackBuffer * duplicate = (AKKAAEBufferStackBuffer *)AKKAAEBufferStackPoolGetUsedBufferAtIndex(&stack->bufferListPool, 0);
-    for (int i = 0; i < duplicate->audioBufferList.mNumberBuffers; i++) {
-        memcpy(duplicate->audioBufferList.mBuffers[i].mData,
-               top->audioBufferList.mBuffers[i].mData,
-               duplicate->audioBufferList.mBuffers[i].mDataByteSize);
+    if (stack->stackCount + 1 > stack->poolSize) {
+#ifdef DEBUG
+        if ( AKKAAERateLimit() )
+            printf("Couldn't push a buffer. Add a breakpoint on AEBufferStackPushFailed to debug.\n");
+        AKKAAEBufferStackPushFailed();
+#endif
+        return NULL;
     }
+    const AKKAAEBufferStackBuffer * top = AKKAAEBufferStackGetEntry(stack, 0);
+    int channels = top->audioBufferList.mNumberBuffers;
+
+    // Every channel may need its own copy when first written, so set the buffers aside now, rather than failing mid-render later
+    if (channels > AKKAAEBufferStackAvailableAudioBuffers(stack)) {
+#ifdef DEBUG
+        if ( AKKAAERateLimit() )
+            printf("Couldn't duplicate a buffer: the audio pool is full. Add a breakpoint on AEBufferStackPushFailed to debug.\n");
+        AKKAAEBufferStackPushFailed();
+#endif
+        return NULL;
+    }
+
+    // 新 entry 的声道直接指向原来的内存，引用计数加一；谁先写谁复制
+    AKKAAEBufferStackBuffer * duplicate = (AKKAAEBufferStackBuffer *)AKKAAEBufferStackPoolGetNextFreeBuffer(&stack->bufferListPool);
+    assert(duplicate);
+    memcpy(&duplicate->audioBufferList, &top->audioBufferList, AEAudioBufferListGetStructSize(&top->audioBufferList));
+    // External channels are shared the same way, just without a reference count: they're never written to
+    for (int i = 0; i < channels; i++) {
+        int * references = AKKAAEBufferStackPoolGetReferences(&stack->audioPool, duplicate->audioBufferList.mBuffers[i].mData);
+        if (references) (*references)++;
+    }
+    stack->reservedAudioBuffers += channels;
     duplicate->timestamp = top->timestamp;
+    duplicate->silentChannels = top->silentChannels;
+    duplicate->gainPending = top->gainPending;
+    if (top->gainPending) {
+        memcpy(AKKAAEBufferStackGetEntryRamps(stack, duplicate), AKKAAEBufferStackGetEntryRamps(stack, (AKKAAEBufferStackBuffer *)top),
+               channels * sizeof(AKKAAEDSPGainRamp));
+    }
+    stack->stackCount++;
     return &duplicate->audioBufferList;
 }
 
@@ -200,15 +412,17 @@ void AKKAAEBufferStackPop(AKKAAEBufferStack * stack, int count) {
 }
 
 void AKKAAEBufferStackRemove(AKKAAEBufferStack * stack, int index) {
-    AKKAAEBufferStackBuffer * buffer = (AKKAAEBufferStackBuffer *)AKKAAEBufferStackPoolGetUsedBufferAtIndex(&stack->bufferListPool, index);
+    AKKAAEBufferStackBuffer * buffer = (AKKAAEBufferStackBuffer *)AKKAAEBufferStackPoolFreeUsedBufferAtIndex(&stack->bufferListPool, index);
     if (!buffer) {
         return;
     }
     for (int j = buffer->audioBufferList.mNumberBuffers - 1; j >= 0; j--) {
+        // One fewer sharer of a buffer, or reader of external audio, so one fewer copy that might be needed
+        int * references = AKKAAEBufferStackPoolGetReferences(&stack->audioPool, buffer->audioBufferList.mBuffers[j].mData);
+        if (!references || *references > 1) stack->reservedAudioBuffers--;
         // Free buffers in reverse order, so that they're in correct order if we push again
         AKKAAEBufferStackPoolFreeBuffer(&stack->audioPool, buffer->audioBufferList.mBuffers[j].mData);
     }
-    AKKAAEBufferStackPoolFreeBuffer(&stack->bufferListPool, buffer);
     stack->stackCount--;
 }
 
@@ -219,35 +433,74 @@ const AudioBufferList * AKKAAEBufferStackMix(AKKAAEBufferStack * stack,int count
 const AudioBufferList * AKKAAEBufferStackMixWithGain(AKKAAEBufferStack * stack, int count,const float * gains) {
     if (count != 0 && count < 2) return NULL;
     
-    for (int i = 1; count ? i < count : i; i++) {
-        const AudioBufferList * abl1 = AKKAAEBufferStackGet(stack, 0);
-        const AudioBufferList * abl2 = AKKAAEBufferStackGet(stack, 1);
-        // 如果其中有一个没有 那么就返回第一个的，要么有，要么没有
-        if (!abl1 || !abl2) return AKKAAEBufferStackGet(stack, 0);
-        // 因为是从1开始计数，但gains[0]是从0开始
-        float abl1Gain = i == 1 && gains ? gains[0] : 1.0;
-        float abl2Gain = gains ? gains[i] : 1.0;
-        //用少的那个开始校准
-        if (abl2->mNumberBuffers < abl1->mNumberBuffers) {
-            // Swap abl1 and abl2, so that we're writing into the buffer with more channels
-            AKKAAEBufferStackSwap(stack);
-            abl1 = AKKAAEBufferStackGet(stack, 0);
-            abl2 = AKKAAEBufferStackGet(stack, 1);
-            float tmp = abl1Gain;
-            abl2Gain = abl1Gain;
-            abl1Gain = tmp;
+    // 0 表示全部；不够的话就只混合现有的
+    count = count ? MIN(count, stack->stackCount) : stack->stackCount;
+    if (count < 2) {
+        AKKAAEBufferStackBuffer * entry = AKKAAEBufferStackGetWritable(stack, 0);
+        return entry ? &entry->audioBufferList : NULL;
+    }
+    
+    // Mix into the buffer with the most channels, so nothing is lost
+    const AudioBufferList * inputs[count];
+    const AKKAAEDSPGainRamp * ramps[count];
+    UInt32 silentChannels[count];
+    int target = 0;
+    for (int i = 0; i < count; i++) {
+        AKKAAEBufferStackBuffer * entry = AKKAAEBufferStackGetEntry(stack, i);
+        inputs[i] = &entry->audioBufferList;
+        ramps[i] = entry->gainPending ? AKKAAEBufferStackGetEntryRamps(stack, entry) : NULL;
+        silentChannels[i] = entry->silentChannels;
+        if (inputs[i]->mNumberBuffers > inputs[target]->mNumberBuffers) target = i;
+    }
+    // The target is summed into, so it needs its own samples; done first, so no other input aliases them
+    AKKAAEBufferStackMakeWritable(stack, AKKAAEBufferStackGetEntry(stack, target), YES);
+    
+    // 一次性把所有的 buffer 累加到 target 上：推子增益在同一遍里乘上去，静音的声道直接跳过
+    UInt32 mixSilentChannels = AKKAAEDSPMixMultipleWithGainRamps(inputs, gains, ramps, silentChannels, count, YES,
+                                                                 stack->frameCount, inputs[target]);
+    AKKAAEBufferStackGetEntry(stack, target)->gainPending = NO;
+    AKKAAEBufferStackSetSilentChannels(stack, target, mixSilentChannels);
+    
+    // Remove the others, deepest first, leaving the target on top
+    for (int i = count - 1; i >= 0; i--) {
+        if (i != target) AKKAAEBufferStackRemove(stack, i);
+    }
+    
+    // The mix's silent channels are known, so they're kept
+    return &AKKAAEBufferStackGetWritable(stack, 0)->audioBufferList;
+}
+
+// A constant gain times a ramp is still a ramp
+static inline AKKAAEDSPGainRamp AKKAAEBufferStackScaleRamp(AKKAAEDSPGainRamp ramp, float gain) {
+    return (AKKAAEDSPGainRamp){ ramp.start * gain, ramp.step * gain, ramp.rampFrames, ramp.gain * gain };
+}
+
+// 把新的增益记到 entry 上而不是马上乘：和已有的待定增益合并，合并不了（两个都在 ramp）才先把旧的乘上去
+static void AKKAAEBufferStackDeferGain(AKKAAEBufferStack * stack, int index, const AKKAAEDSPGainRamp * ramps) {
+    AKKAAEBufferStackBuffer * entry = AKKAAEBufferStackGetEntry(stack, index);
+    AKKAAEDSPGainRamp * pending = AKKAAEBufferStackGetEntryRamps(stack, entry);
+    int channels = entry->audioBufferList.mNumberBuffers;
+    if (entry->gainPending) {
+        for (int i = 0; i < channels; i++) {
+            if (pending[i].rampFrames > 0 && ramps[i].rampFrames > 0) {
+                AKKAAEBufferStackMaterialize(stack, index);
+                break;
+            }
         }
-        
-        AKKAAEBufferStackPop(stack, 1);
-        
-        // 先将abl1开始变换
-        if (i == 1 && abl1Gain != 1.0f) {
-            AKKAAEDSPApplyGain(abl1, abl1Gain, stack->frameCount);
+    }
+    if (!entry->gainPending) {
+        memcpy(pending, ramps, channels * sizeof(AKKAAEDSPGainRamp));
+    } else {
+        for (int i = 0; i < channels; i++) {
+            pending[i] = pending[i].rampFrames == 0
+                ? AKKAAEBufferStackScaleRamp(ramps[i], pending[i].gain)
+                : AKKAAEBufferStackScaleRamp(pending[i], ramps[i].gain);
         }
-        // 再将两个合成
-        AKKAAEDSPMix(abl1, abl2, 1, abl2Gain, YES, stack->frameCount, abl2);
     }
-    return AKKAAEBufferStackGet(stack, 0);
+    entry->gainPending = NO;
+    for (int i = 0; i < channels; i++) {
+        if (!AKKAAEDSPGainRampIsUnity(&pending[i])) entry->gainPending = YES;
+    }
 }
 
 void AKKAAEBufferStackApplyFaders (AKKAAEBufferStack * stack,
@@ -255,10 +508,13 @@ void AKKAAEBufferStackApplyFaders (AKKAAEBufferStack * stack,
                                    float * currentVolume,
                                    float targetBalance,
                                    float * currentBalance) {
-    const AudioBufferList * abl = AKKAAEBufferStackGet(stack, 0);
-    if (!abl) return;
-    if (fabs(targetBalance) > FLT_EPSILON) {
-        // Make mono buffer stereo
+    AKKAAEBufferStackBuffer * entry = AKKAAEBufferStackGetEntry(stack, 0);
+    if (!entry) return;
+    const AudioBufferList * abl = &entry->audioBufferList;
+    UInt32 silentChannels = entry->silentChannels;
+    if (abl->mNumberBuffers == 1 && fabs(targetBalance) > FLT_EPSILON) {
+        // Make mono buffer stereo. A pending gain doesn't survive the pop, so apply it first.
+        AKKAAEBufferStackMaterialize(stack, 0);
         float * priorBuffer = abl->mBuffers[0].mData;
         AKKAAEBufferStackPop(stack, 1);
         abl = AKKAAEBufferStackPushWithChannels(stack, 1, 2);
@@ -268,38 +524,100 @@ void AKKAAEBufferStackApplyFaders (AKKAAEBufferStack * stack,
             return;
         }
         if (abl->mBuffers[0].mData != priorBuffer) {
-            memcpy(abl->mBuffers[1].mData, priorBuffer, abl->mBuffers[1].mDataByteSize);
+            // The prior buffer is still held by a duplicate, so we were given another one
+            memcpy(abl->mBuffers[0].mData, priorBuffer, abl->mBuffers[0].mDataByteSize);
         }
         // 转双声道就是复制下
         memcpy(abl->mBuffers[1].mData, priorBuffer, abl->mBuffers[1].mDataByteSize);
+        silentChannels = (silentChannels & 1) ? 3 : 0;
+        AKKAAEBufferStackSetSilentChannels(stack, 0, silentChannels);
+    }
+    if (silentChannels == AKKAAEBufferStackAllChannels(abl)) {
+        // Any gain of silence is silence. With nothing to hear, the ramps can jump straight to their targets.
+        if (currentVolume) *currentVolume = targetVolume;
+        if (currentBalance) *currentBalance = targetBalance;
+        return;
+    }
+
+    AKKAAEDSPGainRamp ramps[abl->mNumberBuffers];
+    AKKAAEDSPGetVolumeAndBalanceRamps(abl->mNumberBuffers, targetVolume, currentVolume, targetBalance, currentBalance,
+                                      stack->frameCount, ramps);
+    BOOL muted = YES;
+    for (int i = 0; i < abl->mNumberBuffers; i++) {
+        if (ramps[i].rampFrames > 0 || ramps[i].gain >= FLT_EPSILON) muted = NO;
     }
-    AKKAAEDSPApplyVolumeAndBalance(abl, targetVolume, currentVolume, targetBalance, currentBalance, stack->frameCount);
+    if (muted) {
+        // Held at zero volume: silence it now, so mixes skip it
+        AKKAAEBufferStackSilence(stack);
+        return;
+    }
+
+    // 不马上乘：留给下一次混音或者输出在同一遍里做
+    AKKAAEBufferStackDeferGain(stack, 0, ramps);
 }
 
 void AKKAAEBufferStackSilence(AKKAAEBufferStack * stack) {
-    const AudioBufferList * abl = AKKAAEBufferStackGet(stack, 0);
-    if (!abl) return;
+    AKKAAEBufferStackBuffer * entry = AKKAAEBufferStackGetEntry(stack, 0);
+    if (!entry) return;
+    const AudioBufferList * abl = &entry->audioBufferList;
+    entry->gainPending = NO;
+    // Overwritten anyway, so a shared buffer is swapped for a fresh one without copying
+    AKKAAEBufferStackMakeWritable(stack, entry, NO);
     AKKAAEAudioBufferListSilence(abl, 0, stack->frameCount);
+    AKKAAEBufferStackSetSilentChannels(stack, 0, AKKAAEBufferStackAllChannels(abl));
 }
 
-void AKKAAEBufferStackMixToBufferList(AKKAAEBufferStack * stack, int bufferCount, const AudioBufferList * output) {
-    // mix stackItems
-    for (int i = 0; bufferCount ? 1 < bufferCount : 1; i++) {
-        const AudioBufferList * abl = AKKAAEBufferStackGet(stack, i);
-        if (!abl) return;
-        AKKAAEDSPMix(abl,output,1,1,YES,stack->frameCount,output);
+UInt32 AKKAAEBufferStackGetSilentChannels(const AKKAAEBufferStack * stack, int index) {
+    if (index >= stack->stackCount) return 0;
+    return ((const AKKAAEBufferStackBuffer *)AKKAAEBufferStackPoolGetUsedBufferAtIndex(&stack->bufferListPool, index))->silentChannels;
+}
+
+void AKKAAEBufferStackSetSilentChannels(AKKAAEBufferStack * stack, int index, UInt32 silentChannels) {
+    if (index >= stack->stackCount) return;
+    AKKAAEBufferStackBuffer * buffer = (AKKAAEBufferStackBuffer *)AKKAAEBufferStackPoolGetUsedBufferAtIndex(&stack->bufferListPool, index);
+    buffer->silentChannels = silentChannels & AKKAAEBufferStackAllChannels(&buffer->audioBufferList);
+}
+
+UInt32 AKKAAEBufferStackDetectSilence(AKKAAEBufferStack * stack, int index) {
+    if (index >= stack->stackCount) return 0;
+    AKKAAEBufferStackBuffer * buffer = (AKKAAEBufferStackBuffer *)AKKAAEBufferStackPoolGetUsedBufferAtIndex(&stack->bufferListPool, index);
+    const AKKAAEDSPKernels * kernels = AKKAAEDSPKernelsGet();
+    for (int i = 0; i < MIN(buffer->audioBufferList.mNumberBuffers, 32); i++) {
+        if (buffer->silentChannels & (1u << i)) continue;
+        if (kernels->isSilent(buffer->audioBufferList.mBuffers[i].mData, stack->frameCount)) {
+            buffer->silentChannels |= 1u << i;
+        }
+    }
+    return buffer->silentChannels;
+}
+
+// 输出自己作为第一个输入原地累加，所有 buffer 一遍混进去，推子增益也在这一遍里乘
+static void AKKAAEBufferStackMixOnto(AKKAAEBufferStack * stack, int bufferCount, const AudioBufferList * output) {
+    int count = bufferCount ? MIN(bufferCount, stack->stackCount) : stack->stackCount;
+    if (count == 0) return;
+    const AudioBufferList * inputs[count + 1];
+    const AKKAAEDSPGainRamp * ramps[count + 1];
+    UInt32 silentChannels[count + 1];
+    inputs[0] = output;
+    ramps[0] = NULL;
+    silentChannels[0] = 0;
+    for (int i = 0; i < count; i++) {
+        AKKAAEBufferStackBuffer * entry = AKKAAEBufferStackGetEntry(stack, i);
+        inputs[i + 1] = &entry->audioBufferList;
+        ramps[i + 1] = entry->gainPending ? AKKAAEBufferStackGetEntryRamps(stack, entry) : NULL;
+        silentChannels[i + 1] = entry->silentChannels;
     }
+    AKKAAEDSPMixMultipleWithGainRamps(inputs, NULL, ramps, silentChannels, count + 1, YES, stack->frameCount, output);
+}
+
+void AKKAAEBufferStackMixToBufferList(AKKAAEBufferStack * stack, int bufferCount, const AudioBufferList * output) {
+    AKKAAEBufferStackMixOnto(stack, bufferCount, output);
 }
 
 void AKKAAEBufferStackMixToBufferListChannels(AKKAAEBufferStack * stack, int bufferCount, AKKAAEChannelSet channels, const AudioBufferList * output) {
     // Setup output buffer
     AKKAAEAudioBufferListCopyOnStackWithChannelSubset(outputBuffer,output,channels);
-    
-    for (int i = 0; bufferCount ? i < bufferCount : 1 ; i++) {
-        const AudioBufferList * abl = AKKAAEBufferStackGet(stack, i);
-        if (! abl) return;
-        AKKAAEDSPMix(abl, outputBuffer, 1, 1, YES, stack->frameCount, outputBuffer);
-    }
+    AKKAAEBufferStackMixOnto(stack, bufferCount, outputBuffer);
 }
 
 AudioTimeStamp * AKKAAEBufferStackGetTimeStampForBuffer(AKKAAEBufferStack * stack, int index) {
@@ -311,126 +629,109 @@ void AKKAAEBufferStackReset(AKKAAEBufferStack * stack) {
     AKKAAEBufferStackPoolReset(&stack->audioPool);
     AKKAAEBufferStackPoolReset(&stack->bufferListPool);
     stack->stackCount = 0;
+    stack->reservedAudioBuffers = 0;
 }
 
 #pragma mark - Helpers
 
 static void AKKAAEBufferStackPoolInit(AKKAAEBufferStackPool * pool, int entries,size_t bytesPerEntry) {
-    pool->bytes = malloc(entries * bytesPerEntry);
-    pool->used = NULL;
+    // Keep entries pointer-aligned, then put the free and used index arrays after them, in the same block
+    bytesPerEntry = (bytesPerEntry + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+    pool->bytes = malloc((entries * bytesPerEntry) + (2 * entries * sizeof(void*)) + (entries * sizeof(int)));
+    pool->bytesPerEntry = bytesPerEntry;
+    pool->entries = entries;
+    pool->free = (void**)(pool->bytes + (entries * bytesPerEntry));
+    pool->used = pool->free + entries;
+    pool->usedCount = 0;
+    pool->references = (int *)(pool->used + entries);
     
-    AKKAAEBufferStackPoolEntry ** nextPtr = &pool->free;
+    // 第一个 entry 在 free 的顶上，最先被分配出去
+    pool->freeCount = entries;
     for (int i = 0; i < entries; i++) {
-        AKKAAEBufferStackPoolEntry * entry = (AKKAAEBufferStackPoolEntry *)calloc(1, sizeof(AKKAAEBufferStackPoolEntry));
-        entry->buffer = pool->bytes + (i * bytesPerEntry);
-        * nextPtr = entry;
-        nextPtr = &entry->next;
+        pool->free[entries - 1 - i] = pool->bytes + (i * bytesPerEntry);
     }
 }
 
 static void AKKAAEBufferStackPoolCleanup(AKKAAEBufferStackPool * pool) {
-    while (pool->free) {
-        AKKAAEBufferStackPoolEntry * next = pool->free->next;
-        free(pool->free);
-        pool->free = next;
-    }
-    
-    while (pool->used) {
-        AKKAAEBufferStackPoolEntry * next = pool->free->next;
-        free(pool->used);
-        pool->used = next;
-    }
-    // 清空这个pool free 和used 都清空
+    // 索引数组也在 bytes 里，一起释放
     free(pool->bytes);
+    pool->bytes = NULL;
+    pool->free = pool->used = NULL;
+    pool->references = NULL;
+    pool->freeCount = pool->usedCount = 0;
 }
 
 static void AKKAAEBufferStackPoolReset(AKKAAEBufferStackPool * pool) {
-    // Return all used buffers back to the free list
-    // 将used倒序填充到free中 将每一个used的第一个都压到free中
-    AKKAAEBufferStackPoolEntry * entry = pool->used;
-    while (entry) {
-        // Point top entry at beginning of free list, and point free list to top entry (i.e. insert into free list)
-        AKKAAEBufferStackPoolEntry * next = entry->next;
-        entry->next = pool->free;
-        pool->free = entry;
-        
-        entry = next;
+    // Return all used buffers back to the free list, top first, so the bottom-most is handed out next
+    // 将used从栈顶开始依次压到free中
+    for (int i = pool->usedCount - 1; i >= 0; i--) {
+        pool->free[pool->freeCount++] = pool->used[i];
     }
-    pool->used = NULL;
+    pool->usedCount = 0;
+}
+
+static size_t AKKAAEBufferStackPoolGetMemoryUsage(const AKKAAEBufferStackPool * pool) {
+    // Same layout as AKKAAEBufferStackPoolInit: the entries, then the free and used index arrays, then the reference counts
+    return (pool->entries * pool->bytesPerEntry) + (2 * pool->entries * sizeof(void*)) + (pool->entries * sizeof(int));
 }
 
 // 每次获取到一个free buffer 都将 buffer 添加进used
 static void * AKKAAEBufferStackPoolGetNextFreeBuffer(AKKAAEBufferStackPool * pool) {
-    // Get entry at top of free list
-    AKKAAEBufferStackPoolEntry * entry = pool->free;
-    if (!entry) return NULL;
-    
-    // Point free list at next entry (i.e. remove the top entry from the list)
-    pool->free = entry->next;
-    
-    // Point top entry at beginning of used list, and point used list to top entry (i.e. insert into used list)
-    entry->next = pool->used;
-    pool->used = entry;
-    
-    return entry->buffer;
+    if (pool->freeCount == 0) return NULL;
+    void * buffer = pool->free[--pool->freeCount];
+    pool->used[pool->usedCount++] = buffer;
+    *AKKAAEBufferStackPoolGetReferences(pool, buffer) = 1;
+    return buffer;
 }
 
 static BOOL AKKAAEBufferStackPoolFreeBuffer(AKKAAEBufferStackPool * pool,void * buffer) {
+    // Ignore buffers that don't belong to this pool (e.g. external buffers)
+    int * references = AKKAAEBufferStackPoolGetReferences(pool, buffer);
+    if (!references) return NO;
     
-    AKKAAEBufferStackPoolEntry * entry = NULL;
-    
-    if (pool->used && pool->used->buffer == buffer) {
-        // Found the corresponding entry at the top. Remove it from the used list.
-        // 如果是第一个就是要删除的buffer，直接将这个entry移除链表
-        entry = pool->used;
-        pool->used = entry->next;
-    } else {
-        // Find it in the list, and note the preceding item
-        // 在链表中的话就在链表中删除
-        AKKAAEBufferStackPoolEntry * preceding = pool->used;
-        while (preceding && preceding->next && preceding->next->buffer != buffer) {
-            preceding = preceding->next;
-        }
-        if (preceding && preceding->next) {
-            // Found it. Remove it from the list
-            entry = preceding->next;
-            preceding->next = entry->next;
+    // Still shared with another buffer: just drop this reference
+    if (--(*references) > 0) return YES;
+
+    // Buffers are almost always freed from near the top, so search downwards from there
+    for (int i = pool->usedCount - 1; i >= 0; i--) {
+        if (pool->used[i] == buffer) {
+            AKKAAEBufferStackPoolFreeUsedBufferAtIndex(pool, pool->usedCount - 1 - i);
+            return YES;
         }
     }
-    
-    if (!entry) {
-        return NO;
-    }
-    
-    // Point top entry at beginning of free list, and point free list to top entry (i.e. insert into free list)
-    
-    entry->next = pool->free;
-    pool->free = entry;
-    return YES;
+    return NO;
 }
 
 static void * AKKAAEBufferStackPoolGetUsedBufferAtIndex(const AKKAAEBufferStackPool * pool ,int index) {
-    AKKAAEBufferStackPoolEntry * entry = pool->used;
-    for (int i = 0; i < index && entry; i++) {
-        entry = entry->next;
-    }
-    return entry ? entry->buffer : NULL;
+    if (index < 0 || index >= pool->usedCount) return NULL;
+    return pool->used[pool->usedCount - 1 - index];
 }
 
-static void AKKAAEBufferStackSwapTopTwoUsedBuffers(AKKAAEBufferStackPool * pool) {
-    AKKAAEBufferStackPoolEntry * entry = pool->used;
-    if (!entry) return;
-    AKKAAEBufferStackPoolEntry * next = entry->next;
-    if (!next) return;
+static void * AKKAAEBufferStackPoolFreeUsedBufferAtIndex(AKKAAEBufferStackPool * pool, int index) {
+    if (index < 0 || index >= pool->usedCount) return NULL;
+    int position = pool->usedCount - 1 - index;
+    void * buffer = pool->used[position];
     
-    entry->next = next->next;
-    next->next = entry;
-    pool->used = next;
+    // Close the gap; only the entries above this one move
+    if (index > 0) {
+        memmove(&pool->used[position], &pool->used[position + 1], index * sizeof(void*));
+    }
+    pool->usedCount--;
+    pool->free[pool->freeCount++] = buffer;
+    return buffer;
 }
 
+static void AKKAAEBufferStackSwapTopTwoUsedBuffers(AKKAAEBufferStackPool * pool) {
+    if (pool->usedCount < 2) return;
+    void * top = pool->used[pool->usedCount - 1];
+    pool->used[pool->usedCount - 1] = pool->used[pool->usedCount - 2];
+    pool->used[pool->usedCount - 2] = top;
+}
 
-
-
-
-
-
+// NULL for buffers that don't belong to this pool
+static int * AKKAAEBufferStackPoolGetReferences(const AKKAAEBufferStackPool * pool, void * buffer) {
+    if ((char*)buffer < (char*)pool->bytes || (char*)buffer >= (char*)pool->bytes + (pool->entries * pool->bytesPerEntry)) {
+        return NULL;
+    }
+    return &pool->references[((char*)buffer - (char*)pool->bytes) / pool->bytesPerEntry];
+}
@@ -11,6 +11,7 @@ extern "C" {
 #endif
 
 #import <Foundation/Foundation.h>
+#import "AKKAAETime.h"
 
 //! Batch update block
 //! 批量更新block
@@ -26,6 +27,23 @@ typedef void (^AKKAAEManagedValueReleaseBlock)(void * _Nonnull value);
 //! Release notification block
 typedef void (^AKKAAEManagedValueReleaseNotificationBlock)();
 
+/*!
+ * Reclaim statistics
+ *
+ *  Counters for old values across all managed values: retired when replaced, then released by the
+ *  reclaimer once the realtime thread has acknowledged them.
+ *  旧值回收的统计数据（所有实例共享）
+ */
+typedef struct {
+    UInt64 retiredValues;                   //!< Old values replaced and waiting for release, in total
+    UInt64 reclaimedValues;                 //!< Old values released, in total
+    int outstandingValues;                  //!< Old values retired but not yet released
+    int peakOutstandingValues;              //!< Highest outstandingValues seen
+    int releaseNodePoolSize;                //!< Preallocated release nodes
+    UInt64 throttledUpdates;                //!< Updates that backed off because outstandingValues hit the maximum
+    AKKAAESeconds longestReclaimLatency;    //!< Longest time from an old value being replaced to its release
+} AKKAAEManagedValueReclaimStatistics;
+
 /*!
  * Managed value
  *
@@ -39,6 +57,10 @@ typedef void (^AKKAAEManagedValueReleaseNotificationBlock)();
  *  Remember to use the __unsafe_unretained directive to avoid ARC-triggered retains on the
  *  audio thread if using this class to manage an Objective-C object, and only interact with such objects
  *  via C functions they provide, not via Objective-C methods.
+ *
+ *  Old values are released on a dedicated reclaimer thread, as soon as the realtime thread has
+ *  acknowledged them in AKKAAEManagedValueCommitPendingUpdates, at the start of the next render cycle;
+ *  no run loop is involved. Replacing a value doesn't allocate.
  */
 
 /*!
@@ -50,6 +72,8 @@ typedef void (^AKKAAEManagedValueReleaseNotificationBlock)();
  * 记住使用__unsafe_unretained指令，以避免ARC触发的音频线程上的保留，如果使用这个类来管理一个Objective-C对象，
  * 并且只通过它们提供的C函数而不是通过Objective-C方法与这些对象交互。
  *
+ * 旧值在实时线程确认之后，由专门的回收线程马上释放，不依赖 run loop。替换值的时候不分配内存。
+ *
  */
 @interface AKKAAEManagedValue : NSObject
 
@@ -88,7 +112,8 @@ typedef void (^AKKAAEManagedValueReleaseNotificationBlock)();
 /*!
  * Get access to the value on the realtime audio thread
  *
- *  The object or buffer returned is guaranteed to remain valid until the next call to this function.
+ *  The object or buffer returned is guaranteed to remain valid until the end of the render cycle,
+ *  that is, until the next call to AKKAAEManagedValueCommitPendingUpdates.
  *
  *  Can also be called safely on the main thread (although the @link objectValue @endlink and
  *  @link pointerValue @endlink properties are easier).
@@ -100,7 +125,7 @@ typedef void (^AKKAAEManagedValueReleaseNotificationBlock)();
 /*!
  * 获取对实时音频线程的值
  *
- * 返回的对象或缓冲区保证保持有效，直到下一次调用此函数
+ * 返回的对象或缓冲区保证在本渲染周期结束之前（即下一次调用AKKAAEManagedValueCommitPendingUpdates之前）保持有效
  *
  * 也可以安全的在主线程中被调用（虽然@link objectValue @endlink和@link pointerValue @endlink属性更容易）。
  * @param managedValue
@@ -116,7 +141,7 @@ void * _Nullable AKKAAEManagedValueGetValue(__unsafe_unretained AKKAAEManagedVal
  *  then this function is already called for you within that class, so you don't need to do so yourself.
  *
  *  After this function is called, any updates made within the block passed to performAtomicBatchUpdate:
- *  become available on the render thread, and any old values are scheduled for release on the main thread.
+ *  become available on the render thread, and any old values are handed to the reclaimer thread for release.
  *
  *  Important: Only call this function on the audio thread. If you call this on the main thread, you
  *  will see sporadic crashes on the audio thread.
@@ -127,7 +152,7 @@ void * _Nullable AKKAAEManagedValueGetValue(__unsafe_unretained AKKAAEManagedVal
  *
  * 如果您没有使用AEAudioUnitOutput，那么您应该在顶级渲染循环开始时调用此函数，以便同步应用更新。 如果你使用AEAudioUnitOutput，那么这个函数已经在你的类中调用，所以你就不用自己调用这个。
  *
- * 调用此函数后，在block中传递给performAtomicBatchUpdate的任何更新在渲染线程上可用，并且任何旧值都被调度为在主线程上释放。
+ * 调用此函数后，在block中传递给performAtomicBatchUpdate的任何更新在渲染线程上可用，并且任何旧值都交给回收线程释放。
  */
 
 void AKKAAEManagedValueCommitPendingUpdates();
@@ -156,16 +181,44 @@ void AKKAAEManagedValueCommitPendingUpdates();
 @property (nonatomic) void * _Nullable pointerValue;
 
 /*!
- * Block to perform when deleting old items, on main thread. If not specified, will simply use
+ * Block to perform when deleting old items. If not specified, will simply use
  * free() to dispose values set via pointerValue, or CFBridgingRelease() to dispose values set via objectValue.
+ *
+ *  This is called on the reclaimer thread, or on the thread that deallocates the instance for the
+ *  values still held at that point. It must not wait synchronously on the main thread.
  */
 @property (nonatomic, copy) AKKAAEManagedValueReleaseBlock _Nullable releaseBlock;
 
 /*!
  * Block for release notifications. Use this to be informed when an old value has been released.
+ * Called on the same thread as the releaseBlock.
  */
 @property (nonatomic, copy) AKKAAEManagedValueReleaseNotificationBlock _Nullable releaseNotificationBlock;
 
+/*!
+ * Reclaim statistics, across all instances
+ */
++ (AKKAAEManagedValueReclaimStatistics)reclaimStatistics;
+
+/*!
+ * Maximum number of old values waiting for release, across all instances
+ *
+ *  This is a soft limit. When it's reached, setting a value wakes the reclaimer and yields the
+ *  processor a few times so it can catch up, but never sleeps, and then goes ahead regardless. It
+ *  doesn't yield if the realtime thread isn't committing updates, or when called from within a
+ *  release. Default is 1024.
+ *
+ *  超过这个数量时，设置新值会唤醒回收线程并让出几次处理器，但不会睡眠，之后照常设置
+ */
++ (int)maximumOutstandingReleases;
+
+/*!
+ * Set the maximum number of old values waiting for release
+ *
+ * @param maximumOutstandingReleases The new maximum, at least 1
+ */
++ (void)setMaximumOutstandingReleases:(int)maximumOutstandingReleases;
+
 @end
 
 #ifdef __cplusplus
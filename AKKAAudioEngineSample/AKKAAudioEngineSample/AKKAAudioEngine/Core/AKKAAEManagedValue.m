@@ -8,49 +8,145 @@
 
 #import "AKKAAEManagedValue.h"
 #import <pthread.h>
+#import <sched.h>
+#import <stdatomic.h>
 #import <libkern/OSAtomic.h>
-#import "AKKAAEWeakRetainingProxy.h"
 #import "AKKAAEUtilities.h"
+#ifdef __APPLE__
+#import <mach/mach.h>
+#else
+#import <semaphore.h>
+#endif
 
-typedef struct __linkedlistitem_t {
+/*!
+ * Release node: carries one retired value from setValue, via the realtime thread's acknowledgement,
+ * to the reclaimer. Nodes come from a preallocated pool, and go back to it once the value is released.
+ */
+typedef struct __releasenode_t {
     void * data;
-    struct __linkedlistitem_t * next;
-}linkedlistitem_t;
+    void * owner;                   // The AKKAAEManagedValue the value belonged to (unretained)
+    AKKAAEHostTicks retiredTime;
+    struct __releasenode_t * next;
+} releasenode_t;
+
+static const int kReleaseNodeBlockSize = 64;
+static const int kDefaultMaximumOutstandingReleases = 1024;
+static const int kMaximumThrottleYields = 8;
+static const AKKAAESeconds kRenderThreadIdleTimeout = 0.25;
+
+// Wakes the reclaimer; signalling is realtime-safe (no locks, no allocation)
+#ifdef __APPLE__
+typedef semaphore_t AKKAAEManagedValueSemaphore;
+#define AKKAAEManagedValueSemaphoreInit(s) semaphore_create(mach_task_self(), (s), SYNC_POLICY_FIFO, 0)
+#define AKKAAEManagedValueSemaphoreSignal(s) semaphore_signal(*(s))
+#define AKKAAEManagedValueSemaphoreWait(s) semaphore_wait(*(s))
+#else
+typedef sem_t AKKAAEManagedValueSemaphore;
+#define AKKAAEManagedValueSemaphoreInit(s) sem_init((s), 0, 0)
+#define AKKAAEManagedValueSemaphoreSignal(s) sem_post(s)
+#define AKKAAEManagedValueSemaphoreWait(s) while ( sem_wait(s) != 0 )
+#endif
+
+// Batch update state word: generation in the upper bits, plus in-progress and waiting-for-commit flags
+// 批量更新的状态：高位是代数（每次开始批量更新加一），低两位是"正在更新"和"等待提交"
+enum {
+    AKKAAEManagedValueUpdateInProgress      = 1 << 0,
+    AKKAAEManagedValueUpdateWaitingForCommit = 1 << 1,
+    AKKAAEManagedValueUpdateFlags           = AKKAAEManagedValueUpdateInProgress | AKKAAEManagedValueUpdateWaitingForCommit,
+    AKKAAEManagedValueUpdateGeneration      = 1 << 2,
+};
 
 static int __atomicUpdateCounter = 0;
-static pthread_rwlock_t __atomicUpdateMutex = PTHREAD_RWLOCK_INITIALIZER;
+static _Atomic(uint64_t) __atomicUpdateState = 0;
 static NSHashTable * __atomicUpdatedDeferredSyncValues = nil;
-static BOOL __atomicUpdateWaitingForCommit = NO;
 
-static linkedlistitem_t * __pendingInstances = NULL;
-static linkedlistitem_t * __servicedInstances = NULL;
+// Instances with values waiting for the realtime thread's acknowledgement (an intrusive list, so no allocation)
+static __unsafe_unretained AKKAAEManagedValue * __pendingInstances = nil;
 static pthread_mutex_t __pendingInstanceMutex = PTHREAD_MUTEX_INITIALIZER;
 
+// Release nodes: the free pool, and the values the realtime thread has acknowledged, ready to release
+static OSQueueHead __releaseNodePool = OS_ATOMIC_QUEUE_INIT;
+static OSQueueHead __acknowledgedReleases = OS_ATOMIC_QUEUE_INIT;
+
+// Reclaimer. The mutex is recursive, as releasing a value can deallocate another managed value
+// 回收线程：实时线程确认之后马上释放旧值，不依赖 run loop
+static AKKAAEManagedValueSemaphore __reclaimerSemaphore;
+static pthread_mutex_t __reclaimMutex;
+static __thread int __reclaimDepth = 0;
+static _Atomic(AKKAAEHostTicks) __lastCommitTime = 0;
+static _Atomic(int) __maximumOutstandingReleases = kDefaultMaximumOutstandingReleases;
+
+// Statistics
+static _Atomic(UInt64) __retiredCount = 0;
+static _Atomic(UInt64) __reclaimedCount = 0;
+static _Atomic(int) __outstandingCount = 0;
+static _Atomic(int) __releaseNodePoolSize = 0;
+static _Atomic(int) __peakOutstandingCount = 0;
+static _Atomic(UInt64) __throttledCount = 0;
+static AKKAAEHostTicks __longestReclaimLatency = 0;
+
 #ifdef DEBUG
 pthread_t AKKAAEManagedValueRealtimeThreadIdentifier = NULL;
 #endif
 
 
+static BOOL AKKAAEManagedValueServiceReleaseQueue(__unsafe_unretained AKKAAEManagedValue * THIS);
+static void AKKAAEManagedValueStartReclaimer(void);
+static void AKKAAEManagedValueReclaim(void);
+static void AKKAAEManagedValueReclaimNode(releasenode_t * node);
+static void AKKAAEManagedValueThrottle(void);
+static releasenode_t * AKKAAEManagedValueReleaseNodeAlloc(void);
+
 @interface AKKAAEManagedValue () {
-    void    *   _value;
+    void    * _Atomic _value;
     BOOL        _valueSet;
-    void    *   _atomicBatchUpdateLastValue;
+    void    * _Atomic _atomicBatchUpdateLastValue;
     BOOL        _wasUpdatedInAtomicBatchUpdate;
     BOOL        _isObjectValue;
     OSQueueHead _pendingReleaseQueue;
-    int _pendingReleaseCount;
-    OSQueueHead _releaseQueue;
+    BOOL        _isPendingInstance;
+    __unsafe_unretained AKKAAEManagedValue * _nextPendingInstance;
 }
-@property (nonatomic, strong)NSTimer * pollTimer;
-
+- (void)releaseOldValue:(void *)value;
 @end
 
 @implementation AKKAAEManagedValue
 @dynamic objectValue,pointerValue;
 
 +(void)initialize {
-    __atomicUpdatedDeferredSyncValues = [[NSHashTable alloc]initWithOptions:NSPointerFunctionsWeakMemory
-                                                                   capacity:0];
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        __atomicUpdatedDeferredSyncValues = [[NSHashTable alloc]initWithOptions:NSPointerFunctionsWeakMemory
+                                                                       capacity:0];
+        pthread_mutexattr_t attributes;
+        pthread_mutexattr_init(&attributes);
+        pthread_mutexattr_settype(&attributes, PTHREAD_MUTEX_RECURSIVE);
+        pthread_mutex_init(&__reclaimMutex, &attributes);
+        pthread_mutexattr_destroy(&attributes);
+    });
+}
+
++ (AKKAAEManagedValueReclaimStatistics)reclaimStatistics {
+    pthread_mutex_lock(&__reclaimMutex);
+    AKKAAEManagedValueReclaimStatistics statistics = {
+        .retiredValues = atomic_load(&__retiredCount),
+        .reclaimedValues = atomic_load(&__reclaimedCount),
+        .outstandingValues = atomic_load(&__outstandingCount),
+        .peakOutstandingValues = atomic_load(&__peakOutstandingCount),
+        .releaseNodePoolSize = atomic_load(&__releaseNodePoolSize),
+        .throttledUpdates = atomic_load(&__throttledCount),
+        .longestReclaimLatency = AKKAAESecondsFromHostTicks(__longestReclaimLatency),
+    };
+    pthread_mutex_unlock(&__reclaimMutex);
+    return statistics;
+}
+
++ (int)maximumOutstandingReleases {
+    return atomic_load(&__maximumOutstandingReleases);
+}
+
++ (void)setMaximumOutstandingReleases:(int)maximumOutstandingReleases {
+    atomic_store(&__maximumOutstandingReleases, MAX(1, maximumOutstandingReleases));
 }
 
 /*!
@@ -61,10 +157,11 @@ pthread_t AKKAAEManagedValueRealtimeThreadIdentifier = NULL;
  *
  *  - We need to protect against the scenario where the batch-update-in-progress check on the
  *    realtime thread passes followed immediately by the main thread entering the batch update and
- *    changing the value, as this violates atomicity. To do this, we use a mutex to guard the
- *    realtime thread check-and-return. We use a try lock on the realtime thread, the failure
- *    of which conveniently tells us that a batch update is happening, so it's the only check
- *    we need.
+ *    changing the value, as this violates atomicity. To do this without a lock, the batch state is
+ *    a single atomic word carrying a generation count, bumped each time a batch begins. The
+ *    realtime thread reads the state, then the value, then the state again (a sequence lock): if
+ *    a batch was in progress or the state changed in between, it returns the previous value
+ *    instead. Readers only ever perform atomic loads.
  *
  *  - We need the realtime thread to only return the previously set value between the time an
  *    update starts, and the time it's committed. Commit happens on the realtime thread at the
@@ -98,9 +195,9 @@ pthread_t AKKAAEManagedValueRealtimeThreadIdentifier = NULL;
  *  - 这通过使实时线程读取先前设置的值而不是新的值来工作。
  *
  *  - 我们需要防止在实时线程中的批量更新进行中检查立即由主线程进入批量更新并更改值的情况，因为这违反了原子性。(不能在更新的时候获取返回值)
- * 为此，我们使用互斥保护实时线程检查和返回。
- * 我们在实时线程中使用try锁，其失败方便地告诉我们批量更新正在发生，
- * 因此这是我们需要的唯一检查。
+ * 为了不用锁，批量更新状态是一个原子变量，带有每次开始批量更新都会加一的代数。
+ * 实时线程先读状态，再读值，再读一次状态（顺序锁）：如果正在批量更新或者两次状态不同，就返回之前的值。
+ * 读取方只做原子读取。
  *
  *  - 此机制要求在原子批量更新开始时，将先前设置的值（_atomicBatchUpdateLastValue）正确同步到当前值。
  *
@@ -117,7 +214,7 @@ pthread_t AKKAAEManagedValueRealtimeThreadIdentifier = NULL;
  */
 // 在更新的时候不能使用新值
 + (void)performAtomicBatchUpdate:(AKKAAEManagedValueUpdateBlock _Nonnull)block {
-    if (!__atomicUpdateWaitingForCommit) {
+    if (!(atomic_load_explicit(&__atomicUpdateState, memory_order_acquire) & AKKAAEManagedValueUpdateWaitingForCommit)) {
         //对以前批次更新的值执行延迟同步到_atomicBatchUpdateLastValue
         for (AKKAAEManagedValue *value in __atomicUpdatedDeferredSyncValues) {
             value->_atomicBatchUpdateLastValue = value->_value;
@@ -126,10 +223,16 @@ pthread_t AKKAAEManagedValueRealtimeThreadIdentifier = NULL;
     }
 
     if (__atomicUpdateCounter == 0) {
-        // Wait for realtime thread to exit any GetValue calls
-        pthread_rwlock_wrlock(&__atomicUpdateMutex); // 写锁开始
-        // Mark that we're awaiting a commit
-        __atomicUpdateWaitingForCommit = YES;
+        // Begin a new generation, and mark that we're updating and awaiting a commit. The fence orders
+        // this before any value changes made in the block, so readers that overlap will see the change.
+        uint64_t state = atomic_load_explicit(&__atomicUpdateState, memory_order_relaxed);
+        uint64_t newState;
+        do {
+            newState = ((state & ~(uint64_t)AKKAAEManagedValueUpdateFlags) + AKKAAEManagedValueUpdateGeneration)
+                | AKKAAEManagedValueUpdateFlags;
+        } while (!atomic_compare_exchange_weak_explicit(&__atomicUpdateState, &state, newState,
+                                                        memory_order_relaxed, memory_order_relaxed));
+        atomic_thread_fence(memory_order_release);
     }
 
     __atomicUpdateCounter ++;
@@ -140,8 +243,9 @@ pthread_t AKKAAEManagedValueRealtimeThreadIdentifier = NULL;
     __atomicUpdateCounter --;
     
     if (__atomicUpdateCounter == 0) {
-        // Unlock, allowing GetValue to access _value again
-        pthread_rwlock_unlock(&__atomicUpdateMutex);
+        // Finished updating; the realtime thread's next commit makes the new values visible
+        atomic_fetch_and_explicit(&__atomicUpdateState, ~(uint64_t)AKKAAEManagedValueUpdateInProgress,
+                                  memory_order_release);
     }
 }
 
@@ -155,33 +259,56 @@ pthread_t AKKAAEManagedValueRealtimeThreadIdentifier = NULL;
     [__atomicUpdatedDeferredSyncValues removeObject:self];
 
     pthread_mutex_lock(&__pendingInstanceMutex);
-    for (linkedlistitem_t * entry = __pendingInstances,* prior = NULL ; entry ; prior = entry ,entry = entry->next) {
-        if (entry->data == (__bridge void *)self) {
-            if (prior) {
-                prior->next = entry->next;
-            } else {
-                __pendingInstances = entry->next;
+    if (_isPendingInstance) {
+        for (__unsafe_unretained AKKAAEManagedValue * entry = __pendingInstances, * prior = nil ; entry ; prior = entry, entry = entry->_nextPendingInstance) {
+            if (entry == self) {
+                if (prior) {
+                    prior->_nextPendingInstance = _nextPendingInstance;
+                } else {
+                    __pendingInstances = _nextPendingInstance;
+                }
+                break;
             }
-            free(entry);
-            break;
         }
+        _isPendingInstance = NO;
     }
     pthread_mutex_unlock(&__pendingInstanceMutex);
 
+    // Acknowledged values may belong to us, so reclaim them here rather than leave them to the
+    // reclaimer. Holding the reclaim mutex also waits out a release already in progress.
+    pthread_mutex_lock(&__reclaimMutex);
+    AKKAAEManagedValueReclaim();
+
+    // The realtime thread can't see this instance any more, so unacknowledged values can go too
+    releasenode_t * release;
+    __reclaimDepth++;
+    while ( (release = OSAtomicDequeue(&_pendingReleaseQueue, offsetof(releasenode_t, next))) ) {
+        AKKAAEManagedValueReclaimNode(release);
+    }
+
     // Perform any pending release
     if (_value)
         [self releaseOldValue:_value];
+    __reclaimDepth--;
+    pthread_mutex_unlock(&__reclaimMutex);
+}
 
-    linkedlistitem_t * release;
-    while ( (release = OSAtomicDequeue(&_pendingReleaseQueue,offsetof(linkedlistitem_t,next))) ) {
-        OSAtomicEnqueue(&_releaseQueue, release, offsetof(linkedlistitem_t, next));
-    }
-    [self pollReleaseList];
+- (void)setReleaseBlock:(AKKAAEManagedValueReleaseBlock)releaseBlock {
+    // The reclaimer may be using the old block
+    pthread_mutex_lock(&__reclaimMutex);
+    _releaseBlock = [releaseBlock copy];
+    pthread_mutex_unlock(&__reclaimMutex);
+}
+
+- (void)setReleaseNotificationBlock:(AKKAAEManagedValueReleaseNotificationBlock)releaseNotificationBlock {
+    pthread_mutex_lock(&__reclaimMutex);
+    _releaseNotificationBlock = [releaseNotificationBlock copy];
+    pthread_mutex_unlock(&__reclaimMutex);
 }
 
 - (id)objectValue {
     NSAssert(!_valueSet || _isObjectValue, @"You can use objectValue or pointerValue, but not both");
-    return (__bridge id)_value;
+    return (__bridge id)atomic_load_explicit(&_value, memory_order_relaxed);
 }
 
 - (void)setObjectValue:(id)objectValue {
@@ -192,7 +319,7 @@ pthread_t AKKAAEManagedValueRealtimeThreadIdentifier = NULL;
 
 - (void *)pointerValue {
     NSAssert(!_valueSet || !_isObjectValue, @"You can use objectValue or pointerValue, but not both");
-    return _value;
+    return atomic_load_explicit(&_value, memory_order_relaxed);
 }
 
 - (void)setPointerValue:(void *)pointerValue {
@@ -205,10 +332,11 @@ pthread_t AKKAAEManagedValueRealtimeThreadIdentifier = NULL;
     
     //assign new value
     void * oldvalue = _value;
-    _value = value;
+    atomic_store_explicit(&_value, value, memory_order_release);
     _valueSet = YES;
     
-    if (__atomicUpdateCounter == 0 && !__atomicUpdateWaitingForCommit) {
+    if (__atomicUpdateCounter == 0
+            && !(atomic_load_explicit(&__atomicUpdateState, memory_order_acquire) & AKKAAEManagedValueUpdateWaitingForCommit)) {
         // Sync value for recall on realtime thread during atomic batch update
         //同步在原子批量更新期间在实时线程上调用的值
         _atomicBatchUpdateLastValue = _value;
@@ -220,132 +348,222 @@ pthread_t AKKAAEManagedValueRealtimeThreadIdentifier = NULL;
     
     if (oldvalue) {
         // Mark old value as pending release - it'll be transferred to the release queue by
-        // AEManagedValueGetValue on the audio thread
-        // 将旧值标记为待释放 - 它将通过音频线程上的AEManagedValueGetValue传输到释放队列
+        // AKKAAEManagedValueCommitPendingUpdates on the audio thread, at the start of the next render cycle
+        // 将旧值标记为待释放 - 下一个渲染周期开始时，音频线程上的AKKAAEManagedValueCommitPendingUpdates会把它传输到释放队列
+        AKKAAEManagedValueThrottle();
         
-        linkedlistitem_t * release = (linkedlistitem_t *)calloc(1, sizeof(linkedlistitem_t));
+        releasenode_t * release = AKKAAEManagedValueReleaseNodeAlloc();
         release->data = oldvalue;
+        release->owner = (__bridge void *)self;
+        release->retiredTime = AKKAAECurrentTimeInHostTicks();
         
-        OSAtomicEnqueue(&_pendingReleaseQueue, release, offsetof(linkedlistitem_t, next));
-        _pendingReleaseCount++;
+        int outstanding = atomic_fetch_add(&__outstandingCount, 1) + 1;
+        atomic_fetch_add_explicit(&__retiredCount, 1, memory_order_relaxed);
+        int peak = atomic_load_explicit(&__peakOutstandingCount, memory_order_relaxed);
+        while (outstanding > peak
+                && !atomic_compare_exchange_weak_explicit(&__peakOutstandingCount, &peak, outstanding,
+                                                          memory_order_relaxed, memory_order_relaxed));
+        
+        OSAtomicEnqueue(&_pendingReleaseQueue, release, offsetof(releasenode_t, next));
         
-        if (!self.pollTimer) {
-            // Start polling for pending releases
-            // 开始轮询待处理的版本
-            self.pollTimer = [NSTimer scheduledTimerWithTimeInterval:0.1
-                                                              target:[AKKAAEWeakRetainingProxy proxyWithTarget:self]
-                                                            selector:@selector(pollReleaseList)
-                                                            userInfo:nil
-                                                             repeats:YES];
-            self.pollTimer.tolerance = 0.5;
-        }
         //将self添加到在 AEManagedValueCommitPendingUpdates里的实时线程内服务的实例列表
         // Add self to the list of instances to service on the realtime thread within AEManagedValueCommitPendingUpdates
         
         pthread_mutex_lock(&__pendingInstanceMutex);
-        BOOL alreadyPresent = NO;
-        for (linkedlistitem_t * entry = __pendingInstances; entry; entry = entry->next) {
-            if (entry->data == (__bridge void *)self) {
-                alreadyPresent = YES;
-            }
-        }
-        if (!alreadyPresent) {
-            linkedlistitem_t * entry = malloc(sizeof(linkedlistitem_t));
-            entry->next = __pendingInstances;
-            entry->data = (__bridge void * )self;
-            __pendingInstances = entry;
+        if (!_isPendingInstance) {
+            _nextPendingInstance = __pendingInstances;
+            __pendingInstances = self;
+            _isPendingInstance = YES;
         }
         pthread_mutex_unlock(&__pendingInstanceMutex);
     }
 }
 
-void AEManagedValueCommitPendingUpdates() {
+void AKKAAEManagedValueCommitPendingUpdates() {
 #ifdef DEBUG
     if (AKKAAEManagedValueRealtimeThreadIdentifier && AKKAAEManagedValueRealtimeThreadIdentifier != pthread_self()) {
         if (AKKAAERateLimit()) printf("%s called from outside realtime thread\n", __FUNCTION__);
     }
 #endif
     // Finish atomic update
-    if (pthread_rwlock_tryrdlock(&__atomicUpdateMutex) == 0) {
-        __atomicUpdateWaitingForCommit = NO;
-        pthread_rwlock_unlock(&__atomicUpdateMutex);
-    } else {
-        // Still in the middle of an atomic update
-        return;
+    uint64_t state = atomic_load_explicit(&__atomicUpdateState, memory_order_acquire);
+    while (state & AKKAAEManagedValueUpdateWaitingForCommit) {
+        if (state & AKKAAEManagedValueUpdateInProgress) {
+            // Still in the middle of an atomic update
+            return;
+        }
+        if (atomic_compare_exchange_weak_explicit(&__atomicUpdateState, &state, state & ~(uint64_t)AKKAAEManagedValueUpdateWaitingForCommit,
+                                                  memory_order_acq_rel, memory_order_acquire)) {
+            break;
+        }
     }
     
+    // Lets setValue tell whether the render thread is running, and so whether waiting for it is worthwhile
+    atomic_store_explicit(&__lastCommitTime, AKKAAECurrentTimeInHostTicks(), memory_order_relaxed);
+    
     //服务任何等待更新的实例，因此我们可以将旧值标记为可以释放
+    // Values retired before this point can't be read any more: the previous cycle, and any worker threads
+    // it used, have finished, and this cycle's reads all see the current values
     if (pthread_mutex_trylock(&__pendingInstanceMutex) == 0) {
-        linkedlistitem_t * lastEntry = NULL;
-        for ( linkedlistitem_t * entry = __pendingInstances ; entry ; lastEntry = entry,entry = entry->next) {
-            AKKAAEManagedValueServiceReleaseQueue((__bridge AKKAAEManagedValue *)entry->data);
-        }
-        if (lastEntry) {
-            // Move Pending instances to serviced instance list, ready for cleanup on main thread;
-            lastEntry->next = __servicedInstances;
-            __servicedInstances = __pendingInstances;
-            __pendingInstances = NULL;
+        BOOL acknowledged = NO;
+        __unsafe_unretained AKKAAEManagedValue * entry = __pendingInstances;
+        while ( entry ) {
+            __unsafe_unretained AKKAAEManagedValue * next = entry->_nextPendingInstance;
+            acknowledged |= AKKAAEManagedValueServiceReleaseQueue(entry);
+            entry->_nextPendingInstance = nil;
+            entry->_isPendingInstance = NO;
+            entry = next;
         }
+        __pendingInstances = nil;
         pthread_mutex_unlock(&__pendingInstanceMutex);
+        
+        // Wake the reclaimer to release the old values
+        if (acknowledged) AKKAAEManagedValueSemaphoreSignal(&__reclaimerSemaphore);
     }
 }
 
 void * _Nullable AKKAAEManagedValueGetValue(__unsafe_unretained AKKAAEManagedValue * THIS) {
     if (!THIS) return NULL;
-    if (__atomicUpdateWaitingForCommit || pthread_rwlock_tryrdlock(&__atomicUpdateMutex) != 0) {
-        return THIS->_atomicBatchUpdateLastValue;
+    
+    // 顺序锁读取：状态 -> 值 -> 状态，中间有批量更新开始的话就用之前的值
+    uint64_t state = atomic_load_explicit(&__atomicUpdateState, memory_order_acquire);
+    if (state & AKKAAEManagedValueUpdateFlags) {
+        return atomic_load_explicit(&THIS->_atomicBatchUpdateLastValue, memory_order_acquire);
     }
     
-    if (!pthread_main_np()) {
-        AKKAAEManagedValueServiceReleaseQueue(THIS);
+    void * value = atomic_load_explicit(&THIS->_value, memory_order_acquire);
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&__atomicUpdateState, memory_order_relaxed) != state) {
+        // A batch update began while we were reading
+        return atomic_load_explicit(&THIS->_atomicBatchUpdateLastValue, memory_order_acquire);
     }
     
-    void * value = THIS->_value;
-    pthread_rwlock_unlock(&__atomicUpdateMutex);
+    // Old values aren't acknowledged here: another render thread, or an earlier read in this cycle, may
+    // still be using them. AKKAAEManagedValueCommitPendingUpdates does that once the cycle is over.
     return value;
 }
 
-void AKKAAEManagedValueServiceReleaseQueue(__unsafe_unretained AKKAAEManagedValue * THIS) {
+static BOOL AKKAAEManagedValueServiceReleaseQueue(__unsafe_unretained AKKAAEManagedValue * THIS) {
 #ifdef DEBUG
     if ( AKKAAEManagedValueRealtimeThreadIdentifier && AKKAAEManagedValueRealtimeThreadIdentifier != pthread_self() ) {
         if ( AKKAAERateLimit() ) printf("%p: %s called from outside realtime thread\n", THIS, __FUNCTION__);
     }
 #endif
-    linkedlistitem_t * release;
-    while ((release = OSAtomicDequeue(&THIS->_pendingReleaseQueue, offsetof(linkedlistitem_t, next)))) {
-        OSAtomicEnqueue(&THIS->_releaseQueue, release, offsetof(linkedlistitem_t, next));
+    // The old values are no longer in use on this thread; hand them to the reclaimer
+    BOOL acknowledged = NO;
+    releasenode_t * release;
+    while ((release = OSAtomicDequeue(&THIS->_pendingReleaseQueue, offsetof(releasenode_t, next)))) {
+        OSAtomicEnqueue(&__acknowledgedReleases, release, offsetof(releasenode_t, next));
+        acknowledged = YES;
     }
+    return acknowledged;
 }
 
-- (void)pollReleaseList {
-    linkedlistitem_t * release ;
-    while ( (release = OSAtomicDequeue(&_releaseQueue, offsetof(linkedlistitem_t, next)))) {
-        NSAssert(release->data != _value, @"About to release value still in use");
-        [self releaseOldValue:release->data];
-        free(release);
-        _pendingReleaseCount--;
+#pragma mark - Reclamation
+
+static void * AKKAAEManagedValueReclaimerThread(void * userInfo) {
+#ifdef __APPLE__
+    pthread_setname_np("com.akka.audioengine.managed-value-reclaimer");
+    pthread_set_qos_class_self_np(QOS_CLASS_UTILITY, 0);
+#endif
+    while ( 1 ) {
+        AKKAAEManagedValueSemaphoreWait(&__reclaimerSemaphore);
+        @autoreleasepool {
+            AKKAAEManagedValueReclaim();
+        }
     }
-    
-    if (_pendingReleaseCount == 0) {
-        [self.pollTimer invalidate];
-        self.pollTimer = nil;
+    return NULL;
+}
+
+static void AKKAAEManagedValueStartReclaimer(void) {
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        AKKAAEManagedValueSemaphoreInit(&__reclaimerSemaphore);
+        pthread_t thread;
+        pthread_create(&thread, NULL, AKKAAEManagedValueReclaimerThread, NULL);
+        pthread_detach(thread);
+    });
+}
+
+/*!
+ * Release every value the realtime thread has acknowledged
+ */
+static void AKKAAEManagedValueReclaim(void) {
+    pthread_mutex_lock(&__reclaimMutex);
+    __reclaimDepth++;
+    releasenode_t * release;
+    while ( (release = OSAtomicDequeue(&__acknowledgedReleases, offsetof(releasenode_t, next))) ) {
+        AKKAAEManagedValueReclaimNode(release);
     }
-    
-    pthread_mutex_lock(&__pendingInstanceMutex);
-    for (linkedlistitem_t * entry = __servicedInstances , * prior = NULL; entry; prior = entry , entry = entry->next) {
-        if (entry->data == (__bridge void *)self) {
-            if (prior) {
-                prior->next = entry->next;
-            } else {
-                __servicedInstances = entry->next;
-            }
-            free(entry);
-            break;
+    __reclaimDepth--;
+    pthread_mutex_unlock(&__reclaimMutex);
+}
+
+/*!
+ * Release one retired value and return its node to the pool. Call with the reclaim mutex held
+ */
+static void AKKAAEManagedValueReclaimNode(releasenode_t * release) {
+    __unsafe_unretained AKKAAEManagedValue * owner = (__bridge AKKAAEManagedValue *)release->owner;
+    void * data = release->data;
+    AKKAAEHostTicks latency = AKKAAECurrentTimeInHostTicks() - release->retiredTime;
+
+    // Return the node first, as the release may set other values
+    release->data = NULL;
+    release->owner = NULL;
+    OSAtomicEnqueue(&__releaseNodePool, release, offsetof(releasenode_t, next));
+
+    NSCAssert(data != atomic_load(&owner->_value), @"About to release value still in use");
+    [owner releaseOldValue:data];
+
+    if (latency > __longestReclaimLatency) __longestReclaimLatency = latency;
+    atomic_fetch_add_explicit(&__reclaimedCount, 1, memory_order_relaxed);
+    atomic_fetch_sub(&__outstandingCount, 1);
+}
+
+static releasenode_t * AKKAAEManagedValueReleaseNodeAlloc(void) {
+    AKKAAEManagedValueStartReclaimer();
+
+    releasenode_t * release = OSAtomicDequeue(&__releaseNodePool, offsetof(releasenode_t, next));
+    if (!release) {
+        // Grow the pool by another block. Blocks are never freed, so the pool stays at its peak size
+        // 节点池不够用时一次分配一整块，之后一直复用，不再释放
+        releasenode_t * block = (releasenode_t *)calloc(kReleaseNodeBlockSize, sizeof(releasenode_t));
+        for (int i = 1; i < kReleaseNodeBlockSize; i++) {
+            OSAtomicEnqueue(&__releaseNodePool, &block[i], offsetof(releasenode_t, next));
         }
+        atomic_fetch_add(&__releaseNodePoolSize, kReleaseNodeBlockSize);
+        release = &block[0];
+    }
+    return release;
+}
+
+/*!
+ * Apply backpressure when too many old values are waiting to be released
+ *
+ *  Wakes the reclaimer and yields the processor a few times so it can catch up, but never sleeps:
+ *  this usually runs on the main thread. The cap is soft; if the reclaimer is still behind after
+ *  that, the update goes ahead anyway. If the render thread isn't running nothing would be
+ *  acknowledged, so there's no point yielding; nor on the reclaimer itself, or within a release.
+ */
+static void AKKAAEManagedValueThrottle(void) {
+    if (__reclaimDepth > 0) return;
+    int maximum = atomic_load(&__maximumOutstandingReleases);
+    if (atomic_load(&__outstandingCount) < maximum) return;
+
+    AKKAAEHostTicks now = AKKAAECurrentTimeInHostTicks();
+    AKKAAEHostTicks lastCommit = atomic_load_explicit(&__lastCommitTime, memory_order_relaxed);
+    if (!lastCommit || now - lastCommit > AKKAAEHostTicksFromSeconds(kRenderThreadIdleTimeout)) return;
+
+    atomic_fetch_add_explicit(&__throttledCount, 1, memory_order_relaxed);
+
+    AKKAAEManagedValueSemaphoreSignal(&__reclaimerSemaphore);
+    for (int i=0; i<kMaximumThrottleYields && atomic_load(&__outstandingCount) >= maximum; i++) {
+        sched_yield();
     }
-    pthread_mutex_unlock(&__pendingInstanceMutex);
 }
 
+#pragma mark -
+
 - (void)releaseOldValue:(void *)value {
     if (_releaseBlock) {
         _releaseBlock(value);
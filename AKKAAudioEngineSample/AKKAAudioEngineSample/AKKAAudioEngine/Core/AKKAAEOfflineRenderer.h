@@ -0,0 +1,150 @@
+//
+//  AKKAAEOfflineRenderer.h
+//  AKKAAudioEngineSample
+//
+//  Created by 张一鸣 on 2016/12/27.
+//  Copyright © 2016年 AKKA. All rights reserved.
+//
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#import <Foundation/Foundation.h>
+#import <AudioToolbox/AudioToolbox.h>
+#import "AKKAAETypes.h"
+#import "AKKAAETime.h"
+#import "AKKARenderContext.h"
+#import "AKKAAERenderProfiler.h"
+
+/*!
+ * Offline render statistics
+ *
+ *  离线渲染的统计数据，realtimeFactor 大于 1 表示比实时快
+ */
+typedef struct {
+    UInt64 frames;                  //!< Frames rendered
+    UInt64 cycles;                  //!< Render cycles performed
+    AKKAAESeconds audioDuration;    //!< Duration of the rendered audio
+    AKKAAESeconds renderDuration;   //!< Wall-clock time spent in the render block
+    AKKAAESeconds totalDuration;    //!< Wall-clock time spent rendering and writing to the sink
+    AKKAAESeconds longestCycle;     //!< Longest single render cycle
+    double realtimeFactor;          //!< audioDuration / totalDuration; 10 means ten times faster than realtime
+} AKKAAEOfflineRendererStatistics;
+
+/*!
+ * Output block
+ *
+ *  Receives each rendered cycle. The buffer is only valid for the duration of the call.
+ *
+ * @param buffer The rendered audio, in non-interleaved float format
+ * @param frames Number of frames rendered
+ * @param timestamp The timestamp of the first frame
+ * @return YES to continue rendering, NO to stop
+ */
+typedef BOOL (^AKKAAEOfflineRendererOutputBlock)(const AudioBufferList * _Nonnull buffer,
+                                                 UInt32 frames,
+                                                 const AudioTimeStamp * _Nonnull timestamp);
+
+/*!
+ * Offline renderer
+ *
+ *  This class drives a render loop block faster than realtime, with no audio hardware involved,
+ *  for bouncing and batch processing. It owns its own buffer stack and output buffer, and produces
+ *  a synthetic timestamp that advances in sample time from zero (with a matching host time), so
+ *  renders are repeatable. Render contexts it creates have offlineRendering set.
+ *
+ *  Because there is no IO buffer to match, the number of frames per cycle can be much larger than
+ *  a realtime render would use, which amortizes per-cycle overhead.
+ *
+ *  Output goes to a block, a caller-provided buffer list in memory, or a file. Every render call
+ *  updates the statistics, including the realtime factor.
+ *
+ *  这个类不依赖音频硬件，用一个紧凑的循环调用渲染 block，用于离线导出（bounce）和批处理。
+ *  它有自己的 buffer stack，时间戳按采样时间从 0 开始递增。
+ *
+ *  Render methods run on the calling thread; don't call them from more than one thread at once.
+ */
+@interface AKKAAEOfflineRenderer : NSObject
+
+/*!
+ * Initializer
+ *
+ * @param sampleRate Sample rate to render at
+ * @param numberOfChannels Number of output channels
+ * @param framesPerCycle Frames to render per cycle, up to AKKAAEBufferStackMaxFramesPerSlice
+ * @param block The render loop block
+ */
+- (instancetype _Nonnull)initWithSampleRate:(double)sampleRate
+                           numberOfChannels:(int)numberOfChannels
+                             framesPerCycle:(UInt32)framesPerCycle
+                                      block:(AKKAAERenderLoopBlock _Nonnull)block;
+
+/*!
+ * Render to a block
+ *
+ * @param frames Number of frames to render
+ * @param outputBlock Block to receive each cycle's output
+ * @return Number of frames the output block accepted: fewer than requested if it stopped the render, in which
+ *  case the cycle it returned NO for is not counted
+ */
+- (UInt64)renderFrames:(UInt64)frames toBlock:(AKKAAEOfflineRendererOutputBlock _Nonnull)outputBlock;
+
+/*!
+ * Render into memory
+ *
+ *  Renders directly into the given buffer list, with no intermediate copy.
+ *
+ * @param frames Number of frames to render
+ * @param bufferList Buffer list, in non-interleaved float format, with room for the given number of frames
+ */
+- (void)renderFrames:(UInt32)frames toBufferList:(const AudioBufferList * _Nonnull)bufferList;
+
+/*!
+ * Render to a file
+ *
+ *  The PCM file types are written with AKKAAEAudioFile on every platform. AKKAAEAudioFileTypeM4A
+ *  uses ExtAudioFile, and so is only supported on Apple platforms.
+ *
+ * @param frames Number of frames to render
+ * @param url URL of the file to write (any existing file will be overwritten)
+ * @param fileType The type of file to write
+ * @param error If not NULL, the error on output
+ * @return YES on success, NO on failure
+ */
+- (BOOL)renderFrames:(UInt64)frames
+         toFileAtURL:(NSURL * _Nonnull)url
+                type:(AKKAAEAudioFileType)fileType
+               error:(NSError * __autoreleasing _Nullable * _Nullable)error;
+
+/*!
+ * Reset statistics
+ */
+- (void)resetStatistics;
+
+//! The render loop block
+@property (nonatomic, copy) AKKAAERenderLoopBlock _Nonnull block;
+
+//! The sample rate
+@property (nonatomic, readonly) double sampleRate;
+
+//! The number of output channels
+@property (nonatomic, readonly) int numberOfChannels;
+
+//! Frames rendered per cycle
+@property (nonatomic, readonly) UInt32 framesPerCycle;
+
+//! Sample time of the next frame to render. Set this to move the timeline (e.g. to render a section)
+@property (nonatomic) Float64 sampleTime;
+
+//! Accumulated statistics since creation or the last call to resetStatistics
+@property (nonatomic, readonly) AKKAAEOfflineRendererStatistics statistics;
+
+//! Profiler to time each render cycle with, or NULL. The renderer doesn't take ownership of it
+@property (nonatomic) AKKAAERenderProfiler * _Nullable profiler;
+
+@end
+
+#ifdef __cplusplus
+}
+#endif
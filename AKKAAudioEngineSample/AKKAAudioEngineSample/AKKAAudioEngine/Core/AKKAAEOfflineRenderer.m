@@ -0,0 +1,225 @@
+//
+//  AKKAAEOfflineRenderer.m
+//  AKKAAudioEngineSample
+//
+//  Created by 张一鸣 on 2016/12/27.
+//  Copyright © 2016年 AKKA. All rights reserved.
+//
+
+#import "AKKAAEOfflineRenderer.h"
+#import "AKKAAEBufferStack.h"
+#import "AKKAAEManagedValue.h"
+#import "AKKAAEAudioBufferListUtilities.h"
+#import "AKKAAEUtilities.h"
+#import "AKKAAEAudioFile.h"
+
+static const int kStackPoolSize = 16;
+static const int kMaxChannelsPerStackBuffer = 8;
+
+@interface AKKAAEOfflineRenderer () {
+    AKKAAEBufferStack * _stack;
+    AudioBufferList * _buffer;
+    AudioTimeStamp _timestamp;
+    AKKAAEHostTicks _hostTimeOrigin;
+    AKKAAEOfflineRendererStatistics _statistics;
+}
+@end
+
+@implementation AKKAAEOfflineRenderer
+
+- (instancetype)initWithSampleRate:(double)sampleRate
+                  numberOfChannels:(int)numberOfChannels
+                    framesPerCycle:(UInt32)framesPerCycle
+                             block:(AKKAAERenderLoopBlock)block {
+    if ( !(self = [super init]) ) return nil;
+
+    if ( framesPerCycle > AKKAAEBufferStackMaxFramesPerSlice ) {
+        NSLog(@"AKKAAEOfflineRenderer: %u frames per cycle is above the maximum, using %u",
+              (unsigned int)framesPerCycle, (unsigned int)AKKAAEBufferStackMaxFramesPerSlice);
+        framesPerCycle = AKKAAEBufferStackMaxFramesPerSlice;
+    }
+
+    _sampleRate = sampleRate;
+    _numberOfChannels = numberOfChannels;
+    _framesPerCycle = framesPerCycle;
+    _block = [block copy];
+
+    // 离线渲染的切片大小固定，stack 只按它分配
+    _stack = AKKAAEBufferStackNewWithMaxFrames(kStackPoolSize, MAX(numberOfChannels, kMaxChannelsPerStackBuffer), 0, framesPerCycle);
+    _buffer = AKKAAEAudioBufferListCreateWithFormat(AKKAAEAudioDescriptionWithChannelsAndRate(numberOfChannels, sampleRate),
+                                                    framesPerCycle);
+
+    // 合成的时间戳：采样时间从 0 开始，主机时间跟着采样时间走，这样每次渲染结果都一样
+    _hostTimeOrigin = AKKAAECurrentTimeInHostTicks();
+    _timestamp = AKKAAETimeStampWithSamples(0);
+    _timestamp.mFlags |= kAudioTimeStampHostTimeValid;
+    _timestamp.mRateScalar = 1.0;
+
+    return self;
+}
+
+- (void)dealloc {
+    AKKAAEBufferStackFree(_stack);
+    AKKAAEAudioBufferListFree(_buffer);
+}
+
+- (Float64)sampleTime {
+    return _timestamp.mSampleTime;
+}
+
+- (void)setSampleTime:(Float64)sampleTime {
+    _timestamp.mSampleTime = sampleTime;
+}
+
+- (AKKAAEOfflineRendererStatistics)statistics {
+    AKKAAEOfflineRendererStatistics statistics = _statistics;
+    statistics.audioDuration = statistics.frames / _sampleRate;
+    statistics.realtimeFactor = statistics.totalDuration > 0 ? statistics.audioDuration / statistics.totalDuration : 0;
+    return statistics;
+}
+
+- (void)resetStatistics {
+    memset(&_statistics, 0, sizeof(_statistics));
+}
+
+#pragma mark - Rendering
+
+/*!
+ * Run one render cycle into the given output
+ */
+static void AKKAAEOfflineRendererRenderCycle(__unsafe_unretained AKKAAEOfflineRenderer * THIS,
+                                             const AudioBufferList * output, UInt32 frames) {
+    AKKAAEHostTicks start = AKKAAECurrentTimeInHostTicks();
+
+    // Apply any pending updates, as a realtime render loop would
+    AKKAAEManagedValueCommitPendingUpdates();
+
+    THIS->_timestamp.mHostTime = THIS->_hostTimeOrigin
+        + AKKAAEHostTicksFromSeconds(MAX(0.0, THIS->_timestamp.mSampleTime) / THIS->_sampleRate);
+
+    AKKAAEBufferStackReset(THIS->_stack);
+    AKKAAEBufferStackSetFrameCount(THIS->_stack, frames);
+    AKKAAEBufferStackSetTimeStamp(THIS->_stack, &THIS->_timestamp);
+    AKKAAEAudioBufferListSilence(output, 0, frames);
+
+    AKKAAERenderContext context = {
+        .output = output,
+        .frames = frames,
+        .sampleRate = THIS->_sampleRate,
+        .timestamp = &THIS->_timestamp,
+        .offlineRendering = YES,
+        .stack = THIS->_stack,
+    };
+    AKKAAERenderProfiler * profiler = THIS->_profiler;
+    if ( profiler ) AKKAAERenderProfilerBeginCycle(profiler, &context);
+    THIS->_block(&context);
+    if ( profiler ) AKKAAERenderProfilerEndCycle(profiler);
+
+    THIS->_timestamp.mSampleTime += frames;
+
+    AKKAAESeconds duration = AKKAAESecondsFromHostTicks(AKKAAECurrentTimeInHostTicks() - start);
+    THIS->_statistics.renderDuration += duration;
+    THIS->_statistics.longestCycle = MAX(THIS->_statistics.longestCycle, duration);
+    THIS->_statistics.frames += frames;
+    THIS->_statistics.cycles++;
+}
+
+- (UInt64)renderFrames:(UInt64)frames toBlock:(AKKAAEOfflineRendererOutputBlock)outputBlock {
+    AKKAAEHostTicks start = AKKAAECurrentTimeInHostTicks();
+    UInt64 rendered = 0;
+
+    while ( rendered < frames ) {
+        UInt32 cycleFrames = (UInt32)MIN((UInt64)_framesPerCycle, frames - rendered);
+        AudioTimeStamp timestamp = _timestamp;
+        AKKAAEAudioBufferListSetLength(_buffer, cycleFrames);
+        AKKAAEOfflineRendererRenderCycle(self, _buffer, cycleFrames);
+        // A cycle the block turned down isn't counted: the caller never got it
+        if ( !outputBlock(_buffer, cycleFrames, &timestamp) ) break;
+        rendered += cycleFrames;
+    }
+
+    AKKAAEAudioBufferListSetLength(_buffer, _framesPerCycle);
+    _statistics.totalDuration += AKKAAESecondsFromHostTicks(AKKAAECurrentTimeInHostTicks() - start);
+    return rendered;
+}
+
+- (void)renderFrames:(UInt32)frames toBufferList:(const AudioBufferList *)bufferList {
+    AKKAAEHostTicks start = AKKAAECurrentTimeInHostTicks();
+
+    // 直接渲染到调用者的内存中，不用中间拷贝
+    for ( UInt32 offset = 0; offset < frames; ) {
+        UInt32 cycleFrames = MIN(_framesPerCycle, frames - offset);
+        AKKAAEAudioBufferListCopyOnStack(output, bufferList, offset);
+        AKKAAEAudioBufferListSetLength(output, cycleFrames);
+        AKKAAEOfflineRendererRenderCycle(self, output, cycleFrames);
+        offset += cycleFrames;
+    }
+
+    _statistics.totalDuration += AKKAAESecondsFromHostTicks(AKKAAECurrentTimeInHostTicks() - start);
+}
+
+- (BOOL)renderFrames:(UInt64)frames toFileAtURL:(NSURL *)url type:(AKKAAEAudioFileType)fileType error:(NSError **)error {
+    if ( fileType == AKKAAEAudioFileTypeM4A ) {
+#ifdef __APPLE__
+        return [self renderFrames:frames toExtAudioFileAtURL:url type:fileType error:error];
+#else
+        if ( error )
+            *error = [NSError errorWithDomain:NSPOSIXErrorDomain
+                                         code:ENOTSUP
+                                     userInfo:@{ NSLocalizedDescriptionKey: @"M4A output is not supported on this platform" }];
+        return NO;
+#endif
+    }
+
+    AKKAAEAudioFile * audioFile = AKKAAEAudioFileCreate(url, fileType, _sampleRate, _numberOfChannels, error);
+    if ( !audioFile ) return NO;
+
+    // errno is taken as the write fails: rendering the cycle and closing the file may change it
+    __block int writeError = 0;
+    __block BOOL failed = NO;
+    [self renderFrames:frames toBlock:^BOOL(const AudioBufferList * buffer, UInt32 cycleFrames, const AudioTimeStamp * timestamp) {
+        if ( !AKKAAEAudioFileWrite(audioFile, buffer, cycleFrames) ) {
+            writeError = errno;
+            failed = YES;
+        }
+        return !failed;
+    }];
+
+    BOOL closed = AKKAAEAudioFileClose(audioFile, failed ? NULL : error);
+    if ( failed ) {
+        if ( error )
+            *error = [NSError errorWithDomain:NSPOSIXErrorDomain code:writeError
+                                     userInfo:@{ NSLocalizedDescriptionKey: @"Couldn't write to the output file" }];
+        return NO;
+    }
+    return closed;
+}
+
+#ifdef __APPLE__
+
+- (BOOL)renderFrames:(UInt64)frames toExtAudioFileAtURL:(NSURL *)url type:(AKKAAEAudioFileType)fileType error:(NSError **)error {
+    ExtAudioFileRef audioFile = AKKAAEExtAudioFileCreate(url, fileType, _sampleRate, _numberOfChannels, error);
+    if ( !audioFile ) return NO;
+
+    __block OSStatus status = noErr;
+    [self renderFrames:frames toBlock:^BOOL(const AudioBufferList * buffer, UInt32 cycleFrames, const AudioTimeStamp * timestamp) {
+        status = ExtAudioFileWrite(audioFile, cycleFrames, buffer);
+        return AKKAAECheckOSStatus(status, "ExtAudioFileWrite");
+    }];
+
+    ExtAudioFileDispose(audioFile);
+
+    if ( status != noErr ) {
+        if ( error )
+            *error = [NSError errorWithDomain:NSOSStatusErrorDomain
+                                         code:status
+                                     userInfo:@{ NSLocalizedDescriptionKey:
+                                                     NSLocalizedString(@"Couldn't write to the output file", @"") }];
+        return NO;
+    }
+    return YES;
+}
+
+#endif
+
+@end
@@ -0,0 +1,149 @@
+//
+//  AKKAAERecorder.h
+//  AKKAAudioEngineSample
+//
+//  Created by 张一鸣 on 2016/12/27.
+//  Copyright © 2016年 AKKA. All rights reserved.
+//
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#import <Foundation/Foundation.h>
+#import <AudioToolbox/AudioToolbox.h>
+#import "AKKARenderContext.h"
+#import "AKKAAETime.h"
+#import "AKKAAETypes.h"
+
+typedef struct AKKAAERecorder AKKAAERecorder;
+
+/*!
+ * Create a recorder
+ *
+ *  Records from the render thread without blocking it: audio is copied into a preallocated
+ *  lock-free ring (AKKAAEAudioRing), and a shared background writer thread drains the ring into
+ *  the file in large batches. Nothing is allocated, locked or written to disk on the render thread.
+ *
+ *  在渲染线程上只把音频拷进预先分配的无锁环形缓冲区，由后台写线程成批写入文件。
+ *
+ *  The PCM file types are written with AKKAAEAudioFileCreate; AKKAAEAudioFileTypeM4A uses
+ *  AKKAAEExtAudioFileCreate, and is only available on Apple platforms.
+ *
+ *  If the writer falls so far behind that the ring fills, the frames that don't fit are dropped,
+ *  counted, and replaced with silence in the file, so the recording keeps its timing. Recorders
+ *  fed from the same render cycles, such as stems recorded with AKKAAERecorderRecordStackItems,
+ *  stay sample-aligned with each other.
+ *
+ *  Use this function on the main thread.
+ *
+ * @param url URL of the file to write (any existing file will be overwritten)
+ * @param fileType The type of the file to write
+ * @param sampleRate Sample rate
+ * @param channelCount Number of channels
+ * @param bufferDuration How much audio the ring holds, in seconds, or 0 for the default (2 seconds).
+ *  This is how long the writer can be held up, by a slow disk for instance, before frames are dropped.
+ * @param error If not NULL, the error on output
+ * @return The new recorder, or NULL on error
+ */
+AKKAAERecorder * _Nullable AKKAAERecorderNew(NSURL * _Nonnull url,
+                                             AKKAAEAudioFileType fileType,
+                                             double sampleRate,
+                                             int channelCount,
+                                             AKKAAESeconds bufferDuration,
+                                             NSError * _Nullable * _Nullable error);
+
+/*!
+ * Finish recording, close the file and free the recorder
+ *
+ *  Writes out everything still in the ring and completes the file. Use this function on the main
+ *  thread, once the render thread has stopped recording into the recorder.
+ *
+ * @param recorder The recorder
+ * @param error If not NULL, the error on output
+ * @return YES on success, NO if any audio couldn't be written
+ */
+BOOL AKKAAERecorderClose(AKKAAERecorder * _Nonnull recorder, NSError * _Nullable * _Nullable error);
+
+/*!
+ * Set the batch size
+ *
+ *  The writer thread is woken once this much audio is waiting, then writes out all of it. Larger
+ *  batches mean fewer, larger writes; the default is a quarter of a second. The batch size is
+ *  limited to half the ring's capacity.
+ *
+ * @param recorder The recorder
+ * @param frames Batch size, in frames
+ */
+void AKKAAERecorderSetBatchSize(AKKAAERecorder * _Nonnull recorder, UInt32 frames);
+
+/*!
+ * Get the number of frames recorded
+ *
+ * @param recorder The recorder
+ * @return Frames written to the file so far, including silence in place of dropped frames
+ */
+UInt64 AKKAAERecorderGetRecordedFrames(const AKKAAERecorder * _Nonnull recorder);
+
+/*!
+ * Get the number of frames dropped
+ *
+ * @param recorder The recorder
+ * @return Frames that didn't fit in the ring, because the writer fell behind
+ */
+UInt64 AKKAAERecorderGetDroppedFrames(const AKKAAERecorder * _Nonnull recorder);
+
+/*!
+ * Record audio
+ *
+ *  Copies the audio into the recorder's ring. If the buffer list has fewer channels than the
+ *  recorder, its last channel is repeated (so mono is recorded to both sides of a stereo file);
+ *  if it has more, the extra channels are ignored.
+ *
+ *  This function is realtime safe. Use it from one thread only: the render thread.
+ *
+ * @param recorder The recorder
+ * @param bufferList Non-interleaved float audio
+ * @param frames Number of frames
+ */
+void AKKAAERecorderRecordBufferList(AKKAAERecorder * _Nonnull recorder, const AudioBufferList * _Nonnull bufferList, UInt32 frames);
+
+/*!
+ * Record the top buffer on the stack
+ *
+ *  This function is realtime safe.
+ *
+ * @param recorder The recorder
+ * @param context The render context
+ */
+void AKKAAERecorderRecordStack(AKKAAERecorder * _Nonnull recorder, const AKKAAERenderContext * _Nonnull context);
+
+/*!
+ * Record several stack items, one per recorder
+ *
+ *  Records stack item i (0 being the top) into recorders[i], for capturing stems from one render
+ *  cycle. Recorders with no corresponding stack item record silence, to stay aligned.
+ *
+ *  This function is realtime safe.
+ *
+ * @param recorders The recorders
+ * @param count Number of recorders
+ * @param context The render context
+ */
+void AKKAAERecorderRecordStackItems(AKKAAERecorder * _Nonnull const * _Nonnull recorders, int count,
+                                    const AKKAAERenderContext * _Nonnull context);
+
+/*!
+ * Record the render context's output
+ *
+ *  Call this at the end of the render loop, once everything has been output.
+ *  This function is realtime safe.
+ *
+ * @param recorder The recorder
+ * @param context The render context
+ */
+void AKKAAERecorderRecordOutput(AKKAAERecorder * _Nonnull recorder, const AKKAAERenderContext * _Nonnull context);
+
+#ifdef __cplusplus
+}
+#endif
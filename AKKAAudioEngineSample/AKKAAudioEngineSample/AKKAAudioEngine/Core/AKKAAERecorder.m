@@ -0,0 +1,337 @@
+//
+//  AKKAAERecorder.m
+//  AKKAAudioEngineSample
+//
+//  Created by 张一鸣 on 2016/12/27.
+//  Copyright © 2016年 AKKA. All rights reserved.
+//
+
+#import "AKKAAERecorder.h"
+#import "AKKAAEAudioFile.h"
+#import "AKKAAEAudioRing.h"
+#import "AKKAAEAudioBufferListUtilities.h"
+#import "AKKAAEUtilities.h"
+#import <pthread.h>
+#import <stdatomic.h>
+#import <errno.h>
+#ifdef __APPLE__
+#import <mach/mach.h>
+#else
+#import <semaphore.h>
+#endif
+
+static const AKKAAESeconds kDefaultBufferDuration = 2.0;
+static const AKKAAESeconds kDefaultBatchDuration = 0.25;
+static const UInt32 kSilenceFrames = 4096;
+#define kMaxGaps 16
+
+// Wakes the writer; signalling is realtime-safe (no locks, no allocation)
+#ifdef __APPLE__
+typedef semaphore_t AKKAAERecorderSemaphore;
+#define AKKAAERecorderSemaphoreInit(s) semaphore_create(mach_task_self(), (s), SYNC_POLICY_FIFO, 0)
+#define AKKAAERecorderSemaphoreSignal(s) semaphore_signal(*(s))
+#define AKKAAERecorderSemaphoreWait(s) semaphore_wait(*(s))
+#else
+typedef sem_t AKKAAERecorderSemaphore;
+#define AKKAAERecorderSemaphoreInit(s) sem_init((s), 0, 0)
+#define AKKAAERecorderSemaphoreSignal(s) sem_post(s)
+#define AKKAAERecorderSemaphoreWait(s) while ( sem_wait(s) != 0 )
+#endif
+
+// Dropped frames, to be written as silence where they would have been
+typedef struct {
+    UInt64 count;   // The ring's written count where the frames are missing
+    UInt64 frames;
+} AKKAAERecorderGap;
+
+struct AKKAAERecorder {
+    AKKAAEAudioFile * file;
+#ifdef __APPLE__
+    ExtAudioFileRef extAudioFile;
+#endif
+    AKKAAEAudioRing * ring;
+    AudioStreamBasicDescription audioDescription;
+    _Atomic(UInt32) batchFrames;
+
+    // Render thread → writer
+    AKKAAERecorderGap gaps[kMaxGaps];
+    _Atomic(UInt32) gapsWritten;
+    _Atomic(UInt32) gapsRead;
+    _Atomic(UInt64) droppedFrames;
+    _Atomic(BOOL) drainRequested;
+    UInt64 pendingGap;              // Render thread only: dropped frames not yet in the gap queue
+
+    // Writer → others
+    _Atomic(UInt64) recordedFrames;
+    _Atomic(BOOL) writeFailed;
+
+    struct AKKAAERecorder * next;   // In the writer list, guarded by __writerMutex
+};
+
+static pthread_mutex_t __writerMutex = PTHREAD_MUTEX_INITIALIZER;
+static AKKAAERecorder * __writerList = NULL;
+static AKKAAERecorderSemaphore __writerSemaphore;
+static float * __silence = NULL;
+
+static void AKKAAERecorderStartWriter(void);
+static void AKKAAERecorderDrain(AKKAAERecorder * recorder);
+static BOOL AKKAAERecorderPushGap(AKKAAERecorder * recorder);
+
+static void AKKAAERecorderSetError(NSError ** error, int code, NSString * description) {
+    if ( error ) {
+        *error = [NSError errorWithDomain:NSPOSIXErrorDomain code:code
+                                 userInfo:@{ NSLocalizedDescriptionKey: description }];
+    }
+}
+
+AKKAAERecorder * AKKAAERecorderNew(NSURL * url, AKKAAEAudioFileType fileType, double sampleRate, int channelCount,
+                                   AKKAAESeconds bufferDuration, NSError ** error) {
+    AKKAAERecorder * recorder = (AKKAAERecorder *)calloc(1, sizeof(AKKAAERecorder));
+    if ( fileType == AKKAAEAudioFileTypeM4A ) {
+#ifdef __APPLE__
+        recorder->extAudioFile = AKKAAEExtAudioFileCreate(url, fileType, sampleRate, channelCount, error);
+        if ( !recorder->extAudioFile ) {
+            free(recorder);
+            return NULL;
+        }
+#else
+        AKKAAERecorderSetError(error, ENOTSUP, @"M4A recording needs ExtAudioFile");
+        free(recorder);
+        return NULL;
+#endif
+    } else {
+        recorder->file = AKKAAEAudioFileCreate(url, fileType, sampleRate, channelCount, error);
+        if ( !recorder->file ) {
+            free(recorder);
+            return NULL;
+        }
+    }
+
+    UInt32 capacity = (UInt32)MAX(4096.0, round((bufferDuration > 0 ? bufferDuration : kDefaultBufferDuration) * sampleRate));
+    recorder->ring = AKKAAEAudioRingNew(channelCount, capacity);
+    recorder->audioDescription = AKKAAEAudioDescriptionWithChannelsAndRate(channelCount, sampleRate);
+    atomic_init(&recorder->batchFrames, MIN((UInt32)(kDefaultBatchDuration * sampleRate), capacity / 2));
+    atomic_init(&recorder->gapsWritten, 0);
+    atomic_init(&recorder->gapsRead, 0);
+    atomic_init(&recorder->droppedFrames, 0);
+    atomic_init(&recorder->drainRequested, NO);
+    atomic_init(&recorder->recordedFrames, 0);
+    atomic_init(&recorder->writeFailed, NO);
+
+    AKKAAERecorderStartWriter();
+    pthread_mutex_lock(&__writerMutex);
+    recorder->next = __writerList;
+    __writerList = recorder;
+    pthread_mutex_unlock(&__writerMutex);
+
+    return recorder;
+}
+
+BOOL AKKAAERecorderClose(AKKAAERecorder * recorder, NSError ** error) {
+    // Once out of the list, the writer can't be using it
+    pthread_mutex_lock(&__writerMutex);
+    for ( AKKAAERecorder ** entry = &__writerList; *entry; entry = &(*entry)->next ) {
+        if ( *entry == recorder ) {
+            *entry = recorder->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&__writerMutex);
+
+    AKKAAERecorderDrain(recorder);
+    if ( recorder->pendingGap > 0 ) {
+        // The render thread has finished with it, and the gap queue is now empty, so the last dropped frames fit
+        AKKAAERecorderPushGap(recorder);
+        AKKAAERecorderDrain(recorder);
+    }
+
+    BOOL success = !atomic_load(&recorder->writeFailed);
+    if ( recorder->file ) {
+        NSError * closeError = nil;
+        if ( !AKKAAEAudioFileClose(recorder->file, &closeError) && success ) {
+            success = NO;
+            if ( error ) *error = closeError;
+        }
+    }
+#ifdef __APPLE__
+    if ( recorder->extAudioFile ) {
+        AKKAAECheckOSStatus(ExtAudioFileDispose(recorder->extAudioFile), "ExtAudioFileDispose");
+    }
+#endif
+    if ( !success && error && !*error ) {
+        AKKAAERecorderSetError(error, EIO, @"Couldn't write the recording");
+    }
+
+    AKKAAEAudioRingFree(recorder->ring);
+    free(recorder);
+    return success;
+}
+
+void AKKAAERecorderSetBatchSize(AKKAAERecorder * recorder, UInt32 frames) {
+    atomic_store_explicit(&recorder->batchFrames, MAX(1, MIN(frames, AKKAAEAudioRingGetCapacity(recorder->ring) / 2)),
+                          memory_order_relaxed);
+}
+
+UInt64 AKKAAERecorderGetRecordedFrames(const AKKAAERecorder * recorder) {
+    return atomic_load_explicit(&recorder->recordedFrames, memory_order_relaxed);
+}
+
+UInt64 AKKAAERecorderGetDroppedFrames(const AKKAAERecorder * recorder) {
+    return atomic_load_explicit(&recorder->droppedFrames, memory_order_relaxed);
+}
+
+#pragma mark - Recording
+
+// Queue the pending dropped frames at the current write position. Returns NO if the queue is full.
+static BOOL AKKAAERecorderPushGap(AKKAAERecorder * recorder) {
+    UInt32 gapsWritten = atomic_load_explicit(&recorder->gapsWritten, memory_order_relaxed);
+    if ( gapsWritten - atomic_load_explicit(&recorder->gapsRead, memory_order_acquire) == kMaxGaps ) return NO;
+    UInt64 written;
+    AKKAAEAudioRingGetCounts(recorder->ring, &written, NULL);
+    recorder->gaps[gapsWritten % kMaxGaps] = (AKKAAERecorderGap) { .count = written, .frames = recorder->pendingGap };
+    atomic_store_explicit(&recorder->gapsWritten, gapsWritten + 1, memory_order_release);
+    recorder->pendingGap = 0;
+    return YES;
+}
+
+void AKKAAERecorderRecordBufferList(AKKAAERecorder * recorder, const AudioBufferList * bufferList, UInt32 frames) {
+    UInt32 done = 0;
+
+    // Earlier dropped frames have to be placed before any new audio, or the timing would be lost
+    if ( recorder->pendingGap == 0 || AKKAAERecorderPushGap(recorder) ) {
+        int sourceChannels = bufferList->mNumberBuffers;
+        AKKAAEAudioBufferListCreateOnStackWithFormat(target, recorder->audioDescription);
+        for ( int run=0; run<2 && done < frames; run++ ) {
+            UInt32 count = AKKAAEAudioRingGetWriteBuffer(recorder->ring, target, frames - done);
+            if ( count == 0 ) break;
+            for ( int c=0; c<(int)target->mNumberBuffers; c++ ) {
+                const float * source = (const float *)bufferList->mBuffers[MIN(c, sourceChannels-1)].mData + done;
+                memcpy(target->mBuffers[c].mData, source, count * sizeof(float));
+            }
+            AKKAAEAudioRingCommitWrite(recorder->ring, count);
+            done += count;
+        }
+    }
+
+    if ( done < frames ) {
+        recorder->pendingGap += frames - done;
+        atomic_fetch_add_explicit(&recorder->droppedFrames, frames - done, memory_order_relaxed);
+    }
+
+    if ( (AKKAAEAudioRingGetFillCount(recorder->ring) >= atomic_load_explicit(&recorder->batchFrames, memory_order_relaxed)
+            || recorder->pendingGap > 0)
+            && !atomic_exchange_explicit(&recorder->drainRequested, YES, memory_order_acq_rel) ) {
+        AKKAAERecorderSemaphoreSignal(&__writerSemaphore);
+    }
+}
+
+void AKKAAERecorderRecordStack(AKKAAERecorder * recorder, const AKKAAERenderContext * context) {
+    AKKAAERecorderRecordStackItems(&recorder, 1, context);
+}
+
+void AKKAAERecorderRecordStackItems(AKKAAERecorder * const * recorders, int count, const AKKAAERenderContext * context) {
+    for ( int i=0; i<count; i++ ) {
+        // Record what will be heard: with any fader gain still pending on the buffer
+        AKKAAEBufferStackMaterialize(context->stack, i);
+        const AudioBufferList * abl = AKKAAEBufferStackGet(context->stack, i);
+        if ( !abl ) {
+            // Nothing to record, but keep time with the other stems
+            AudioBufferList silence = { .mNumberBuffers = 1, .mBuffers = { { 1, context->frames * sizeof(float), __silence } } };
+            AKKAAERecorderRecordBufferList(recorders[i], &silence, MIN(context->frames, kSilenceFrames));
+            continue;
+        }
+        AKKAAERecorderRecordBufferList(recorders[i], abl, context->frames);
+    }
+}
+
+void AKKAAERecorderRecordOutput(AKKAAERecorder * recorder, const AKKAAERenderContext * context) {
+    AKKAAERecorderRecordBufferList(recorder, context->output, context->frames);
+}
+
+#pragma mark - Writer
+
+static BOOL AKKAAERecorderWrite(AKKAAERecorder * recorder, const AudioBufferList * bufferList, UInt32 frames) {
+    BOOL success;
+#ifdef __APPLE__
+    if ( recorder->extAudioFile ) {
+        success = AKKAAECheckOSStatus(ExtAudioFileWrite(recorder->extAudioFile, frames, bufferList), "ExtAudioFileWrite");
+    } else
+#endif
+    {
+        success = AKKAAEAudioFileWrite(recorder->file, bufferList, frames);
+    }
+    if ( success ) {
+        atomic_fetch_add_explicit(&recorder->recordedFrames, frames, memory_order_relaxed);
+    } else {
+        atomic_store_explicit(&recorder->writeFailed, YES, memory_order_relaxed);
+    }
+    return success;
+}
+
+// Write out everything in the ring, with silence in place of dropped frames
+static void AKKAAERecorderDrain(AKKAAERecorder * recorder) {
+    AKKAAEAudioBufferListCreateOnStackWithFormat(source, recorder->audioDescription);
+    while ( 1 ) {
+        UInt64 read;
+        AKKAAEAudioRingGetCounts(recorder->ring, NULL, &read);
+
+        // Stop at the next gap, if there is one
+        UInt32 limit = UINT32_MAX;
+        UInt32 gapsRead = atomic_load_explicit(&recorder->gapsRead, memory_order_relaxed);
+        const AKKAAERecorderGap * gap = NULL;
+        if ( gapsRead != atomic_load_explicit(&recorder->gapsWritten, memory_order_acquire) ) {
+            gap = &recorder->gaps[gapsRead % kMaxGaps];
+            limit = (UInt32)(gap->count - read);
+        }
+
+        if ( gap && limit == 0 ) {
+            for ( UInt64 written = 0; written < gap->frames; written += kSilenceFrames ) {
+                UInt32 frames = (UInt32)MIN((UInt64)kSilenceFrames, gap->frames - written);
+                for ( int c=0; c<(int)source->mNumberBuffers; c++ ) {
+                    source->mBuffers[c].mData = __silence;
+                    source->mBuffers[c].mDataByteSize = frames * sizeof(float);
+                }
+                AKKAAERecorderWrite(recorder, source, frames);
+            }
+            atomic_store_explicit(&recorder->gapsRead, gapsRead + 1, memory_order_release);
+            continue;
+        }
+
+        // Straight from the ring to the file: a batch is at most two contiguous runs
+        UInt32 frames = AKKAAEAudioRingGetReadBuffer(recorder->ring, source, limit);
+        if ( frames == 0 ) break;
+        AKKAAERecorderWrite(recorder, source, frames);
+        AKKAAEAudioRingCommitRead(recorder->ring, frames);
+    }
+}
+
+static void * AKKAAERecorderWriterThread(void * userInfo) {
+#ifdef __APPLE__
+    pthread_setname_np("com.akka.audioengine.recorder");
+    pthread_set_qos_class_self_np(QOS_CLASS_USER_INITIATED, 0);
+#endif
+
+    while ( 1 ) {
+        AKKAAERecorderSemaphoreWait(&__writerSemaphore);
+        pthread_mutex_lock(&__writerMutex);
+        for ( AKKAAERecorder * recorder = __writerList; recorder; recorder = recorder->next ) {
+            // Clear the request first: one made while draining brings another pass
+            if ( atomic_exchange_explicit(&recorder->drainRequested, NO, memory_order_acq_rel) ) {
+                AKKAAERecorderDrain(recorder);
+            }
+        }
+        pthread_mutex_unlock(&__writerMutex);
+    }
+    return NULL;
+}
+
+static void AKKAAERecorderStartWriter(void) {
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        __silence = (float *)calloc(kSilenceFrames, sizeof(float));
+        AKKAAERecorderSemaphoreInit(&__writerSemaphore);
+        pthread_t thread;
+        pthread_create(&thread, NULL, AKKAAERecorderWriterThread, NULL);
+        pthread_detach(thread);
+    });
+}
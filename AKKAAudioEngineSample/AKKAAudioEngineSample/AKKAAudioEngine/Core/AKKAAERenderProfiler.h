@@ -0,0 +1,186 @@
+//
+//  AKKAAERenderProfiler.h
+//  AKKAAudioEngineSample
+//
+//  Created by 张一鸣 on 2016/12/27.
+//  Copyright © 2016年 AKKA. All rights reserved.
+//
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#import <Foundation/Foundation.h>
+#import "AKKARenderContext.h"
+#import "AKKAAETime.h"
+
+#define AKKAAERenderProfilerMaxSections 16      //!< Maximum number of named sections per profiler
+#define AKKAAERenderProfilerMaxSectionName 32   //!< Maximum section name length, including the terminator
+#define AKKAAERenderProfilerTimeBins 32         //!< Bin i counts durations from 2^i to 2^(i+1) ns (bin 0 also counts < 1 ns)
+#define AKKAAERenderProfilerLoadBins 21         //!< Bin i counts loads from i*10% to (i+1)*10%; the last bin counts 200% and over
+
+/*!
+ * Profiled section statistics
+ */
+typedef struct {
+    char name[AKKAAERenderProfilerMaxSectionName];  //!< The section name
+    UInt64 calls;                                   //!< Times the section was timed
+    UInt64 cycles;                                  //!< Render cycles in which the section was timed
+    AKKAAESeconds totalTime;                        //!< Total time spent in the section
+    AKKAAESeconds longestCycle;                     //!< Most time spent in the section in one render cycle
+    UInt64 timeHistogram[AKKAAERenderProfilerTimeBins]; //!< Time spent in the section per render cycle
+} AKKAAERenderProfilerSectionStatistics;
+
+/*!
+ * Profiler snapshot
+ */
+typedef struct {
+    UInt64 cycles;                  //!< Render cycles profiled
+    UInt64 frames;                  //!< Frames rendered in those cycles
+    UInt64 overruns;                //!< Cycles that took longer than their budget (frames / sampleRate)
+    AKKAAESeconds totalTime;        //!< Time spent rendering
+    AKKAAESeconds totalBudget;      //!< Sum of the cycles' budgets, i.e. the duration of the audio rendered
+    AKKAAESeconds longestCycle;     //!< Longest single render cycle
+    double averageLoad;             //!< totalTime / totalBudget: 0.5 means the render thread was busy half the time
+    double peakLoad;                //!< Highest load of a single cycle
+    UInt64 timeHistogram[AKKAAERenderProfilerTimeBins]; //!< Cycle durations
+    UInt64 loadHistogram[AKKAAERenderProfilerLoadBins]; //!< Cycle loads
+    int sectionCount;               //!< Number of sections added
+    AKKAAERenderProfilerSectionStatistics sections[AKKAAERenderProfilerMaxSections]; //!< Per-section statistics
+} AKKAAERenderProfilerSnapshot;
+
+typedef struct AKKAAERenderProfiler AKKAAERenderProfiler;
+
+/*!
+ * Create a render profiler
+ *
+ *  Measures each render cycle between AKKAAERenderProfilerBeginCycle and AKKAAERenderProfilerEndCycle,
+ *  and works out its load: the time it took over its budget, frames / sampleRate. Cycle times and
+ *  loads go into fixed-size histograms, and cycles over budget are counted as overruns. Named
+ *  sections within the cycle, such as a mix, can be timed too.
+ *
+ *  渲染线程只做两次取时和几次计数器写入，不加锁不分配；任意线程都可以随时取快照。
+ *
+ *  Each counter has a single writer, the render thread, and is read with atomic loads, so taking a
+ *  snapshot never blocks the render thread. Counters are read one by one, so a snapshot taken
+ *  during a cycle can be one cycle out between fields. The cost per cycle is two clock reads and a
+ *  few dozen stores, far below 1% of any realistic cycle budget, so the profiler can be left on.
+ *
+ *  Use this function on the main thread.
+ *
+ * @return The new profiler
+ */
+AKKAAERenderProfiler * _Nonnull AKKAAERenderProfilerNew(void);
+
+/*!
+ * Free a profiler
+ *
+ *  Use this function on the main thread, once the render thread is done with the profiler.
+ *
+ * @param profiler The profiler
+ */
+void AKKAAERenderProfilerFree(AKKAAERenderProfiler * _Nonnull profiler);
+
+/*!
+ * Add a named section
+ *
+ *  Use this function on the main thread, before the section is timed.
+ *
+ * @param profiler The profiler
+ * @param name Section name, truncated to AKKAAERenderProfilerMaxSectionName - 1 characters
+ * @return The section index, for AKKAAERenderProfilerEndSection, or -1 if the profiler already has
+ *  AKKAAERenderProfilerMaxSections sections
+ */
+int AKKAAERenderProfilerAddSection(AKKAAERenderProfiler * _Nonnull profiler, const char * _Nonnull name);
+
+/*!
+ * Begin a render cycle
+ *
+ *  Call this at the start of the render loop. This function is realtime safe. Use it, and the
+ *  other render functions, from one thread only: the render thread.
+ *
+ * @param profiler The profiler
+ * @param context The render context, for the cycle's frame count and sample rate
+ */
+void AKKAAERenderProfilerBeginCycle(AKKAAERenderProfiler * _Nonnull profiler, const AKKAAERenderContext * _Nonnull context);
+
+/*!
+ * End a render cycle
+ *
+ *  Call this at the end of the render loop. This function is realtime safe.
+ *
+ * @param profiler The profiler
+ */
+void AKKAAERenderProfilerEndCycle(AKKAAERenderProfiler * _Nonnull profiler);
+
+/*!
+ * Begin timing a section
+ *
+ *  This function is realtime safe.
+ *
+ * @param profiler The profiler
+ * @return The start time, to pass to AKKAAERenderProfilerEndSection
+ */
+static inline AKKAAEHostTicks AKKAAERenderProfilerBeginSection(AKKAAERenderProfiler * _Nonnull profiler) {
+    return AKKAAECurrentTimeInHostTicks();
+}
+
+/*!
+ * End timing a section
+ *
+ *  A section can be timed several times per cycle, such as once per mix; its time per cycle is
+ *  the sum. This function is realtime safe.
+ *
+ * @param profiler The profiler
+ * @param section The section index returned by AKKAAERenderProfilerAddSection
+ * @param start The time returned by AKKAAERenderProfilerBeginSection
+ */
+void AKKAAERenderProfilerEndSection(AKKAAERenderProfiler * _Nonnull profiler, int section, AKKAAEHostTicks start);
+
+/*!
+ * Time a statement as a section
+ *
+ *  For example: AKKAAERenderProfilerTimeSection(profiler, mixSection, AKKAAEBufferStackMix(context->stack, 2));
+ */
+#define AKKAAERenderProfilerTimeSection(profiler, section, statement) \
+    do { \
+        AKKAAEHostTicks _akkaaeSectionStart = AKKAAERenderProfilerBeginSection(profiler); \
+        statement; \
+        AKKAAERenderProfilerEndSection((profiler), (section), _akkaaeSectionStart); \
+    } while (0)
+
+/*!
+ * Take a snapshot
+ *
+ *  Use this function on any thread but the render thread.
+ *
+ * @param profiler The profiler
+ * @param outSnapshot On output, the statistics since creation or the last reset
+ */
+void AKKAAERenderProfilerGetSnapshot(const AKKAAERenderProfiler * _Nonnull profiler,
+                                     AKKAAERenderProfilerSnapshot * _Nonnull outSnapshot);
+
+/*!
+ * Reset statistics
+ *
+ *  The render thread clears the statistics at the start of its next cycle, so that it stays the
+ *  only writer; until then, snapshots show the old values.
+ *
+ * @param profiler The profiler
+ */
+void AKKAAERenderProfilerReset(AKKAAERenderProfiler * _Nonnull profiler);
+
+/*!
+ * Export a snapshot
+ *
+ *  Times are in seconds; histograms are arrays with the bin counts, trailing empty bins removed.
+ *  The dictionary can be written out with NSJSONSerialization.
+ *
+ * @param snapshot The snapshot
+ * @return A dictionary of the snapshot's values
+ */
+NSDictionary * _Nonnull AKKAAERenderProfilerSnapshotDictionary(const AKKAAERenderProfilerSnapshot * _Nonnull snapshot);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,236 @@
+//
+//  AKKAAERenderProfiler.m
+//  AKKAAudioEngineSample
+//
+//  Created by 张一鸣 on 2016/12/27.
+//  Copyright © 2016年 AKKA. All rights reserved.
+//
+
+#import "AKKAAERenderProfiler.h"
+#import <stdatomic.h>
+
+// 所有计数器都只有渲染线程一个写者，所以用 load + store 代替原子加法，读者用原子读，互不阻塞
+typedef struct {
+    _Atomic(UInt64) calls;
+    _Atomic(UInt64) cycles;
+    _Atomic(UInt64) totalTicks;
+    _Atomic(UInt64) longestTicks;
+    _Atomic(UInt64) timeHistogram[AKKAAERenderProfilerTimeBins];
+} AKKAAERenderProfilerSectionCounters;
+
+typedef struct {
+    _Atomic(UInt64) cycles;
+    _Atomic(UInt64) frames;
+    _Atomic(UInt64) overruns;
+    _Atomic(UInt64) totalTicks;
+    _Atomic(UInt64) budgetTicks;
+    _Atomic(UInt64) longestTicks;
+    _Atomic(UInt64) peakLoadPPM;
+    _Atomic(UInt64) timeHistogram[AKKAAERenderProfilerTimeBins];
+    _Atomic(UInt64) loadHistogram[AKKAAERenderProfilerLoadBins];
+    AKKAAERenderProfilerSectionCounters sections[AKKAAERenderProfilerMaxSections];
+} AKKAAERenderProfilerCounters;
+
+struct AKKAAERenderProfiler {
+    AKKAAERenderProfilerCounters counters;
+    char names[AKKAAERenderProfilerMaxSections][AKKAAERenderProfilerMaxSectionName];
+    _Atomic(int) sectionCount;
+    _Atomic(BOOL) resetRequested;
+    double nanosecondsPerTick;
+
+    // Render thread only
+    AKKAAEHostTicks cycleStart;
+    AKKAAEHostTicks cycleBudget;
+    UInt32 cycleFrames;
+    UInt32 budgetFrames;
+    double budgetSampleRate;
+    UInt32 touchedSections;
+    AKKAAEHostTicks sectionTicks[AKKAAERenderProfilerMaxSections];
+    UInt64 sectionCalls[AKKAAERenderProfilerMaxSections];
+};
+
+static inline void AKKAAERenderProfilerCounterAdd(_Atomic(UInt64) * counter, UInt64 value) {
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + value, memory_order_relaxed);
+}
+
+static inline void AKKAAERenderProfilerCounterMax(_Atomic(UInt64) * counter, UInt64 value) {
+    if ( value > atomic_load_explicit(counter, memory_order_relaxed) ) {
+        atomic_store_explicit(counter, value, memory_order_relaxed);
+    }
+}
+
+static inline UInt64 AKKAAERenderProfilerCounterGet(const _Atomic(UInt64) * counter) {
+    return atomic_load_explicit((_Atomic(UInt64) *)counter, memory_order_relaxed);
+}
+
+static inline int AKKAAERenderProfilerTimeBin(AKKAAERenderProfiler * profiler, AKKAAEHostTicks ticks) {
+    UInt64 nanoseconds = (UInt64)(ticks * profiler->nanosecondsPerTick);
+    if ( nanoseconds == 0 ) return 0;
+    int bin = 63 - __builtin_clzll(nanoseconds);
+    return bin < AKKAAERenderProfilerTimeBins ? bin : AKKAAERenderProfilerTimeBins - 1;
+}
+
+AKKAAERenderProfiler * AKKAAERenderProfilerNew(void) {
+    AKKAAERenderProfiler * profiler = (AKKAAERenderProfiler *)calloc(1, sizeof(AKKAAERenderProfiler));
+    // 十亿个 tick 的秒数，正好是每个 tick 的纳秒数
+    profiler->nanosecondsPerTick = AKKAAESecondsFromHostTicks(1000000000);
+    return profiler;
+}
+
+void AKKAAERenderProfilerFree(AKKAAERenderProfiler * profiler) {
+    free(profiler);
+}
+
+int AKKAAERenderProfilerAddSection(AKKAAERenderProfiler * profiler, const char * name) {
+    int section = atomic_load_explicit(&profiler->sectionCount, memory_order_relaxed);
+    if ( section >= AKKAAERenderProfilerMaxSections ) return -1;
+    strncpy(profiler->names[section], name, AKKAAERenderProfilerMaxSectionName - 1);
+    profiler->names[section][AKKAAERenderProfilerMaxSectionName - 1] = '\0';
+    atomic_store_explicit(&profiler->sectionCount, section + 1, memory_order_release);
+    return section;
+}
+
+void AKKAAERenderProfilerBeginCycle(AKKAAERenderProfiler * profiler, const AKKAAERenderContext * context) {
+    if ( atomic_load_explicit(&profiler->resetRequested, memory_order_relaxed)
+            && atomic_exchange(&profiler->resetRequested, NO) ) {
+        _Atomic(UInt64) * counters = (_Atomic(UInt64) *)&profiler->counters;
+        for ( size_t i = 0; i < sizeof(profiler->counters) / sizeof(*counters); i++ ) {
+            atomic_store_explicit(&counters[i], 0, memory_order_relaxed);
+        }
+    }
+
+    // The budget only needs working out again when the cycle length changes
+    if ( context->frames != profiler->budgetFrames || context->sampleRate != profiler->budgetSampleRate ) {
+        profiler->budgetFrames = context->frames;
+        profiler->budgetSampleRate = context->sampleRate;
+        profiler->cycleBudget = context->sampleRate > 0
+            ? AKKAAEHostTicksFromSeconds(context->frames / context->sampleRate) : 0;
+    }
+    profiler->cycleFrames = context->frames;
+    profiler->cycleStart = AKKAAECurrentTimeInHostTicks();
+}
+
+void AKKAAERenderProfilerEndCycle(AKKAAERenderProfiler * profiler) {
+    AKKAAEHostTicks elapsed = AKKAAECurrentTimeInHostTicks() - profiler->cycleStart;
+    AKKAAEHostTicks budget = profiler->cycleBudget;
+    AKKAAERenderProfilerCounters * counters = &profiler->counters;
+
+    AKKAAERenderProfilerCounterAdd(&counters->cycles, 1);
+    AKKAAERenderProfilerCounterAdd(&counters->frames, profiler->cycleFrames);
+    AKKAAERenderProfilerCounterAdd(&counters->totalTicks, elapsed);
+    AKKAAERenderProfilerCounterAdd(&counters->budgetTicks, budget);
+    AKKAAERenderProfilerCounterMax(&counters->longestTicks, elapsed);
+    AKKAAERenderProfilerCounterAdd(&counters->timeHistogram[AKKAAERenderProfilerTimeBin(profiler, elapsed)], 1);
+
+    if ( budget > 0 ) {
+        if ( elapsed > budget ) AKKAAERenderProfilerCounterAdd(&counters->overruns, 1);
+        AKKAAERenderProfilerCounterMax(&counters->peakLoadPPM, elapsed * 1000000 / budget);
+        UInt64 loadBin = elapsed * 10 / budget;
+        AKKAAERenderProfilerCounterAdd(&counters->loadHistogram[MIN(loadBin, (UInt64)AKKAAERenderProfilerLoadBins - 1)], 1);
+    }
+
+    // Fold this cycle's section times in, visiting only the sections that were timed
+    while ( profiler->touchedSections ) {
+        int section = __builtin_ctz(profiler->touchedSections);
+        profiler->touchedSections &= profiler->touchedSections - 1;
+        AKKAAERenderProfilerSectionCounters * sectionCounters = &counters->sections[section];
+        AKKAAEHostTicks ticks = profiler->sectionTicks[section];
+        AKKAAERenderProfilerCounterAdd(&sectionCounters->calls, profiler->sectionCalls[section]);
+        AKKAAERenderProfilerCounterAdd(&sectionCounters->cycles, 1);
+        AKKAAERenderProfilerCounterAdd(&sectionCounters->totalTicks, ticks);
+        AKKAAERenderProfilerCounterMax(&sectionCounters->longestTicks, ticks);
+        AKKAAERenderProfilerCounterAdd(&sectionCounters->timeHistogram[AKKAAERenderProfilerTimeBin(profiler, ticks)], 1);
+        profiler->sectionTicks[section] = 0;
+        profiler->sectionCalls[section] = 0;
+    }
+}
+
+void AKKAAERenderProfilerEndSection(AKKAAERenderProfiler * profiler, int section, AKKAAEHostTicks start) {
+    AKKAAEHostTicks end = AKKAAECurrentTimeInHostTicks();
+    if ( section < 0 || section >= AKKAAERenderProfilerMaxSections ) return;
+    profiler->sectionTicks[section] += end - start;
+    profiler->sectionCalls[section]++;
+    profiler->touchedSections |= 1u << section;
+}
+
+void AKKAAERenderProfilerGetSnapshot(const AKKAAERenderProfiler * profiler, AKKAAERenderProfilerSnapshot * outSnapshot) {
+    const AKKAAERenderProfilerCounters * counters = &profiler->counters;
+    memset(outSnapshot, 0, sizeof(AKKAAERenderProfilerSnapshot));
+
+    outSnapshot->cycles = AKKAAERenderProfilerCounterGet(&counters->cycles);
+    outSnapshot->frames = AKKAAERenderProfilerCounterGet(&counters->frames);
+    outSnapshot->overruns = AKKAAERenderProfilerCounterGet(&counters->overruns);
+    UInt64 totalTicks = AKKAAERenderProfilerCounterGet(&counters->totalTicks);
+    UInt64 budgetTicks = AKKAAERenderProfilerCounterGet(&counters->budgetTicks);
+    outSnapshot->totalTime = AKKAAESecondsFromHostTicks(totalTicks);
+    outSnapshot->totalBudget = AKKAAESecondsFromHostTicks(budgetTicks);
+    outSnapshot->longestCycle = AKKAAESecondsFromHostTicks(AKKAAERenderProfilerCounterGet(&counters->longestTicks));
+    outSnapshot->averageLoad = budgetTicks > 0 ? (double)totalTicks / budgetTicks : 0;
+    outSnapshot->peakLoad = AKKAAERenderProfilerCounterGet(&counters->peakLoadPPM) / 1000000.0;
+    for ( int i = 0; i < AKKAAERenderProfilerTimeBins; i++ ) {
+        outSnapshot->timeHistogram[i] = AKKAAERenderProfilerCounterGet(&counters->timeHistogram[i]);
+    }
+    for ( int i = 0; i < AKKAAERenderProfilerLoadBins; i++ ) {
+        outSnapshot->loadHistogram[i] = AKKAAERenderProfilerCounterGet(&counters->loadHistogram[i]);
+    }
+
+    outSnapshot->sectionCount = atomic_load_explicit((_Atomic(int) *)&profiler->sectionCount, memory_order_acquire);
+    for ( int section = 0; section < outSnapshot->sectionCount; section++ ) {
+        const AKKAAERenderProfilerSectionCounters * sectionCounters = &counters->sections[section];
+        AKKAAERenderProfilerSectionStatistics * statistics = &outSnapshot->sections[section];
+        memcpy(statistics->name, profiler->names[section], AKKAAERenderProfilerMaxSectionName);
+        statistics->calls = AKKAAERenderProfilerCounterGet(&sectionCounters->calls);
+        statistics->cycles = AKKAAERenderProfilerCounterGet(&sectionCounters->cycles);
+        statistics->totalTime = AKKAAESecondsFromHostTicks(AKKAAERenderProfilerCounterGet(&sectionCounters->totalTicks));
+        statistics->longestCycle = AKKAAESecondsFromHostTicks(AKKAAERenderProfilerCounterGet(&sectionCounters->longestTicks));
+        for ( int i = 0; i < AKKAAERenderProfilerTimeBins; i++ ) {
+            statistics->timeHistogram[i] = AKKAAERenderProfilerCounterGet(&sectionCounters->timeHistogram[i]);
+        }
+    }
+}
+
+void AKKAAERenderProfilerReset(AKKAAERenderProfiler * profiler) {
+    atomic_store(&profiler->resetRequested, YES);
+}
+
+/*!
+ * Histogram bins as an array, without the trailing empty bins
+ */
+static NSArray * AKKAAERenderProfilerHistogramArray(const UInt64 * bins, int count) {
+    while ( count > 0 && bins[count - 1] == 0 ) count--;
+    NSMutableArray * array = [NSMutableArray arrayWithCapacity:count];
+    for ( int i = 0; i < count; i++ ) {
+        [array addObject:@(bins[i])];
+    }
+    return array;
+}
+
+NSDictionary * AKKAAERenderProfilerSnapshotDictionary(const AKKAAERenderProfilerSnapshot * snapshot) {
+    NSMutableArray * sections = [NSMutableArray arrayWithCapacity:snapshot->sectionCount];
+    for ( int section = 0; section < snapshot->sectionCount; section++ ) {
+        const AKKAAERenderProfilerSectionStatistics * statistics = &snapshot->sections[section];
+        [sections addObject:@{
+            @"name": @(statistics->name),
+            @"calls": @(statistics->calls),
+            @"cycles": @(statistics->cycles),
+            @"totalTime": @(statistics->totalTime),
+            @"longestCycle": @(statistics->longestCycle),
+            @"load": @(snapshot->totalBudget > 0 ? statistics->totalTime / snapshot->totalBudget : 0),
+            @"timeHistogram": AKKAAERenderProfilerHistogramArray(statistics->timeHistogram, AKKAAERenderProfilerTimeBins),
+        }];
+    }
+
+    return @{
+        @"cycles": @(snapshot->cycles),
+        @"frames": @(snapshot->frames),
+        @"overruns": @(snapshot->overruns),
+        @"totalTime": @(snapshot->totalTime),
+        @"totalBudget": @(snapshot->totalBudget),
+        @"longestCycle": @(snapshot->longestCycle),
+        @"averageLoad": @(snapshot->averageLoad),
+        @"peakLoad": @(snapshot->peakLoad),
+        @"timeHistogram": AKKAAERenderProfilerHistogramArray(snapshot->timeHistogram, AKKAAERenderProfilerTimeBins),
+        @"loadHistogram": AKKAAERenderProfilerHistogramArray(snapshot->loadHistogram, AKKAAERenderProfilerLoadBins),
+        @"sections": sections,
+    };
+}
@@ -0,0 +1,142 @@
+//
+//  AKKAAERenderScheduler.h
+//  AKKAAudioEngineSample
+//
+//  Created by 张一鸣 on 2016/12/27.
+//  Copyright © 2016年 AKKA. All rights reserved.
+//
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#import <Foundation/Foundation.h>
+#import <AudioToolbox/AudioToolbox.h>
+#import "AKKARenderContext.h"
+
+/*!
+ * Render task function
+ *
+ *  Renders one independent part of the graph (a track, a bus) on a worker thread. The context's
+ *  output is the task's own output buffer, silenced beforehand, and the context's stack is an empty
+ *  stack that belongs to the worker; use it exactly as you would in a top-level render loop, finishing
+ *  with AKKAAERenderContextOutput.
+ *
+ *  The task may run on any worker, concurrently with other tasks, so it must not touch state shared
+ *  with other tasks. The same realtime rules as the main render loop apply.
+ *
+ * @param userInfo The task's userInfo pointer
+ * @param context The render context for this task
+ */
+typedef void (*AKKAAERenderSchedulerTaskFunction)(void * _Nullable userInfo, const AKKAAERenderContext * _Nonnull context);
+
+/*!
+ * Render task
+ */
+typedef struct {
+    AKKAAERenderSchedulerTaskFunction _Nonnull render; //!< The render function
+    void * _Nullable userInfo;                         //!< Passed to the render function
+} AKKAAERenderSchedulerTask;
+
+typedef struct AKKAAERenderScheduler AKKAAERenderScheduler;
+
+/*!
+ * Create a render scheduler
+ *
+ *  The scheduler runs independent render tasks in parallel within one render cycle, on a fixed pool
+ *  of worker threads, then joins their results back into the render thread's stack.
+ *  在一个渲染周期内，把互相独立的渲染任务分到固定数量的工作线程上并行执行，最后合并回渲染线程的 stack。
+ *
+ *  Each worker has its own preallocated buffer stack, and each task slot its own preallocated output
+ *  buffer. Tasks are split evenly between workers at the start of the cycle, and workers that run out
+ *  steal from the others. Nothing is allocated and no locks are taken while rendering.
+ *
+ *  The render thread is one of the workers, so a scheduler with one worker creates no threads and
+ *  simply runs the tasks in order.
+ *
+ *  The render thread waits for the workers by spinning, so the workers take on its scheduling
+ *  policy (its time constraint on Apple platforms, its SCHED_FIFO or SCHED_RR priority elsewhere).
+ *  They read it again whenever the cycle length changes. If the render thread has no realtime
+ *  policy, as in offline rendering, the workers keep their default priority.
+ *
+ *  Use this function on the main thread.
+ *
+ * @param workerCount Number of workers, including the render thread
+ * @param maxTasks Maximum number of tasks per cycle
+ * @param numberOfChannels Number of channels in each task's output
+ * @param stackPoolSize Pool size for each worker's stack (0 for default)
+ * @param maxChannelsPerBuffer Maximum channels per buffer in each worker's stack
+ * @return The new scheduler
+ */
+AKKAAERenderScheduler * _Nonnull AKKAAERenderSchedulerNew(int workerCount, int maxTasks, int numberOfChannels,
+                                                          int stackPoolSize, int maxChannelsPerBuffer);
+
+/*!
+ * Stop the worker threads and free the scheduler
+ *
+ *  Use this function on the main thread, while the scheduler is not rendering.
+ *
+ * @param scheduler The scheduler
+ */
+void AKKAAERenderSchedulerFree(AKKAAERenderScheduler * _Nonnull scheduler);
+
+/*!
+ * Get the number of workers, including the render thread
+ *
+ * @param scheduler The scheduler
+ * @return Number of workers
+ */
+int AKKAAERenderSchedulerGetWorkerCount(const AKKAAERenderScheduler * _Nonnull scheduler);
+
+/*!
+ * Resize the workers' stacks and the task outputs for a new maximum frames per slice
+ *
+ *  A scheduler starts sized for AKKAAEBufferStackMaxFramesPerSlice; sizing it to the IO buffer
+ *  instead cuts its memory by the same ratio. Use this function on the main thread, while the
+ *  scheduler is not rendering.
+ *
+ * @param scheduler The scheduler
+ * @param maxFramesPerSlice The most frames per cycle, up to AKKAAEBufferStackMaxFramesPerSlice (or 0 for that default)
+ */
+void AKKAAERenderSchedulerSetMaxFramesPerSlice(AKKAAERenderScheduler * _Nonnull scheduler, UInt32 maxFramesPerSlice);
+
+/*!
+ * Get the maximum frames per slice
+ *
+ * @param scheduler The scheduler
+ * @return The most frames per cycle the scheduler can render
+ */
+UInt32 AKKAAERenderSchedulerGetMaxFramesPerSlice(const AKKAAERenderScheduler * _Nonnull scheduler);
+
+/*!
+ * Get the memory the scheduler has allocated
+ *
+ * @param scheduler The scheduler
+ * @return Bytes allocated for the scheduler, its workers' stacks and its task outputs
+ */
+size_t AKKAAERenderSchedulerGetMemoryUsage(const AKKAAERenderScheduler * _Nonnull scheduler);
+
+/*!
+ * Run tasks in parallel, and push their outputs onto the stack
+ *
+ *  Runs every task, using the context's frame count, sample rate and timestamp, and returns once
+ *  they have all finished. The tasks' outputs are then pushed onto the context's stack in task
+ *  order (the last task ends up on top), ready for a final mix with AKKAAEBufferStackMix. The
+ *  pushed buffers point to the scheduler's memory and are valid until the next call.
+ *
+ *  Use this function on the render thread.
+ *
+ * @param scheduler The scheduler
+ * @param context The render thread's context, with up to the scheduler's maximum frames per slice
+ * @param tasks The tasks
+ * @param count Number of tasks, up to the maxTasks given at creation
+ * @return Number of buffers pushed onto the context's stack
+ */
+int AKKAAERenderSchedulerRun(AKKAAERenderScheduler * _Nonnull scheduler,
+                             const AKKAAERenderContext * _Nonnull context,
+                             const AKKAAERenderSchedulerTask * _Nonnull tasks,
+                             int count);
+
+#ifdef __cplusplus
+}
+#endif
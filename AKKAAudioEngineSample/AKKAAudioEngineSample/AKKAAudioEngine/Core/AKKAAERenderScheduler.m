@@ -0,0 +1,375 @@
+//
+//  AKKAAERenderScheduler.m
+//  AKKAAudioEngineSample
+//
+//  Created by 张一鸣 on 2016/12/27.
+//  Copyright © 2016年 AKKA. All rights reserved.
+//
+
+#import "AKKAAERenderScheduler.h"
+#import "AKKAAEBufferStack.h"
+#import "AKKAAEAudioBufferListUtilities.h"
+#import "AKKAAETypes.h"
+#import <pthread.h>
+#import <stdatomic.h>
+#ifdef __APPLE__
+#import <mach/mach.h>
+#else
+#import <semaphore.h>
+#import <sched.h>
+#endif
+
+#define kCacheLineSize 64
+
+#if defined(__x86_64__) || defined(__i386__)
+#define AKKAAERenderSchedulerPause() __builtin_ia32_pause()
+#elif defined(__arm__) || defined(__arm64__) || defined(__aarch64__)
+#define AKKAAERenderSchedulerPause() __asm__ __volatile__("yield")
+#else
+#define AKKAAERenderSchedulerPause()
+#endif
+
+// Wakes a worker; signalling is realtime-safe (no locks, no allocation)
+#ifdef __APPLE__
+typedef semaphore_t AKKAAERenderSchedulerSemaphore;
+#define AKKAAERenderSchedulerSemaphoreInit(s) semaphore_create(mach_task_self(), (s), SYNC_POLICY_FIFO, 0)
+#define AKKAAERenderSchedulerSemaphoreSignal(s) semaphore_signal(*(s))
+#define AKKAAERenderSchedulerSemaphoreWait(s) semaphore_wait(*(s))
+#define AKKAAERenderSchedulerSemaphoreDestroy(s) semaphore_destroy(mach_task_self(), *(s))
+#else
+typedef sem_t AKKAAERenderSchedulerSemaphore;
+#define AKKAAERenderSchedulerSemaphoreInit(s) sem_init((s), 0, 0)
+#define AKKAAERenderSchedulerSemaphoreSignal(s) sem_post(s)
+#define AKKAAERenderSchedulerSemaphoreWait(s) while ( sem_wait(s) != 0 )
+#define AKKAAERenderSchedulerSemaphoreDestroy(s) sem_destroy(s)
+#endif
+
+// The render thread's scheduling policy, which the workers copy: the render thread spins waiting on them,
+// so they mustn't be preempted by anything it outranks
+#ifdef __APPLE__
+typedef thread_time_constraint_policy_data_t AKKAAERenderSchedulerPolicy;
+#else
+typedef struct {
+    int policy;
+    struct sched_param parameters;
+} AKKAAERenderSchedulerPolicy;
+#endif
+
+// 每个 worker 的任务区间，高 32 位是 next，低 32 位是 end；自己从前面取，别人从后面偷，都用 CAS
+typedef struct {
+    _Alignas(kCacheLineSize) _Atomic(uint64_t) range;
+    AKKAAEBufferStack * stack;
+    AKKAAERenderSchedulerSemaphore wake;
+    pthread_t thread;
+    struct AKKAAERenderScheduler * scheduler;
+    int index;
+    int policyGeneration;   // The generation of the policy this worker last took on
+} AKKAAERenderSchedulerWorker;
+
+struct AKKAAERenderScheduler {
+    int workerCount;
+    int maxTasks;
+    int numberOfChannels;
+    UInt32 maxFramesPerSlice;
+    AKKAAERenderSchedulerWorker * workers;
+    AudioBufferList ** outputs;
+
+    // Per-cycle state, written by the render thread before any task range is published
+    AKKAAERenderContext context;
+    const AKKAAERenderSchedulerTask * tasks;
+
+    // Render thread policy: written by the render thread when the cycle length changes, under a sequence
+    // count that is odd while it's being written
+    AKKAAERenderSchedulerPolicy policy;
+    BOOL hasPolicy;
+    UInt32 policyFrames;
+    double policySampleRate;
+    _Atomic(int) policyGeneration;
+
+    _Alignas(kCacheLineSize) _Atomic(int) remaining;
+    _Atomic(BOOL) stop;
+};
+
+static void * AKKAAERenderSchedulerWorkerThread(void * userInfo);
+static void AKKAAERenderSchedulerWork(AKKAAERenderScheduler * scheduler, AKKAAERenderSchedulerWorker * worker);
+static void AKKAAERenderSchedulerCreateOutputs(AKKAAERenderScheduler * scheduler);
+static void AKKAAERenderSchedulerCapturePolicy(AKKAAERenderScheduler * scheduler);
+static void AKKAAERenderSchedulerAdoptPolicy(AKKAAERenderScheduler * scheduler, AKKAAERenderSchedulerWorker * worker);
+
+static inline uint64_t AKKAAERenderSchedulerRangeMake(uint32_t next, uint32_t end) {
+    return ((uint64_t)next << 32) | end;
+}
+
+AKKAAERenderScheduler * AKKAAERenderSchedulerNew(int workerCount, int maxTasks, int numberOfChannels,
+                                                 int stackPoolSize, int maxChannelsPerBuffer) {
+    assert(workerCount > 0 && maxTasks > 0 && numberOfChannels > 0);
+
+    AKKAAERenderScheduler * scheduler = (AKKAAERenderScheduler *)calloc(1, sizeof(AKKAAERenderScheduler));
+    scheduler->workerCount = workerCount;
+    scheduler->maxTasks = maxTasks;
+    scheduler->numberOfChannels = numberOfChannels;
+    atomic_init(&scheduler->remaining, 0);
+    atomic_init(&scheduler->stop, NO);
+    atomic_init(&scheduler->policyGeneration, 0);
+
+    // Task outputs are allocated up front, at the full slice size
+    scheduler->maxFramesPerSlice = AKKAAEBufferStackMaxFramesPerSlice;
+    scheduler->outputs = (AudioBufferList **)calloc(maxTasks, sizeof(AudioBufferList *));
+    AKKAAERenderSchedulerCreateOutputs(scheduler);
+
+    // Workers sit on their own cache lines so the range CAS traffic doesn't false-share
+    void * workers = NULL;
+    posix_memalign(&workers, kCacheLineSize, sizeof(AKKAAERenderSchedulerWorker) * workerCount);
+    memset(workers, 0, sizeof(AKKAAERenderSchedulerWorker) * workerCount);
+    scheduler->workers = (AKKAAERenderSchedulerWorker *)workers;
+
+    for ( int i=0; i<workerCount; i++ ) {
+        AKKAAERenderSchedulerWorker * worker = &scheduler->workers[i];
+        atomic_init(&worker->range, 0);
+        worker->stack = AKKAAEBufferStackNewWithOptions(stackPoolSize, maxChannelsPerBuffer, 0);
+        worker->scheduler = scheduler;
+        worker->index = i;
+
+        // Worker 0 is the render thread itself
+        if ( i > 0 ) {
+            AKKAAERenderSchedulerSemaphoreInit(&worker->wake);
+            pthread_create(&worker->thread, NULL, AKKAAERenderSchedulerWorkerThread, worker);
+        }
+    }
+
+    return scheduler;
+}
+
+void AKKAAERenderSchedulerFree(AKKAAERenderScheduler * scheduler) {
+    atomic_store(&scheduler->stop, YES);
+    for ( int i=1; i<scheduler->workerCount; i++ ) {
+        AKKAAERenderSchedulerSemaphoreSignal(&scheduler->workers[i].wake);
+    }
+    for ( int i=0; i<scheduler->workerCount; i++ ) {
+        AKKAAERenderSchedulerWorker * worker = &scheduler->workers[i];
+        if ( i > 0 ) {
+            pthread_join(worker->thread, NULL);
+            AKKAAERenderSchedulerSemaphoreDestroy(&worker->wake);
+        }
+        AKKAAEBufferStackFree(worker->stack);
+    }
+    free(scheduler->workers);
+
+    for ( int i=0; i<scheduler->maxTasks; i++ ) {
+        AKKAAEAudioBufferListFree(scheduler->outputs[i]);
+    }
+    free(scheduler->outputs);
+    free(scheduler);
+}
+
+int AKKAAERenderSchedulerGetWorkerCount(const AKKAAERenderScheduler * scheduler) {
+    return scheduler->workerCount;
+}
+
+void AKKAAERenderSchedulerSetMaxFramesPerSlice(AKKAAERenderScheduler * scheduler, UInt32 maxFramesPerSlice) {
+    if ( !maxFramesPerSlice ) maxFramesPerSlice = AKKAAEBufferStackMaxFramesPerSlice;
+    assert(maxFramesPerSlice <= AKKAAEBufferStackMaxFramesPerSlice);
+    if ( maxFramesPerSlice == scheduler->maxFramesPerSlice ) return;
+    scheduler->maxFramesPerSlice = maxFramesPerSlice;
+
+    // Worker stacks keep their last task's buffers until the next task starts, so clear them first
+    for ( int i=0; i<scheduler->workerCount; i++ ) {
+        AKKAAEBufferStackReset(scheduler->workers[i].stack);
+        AKKAAEBufferStackSetMaxFramesPerSlice(scheduler->workers[i].stack, maxFramesPerSlice);
+    }
+    for ( int i=0; i<scheduler->maxTasks; i++ ) {
+        AKKAAEAudioBufferListFree(scheduler->outputs[i]);
+    }
+    AKKAAERenderSchedulerCreateOutputs(scheduler);
+}
+
+UInt32 AKKAAERenderSchedulerGetMaxFramesPerSlice(const AKKAAERenderScheduler * scheduler) {
+    return scheduler->maxFramesPerSlice;
+}
+
+size_t AKKAAERenderSchedulerGetMemoryUsage(const AKKAAERenderScheduler * scheduler) {
+    size_t bytes = sizeof(AKKAAERenderScheduler)
+        + sizeof(AKKAAERenderSchedulerWorker) * scheduler->workerCount
+        + sizeof(AudioBufferList *) * scheduler->maxTasks;
+    for ( int i=0; i<scheduler->workerCount; i++ ) {
+        bytes += AKKAAEBufferStackGetMemoryUsage(scheduler->workers[i].stack);
+    }
+    for ( int i=0; i<scheduler->maxTasks; i++ ) {
+        bytes += AEAudioBufferListGetStructSize(scheduler->outputs[i])
+            + (size_t)scheduler->numberOfChannels * scheduler->maxFramesPerSlice * sizeof(float);
+    }
+    return bytes;
+}
+
+int AKKAAERenderSchedulerRun(AKKAAERenderScheduler * scheduler,
+                             const AKKAAERenderContext * context,
+                             const AKKAAERenderSchedulerTask * tasks,
+                             int count) {
+
+    count = MIN(count, scheduler->maxTasks);
+    if ( count <= 0 ) return 0;
+    assert(context->frames <= scheduler->maxFramesPerSlice);
+
+    if ( context->frames != scheduler->policyFrames || context->sampleRate != scheduler->policySampleRate ) {
+        // New IO buffer or rate, and perhaps a new render thread: hand its policy on to the workers
+        scheduler->policyFrames = context->frames;
+        scheduler->policySampleRate = context->sampleRate;
+        AKKAAERenderSchedulerCapturePolicy(scheduler);
+    }
+
+    scheduler->context = *context;
+    scheduler->tasks = tasks;
+    for ( int i=0; i<count; i++ ) {
+        AKKAAEAudioBufferListSetLength(scheduler->outputs[i], context->frames);
+    }
+    atomic_store_explicit(&scheduler->remaining, count, memory_order_relaxed);
+
+    // Split the tasks evenly; publishing the ranges (release) makes the state above visible to workers
+    int workerCount = MIN(scheduler->workerCount, count);
+    for ( int i=0; i<scheduler->workerCount; i++ ) {
+        uint32_t start = i < workerCount ? (uint32_t)(((int64_t)count * i) / workerCount) : 0;
+        uint32_t end = i < workerCount ? (uint32_t)(((int64_t)count * (i+1)) / workerCount) : 0;
+        atomic_store_explicit(&scheduler->workers[i].range, AKKAAERenderSchedulerRangeMake(start, end), memory_order_release);
+    }
+    for ( int i=1; i<workerCount; i++ ) {
+        AKKAAERenderSchedulerSemaphoreSignal(&scheduler->workers[i].wake);
+    }
+
+    // The render thread works too, then waits for any stragglers
+    AKKAAERenderSchedulerWork(scheduler, &scheduler->workers[0]);
+    while ( atomic_load_explicit(&scheduler->remaining, memory_order_acquire) > 0 ) {
+        AKKAAERenderSchedulerPause();
+    }
+
+    // Join: push each task's output onto the render thread's stack, in task order
+    int pushed = 0;
+    for ( int i=0; i<count; i++ ) {
+        if ( !AKKAAEBufferStackPushExternal(context->stack, scheduler->outputs[i]) ) break;
+        pushed++;
+    }
+    return pushed;
+}
+
+#pragma mark - Helpers
+
+static void * AKKAAERenderSchedulerWorkerThread(void * userInfo) {
+    AKKAAERenderSchedulerWorker * worker = (AKKAAERenderSchedulerWorker *)userInfo;
+    AKKAAERenderScheduler * scheduler = worker->scheduler;
+
+#ifdef __APPLE__
+    pthread_setname_np("com.akka.audioengine.render-worker");
+    pthread_set_qos_class_self_np(QOS_CLASS_USER_INTERACTIVE, 0);
+#endif
+
+    while ( 1 ) {
+        AKKAAERenderSchedulerSemaphoreWait(&worker->wake);
+        if ( atomic_load_explicit(&scheduler->stop, memory_order_acquire) ) break;
+        if ( atomic_load_explicit(&scheduler->policyGeneration, memory_order_acquire) != worker->policyGeneration ) {
+            AKKAAERenderSchedulerAdoptPolicy(scheduler, worker);
+        }
+        AKKAAERenderSchedulerWork(scheduler, worker);
+    }
+    return NULL;
+}
+
+// Take the next task from the front of a worker's range, or -1 if it's empty
+static inline int AKKAAERenderSchedulerTakeFront(AKKAAERenderSchedulerWorker * worker) {
+    uint64_t range = atomic_load_explicit(&worker->range, memory_order_acquire);
+    while ( 1 ) {
+        uint32_t next = (uint32_t)(range >> 32), end = (uint32_t)range;
+        if ( next >= end ) return -1;
+        if ( atomic_compare_exchange_weak_explicit(&worker->range, &range, AKKAAERenderSchedulerRangeMake(next + 1, end),
+                                                   memory_order_acq_rel, memory_order_acquire) ) {
+            return next;
+        }
+    }
+}
+
+// Steal a task from the back of a worker's range, or -1 if it's empty
+static inline int AKKAAERenderSchedulerStealBack(AKKAAERenderSchedulerWorker * worker) {
+    uint64_t range = atomic_load_explicit(&worker->range, memory_order_acquire);
+    while ( 1 ) {
+        uint32_t next = (uint32_t)(range >> 32), end = (uint32_t)range;
+        if ( next >= end ) return -1;
+        if ( atomic_compare_exchange_weak_explicit(&worker->range, &range, AKKAAERenderSchedulerRangeMake(next, end - 1),
+                                                   memory_order_acq_rel, memory_order_acquire) ) {
+            return end - 1;
+        }
+    }
+}
+
+static void AKKAAERenderSchedulerWork(AKKAAERenderScheduler * scheduler, AKKAAERenderSchedulerWorker * worker) {
+    while ( 1 ) {
+        // Own work first, then steal from the others, starting with the next worker along
+        int task = AKKAAERenderSchedulerTakeFront(worker);
+        for ( int i=1; task == -1 && i<scheduler->workerCount; i++ ) {
+            task = AKKAAERenderSchedulerStealBack(&scheduler->workers[(worker->index + i) % scheduler->workerCount]);
+        }
+        if ( task == -1 ) return;
+
+        // The per-cycle state is stable while any task is outstanding, so read it after claiming
+        AKKAAERenderContext context = scheduler->context;
+        const AudioBufferList * output = scheduler->outputs[task];
+        context.output = output;
+        context.stack = worker->stack;
+
+        AKKAAEBufferStackReset(worker->stack);
+        AKKAAEBufferStackSetFrameCount(worker->stack, context.frames);
+        AKKAAEBufferStackSetTimeStamp(worker->stack, context.timestamp);
+        AKKAAEAudioBufferListSilence(output, 0, context.frames);
+
+        const AKKAAERenderSchedulerTask * entry = &scheduler->tasks[task];
+        entry->render(entry->userInfo, &context);
+
+        atomic_fetch_sub_explicit(&scheduler->remaining, 1, memory_order_release);
+    }
+}
+
+// Render thread: read its own policy. Only when the cycle length changes, so the system call is rare.
+static void AKKAAERenderSchedulerCapturePolicy(AKKAAERenderScheduler * scheduler) {
+    AKKAAERenderSchedulerPolicy policy;
+    BOOL hasPolicy;
+#ifdef __APPLE__
+    mach_msg_type_number_t count = THREAD_TIME_CONSTRAINT_POLICY_COUNT;
+    boolean_t isDefault = FALSE;
+    kern_return_t result = thread_policy_get(pthread_mach_thread_np(pthread_self()), THREAD_TIME_CONSTRAINT_POLICY,
+                                             (thread_policy_t)&policy, &count, &isDefault);
+    // A thread without a time constraint (such as the offline renderer's) gets the default back
+    hasPolicy = result == KERN_SUCCESS && !isDefault;
+#else
+    hasPolicy = pthread_getschedparam(pthread_self(), &policy.policy, &policy.parameters) == 0
+        && policy.policy != SCHED_OTHER;
+#endif
+    int generation = atomic_load_explicit(&scheduler->policyGeneration, memory_order_relaxed);
+    atomic_store_explicit(&scheduler->policyGeneration, generation + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    scheduler->policy = policy;
+    scheduler->hasPolicy = hasPolicy;
+    atomic_store_explicit(&scheduler->policyGeneration, generation + 2, memory_order_release);
+}
+
+// Worker thread: take on the render thread's policy, if it has a realtime one
+static void AKKAAERenderSchedulerAdoptPolicy(AKKAAERenderScheduler * scheduler, AKKAAERenderSchedulerWorker * worker) {
+    int generation = atomic_load_explicit(&scheduler->policyGeneration, memory_order_acquire);
+    if ( generation & 1 ) return; // Being written; try again next wake
+    AKKAAERenderSchedulerPolicy policy = scheduler->policy;
+    BOOL hasPolicy = scheduler->hasPolicy;
+    atomic_thread_fence(memory_order_acquire);
+    if ( atomic_load_explicit(&scheduler->policyGeneration, memory_order_relaxed) != generation ) return;
+    worker->policyGeneration = generation;
+    if ( !hasPolicy ) return;
+#ifdef __APPLE__
+    thread_policy_set(pthread_mach_thread_np(pthread_self()), THREAD_TIME_CONSTRAINT_POLICY, (thread_policy_t)&policy,
+                      THREAD_TIME_CONSTRAINT_POLICY_COUNT);
+#else
+    // Needs the same rights the render thread had to get it, which this process evidently has
+    pthread_setschedparam(pthread_self(), policy.policy, &policy.parameters);
+#endif
+}
+
+static void AKKAAERenderSchedulerCreateOutputs(AKKAAERenderScheduler * scheduler) {
+    AudioStreamBasicDescription format = AKKAAEAudioDescriptionWithChannelsAndRate(scheduler->numberOfChannels, 0);
+    for ( int i=0; i<scheduler->maxTasks; i++ ) {
+        scheduler->outputs[i] = AKKAAEAudioBufferListCreateWithFormat(format, scheduler->maxFramesPerSlice);
+    }
+}
@@ -0,0 +1,169 @@
+//
+//  AKKAAEStreamingFilePlayer.h
+//  AKKAAudioEngineSample
+//
+//  Created by 张一鸣 on 2016/12/27.
+//  Copyright © 2016年 AKKA. All rights reserved.
+//
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#import <Foundation/Foundation.h>
+#import <AudioToolbox/AudioToolbox.h>
+#import "AKKARenderContext.h"
+#import "AKKAAETime.h"
+
+typedef struct AKKAAEStreamingFilePlayer AKKAAEStreamingFilePlayer;
+
+/*!
+ * Streaming player statistics
+ */
+typedef struct {
+    UInt64 underruns;        //!< Render cycles that found less audio ready than they needed
+    UInt64 underrunFrames;   //!< Frames of silence output because of underruns
+    UInt32 minimumLookahead; //!< Lowest number of frames seen ready at the start of a render cycle
+    BOOL readFailed;         //!< The file ended early or couldn't be read, so playback stopped there (until the next seek)
+} AKKAAEStreamingFilePlayerStatistics;
+
+/*!
+ * Create a streaming file player
+ *
+ *  Plays a file of any length from disk without loading it into memory, and without the render
+ *  thread ever touching the file: a shared background I/O thread decodes ahead of each player into
+ *  a lock-free ring (AKKAAEAudioRing), and the render thread only copies out of the ring.
+ *
+ *  后台 I/O 线程提前把音频解码进无锁环形缓冲区，渲染线程只从环里拷贝，永远不碰磁盘。
+ *
+ *  One I/O thread serves every player. When several need audio it tops up the one with the least
+ *  ready first, a quarter of its lookahead at a time, so a large number of streams share the disk
+ *  fairly. Files are read with AKKAAEAudioFileOpen, so WAV, AIFF and AIFC files are supported.
+ *
+ *  The player starts stopped, at the start of the file. Use this function on the main thread.
+ *
+ * @param url URL of the file to play
+ * @param lookahead How much audio to keep decoded ahead of the play head, in seconds, or 0 for the
+ *  default (1.5 seconds). Longer lookahead rides out slower disks, at the cost of memory.
+ * @param error If not NULL, the error on output
+ * @return The new player, or NULL on error
+ */
+AKKAAEStreamingFilePlayer * _Nullable AKKAAEStreamingFilePlayerNew(NSURL * _Nonnull url,
+                                                                   AKKAAESeconds lookahead,
+                                                                   NSError * _Nullable * _Nullable error);
+
+/*!
+ * Free a player
+ *
+ *  Use this function on the main thread, once the render thread is done with the player.
+ *
+ * @param player The player
+ */
+void AKKAAEStreamingFilePlayerFree(AKKAAEStreamingFilePlayer * _Nonnull player);
+
+/*!
+ * Get the format of the audio the player renders
+ *
+ * @param player The player
+ * @return AKKAAEAudioDescription with the file's channel count and sample rate
+ */
+AudioStreamBasicDescription AKKAAEStreamingFilePlayerGetAudioDescription(const AKKAAEStreamingFilePlayer * _Nonnull player);
+
+/*!
+ * Get the length of the file
+ *
+ * @param player The player
+ * @return Length in frames
+ */
+UInt64 AKKAAEStreamingFilePlayerGetLength(const AKKAAEStreamingFilePlayer * _Nonnull player);
+
+/*!
+ * Start or stop playback
+ *
+ *  Stopping keeps the play head where it is; playing again carries on from there.
+ *
+ * @param player The player
+ * @param playing Whether to play
+ */
+void AKKAAEStreamingFilePlayerSetPlaying(AKKAAEStreamingFilePlayer * _Nonnull player, BOOL playing);
+
+/*!
+ * Get whether the player is playing
+ *
+ * @param player The player
+ * @return Whether playback is started
+ */
+BOOL AKKAAEStreamingFilePlayerGetPlaying(const AKKAAEStreamingFilePlayer * _Nonnull player);
+
+/*!
+ * Move the play head
+ *
+ *  The I/O thread refills the lookahead from the new position; until it has, the player renders
+ *  silence, so seek a little before audio is needed where possible.
+ *
+ * @param player The player
+ * @param frame The frame to play from
+ */
+void AKKAAEStreamingFilePlayerSeek(AKKAAEStreamingFilePlayer * _Nonnull player, UInt64 frame);
+
+/*!
+ * Set the loop region
+ *
+ *  Looping is seamless: the I/O thread reads the start of the loop into the ring right after the
+ *  end of it.
+ *
+ * @param player The player
+ * @param loop Whether to loop
+ * @param loopStart First frame of the loop
+ * @param loopEnd Frame after the last frame of the loop, or 0 for the end of the file
+ */
+void AKKAAEStreamingFilePlayerSetLoop(AKKAAEStreamingFilePlayer * _Nonnull player, BOOL loop, UInt64 loopStart, UInt64 loopEnd);
+
+/*!
+ * Get the play head position
+ *
+ * @param player The player
+ * @return The frame that will be rendered next
+ */
+UInt64 AKKAAEStreamingFilePlayerGetPlayhead(const AKKAAEStreamingFilePlayer * _Nonnull player);
+
+/*!
+ * Get whether playback has reached the end of the file
+ *
+ * @param player The player
+ * @return YES once all of a non-looping file has been rendered
+ */
+BOOL AKKAAEStreamingFilePlayerGetFinished(const AKKAAEStreamingFilePlayer * _Nonnull player);
+
+/*!
+ * Get accumulated statistics
+ *
+ * @param player The player
+ * @return Statistics since creation or the last reset
+ */
+AKKAAEStreamingFilePlayerStatistics AKKAAEStreamingFilePlayerGetStatistics(const AKKAAEStreamingFilePlayer * _Nonnull player);
+
+/*!
+ * Reset statistics
+ *
+ * @param player The player
+ */
+void AKKAAEStreamingFilePlayerResetStatistics(AKKAAEStreamingFilePlayer * _Nonnull player);
+
+/*!
+ * Render
+ *
+ *  Pushes one buffer with the file's channel count onto the context's stack, holding the next
+ *  context->frames frames, or silence when stopped, finished, seeking or short of audio.
+ *
+ *  This function is realtime safe: it only copies from the ring, and wakes the I/O thread when
+ *  the lookahead needs topping up.
+ *
+ * @param player The player
+ * @param context The render context
+ */
+void AKKAAEStreamingFilePlayerRender(AKKAAEStreamingFilePlayer * _Nonnull player, const AKKAAERenderContext * _Nonnull context);
+
+#ifdef __cplusplus
+}
+#endif
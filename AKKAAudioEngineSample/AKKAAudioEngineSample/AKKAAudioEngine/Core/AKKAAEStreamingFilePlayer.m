@@ -0,0 +1,493 @@
+//
+//  AKKAAEStreamingFilePlayer.m
+//  AKKAAudioEngineSample
+//
+//  Created by 张一鸣 on 2016/12/27.
+//  Copyright © 2016年 AKKA. All rights reserved.
+//
+
+#import "AKKAAEStreamingFilePlayer.h"
+#import "AKKAAEAudioFile.h"
+#import "AKKAAEAudioRing.h"
+#import "AKKAAEAudioBufferListUtilities.h"
+#import "AKKAAETypes.h"
+#import <pthread.h>
+#import <stdatomic.h>
+#import <errno.h>
+#ifdef __APPLE__
+#import <mach/mach.h>
+#else
+#import <semaphore.h>
+#endif
+
+static const AKKAAESeconds kDefaultLookahead = 1.5;
+static const size_t kFileBufferSize = 256 * 1024;
+
+// Seek requests and the marks that answer them pack a 16-bit generation above a 48-bit frame or count
+#define kGenerationShift 48
+#define kPositionMask ((1ULL << kGenerationShift) - 1)
+#define AKKAAEStreamingFilePlayerPack(generation, position) (((UInt64)(generation) << kGenerationShift) | ((position) & kPositionMask))
+#define AKKAAEStreamingFilePlayerGeneration(value) ((UInt32)((value) >> kGenerationShift))
+#define AKKAAEStreamingFilePlayerPosition(value) ((value) & kPositionMask)
+#define kNoEndMark UINT64_MAX
+#define kMaxJumps 32
+
+// Wakes the I/O thread; signalling is realtime-safe (no locks, no allocation)
+#ifdef __APPLE__
+typedef semaphore_t AKKAAEStreamingFilePlayerSemaphore;
+#define AKKAAEStreamingFilePlayerSemaphoreInit(s) semaphore_create(mach_task_self(), (s), SYNC_POLICY_FIFO, 0)
+#define AKKAAEStreamingFilePlayerSemaphoreSignal(s) semaphore_signal(*(s))
+#define AKKAAEStreamingFilePlayerSemaphoreWait(s) semaphore_wait(*(s))
+#else
+typedef sem_t AKKAAEStreamingFilePlayerSemaphore;
+#define AKKAAEStreamingFilePlayerSemaphoreInit(s) sem_init((s), 0, 0)
+#define AKKAAEStreamingFilePlayerSemaphoreSignal(s) sem_post(s)
+#define AKKAAEStreamingFilePlayerSemaphoreWait(s) while ( sem_wait(s) != 0 )
+#endif
+
+// A loop wrap, recorded by the I/O thread so the render thread can follow the play head around it
+typedef struct {
+    UInt32 generation;
+    UInt64 count;       // The ring's written count where the wrap happens
+    UInt64 position;    // The file position audio continues from
+} AKKAAEStreamingFilePlayerJump;
+
+struct AKKAAEStreamingFilePlayer {
+    AKKAAEAudioFile * file;
+    AKKAAEAudioRing * ring;
+    AudioStreamBasicDescription audioDescription;
+    UInt64 length;
+    UInt32 chunkFrames;             // The I/O thread refills this much at a time
+
+    // Main thread → both
+    _Atomic(BOOL) playing;
+    _Atomic(UInt64) seekRequest;    // Packed generation and frame
+    _Atomic(BOOL) loop;
+    _Atomic(UInt64) loopStart;
+    _Atomic(UInt64) loopEnd;
+    UInt32 seekGeneration;          // Main thread only
+
+    // I/O thread → render thread
+    _Atomic(UInt64) discardMark;    // Packed generation and the ring's written count when that seek took effect
+    _Atomic(UInt64) endMark;        // Packed generation and the ring's written count at the end of the file
+    _Atomic(BOOL) readFailed;       // The file ended early or couldn't be read; not retried until the next seek
+    AKKAAEStreamingFilePlayerJump jumps[kMaxJumps];
+    _Atomic(UInt32) jumpsWritten;
+    _Atomic(UInt32) jumpsRead;
+
+    // Render thread → others
+    _Atomic(UInt64) playhead;
+    _Atomic(BOOL) finished;
+    _Atomic(BOOL) serviceRequested;
+    _Atomic(UInt64) underruns;
+    _Atomic(UInt64) underrunFrames;
+    _Atomic(UInt32) minimumLookahead;
+    UInt32 renderGeneration;        // Render thread only
+    UInt64 playheadCount;           // Render thread only: the ring's read count the play head was last worked out at
+
+    // I/O thread only, guarded by __ioMutex
+    UInt32 ioGeneration;
+    UInt64 readPosition;
+    BOOL atEnd;
+    BOOL stalled;                   // Couldn't make progress this round
+
+    struct AKKAAEStreamingFilePlayer * next; // In the I/O list, guarded by __ioMutex
+};
+
+static pthread_mutex_t __ioMutex = PTHREAD_MUTEX_INITIALIZER;
+static AKKAAEStreamingFilePlayer * __ioList = NULL;
+static AKKAAEStreamingFilePlayerSemaphore __ioSemaphore;
+
+static void AKKAAEStreamingFilePlayerStartIOThread(void);
+
+static void AKKAAEStreamingFilePlayerSetError(NSError ** error, int code, NSString * description) {
+    if ( error ) {
+        *error = [NSError errorWithDomain:NSPOSIXErrorDomain code:code
+                                 userInfo:@{ NSLocalizedDescriptionKey: description }];
+    }
+}
+
+AKKAAEStreamingFilePlayer * AKKAAEStreamingFilePlayerNew(NSURL * url, AKKAAESeconds lookahead, NSError ** error) {
+    AudioStreamBasicDescription audioDescription;
+    UInt64 length;
+    AKKAAEAudioFile * file = AKKAAEAudioFileOpen(url, &audioDescription, &length, error);
+    if ( !file ) return NULL;
+
+    // Many players may be open at once; each only needs to read a chunk at a time
+    if ( !AKKAAEAudioFileSetBufferSize(file, kFileBufferSize) ) {
+        AKKAAEAudioFileClose(file, NULL);
+        AKKAAEStreamingFilePlayerSetError(error, ENOMEM, @"Couldn't allocate the file buffer");
+        return NULL;
+    }
+
+    UInt32 capacity = (UInt32)MAX(1024.0, round((lookahead > 0 ? lookahead : kDefaultLookahead) * audioDescription.mSampleRate));
+
+    AKKAAEStreamingFilePlayer * player = (AKKAAEStreamingFilePlayer *)calloc(1, sizeof(AKKAAEStreamingFilePlayer));
+    player->file = file;
+    player->ring = AKKAAEAudioRingNew(audioDescription.mChannelsPerFrame, capacity);
+    player->audioDescription = audioDescription;
+    player->length = length;
+    player->chunkFrames = capacity / 4;
+    atomic_init(&player->playing, NO);
+    atomic_init(&player->seekRequest, AKKAAEStreamingFilePlayerPack(0, 0));
+    atomic_init(&player->loop, NO);
+    atomic_init(&player->loopStart, 0);
+    atomic_init(&player->loopEnd, 0);
+    atomic_init(&player->discardMark, AKKAAEStreamingFilePlayerPack(0, 0));
+    atomic_init(&player->endMark, kNoEndMark);
+    atomic_init(&player->jumpsWritten, 0);
+    atomic_init(&player->jumpsRead, 0);
+    atomic_init(&player->playhead, 0);
+    atomic_init(&player->finished, NO);
+    atomic_init(&player->serviceRequested, NO);
+    atomic_init(&player->underruns, 0);
+    atomic_init(&player->underrunFrames, 0);
+    atomic_init(&player->minimumLookahead, UINT32_MAX);
+
+    // Not a valid generation, so the I/O thread starts by seeking to the initial request
+    player->ioGeneration = UINT32_MAX;
+
+    AKKAAEStreamingFilePlayerStartIOThread();
+    pthread_mutex_lock(&__ioMutex);
+    player->next = __ioList;
+    __ioList = player;
+    pthread_mutex_unlock(&__ioMutex);
+    AKKAAEStreamingFilePlayerSemaphoreSignal(&__ioSemaphore);
+
+    return player;
+}
+
+void AKKAAEStreamingFilePlayerFree(AKKAAEStreamingFilePlayer * player) {
+    // Once out of the list, the I/O thread can't be using it
+    pthread_mutex_lock(&__ioMutex);
+    for ( AKKAAEStreamingFilePlayer ** entry = &__ioList; *entry; entry = &(*entry)->next ) {
+        if ( *entry == player ) {
+            *entry = player->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&__ioMutex);
+
+    AKKAAEAudioFileClose(player->file, NULL);
+    AKKAAEAudioRingFree(player->ring);
+    free(player);
+}
+
+AudioStreamBasicDescription AKKAAEStreamingFilePlayerGetAudioDescription(const AKKAAEStreamingFilePlayer * player) {
+    return player->audioDescription;
+}
+
+UInt64 AKKAAEStreamingFilePlayerGetLength(const AKKAAEStreamingFilePlayer * player) {
+    return player->length;
+}
+
+void AKKAAEStreamingFilePlayerSetPlaying(AKKAAEStreamingFilePlayer * player, BOOL playing) {
+    atomic_store_explicit(&player->playing, playing, memory_order_release);
+    AKKAAEStreamingFilePlayerSemaphoreSignal(&__ioSemaphore);
+}
+
+BOOL AKKAAEStreamingFilePlayerGetPlaying(const AKKAAEStreamingFilePlayer * player) {
+    return atomic_load_explicit(&player->playing, memory_order_acquire);
+}
+
+void AKKAAEStreamingFilePlayerSeek(AKKAAEStreamingFilePlayer * player, UInt64 frame) {
+    player->seekGeneration = (player->seekGeneration + 1) & 0xFFFF;
+    atomic_store_explicit(&player->seekRequest,
+                          AKKAAEStreamingFilePlayerPack(player->seekGeneration, MIN(frame, player->length)),
+                          memory_order_release);
+    atomic_store_explicit(&player->playhead, MIN(frame, player->length), memory_order_relaxed);
+    AKKAAEStreamingFilePlayerSemaphoreSignal(&__ioSemaphore);
+}
+
+void AKKAAEStreamingFilePlayerSetLoop(AKKAAEStreamingFilePlayer * player, BOOL loop, UInt64 loopStart, UInt64 loopEnd) {
+    atomic_store_explicit(&player->loopStart, loopStart, memory_order_relaxed);
+    atomic_store_explicit(&player->loopEnd, loopEnd, memory_order_relaxed);
+    atomic_store_explicit(&player->loop, loop, memory_order_release);
+    AKKAAEStreamingFilePlayerSemaphoreSignal(&__ioSemaphore);
+}
+
+UInt64 AKKAAEStreamingFilePlayerGetPlayhead(const AKKAAEStreamingFilePlayer * player) {
+    return atomic_load_explicit(&player->playhead, memory_order_relaxed);
+}
+
+BOOL AKKAAEStreamingFilePlayerGetFinished(const AKKAAEStreamingFilePlayer * player) {
+    return atomic_load_explicit(&player->finished, memory_order_relaxed);
+}
+
+AKKAAEStreamingFilePlayerStatistics AKKAAEStreamingFilePlayerGetStatistics(const AKKAAEStreamingFilePlayer * player) {
+    UInt32 minimumLookahead = atomic_load_explicit(&player->minimumLookahead, memory_order_relaxed);
+    return (AKKAAEStreamingFilePlayerStatistics) {
+        .underruns = atomic_load_explicit(&player->underruns, memory_order_relaxed),
+        .underrunFrames = atomic_load_explicit(&player->underrunFrames, memory_order_relaxed),
+        .minimumLookahead = minimumLookahead == UINT32_MAX ? 0 : minimumLookahead,
+        .readFailed = atomic_load_explicit(&player->readFailed, memory_order_relaxed),
+    };
+}
+
+void AKKAAEStreamingFilePlayerResetStatistics(AKKAAEStreamingFilePlayer * player) {
+    atomic_store_explicit(&player->underruns, 0, memory_order_relaxed);
+    atomic_store_explicit(&player->underrunFrames, 0, memory_order_relaxed);
+    atomic_store_explicit(&player->minimumLookahead, UINT32_MAX, memory_order_relaxed);
+}
+
+// The loop region in effect, or NO if not looping
+static BOOL AKKAAEStreamingFilePlayerGetLoopRegion(const AKKAAEStreamingFilePlayer * player, UInt64 * outStart, UInt64 * outEnd) {
+    if ( !atomic_load_explicit(&player->loop, memory_order_acquire) ) return NO;
+    UInt64 start = atomic_load_explicit(&player->loopStart, memory_order_relaxed);
+    UInt64 end = atomic_load_explicit(&player->loopEnd, memory_order_relaxed);
+    if ( end == 0 || end > player->length ) end = player->length;
+    if ( start >= end ) return NO;
+    *outStart = start;
+    *outEnd = end;
+    return YES;
+}
+
+// Whether generation a comes before generation b, allowing for wrap-around
+static inline BOOL AKKAAEStreamingFilePlayerGenerationIsOlder(UInt32 a, UInt32 b) {
+    UInt32 distance = (b - a) & 0xFFFF;
+    return distance != 0 && distance < 0x8000;
+}
+
+// Move the play head, which was at the given position at player->playheadCount, on to the ring's read count,
+// following any loop wraps the I/O thread recorded along the way. Render thread only.
+static void AKKAAEStreamingFilePlayerAdvancePlayhead(AKKAAEStreamingFilePlayer * player, UInt64 playhead, UInt64 read) {
+    UInt32 jumpsRead = atomic_load_explicit(&player->jumpsRead, memory_order_relaxed);
+    UInt32 jumpsWritten = atomic_load_explicit(&player->jumpsWritten, memory_order_acquire);
+    while ( jumpsRead != jumpsWritten ) {
+        const AKKAAEStreamingFilePlayerJump * jump = &player->jumps[jumpsRead % kMaxJumps];
+        if ( AKKAAEStreamingFilePlayerGenerationIsOlder(jump->generation, player->renderGeneration) ) {
+            // From before a seek
+            jumpsRead++;
+            continue;
+        }
+        if ( jump->generation != player->renderGeneration || jump->count > read ) break;
+        playhead = jump->position;
+        player->playheadCount = jump->count;
+        jumpsRead++;
+    }
+    atomic_store_explicit(&player->jumpsRead, jumpsRead, memory_order_release);
+
+    playhead += read - player->playheadCount;
+    player->playheadCount = read;
+    atomic_store_explicit(&player->playhead, playhead, memory_order_relaxed);
+}
+
+void AKKAAEStreamingFilePlayerRender(AKKAAEStreamingFilePlayer * player, const AKKAAERenderContext * context) {
+    const AudioBufferList * abl = AKKAAEBufferStackPushWithChannels(context->stack, 1, player->audioDescription.mChannelsPerFrame);
+    if ( !abl ) return;
+
+    UInt32 frames = context->frames;
+    UInt32 done = 0;
+
+    UInt64 request = atomic_load_explicit(&player->seekRequest, memory_order_acquire);
+    UInt32 generation = AKKAAEStreamingFilePlayerGeneration(request);
+    if ( generation != player->renderGeneration ) {
+        // 等 I/O 线程完成 seek 后，丢掉环里旧位置的音频；停止时也要做，好让 I/O 线程提前填好新位置
+        UInt64 mark = atomic_load_explicit(&player->discardMark, memory_order_acquire);
+        if ( AKKAAEStreamingFilePlayerGeneration(mark) == generation ) {
+            UInt64 read;
+            AKKAAEAudioRingGetCounts(player->ring, NULL, &read);
+            UInt64 markCount = AKKAAEStreamingFilePlayerPosition(mark);
+            if ( markCount > AKKAAEStreamingFilePlayerPosition(read) ) {
+                AKKAAEAudioRingDiscard(player->ring, (UInt32)(markCount - AKKAAEStreamingFilePlayerPosition(read)));
+                read += markCount - AKKAAEStreamingFilePlayerPosition(read);
+            }
+            // If some audio from the new position was already played before noticing the seek, this catches up
+            player->renderGeneration = generation;
+            player->playheadCount = markCount;
+            AKKAAEStreamingFilePlayerAdvancePlayhead(player, AKKAAEStreamingFilePlayerPosition(request), read);
+            atomic_store_explicit(&player->finished, NO, memory_order_relaxed);
+            atomic_store_explicit(&player->serviceRequested, YES, memory_order_relaxed);
+            AKKAAEStreamingFilePlayerSemaphoreSignal(&__ioSemaphore);
+        }
+    }
+
+    if ( generation == player->renderGeneration && atomic_load_explicit(&player->playing, memory_order_acquire) ) {
+        UInt32 lookahead = AKKAAEAudioRingGetFillCount(player->ring);
+        if ( lookahead < atomic_load_explicit(&player->minimumLookahead, memory_order_relaxed) ) {
+            atomic_store_explicit(&player->minimumLookahead, lookahead, memory_order_relaxed);
+        }
+
+        done = AKKAAEAudioRingRead(player->ring, abl, frames);
+
+        UInt64 read;
+        AKKAAEAudioRingGetCounts(player->ring, NULL, &read);
+        AKKAAEStreamingFilePlayerAdvancePlayhead(player, atomic_load_explicit(&player->playhead, memory_order_relaxed), read);
+
+        if ( done < frames ) {
+            UInt64 endMark = atomic_load_explicit(&player->endMark, memory_order_acquire);
+            if ( endMark != kNoEndMark && AKKAAEStreamingFilePlayerGeneration(endMark) == generation
+                    && AKKAAEStreamingFilePlayerPosition(endMark) == AKKAAEStreamingFilePlayerPosition(read) ) {
+                // Reached the end of the file: not an underrun
+                atomic_store_explicit(&player->finished, YES, memory_order_relaxed);
+            } else {
+                atomic_fetch_add_explicit(&player->underruns, 1, memory_order_relaxed);
+                atomic_fetch_add_explicit(&player->underrunFrames, frames - done, memory_order_relaxed);
+            }
+        }
+
+        // Wake the I/O thread once there's room for a chunk
+        if ( lookahead - done + player->chunkFrames <= AKKAAEAudioRingGetCapacity(player->ring)
+                && !atomic_exchange_explicit(&player->serviceRequested, YES, memory_order_acq_rel) ) {
+            AKKAAEStreamingFilePlayerSemaphoreSignal(&__ioSemaphore);
+        }
+    }
+
+    if ( done == 0 ) {
+        // Stopped or starved: flag the buffer as silent, so mixing skips it
+        AKKAAEBufferStackSilence(context->stack);
+    } else if ( done < frames ) {
+        AKKAAEAudioBufferListSilence(abl, done, frames - done);
+    }
+}
+
+#pragma mark - I/O thread
+
+// Record a loop wrap at the current write position. Returns NO if the queue is full, until the render thread catches up.
+static BOOL AKKAAEStreamingFilePlayerPushJump(AKKAAEStreamingFilePlayer * player, UInt32 generation, UInt64 position) {
+    UInt32 jumpsWritten = atomic_load_explicit(&player->jumpsWritten, memory_order_relaxed);
+    if ( jumpsWritten - atomic_load_explicit(&player->jumpsRead, memory_order_acquire) == kMaxJumps ) return NO;
+    UInt64 written;
+    AKKAAEAudioRingGetCounts(player->ring, &written, NULL);
+    player->jumps[jumpsWritten % kMaxJumps] = (AKKAAEStreamingFilePlayerJump) {
+        .generation = generation,
+        .count = written,
+        .position = position,
+    };
+    atomic_store_explicit(&player->jumpsWritten, jumpsWritten + 1, memory_order_release);
+    return YES;
+}
+
+// Read up to one chunk into the ring, following seeks and loops. Returns NO if nothing could be done.
+static BOOL AKKAAEStreamingFilePlayerService(AKKAAEStreamingFilePlayer * player) {
+    UInt64 request = atomic_load_explicit(&player->seekRequest, memory_order_acquire);
+    UInt32 generation = AKKAAEStreamingFilePlayerGeneration(request);
+    UInt64 written;
+    BOOL progress = NO;
+
+    if ( generation != player->ioGeneration ) {
+        // Start the new position; the render thread drops everything written before this point
+        player->ioGeneration = generation;
+        player->readPosition = AKKAAEStreamingFilePlayerPosition(request);
+        player->atEnd = NO;
+        atomic_store_explicit(&player->readFailed, NO, memory_order_relaxed);
+        AKKAAEAudioFileSeek(player->file, player->readPosition);
+        AKKAAEAudioRingGetCounts(player->ring, &written, NULL);
+        atomic_store_explicit(&player->endMark, kNoEndMark, memory_order_release);
+        atomic_store_explicit(&player->discardMark, AKKAAEStreamingFilePlayerPack(generation, written), memory_order_release);
+        progress = YES;
+    }
+
+    UInt64 loopStart = 0, loopEnd = player->length;
+    BOOL loop = AKKAAEStreamingFilePlayerGetLoopRegion(player, &loopStart, &loopEnd);
+    if ( player->atEnd ) {
+        // A file that can't be read to the end stays ended, looping or not, rather than failing again every round
+        if ( !loop || atomic_load_explicit(&player->readFailed, memory_order_relaxed) ) return progress;
+        // Looping was turned on after reaching the end: carry on from the loop start
+        player->atEnd = NO;
+        atomic_store_explicit(&player->endMark, kNoEndMark, memory_order_release);
+    }
+
+    AKKAAEAudioBufferListCreateOnStackWithFormat(target, player->audioDescription);
+    UInt32 remaining = player->chunkFrames;
+    while ( remaining > 0 ) {
+        // Wrap at the loop end, or at the end of the file if already past the loop when it was set
+        UInt64 bound = loop && player->readPosition <= loopEnd ? loopEnd : player->length;
+        if ( player->readPosition >= bound ) {
+            if ( loop ) {
+                if ( !AKKAAEStreamingFilePlayerPushJump(player, generation, loopStart) ) break;
+                player->readPosition = loopStart;
+                AKKAAEAudioFileSeek(player->file, loopStart);
+                continue;
+            }
+            AKKAAEAudioRingGetCounts(player->ring, &written, NULL);
+            atomic_store_explicit(&player->endMark, AKKAAEStreamingFilePlayerPack(generation, written), memory_order_release);
+            player->atEnd = YES;
+            progress = YES;
+            break;
+        }
+
+        // Decode straight into the ring
+        UInt32 frames = AKKAAEAudioRingGetWriteBuffer(player->ring, target, (UInt32)MIN(remaining, bound - player->readPosition));
+        if ( frames == 0 ) break;
+        UInt32 read = AKKAAEAudioFileRead(player->file, target, frames);
+        AKKAAEAudioRingCommitWrite(player->ring, read);
+        player->readPosition += read;
+        remaining -= read;
+        progress = progress || read > 0;
+
+        if ( read < frames ) {
+            // Read error or truncated file: treat it as the end, for good. Only what was read counts as progress.
+            AKKAAEAudioRingGetCounts(player->ring, &written, NULL);
+            atomic_store_explicit(&player->endMark, AKKAAEStreamingFilePlayerPack(generation, written), memory_order_release);
+            atomic_store_explicit(&player->readFailed, YES, memory_order_relaxed);
+            player->atEnd = YES;
+            break;
+        }
+    }
+    return progress;
+}
+
+// 选出最需要补充的播放器：有未处理的 seek，或者已缓冲的时长最短
+static AKKAAEStreamingFilePlayer * AKKAAEStreamingFilePlayerNextToService(void) {
+    AKKAAEStreamingFilePlayer * best = NULL;
+    double bestLookahead = INFINITY;
+    for ( AKKAAEStreamingFilePlayer * player = __ioList; player; player = player->next ) {
+        UInt64 request = atomic_load_explicit(&player->seekRequest, memory_order_acquire);
+        double lookahead;
+        if ( AKKAAEStreamingFilePlayerGeneration(request) != player->ioGeneration ) {
+            lookahead = -1;
+        } else {
+            UInt64 loopStart, loopEnd;
+            if ( player->stalled ) continue;
+            if ( player->atEnd && (atomic_load_explicit(&player->readFailed, memory_order_relaxed)
+                                   || !AKKAAEStreamingFilePlayerGetLoopRegion(player, &loopStart, &loopEnd)) ) continue;
+            UInt32 fill = AKKAAEAudioRingGetFillCount(player->ring);
+            if ( AKKAAEAudioRingGetCapacity(player->ring) - fill < player->chunkFrames ) continue;
+            lookahead = fill / player->audioDescription.mSampleRate;
+        }
+        if ( lookahead < bestLookahead ) {
+            best = player;
+            bestLookahead = lookahead;
+        }
+    }
+    return best;
+}
+
+static void * AKKAAEStreamingFilePlayerIOThread(void * userInfo) {
+#ifdef __APPLE__
+    pthread_setname_np("com.akka.audioengine.streaming-file-player");
+    pthread_set_qos_class_self_np(QOS_CLASS_USER_INTERACTIVE, 0);
+#endif
+
+    while ( 1 ) {
+        AKKAAEStreamingFilePlayerSemaphoreWait(&__ioSemaphore);
+        pthread_mutex_lock(&__ioMutex);
+        AKKAAEStreamingFilePlayer * player;
+        while ( (player = AKKAAEStreamingFilePlayerNextToService()) ) {
+            if ( !AKKAAEStreamingFilePlayerService(player) ) {
+                // Waiting on the render thread; try again when next woken
+                player->stalled = YES;
+            }
+        }
+
+        // Cleared only once nothing needs service, right before waiting again, so a request can't be lost:
+        // every request made since is still waiting to be taken from the semaphore
+        for ( player = __ioList; player; player = player->next ) {
+            player->stalled = NO;
+            atomic_store_explicit(&player->serviceRequested, NO, memory_order_release);
+        }
+        pthread_mutex_unlock(&__ioMutex);
+    }
+    return NULL;
+}
+
+static void AKKAAEStreamingFilePlayerStartIOThread(void) {
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        AKKAAEStreamingFilePlayerSemaphoreInit(&__ioSemaphore);
+        pthread_t thread;
+        pthread_create(&thread, NULL, AKKAAEStreamingFilePlayerIOThread, NULL);
+        pthread_detach(thread);
+    });
+}
@@ -7,7 +7,18 @@
 //
 
 #import "AKKAAETime.h"
+#ifdef __APPLE__
 #import <mach/mach_time.h>
+#else
+#import <time.h>
+
+// Elsewhere host ticks are nanoseconds on the monotonic clock
+static inline uint64_t mach_absolute_time(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((uint64_t)now.tv_sec * 1000000000ull) + now.tv_nsec;
+}
+#endif
 
 static double __hostTickToSeconds = 0.0;
 static double __secondToHostTicks = 0.0;
@@ -17,9 +28,13 @@ const AudioTimeStamp AKKAAETimeStampNone = {};
 void AKKAAETimeInit() {
     static dispatch_once_t onceToken;
     dispatch_once(&onceToken, ^{
+#ifdef __APPLE__
         mach_timebase_info_data_t tinfo;
         mach_timebase_info(&tinfo);
         __hostTickToSeconds = ((double)tinfo.numer / tinfo.denom) * 1.0e-9;
+#else
+        __hostTickToSeconds = 1.0e-9;
+#endif
         __secondToHostTicks = 1.0 / __hostTickToSeconds;
     });
 }
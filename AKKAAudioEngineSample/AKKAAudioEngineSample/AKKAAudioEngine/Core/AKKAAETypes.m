@@ -26,4 +26,4 @@ AudioStreamBasicDescription AKKAAEAudioDescriptionWithChannelsAndRate(int channe
     return description;
 }
 
-AKKAAEChannelSet AEChannelSetDefault = {0, 1};
+AKKAAEChannelSet AKKAAEChannelSetDefault = {0, 1};
@@ -41,6 +41,16 @@ typedef struct {
     AKKAAEBufferStack * _Nonnull stack;
     
 } AKKAAERenderContext;
+
+/*!
+ * Render loop block
+ *
+ *  The top-level render block, called once per render cycle with the current context.
+ *  Use the context's stack to generate and process audio, then mix it to the context's output.
+ *
+ * @param context The rendering context
+ */
+typedef void (^AKKAAERenderLoopBlock)(const AKKAAERenderContext * _Nonnull context);
     
 /*!
  * Mix stack items onto the output
@@ -0,0 +1,131 @@
+//
+//  AKKAAEArrayBenchmarks.m
+//  AKKAAudioEngineSampleTests
+//
+//  Created by 张一鸣 on 2016/12/6.
+//  Copyright (c) 2016 AKKA. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "AKKAAETime.h"
+#import "AKKAAEArray.h"
+
+@interface AKKAAEArrayBenchmarks : XCTestCase
+@end
+
+@implementation AKKAAEArrayBenchmarks
+
+- (void)testArrayUpdateScaling {
+    const int sizes[] = { 100, 1000, 10000 };
+    const int updates = 50;
+
+    for ( int s=0; s<sizeof(sizes)/sizeof(int); s++ ) {
+        int size = sizes[s];
+        NSMutableArray * objects = [NSMutableArray array];
+        for ( int i=0; i<size; i++ ) [objects addObject:[NSObject new]];
+
+        AKKAAEArray * array = [[AKKAAEArray alloc] initWithCustomMapping:^void *(id item) {
+            return calloc(1, sizeof(int));
+        }];
+        [array updateWithContentsOfArray:objects];
+
+        // Typical edits: replace, insert and remove one item, then an identical update (which is a no-op)
+        AKKAAEHostTicks start = AKKAAECurrentTimeInHostTicks();
+        for ( int i=0; i<updates; i++ ) {
+            NSMutableArray * edited = [objects mutableCopy];
+            edited[(i * 7919) % size] = [NSObject new];
+            [edited insertObject:[NSObject new] atIndex:(i * 104729) % size];
+            [edited removeObjectAtIndex:(i * 1299709) % size];
+            objects = edited;
+            [array updateWithContentsOfArray:objects];
+            [array updateWithContentsOfArray:objects];
+        }
+        AKKAAESeconds updateDuration = AKKAAESecondsFromHostTicks(AKKAAECurrentTimeInHostTicks() - start);
+
+        // Per-object lookups and pointer updates
+        start = AKKAAECurrentTimeInHostTicks();
+        int found = 0;
+        for ( id object in objects ) {
+            if ( [array pointerValueForObject:object] ) found++;
+        }
+        AKKAAESeconds lookupDuration = AKKAAESecondsFromHostTicks(AKKAAECurrentTimeInHostTicks() - start);
+        XCTAssertEqual(found, size);
+
+        start = AKKAAECurrentTimeInHostTicks();
+        for ( int i=0; i<updates; i++ ) {
+            [array updatePointerValue:calloc(1, sizeof(int)) forObject:objects[(i * 7919) % size]];
+        }
+        AKKAAESeconds pointerUpdateDuration = AKKAAESecondsFromHostTicks(AKKAAECurrentTimeInHostTicks() - start);
+
+        XCTAssertEqual(array.count, size);
+        for ( int i=0; i<size; i++ ) XCTAssertEqual(array[i], objects[i]);
+
+        printf("array size=%5d update=%8.1fus lookup=%6.1fns pointer-update=%8.1fus\n", size,
+               updateDuration / updates * 1.0e6, lookupDuration / size * 1.0e9, pointerUpdateDuration / updates * 1.0e6);
+    }
+}
+
+- (void)testArrayIncrementalEdits {
+    const int sizes[] = { 1000, 10000, 100000 };
+    const int edits = 1000;
+
+    for ( int s=0; s<sizeof(sizes)/sizeof(int); s++ ) {
+        int size = sizes[s];
+        NSMutableArray * objects = [NSMutableArray array];
+        for ( int i=0; i<size; i++ ) [objects addObject:[NSObject new]];
+
+        AKKAAEArray * array = [[AKKAAEArray alloc] initWithCustomMapping:^void *(id item) {
+            return calloc(1, sizeof(int));
+        }];
+        [array updateWithContentsOfArray:objects];
+
+        // One voice or track at a time: insert, remove and replace at scattered indices
+        AKKAAEHostTicks start = AKKAAECurrentTimeInHostTicks();
+        for ( int i=0; i<edits; i++ ) {
+            id object = [NSObject new];
+            int index = (i * 7919) % (int)objects.count;
+            switch ( i % 3 ) {
+                case 0:
+                    [array insertObject:object atIndex:index];
+                    [objects insertObject:object atIndex:index];
+                    break;
+                case 1:
+                    [array removeObjectAtIndex:index];
+                    [objects removeObjectAtIndex:index];
+                    break;
+                case 2:
+                    [array replaceObjectAtIndex:index withObject:object];
+                    objects[index] = object;
+                    break;
+            }
+        }
+        AKKAAESeconds editDuration = AKKAAESecondsFromHostTicks(AKKAAECurrentTimeInHostTicks() - start);
+
+        // The same kind of edit through a full update, for comparison
+        start = AKKAAECurrentTimeInHostTicks();
+        for ( int i=0; i<10; i++ ) {
+            objects[(i * 7919) % size] = [NSObject new];
+            [array updateWithContentsOfArray:objects];
+        }
+        AKKAAESeconds updateDuration = AKKAAESecondsFromHostTicks(AKKAAECurrentTimeInHostTicks() - start);
+
+        // Realtime access, through a token
+        AKKAAEArrayToken token = AKKAAEArrayGetToken(array);
+        XCTAssertEqual(AKKAAEArrayGetCount(token), (int)objects.count);
+        start = AKKAAECurrentTimeInHostTicks();
+        uintptr_t sink = 0;
+        for ( int i=0; i<AKKAAEArrayGetCount(token); i++ ) sink += (uintptr_t)AKKAAEArrayGetItem(token, i);
+        AKKAAESeconds accessDuration = AKKAAESecondsFromHostTicks(AKKAAECurrentTimeInHostTicks() - start);
+        XCTAssertNotEqual(sink, 0);
+
+        XCTAssertEqualObjects(array.allValues, objects);
+        for ( int i=0; i<objects.count; i+=97 ) {
+            XCTAssertEqual(AKKAAEArrayGetItem(token, i), [array pointerValueForObject:objects[i]]);
+        }
+
+        printf("array size=%6d incremental-edit=%7.2fus full-update=%9.1fus get-item=%5.1fns\n", size,
+               editDuration / edits * 1.0e6, updateDuration / 10 * 1.0e6, accessDuration / objects.count * 1.0e9);
+    }
+}
+
+@end
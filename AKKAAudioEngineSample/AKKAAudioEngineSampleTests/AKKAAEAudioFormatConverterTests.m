@@ -0,0 +1,68 @@
+//
+//  AKKAAEAudioFormatConverterTests.m
+//  AKKAAudioEngineSampleTests
+//
+//  Created by 张一鸣 on 2016/12/6.
+//  Copyright (c) 2016 AKKA. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "AKKAAEAudioFormatConverter.h"
+#import "AKKAAEAudioBufferListUtilities.h"
+#import "AKKAAEBenchmarkSupport.h"
+
+@interface AKKAAEAudioFormatConverterTests : XCTestCase
+@end
+
+@implementation AKKAAEAudioFormatConverterTests
+
+- (void)testFormatConverterRoundTrip {
+    // Every sample type, both byte orders, both layouts, and a channel count change, against float
+    const struct { int bits; BOOL isFloat; double quantum; } types[] = {
+        { 16, NO, 1.0 / 32768.0 }, { 24, NO, 1.0 / 8388608.0 }, { 32, NO, 1.0e-7 }, { 32, YES, 1.0e-7 }, { 64, YES, 1.0e-7 },
+    };
+    const UInt32 frames = 5000;
+    AudioStreamBasicDescription floatFormat = AKKAAEBenchmarkPCMFormat(32, YES, NO, NO, 2);
+    AudioBufferList * reference = AKKAAEAudioBufferListCreateWithFormat(floatFormat, frames);
+    AudioBufferList * result = AKKAAEAudioBufferListCreateWithFormat(floatFormat, frames);
+    for ( int c=0; c<2; c++ ) {
+        float * samples = (float *)reference->mBuffers[c].mData;
+        for ( UInt32 i=0; i<frames; i++ ) samples[i] = 0.9f * sinf(i * 0.01f * (c + 1));
+        samples[100] = 1.5f; // Clips in integer formats
+    }
+
+    for ( int t=0; t<sizeof(types)/sizeof(types[0]); t++ ) {
+        for ( int variant=0; variant<8; variant++ ) {
+            BOOL bigEndian = variant & 1, interleaved = variant & 2;
+            int channels = (variant & 4) ? 1 : 2;
+            AudioStreamBasicDescription format = AKKAAEBenchmarkPCMFormat(types[t].bits, types[t].isFloat, bigEndian, interleaved, channels);
+            XCTAssertTrue(AKKAAEAudioFormatConverterSupportsFormat(format));
+
+            AKKAAEAudioFormatConverter * encoder = AKKAAEAudioFormatConverterNew(floatFormat, format);
+            AKKAAEAudioFormatConverter * decoder = AKKAAEAudioFormatConverterNew(format, floatFormat);
+            AudioBufferList * converted = AKKAAEAudioBufferListCreateWithFormat(format, frames);
+            AKKAAEAudioFormatConverterConvert(encoder, reference, converted, frames);
+            AKKAAEAudioFormatConverterConvert(decoder, converted, result, frames);
+
+            double maxError = 0;
+            for ( int c=0; c<2; c++ ) {
+                const float * expected = (const float *)reference->mBuffers[c].mData;
+                const float * actual = (const float *)result->mBuffers[c].mData;
+                for ( UInt32 i=0; i<frames; i++ ) {
+                    float sample = c >= channels ? 0.0f : types[t].isFloat ? expected[i] : MAX(-1.0f, MIN(1.0f, expected[i]));
+                    maxError = MAX(maxError, fabs(actual[i] - sample));
+                }
+            }
+            XCTAssertLessThanOrEqual(maxError, types[t].quantum, @"%s", AKKAAEAudioFormatConverterGetDescription(encoder));
+
+            AKKAAEAudioBufferListFree(converted);
+            AKKAAEAudioFormatConverterFree(encoder);
+            AKKAAEAudioFormatConverterFree(decoder);
+        }
+    }
+
+    AKKAAEAudioBufferListFree(reference);
+    AKKAAEAudioBufferListFree(result);
+}
+
+@end
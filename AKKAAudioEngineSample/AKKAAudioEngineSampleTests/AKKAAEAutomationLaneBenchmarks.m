@@ -0,0 +1,82 @@
+//
+//  AKKAAEAutomationLaneBenchmarks.m
+//  AKKAAudioEngineSampleTests
+//
+//  Created by 张一鸣 on 2016/12/6.
+//  Copyright (c) 2016 AKKA. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "AKKAAETime.h"
+#import "AKKAAEDSPUtilties.h"
+#import "AKKAAEAudioBufferListUtilities.h"
+#import "AKKAAEAutomationLane.h"
+
+@interface AKKAAEAutomationLaneBenchmarks : XCTestCase
+@end
+
+@implementation AKKAAEAutomationLaneBenchmarks
+
+- (void)testAutomationThousandParameters {
+    const int parameters = 1000;
+    const UInt32 frames = 256;
+    const int cycles = 400;
+    const double sampleRate = 44100.0;
+
+    // One stereo buffer per parameter; a new breakpoint on every lane every 8 cycles, at a different offset
+    AKKAAEAutomationLane ** lanes = malloc(sizeof(AKKAAEAutomationLane *) * parameters);
+    AudioBufferList ** buffers = malloc(sizeof(AudioBufferList *) * parameters);
+    for ( int i=0; i<parameters; i++ ) {
+        lanes[i] = AKKAAEAutomationLaneNew(64, 0.5f);
+        buffers[i] = AKKAAEAudioBufferListCreate(frames);
+    }
+    float * currentGains = calloc(parameters, sizeof(float));
+    AKKAAESeconds automationTime = 0, smoothedTime = 0;
+    for ( int c=0; c<cycles; c++ ) {
+        if ( c % 8 == 0 ) {
+            for ( int i=0; i<parameters; i++ ) {
+                AKKAAEAutomationEvent event = {
+                    .sampleTime = (c + 4) * frames + (i % frames),
+                    .value = (c / 8) % 2 ? 0.2f : 0.8f,
+                    .curve = (AKKAAEAutomationCurve)(i % 4),
+                };
+                XCTAssert(AKKAAEAutomationLaneSchedule(lanes[i], event));
+            }
+        }
+
+        AKKAAEHostTicks start = AKKAAECurrentTimeInHostTicks();
+        for ( int i=0; i<parameters; i++ ) {
+            AKKAAEAutomationLaneApply(lanes[i], buffers[i], c * frames, frames);
+        }
+        automationTime += AKKAAESecondsFromHostTicks(AKKAAECurrentTimeInHostTicks() - start);
+
+        // Per-cycle gain smoothing, the way parameters were applied before: the target only lands at the next cycle
+        start = AKKAAECurrentTimeInHostTicks();
+        for ( int i=0; i<parameters; i++ ) {
+            AKKAAEDSPApplyGainWithRamp(buffers[i], (c / 8) % 2 ? 0.2f : 0.8f, &currentGains[i], frames, frames);
+        }
+        smoothedTime += AKKAAESecondsFromHostTicks(AKKAAECurrentTimeInHostTicks() - start);
+
+        // Keep the audio away from denormals
+        for ( int i=0; i<parameters; i++ ) {
+            for ( int ch=0; ch<2; ch++ ) {
+                for ( UInt32 f=0; f<frames; f++ ) ((float *)buffers[i]->mBuffers[ch].mData)[f] = 1.0f;
+            }
+        }
+    }
+
+    AKKAAESeconds budget = frames / sampleRate;
+    printf("automation: %d parameters, %.0f ns per parameter per %u-frame cycle (%.1f%% of the cycle), "
+           "per-cycle smoothing %.0f ns\n", parameters, automationTime / cycles / parameters * 1.0e9, (unsigned int)frames,
+           automationTime / cycles / budget * 100.0, smoothedTime / cycles / parameters * 1.0e9);
+
+    for ( int i=0; i<parameters; i++ ) {
+        AKKAAEAutomationLaneFree(lanes[i]);
+        AKKAAEAudioBufferListFree(buffers[i]);
+    }
+    free(lanes);
+    free(buffers);
+    free(currentGains);
+}
+
+@end
@@ -0,0 +1,81 @@
+//
+//  AKKAAEAutomationLaneTests.m
+//  AKKAAudioEngineSampleTests
+//
+//  Created by 张一鸣 on 2016/12/6.
+//  Copyright (c) 2016 AKKA. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "AKKAAEAudioBufferListUtilities.h"
+#import "AKKAAEAutomationLane.h"
+
+@interface AKKAAEAutomationLaneTests : XCTestCase
+@end
+
+@implementation AKKAAEAutomationLaneTests
+
+- (void)testAutomationLaneSampleAccuracy {
+    const UInt32 frames = 256;
+    AKKAAEAutomationLane * lane = AKKAAEAutomationLaneNew(16, 1.0f);
+    // Mute on frame 300, ramp back up by frame 400, then an exponential fall to 0.01 by frame 600
+    XCTAssert(AKKAAEAutomationLaneSchedule(lane, (AKKAAEAutomationEvent){ 400, 1.0f, AKKAAEAutomationCurveLinear }));
+    XCTAssert(AKKAAEAutomationLaneSchedule(lane, (AKKAAEAutomationEvent){ 300, 0.0f, AKKAAEAutomationCurveStep }));
+    XCTAssert(AKKAAEAutomationLaneSchedule(lane, (AKKAAEAutomationEvent){ 600, 0.01f, AKKAAEAutomationCurveExponential }));
+
+    AudioBufferList * buffer = AKKAAEAudioBufferListCreate(frames * 3);
+    for ( int c=0; c<2; c++ ) {
+        for ( UInt32 i=0; i<frames * 3; i++ ) ((float *)buffer->mBuffers[c].mData)[i] = 1.0f;
+    }
+    for ( UInt32 offset=0; offset<frames * 3; offset += frames ) {
+        AKKAAEAudioBufferListCopyOnStack(cycle, buffer, offset);
+        AKKAAEAutomationLaneApply(lane, cycle, offset, frames);
+    }
+    const float * samples = (const float *)buffer->mBuffers[1].mData;
+    XCTAssertEqual(samples[299], 1.0f);
+    XCTAssertEqual(samples[300], 0.0f);
+    XCTAssertEqualWithAccuracy(samples[350], 0.5f, 1.0e-6);
+    XCTAssertEqual(samples[400], 1.0f);
+    // Curves are drawn as 16-frame chords: even a 40 dB fall in 200 frames stays within 2%
+    for ( UInt32 i=400; i<=600; i++ ) {
+        float expected = powf(0.01f, (i - 400) / 200.0f);
+        XCTAssertEqualWithAccuracy(samples[i], expected, expected * 0.02f, @"frame %u", (unsigned int)i);
+    }
+    XCTAssertEqual(samples[frames * 3 - 1], 0.01f);
+    XCTAssertEqual(AKKAAEAutomationLaneGetValue(lane), 0.01f);
+
+    AKKAAEAutomationLaneFree(lane);
+    AKKAAEAudioBufferListFree(buffer);
+}
+
+- (void)testAutomationLaneCapacity {
+    const UInt32 frames = 64;
+    AKKAAEAutomationLane * lane = AKKAAEAutomationLaneNew(4, 0.0f);
+
+    // Queued and held breakpoints both count, so a breakpoint is refused rather than accepted and dropped
+    for ( int i=0; i<3; i++ ) {
+        XCTAssert(AKKAAEAutomationLaneSchedule(lane, (AKKAAEAutomationEvent){ (i + 1) * frames, i + 1, AKKAAEAutomationCurveStep }));
+    }
+    AKKAAEAutomationLaneUpdate(lane);
+    XCTAssert(AKKAAEAutomationLaneSchedule(lane, (AKKAAEAutomationEvent){ 4 * frames, 4.0f, AKKAAEAutomationCurveStep }));
+    XCTAssertFalse(AKKAAEAutomationLaneSchedule(lane, (AKKAAEAutomationEvent){ 5 * frames, 5.0f, AKKAAEAutomationCurveStep }));
+
+    // Passed breakpoints make room again, and everything accepted plays
+    AudioBufferList * buffer = AKKAAEAudioBufferListCreate(frames);
+    for ( UInt32 cycle=0; cycle<7; cycle++ ) {
+        if ( cycle == 3 ) {
+            XCTAssert(AKKAAEAutomationLaneSchedule(lane, (AKKAAEAutomationEvent){ 5 * frames, 5.0f, AKKAAEAutomationCurveStep }));
+            XCTAssert(AKKAAEAutomationLaneSchedule(lane, (AKKAAEAutomationEvent){ 6 * frames, 6.0f, AKKAAEAutomationCurveStep }));
+        }
+        for ( int c=0; c<2; c++ ) {
+            for ( UInt32 i=0; i<frames; i++ ) ((float *)buffer->mBuffers[c].mData)[i] = 1.0f;
+        }
+        AKKAAEAutomationLaneApply(lane, buffer, cycle * frames, frames);
+        XCTAssertEqual(((float *)buffer->mBuffers[0].mData)[0], (float)cycle, @"cycle %u", (unsigned int)cycle);
+    }
+
+    AKKAAEAutomationLaneFree(lane);
+    AKKAAEAudioBufferListFree(buffer);
+}
+
+@end
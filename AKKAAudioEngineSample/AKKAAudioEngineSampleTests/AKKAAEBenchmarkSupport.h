@@ -0,0 +1,48 @@
+//
+//  AKKAAEBenchmarkSupport.h
+//  AKKAAudioEngineSampleTests
+//
+//  Created by 张一鸣 on 2016/12/6.
+//  Copyright (c) 2016 AKKA. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <AudioToolbox/AudioToolbox.h>
+#import "AKKAAEDSPKernels.h"
+
+//! Frame counts the throughput benchmarks sweep, from a small IO buffer to the largest slice
+extern const UInt32 kBenchmarkFrameCounts[];
+extern const int kBenchmarkFrameCountsCount;
+
+//! Every kernel backend; those not built for this machine return NULL from AKKAAEDSPKernelsGetForBackend
+extern const AKKAAEDSPKernelBackend kKernelBackends[];
+extern const int kKernelBackendsCount;
+
+/*!
+ * Run a block repeatedly and report throughput
+ *
+ * @param frames Frames processed by one invocation of the block
+ * @param block The work to time
+ * @return Frames processed per second
+ */
+double AKKAAEBenchmarkFramesPerSecond(UInt32 frames, void (^block)(void));
+
+/*!
+ * Fill a buffer with white noise between -1 and 1
+ *
+ * @param buffer The samples
+ * @param frames Number of samples
+ */
+void AKKAAEBenchmarkFillNoise(float * buffer, UInt32 frames);
+
+/*!
+ * A packed linear PCM format, for the converter tests and benchmarks
+ *
+ * @param bits Bits per sample
+ * @param isFloat Whether samples are floating point, rather than signed integers
+ * @param bigEndian Whether samples are big-endian
+ * @param interleaved Whether channels are interleaved in one buffer
+ * @param channels Number of channels
+ * @return The format, at 44.1kHz
+ */
+AudioStreamBasicDescription AKKAAEBenchmarkPCMFormat(int bits, BOOL isFloat, BOOL bigEndian, BOOL interleaved, int channels);
@@ -0,0 +1,54 @@
+//
+//  AKKAAEBenchmarkSupport.m
+//  AKKAAudioEngineSampleTests
+//
+//  Created by 张一鸣 on 2016/12/6.
+//  Copyright (c) 2016 AKKA. All rights reserved.
+//
+
+#import "AKKAAEBenchmarkSupport.h"
+#import "AKKAAETime.h"
+
+static const double kBenchmarkFramesPerRun = 64 * 1024 * 1024;
+
+const UInt32 kBenchmarkFrameCounts[] = { 64, 256, 1024, 4096 };
+const int kBenchmarkFrameCountsCount = sizeof(kBenchmarkFrameCounts) / sizeof(UInt32);
+
+const AKKAAEDSPKernelBackend kKernelBackends[] = {
+    AKKAAEDSPKernelBackendScalar,
+    AKKAAEDSPKernelBackendSSE2,
+    AKKAAEDSPKernelBackendAVX2,
+    AKKAAEDSPKernelBackendNEON,
+    AKKAAEDSPKernelBackendAccelerate,
+};
+const int kKernelBackendsCount = sizeof(kKernelBackends) / sizeof(AKKAAEDSPKernelBackend);
+
+double AKKAAEBenchmarkFramesPerSecond(UInt32 frames, void (^block)(void)) {
+    int iterations = MAX(1, (int)(kBenchmarkFramesPerRun / frames));
+    AKKAAEHostTicks start = AKKAAECurrentTimeInHostTicks();
+    for ( int i=0; i<iterations; i++ ) {
+        block();
+    }
+    AKKAAESeconds elapsed = AKKAAESecondsFromHostTicks(AKKAAECurrentTimeInHostTicks() - start);
+    return ((double)iterations * frames) / elapsed;
+}
+
+void AKKAAEBenchmarkFillNoise(float * buffer, UInt32 frames) {
+    for ( UInt32 i=0; i<frames; i++ ) buffer[i] = ((float)arc4random_uniform(20001) / 10000.0f) - 1.0f;
+}
+
+AudioStreamBasicDescription AKKAAEBenchmarkPCMFormat(int bits, BOOL isFloat, BOOL bigEndian, BOOL interleaved, int channels) {
+    int bytesPerSample = bits / 8;
+    AudioStreamBasicDescription format = {
+        .mFormatID = kAudioFormatLinearPCM,
+        .mFormatFlags = (isFloat ? kAudioFormatFlagIsFloat : kAudioFormatFlagIsSignedInteger) | kAudioFormatFlagIsPacked
+            | (bigEndian ? kAudioFormatFlagIsBigEndian : 0) | (interleaved ? 0 : kAudioFormatFlagIsNonInterleaved),
+        .mChannelsPerFrame = (UInt32)channels,
+        .mBytesPerPacket = (UInt32)(bytesPerSample * (interleaved ? channels : 1)),
+        .mFramesPerPacket = 1,
+        .mBytesPerFrame = (UInt32)(bytesPerSample * (interleaved ? channels : 1)),
+        .mBitsPerChannel = (UInt32)bits,
+        .mSampleRate = 44100.0,
+    };
+    return format;
+}
@@ -0,0 +1,210 @@
+//
+//  AKKAAEBufferStackBenchmarks.m
+//  AKKAAudioEngineSampleTests
+//
+//  Created by 张一鸣 on 2016/12/6.
+//  Copyright (c) 2016 AKKA. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "AKKAAETime.h"
+#import "AKKAAEBufferStack.h"
+#import "AKKAAEAudioBufferListUtilities.h"
+#import "AKKAAEBenchmarkSupport.h"
+
+@interface AKKAAEBufferStackBenchmarks : XCTestCase
+@end
+
+@implementation AKKAAEBufferStackBenchmarks
+
+- (void)testBufferStackDeepStackThroughput {
+    const int depth = 64;
+    const int cycles = 20000;
+    AKKAAEBufferStack * stack = AKKAAEBufferStackNew(depth);
+    AKKAAEBufferStackSetFrameCount(stack, 64);
+
+    __block uintptr_t sink = 0;
+    AKKAAEHostTicks start = AKKAAECurrentTimeInHostTicks();
+    for ( int c=0; c<cycles; c++ ) {
+        XCTAssert(AKKAAEBufferStackPush(stack, depth));
+        for ( int i=0; i<depth; i++ ) sink += (uintptr_t)AKKAAEBufferStackGet(stack, i);
+        for ( int i=0; i<depth; i++ ) sink += (uintptr_t)AKKAAEBufferStackGetTimeStampForBuffer(stack, i);
+        for ( int i=0; i<8; i++ ) AKKAAEBufferStackRemove(stack, depth/2);
+        AKKAAEBufferStackPop(stack, depth);
+    }
+    AKKAAESeconds elapsed = AKKAAESecondsFromHostTicks(AKKAAECurrentTimeInHostTicks() - start);
+    XCTAssertEqual(AKKAAEBufferStackCount(stack), 0);
+    XCTAssertNotEqual(sink, 0);
+    printf("buffer-stack depth=%d push/get/timestamp/remove/pop=%.2f us/cycle\n", depth, elapsed / cycles * 1.0e6);
+
+    AKKAAEBufferStackFree(stack);
+}
+
+- (void)testBufferStackSilenceTracking {
+    const int tracks = 128;
+    const UInt32 frames = 256;
+    const int cycles = 2100;
+    const char * names[] = { "untracked", "silenced", "detected" };
+    AKKAAEBufferStack * stack = AKKAAEBufferStackNewWithMaxFrames(tracks + 1, 2, 0, frames);
+    AKKAAEBufferStackSetFrameCount(stack, frames);
+    float * noise = malloc(sizeof(float) * frames);
+    AKKAAEBenchmarkFillNoise(noise, frames);
+
+    // A sparse session: one track in eight is playing, the rest render silence, each through a fader, then one
+    // mix. Untracked, silent tracks are zeroed but not flagged, as before; silenced ones use AKKAAEBufferStackSilence;
+    // detected ones are zeroed by the generator and found by AKKAAEBufferStackDetectSilence.
+    AudioBufferList * outputs[3];
+    AKKAAESeconds elapsed[3] = { 0, 0, 0 };
+    for ( int mode=0; mode<3; mode++ ) outputs[mode] = AKKAAEAudioBufferListCreate(frames);
+    for ( int c=0; c<cycles; c++ ) {
+        int mode = c % 3;
+        AKKAAEAudioBufferListSilence(outputs[mode], 0, frames);
+        AKKAAEHostTicks start = AKKAAECurrentTimeInHostTicks();
+        for ( int i=0; i<tracks; i++ ) {
+            const AudioBufferList * abl = AKKAAEBufferStackPush(stack, 1);
+            if ( i % 8 == 0 ) {
+                for ( int ch=0; ch<2; ch++ ) memcpy(abl->mBuffers[ch].mData, noise, sizeof(float) * frames);
+            } else if ( mode == 1 ) {
+                AKKAAEBufferStackSilence(stack);
+            } else {
+                AKKAAEAudioBufferListSilence(abl, 0, frames);
+            }
+            if ( mode == 2 ) AKKAAEBufferStackDetectSilence(stack, 0);
+            AKKAAEBufferStackApplyFaders(stack, 0.5f, NULL, 0.0f, NULL);
+        }
+        AKKAAEBufferStackMix(stack, 0);
+        AKKAAEBufferStackMixToBufferList(stack, 1, outputs[mode]);
+        AKKAAEBufferStackPop(stack, 1);
+        elapsed[mode] += AKKAAESecondsFromHostTicks(AKKAAECurrentTimeInHostTicks() - start);
+    }
+
+    // Skipping silence changes nothing audible
+    for ( int mode=1; mode<3; mode++ ) {
+        for ( int ch=0; ch<2; ch++ ) {
+            XCTAssertEqual(memcmp(outputs[mode]->mBuffers[ch].mData, outputs[0]->mBuffers[ch].mData, sizeof(float) * frames), 0);
+        }
+    }
+    for ( int mode=0; mode<3; mode++ ) {
+        AKKAAESeconds perCycle = elapsed[mode] / (cycles / 3);
+        AKKAAESeconds untracked = elapsed[0] / (cycles / 3);
+        printf("silence tracking, %d tracks, 1 in 8 playing, %s: %.1f us per %u-frame cycle (%.0f%% saved)\n",
+               tracks, names[mode], perCycle * 1.0e6, (unsigned int)frames, (1.0 - perCycle / untracked) * 100.0);
+        AKKAAEAudioBufferListFree(outputs[mode]);
+    }
+
+    AKKAAEBufferStackFree(stack);
+    free(noise);
+}
+
+- (void)testDeferredFaderMix {
+    const int tracks = 64;
+    const UInt32 frames = 256;
+    const int cycles = 3000;
+    AKKAAEBufferStack * stack = AKKAAEBufferStackNewWithMaxFrames(tracks + 1, 2, 0, frames);
+    AKKAAEBufferStackSetFrameCount(stack, frames);
+    float * noise = malloc(sizeof(float) * (frames + tracks));
+    AKKAAEBenchmarkFillNoise(noise, frames + tracks);
+
+    // Every track has a fader that moves now and then, some a second fader on top. Deferred, the gains are
+    // applied by the mix; materialized, each track is multiplied in place first, as before.
+    float volumes[2][tracks], balances[2][tracks];
+    memset(volumes, 0, sizeof(volumes));
+    memset(balances, 0, sizeof(balances));
+    AudioBufferList * outputs[2] = { AKKAAEAudioBufferListCreate(frames), AKKAAEAudioBufferListCreate(frames) };
+    AKKAAESeconds elapsed[2] = { 0, 0 };
+    float maxError = 0.0f;
+    for ( int c=0; c<cycles; c++ ) {
+        for ( int mode=0; mode<2; mode++ ) {
+            AKKAAEAudioBufferListSilence(outputs[mode], 0, frames);
+            AKKAAEHostTicks start = AKKAAECurrentTimeInHostTicks();
+            for ( int i=0; i<tracks; i++ ) {
+                const AudioBufferList * abl = AKKAAEBufferStackPush(stack, 1);
+                for ( int ch=0; ch<2; ch++ ) memcpy(abl->mBuffers[ch].mData, noise + i, sizeof(float) * frames);
+                float volume = ((c / 40 + i) % 3) * 0.4f;
+                float balance = ((c / 50 + i) % 2) * 0.5f;
+                AKKAAEBufferStackApplyFaders(stack, volume, &volumes[mode][i], balance, &balances[mode][i]);
+                if ( i % 4 == 0 ) AKKAAEBufferStackApplyFaders(stack, 0.8f, NULL, 0.0f, NULL);
+                if ( mode == 1 ) AKKAAEBufferStackMaterialize(stack, 0);
+            }
+            AKKAAEBufferStackMix(stack, 0);
+            AKKAAEBufferStackApplyFaders(stack, 0.9f, NULL, 0.0f, NULL);
+            AKKAAEBufferStackMixToBufferList(stack, 1, outputs[mode]);
+            AKKAAEBufferStackPop(stack, 1);
+            elapsed[mode] += AKKAAESecondsFromHostTicks(AKKAAECurrentTimeInHostTicks() - start);
+        }
+        for ( int ch=0; ch<2; ch++ ) {
+            for ( UInt32 f=0; f<frames; f++ ) {
+                maxError = MAX(maxError, fabsf(((float *)outputs[0]->mBuffers[ch].mData)[f] - ((float *)outputs[1]->mBuffers[ch].mData)[f]));
+            }
+        }
+    }
+    printf("deferred faders, %d tracks: %.1f us per %u-frame cycle, materialized %.1f us (%.0f%% saved), max difference %g\n",
+           tracks, elapsed[0] / cycles * 1.0e6, (unsigned int)frames, elapsed[1] / cycles * 1.0e6,
+           (1.0 - elapsed[0] / elapsed[1]) * 100.0, maxError);
+
+    AKKAAEAudioBufferListFree(outputs[0]);
+    AKKAAEAudioBufferListFree(outputs[1]);
+    AKKAAEBufferStackFree(stack);
+    free(noise);
+}
+
+- (void)testBufferStackCopyOnWriteSends {
+    const int tracks = 100;
+    const int sends = 8;
+    const UInt32 frames = 256;
+    const int cycles = 400;
+    AKKAAEBufferStack * stack = AKKAAEBufferStackNewWithMaxFrames(4, 2, 0, frames);
+    AKKAAEBufferStackSetFrameCount(stack, frames);
+    float * noise = malloc(sizeof(float) * (frames + tracks));
+    AKKAAEBenchmarkFillNoise(noise, frames + tracks);
+
+    // Every track feeds 8 send buses and the master. Shared, each send is a duplicate that is faded and mixed
+    // without ever being copied; copied, AKKAAEBufferStackGet forces the copy Duplicate used to make.
+    AudioBufferList * buses[2][sends];
+    AudioBufferList * masters[2];
+    for ( int mode=0; mode<2; mode++ ) {
+        masters[mode] = AKKAAEAudioBufferListCreate(frames);
+        for ( int s=0; s<sends; s++ ) buses[mode][s] = AKKAAEAudioBufferListCreate(frames);
+    }
+    AKKAAESeconds elapsed[2] = { 0, 0 };
+    for ( int c=0; c<cycles; c++ ) {
+        for ( int mode=0; mode<2; mode++ ) {
+            AKKAAEAudioBufferListSilence(masters[mode], 0, frames);
+            for ( int s=0; s<sends; s++ ) AKKAAEAudioBufferListSilence(buses[mode][s], 0, frames);
+            AKKAAEHostTicks start = AKKAAECurrentTimeInHostTicks();
+            for ( int i=0; i<tracks; i++ ) {
+                const AudioBufferList * abl = AKKAAEBufferStackPush(stack, 1);
+                for ( int ch=0; ch<2; ch++ ) memcpy(abl->mBuffers[ch].mData, noise + i, sizeof(float) * frames);
+                for ( int s=0; s<sends; s++ ) {
+                    AKKAAEBufferStackDuplicate(stack);
+                    if ( mode == 1 ) AKKAAEBufferStackGetMutable(stack, 0);
+                    AKKAAEBufferStackApplyFaders(stack, 0.1f * (s + 1), NULL, 0.0f, NULL);
+                    AKKAAEBufferStackMixToBufferList(stack, 1, buses[mode][s]);
+                    AKKAAEBufferStackPop(stack, 1);
+                }
+                AKKAAEBufferStackApplyFaders(stack, 0.5f, NULL, 0.0f, NULL);
+                AKKAAEBufferStackMixToBufferList(stack, 1, masters[mode]);
+                AKKAAEBufferStackPop(stack, 1);
+            }
+            elapsed[mode] += AKKAAESecondsFromHostTicks(AKKAAECurrentTimeInHostTicks() - start);
+        }
+    }
+    for ( int ch=0; ch<2; ch++ ) {
+        XCTAssertEqual(memcmp(masters[0]->mBuffers[ch].mData, masters[1]->mBuffers[ch].mData, sizeof(float) * frames), 0);
+        for ( int s=0; s<sends; s++ ) {
+            XCTAssertEqual(memcmp(buses[0][s]->mBuffers[ch].mData, buses[1][s]->mBuffers[ch].mData, sizeof(float) * frames), 0);
+        }
+    }
+    printf("copy-on-write sends, %d tracks x %d sends: %.1f us per %u-frame cycle, copied %.1f us (%.0f%% saved)\n",
+           tracks, sends, elapsed[0] / cycles * 1.0e6, (unsigned int)frames, elapsed[1] / cycles * 1.0e6,
+           (1.0 - elapsed[0] / elapsed[1]) * 100.0);
+    for ( int mode=0; mode<2; mode++ ) {
+        AKKAAEAudioBufferListFree(masters[mode]);
+        for ( int s=0; s<sends; s++ ) AKKAAEAudioBufferListFree(buses[mode][s]);
+    }
+
+    AKKAAEBufferStackFree(stack);
+    free(noise);
+}
+
+@end
@@ -0,0 +1,330 @@
+//
+//  AKKAAEBufferStackTests.m
+//  AKKAAudioEngineSampleTests
+//
+//  Created by 张一鸣 on 2016/12/6.
+//  Copyright (c) 2016 AKKA. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "AKKAAEBufferStack.h"
+#import "AKKAAEAudioBufferListUtilities.h"
+#import "AKKAAERenderScheduler.h"
+
+static const UInt32 kTestFrames = 256;
+
+// Fill every channel of a buffer with a ramp, different per channel, so copies and gains can be told apart
+static void AKKAAEBufferStackTestFill(const AudioBufferList * abl, float offset) {
+    for ( int ch=0; ch<abl->mNumberBuffers; ch++ ) {
+        for ( UInt32 f=0; f<kTestFrames; f++ ) {
+            ((float *)abl->mBuffers[ch].mData)[f] = offset + ch + (float)f / kTestFrames;
+        }
+    }
+}
+
+@interface AKKAAEBufferStackTests : XCTestCase
+@end
+
+@implementation AKKAAEBufferStackTests
+
+- (void)testSilenceTracking {
+    AKKAAEBufferStack * stack = AKKAAEBufferStackNewWithMaxFrames(8, 2, 0, kTestFrames);
+    AKKAAEBufferStackSetFrameCount(stack, kTestFrames);
+
+    // Pushed buffers start unflagged; silencing zeroes the samples and flags every channel
+    const AudioBufferList * abl = AKKAAEBufferStackPush(stack, 1);
+    XCTAssertEqual(AKKAAEBufferStackGetSilentChannels(stack, 0), 0);
+    AKKAAEBufferStackTestFill(abl, 1.0f);
+    AKKAAEBufferStackSilence(stack);
+    XCTAssertEqual(AKKAAEBufferStackGetSilentChannels(stack, 0), 3);
+    abl = AKKAAEBufferStackGet(stack, 0);
+    for ( int ch=0; ch<2; ch++ ) {
+        for ( UInt32 f=0; f<kTestFrames; f++ ) XCTAssertEqual(((float *)abl->mBuffers[ch].mData)[f], 0.0f);
+    }
+
+    // Detection flags the channels that are all zeros, even with a single sample set at the very end
+    abl = AKKAAEBufferStackPush(stack, 1);
+    AKKAAEAudioBufferListSilence(abl, 0, kTestFrames);
+    ((float *)abl->mBuffers[1].mData)[kTestFrames - 1] = 0.5f;
+    XCTAssertEqual(AKKAAEBufferStackDetectSilence(stack, 0), 1);
+    XCTAssertEqual(AKKAAEBufferStackGetSilentChannels(stack, 0), 1);
+
+    // A mix is silent only where all its inputs are, and still carries the audible sample
+    AKKAAEBufferStackMix(stack, 2);
+    XCTAssertEqual(AKKAAEBufferStackCount(stack), 1);
+    XCTAssertEqual(AKKAAEBufferStackGetSilentChannels(stack, 0), 1);
+    AKKAAEBufferStackMaterialize(stack, 0);
+    abl = AKKAAEBufferStackGet(stack, 0);
+    for ( UInt32 f=0; f<kTestFrames; f++ ) {
+        XCTAssertEqual(((float *)abl->mBuffers[0].mData)[f], 0.0f);
+        XCTAssertEqual(((float *)abl->mBuffers[1].mData)[f], f == kTestFrames - 1 ? 0.5f : 0.0f);
+    }
+
+    // Duplicates keep the flags; a fader at zero silences the rest
+    AKKAAEBufferStackDuplicate(stack);
+    XCTAssertEqual(AKKAAEBufferStackGetSilentChannels(stack, 0), 1);
+    AKKAAEBufferStackApplyFaders(stack, 0.0f, NULL, 0.0f, NULL);
+    XCTAssertEqual(AKKAAEBufferStackGetSilentChannels(stack, 0), 3);
+    AKKAAEBufferStackMaterialize(stack, 0);
+    XCTAssertEqual(((float *)AKKAAEBufferStackGet(stack, 0)->mBuffers[1].mData)[kTestFrames - 1], 0.0f);
+    XCTAssertEqual(((float *)AKKAAEBufferStackGet(stack, 1)->mBuffers[1].mData)[kTestFrames - 1], 0.5f);
+    AKKAAEBufferStackPop(stack, 2);
+
+    // Skipping silent tracks changes nothing audible: two playing tracks among silenced and detected ones
+    AudioBufferList * output = AKKAAEAudioBufferListCreate(kTestFrames);
+    AKKAAEAudioBufferListSilence(output, 0, kTestFrames);
+    for ( int i=0; i<6; i++ ) {
+        abl = AKKAAEBufferStackPush(stack, 1);
+        if ( i % 3 == 0 ) {
+            AKKAAEBufferStackTestFill(abl, 1.0f);
+        } else if ( i % 3 == 1 ) {
+            AKKAAEBufferStackSilence(stack);
+        } else {
+            AKKAAEAudioBufferListSilence(abl, 0, kTestFrames);
+            XCTAssertEqual(AKKAAEBufferStackDetectSilence(stack, 0), 3);
+        }
+        AKKAAEBufferStackApplyFaders(stack, 0.5f, NULL, 0.0f, NULL);
+    }
+    AKKAAEBufferStackMix(stack, 0);
+    XCTAssertEqual(AKKAAEBufferStackGetSilentChannels(stack, 0), 0);
+    AKKAAEBufferStackMixToBufferList(stack, 1, output);
+    AKKAAEBufferStackPop(stack, 1);
+    for ( int ch=0; ch<2; ch++ ) {
+        for ( UInt32 f=0; f<kTestFrames; f++ ) {
+            XCTAssertEqual(((float *)output->mBuffers[ch].mData)[f], 1.0f + ch + (float)f / kTestFrames);
+        }
+    }
+
+    AKKAAEAudioBufferListFree(output);
+    AKKAAEBufferStackFree(stack);
+}
+
+- (void)testWriteAfterSilence {
+    AKKAAEBufferStack * stack = AKKAAEBufferStackNewWithMaxFrames(8, 2, 0, kTestFrames);
+    AKKAAEBufferStackSetFrameCount(stack, kTestFrames);
+
+    // Audio written into silenced and detected-silent buffers is mixed, not skipped
+    AKKAAEBufferStackTestFill(AKKAAEBufferStackPush(stack, 1), 1.0f);
+    AKKAAEBufferStackPush(stack, 1);
+    AKKAAEBufferStackSilence(stack);
+    const AudioBufferList * abl = AKKAAEBufferStackGetMutable(stack, 0);
+    XCTAssertEqual(AKKAAEBufferStackGetSilentChannels(stack, 0), 0);
+    AKKAAEBufferStackTestFill(abl, 2.0f);
+    abl = AKKAAEBufferStackPush(stack, 1);
+    AKKAAEAudioBufferListSilence(abl, 0, kTestFrames);
+    XCTAssertEqual(AKKAAEBufferStackDetectSilence(stack, 0), 3);
+    ((float *)AKKAAEBufferStackGetMutable(stack, 0)->mBuffers[1].mData)[0] = 0.5f;
+    XCTAssertEqual(AKKAAEBufferStackGetSilentChannels(stack, 0), 0);
+
+    abl = AKKAAEBufferStackMix(stack, 3);
+    XCTAssertEqual(AKKAAEBufferStackGetSilentChannels(stack, 0), 0);
+    for ( int ch=0; ch<2; ch++ ) {
+        for ( UInt32 f=0; f<kTestFrames; f++ ) {
+            float expected = 3.0f + 2 * (ch + (float)f / kTestFrames) + (ch == 1 && f == 0 ? 0.5f : 0.0f);
+            XCTAssertEqualWithAccuracy(((float *)abl->mBuffers[ch].mData)[f], expected, 1.0e-5f);
+        }
+    }
+
+    AKKAAEBufferStackFree(stack);
+}
+
+- (void)testDeferredFaders {
+    AKKAAEBufferStack * stack = AKKAAEBufferStackNewWithMaxFrames(8, 2, 0, kTestFrames);
+    AKKAAEBufferStackSetFrameCount(stack, kTestFrames);
+
+    // Deferred gain mixes the same as gain multiplied in place: moving faders, a second fader on some
+    // tracks and one on the bus
+    const int tracks = 4;
+    float volumes[2][tracks], balances[2][tracks];
+    memset(volumes, 0, sizeof(volumes));
+    memset(balances, 0, sizeof(balances));
+    AudioBufferList * outputs[2] = { AKKAAEAudioBufferListCreate(kTestFrames), AKKAAEAudioBufferListCreate(kTestFrames) };
+    for ( int c=0; c<4; c++ ) {
+        for ( int mode=0; mode<2; mode++ ) {
+            AKKAAEAudioBufferListSilence(outputs[mode], 0, kTestFrames);
+            for ( int i=0; i<tracks; i++ ) {
+                AKKAAEBufferStackTestFill(AKKAAEBufferStackPush(stack, 1), i);
+                AKKAAEBufferStackApplyFaders(stack, ((c + i) % 3) * 0.4f, &volumes[mode][i], ((c + i) % 2) * 0.5f, &balances[mode][i]);
+                if ( i % 2 == 0 ) AKKAAEBufferStackApplyFaders(stack, 0.8f, NULL, 0.0f, NULL);
+                if ( mode == 1 ) AKKAAEBufferStackMaterialize(stack, 0);
+            }
+            AKKAAEBufferStackMix(stack, 0);
+            AKKAAEBufferStackApplyFaders(stack, 0.9f, NULL, 0.0f, NULL);
+            AKKAAEBufferStackMixToBufferList(stack, 1, outputs[mode]);
+            AKKAAEBufferStackPop(stack, 1);
+        }
+        for ( int ch=0; ch<2; ch++ ) {
+            for ( UInt32 f=0; f<kTestFrames; f++ ) {
+                XCTAssertEqualWithAccuracy(((float *)outputs[0]->mBuffers[ch].mData)[f],
+                                           ((float *)outputs[1]->mBuffers[ch].mData)[f], 1.0e-5f);
+            }
+        }
+    }
+    AKKAAEAudioBufferListFree(outputs[0]);
+    AKKAAEAudioBufferListFree(outputs[1]);
+
+    // Getting the buffer to write applies the fader; duplicates carry it along
+    const AudioBufferList * abl = AKKAAEBufferStackPush(stack, 1);
+    for ( int ch=0; ch<2; ch++ ) {
+        for ( UInt32 f=0; f<kTestFrames; f++ ) ((float *)abl->mBuffers[ch].mData)[f] = 1.0f;
+    }
+    AKKAAEBufferStackApplyFaders(stack, 0.25f, NULL, 0.0f, NULL);
+    XCTAssertTrue(AKKAAEBufferStackHasPendingGain(stack, 0));
+    XCTAssertEqual(((float *)AKKAAEBufferStackGet(stack, 0)->mBuffers[1].mData)[9], 1.0f);
+    AKKAAEBufferStackDuplicate(stack);
+    XCTAssertTrue(AKKAAEBufferStackHasPendingGain(stack, 0));
+    XCTAssertEqual(((float *)AKKAAEBufferStackGetMutable(stack, 0)->mBuffers[1].mData)[9], 0.25f);
+    XCTAssertFalse(AKKAAEBufferStackHasPendingGain(stack, 0));
+    XCTAssertTrue(AKKAAEBufferStackHasPendingGain(stack, 1));
+    AKKAAEBufferStackMaterialize(stack, 1);
+    XCTAssertEqual(((float *)AKKAAEBufferStackGet(stack, 1)->mBuffers[1].mData)[9], 0.25f);
+    AKKAAEBufferStackPop(stack, 2);
+
+    // Balance on a stereo buffer only pans it: the right channel keeps its own samples
+    abl = AKKAAEBufferStackPush(stack, 1);
+    for ( UInt32 f=0; f<kTestFrames; f++ ) {
+        ((float *)abl->mBuffers[0].mData)[f] = 1.0f;
+        ((float *)abl->mBuffers[1].mData)[f] = 2.0f;
+    }
+    AKKAAEBufferStackApplyFaders(stack, 1.0f, NULL, 0.5f, NULL);
+    abl = AKKAAEBufferStackGetMutable(stack, 0);
+    XCTAssertEqual(abl->mNumberBuffers, 2);
+    XCTAssertEqual(((float *)abl->mBuffers[0].mData)[9], 0.5f);
+    XCTAssertEqual(((float *)abl->mBuffers[1].mData)[9], 2.0f);
+    AKKAAEBufferStackPop(stack, 1);
+
+    // A mono buffer is widened to stereo first, and then panned
+    abl = AKKAAEBufferStackPushWithChannels(stack, 1, 1);
+    for ( UInt32 f=0; f<kTestFrames; f++ ) ((float *)abl->mBuffers[0].mData)[f] = 1.0f;
+    AKKAAEBufferStackApplyFaders(stack, 1.0f, NULL, 0.5f, NULL);
+    abl = AKKAAEBufferStackGetMutable(stack, 0);
+    XCTAssertEqual(abl->mNumberBuffers, 2);
+    XCTAssertEqual(((float *)abl->mBuffers[0].mData)[9], 0.5f);
+    XCTAssertEqual(((float *)abl->mBuffers[1].mData)[9], 1.0f);
+    AKKAAEBufferStackPop(stack, 1);
+
+    AKKAAEBufferStackFree(stack);
+}
+
+- (void)testCopyOnWriteDuplicates {
+    AKKAAEBufferStack * stack = AKKAAEBufferStackNewWithMaxFrames(8, 2, 0, kTestFrames);
+    AKKAAEBufferStackSetFrameCount(stack, kTestFrames);
+
+    // Reading shares the samples; writing either side copies, and leaves the other alone
+    const AudioBufferList * original = AKKAAEBufferStackPush(stack, 1);
+    AKKAAEBufferStackTestFill(original, 1.0f);
+    void * samples = original->mBuffers[0].mData;
+    AKKAAEBufferStackDuplicate(stack);
+    XCTAssertTrue(AKKAAEBufferStackIsShared(stack, 0));
+    XCTAssertTrue(AKKAAEBufferStackIsShared(stack, 1));
+    XCTAssertEqual(AKKAAEBufferStackGet(stack, 0)->mBuffers[0].mData, samples);
+    XCTAssertEqual(AKKAAEBufferStackGet(stack, 1)->mBuffers[0].mData, samples);
+    const AudioBufferList * duplicate = AKKAAEBufferStackGetMutable(stack, 0);
+    XCTAssertNotEqual(duplicate->mBuffers[0].mData, samples);
+    XCTAssertFalse(AKKAAEBufferStackIsShared(stack, 0));
+    XCTAssertFalse(AKKAAEBufferStackIsShared(stack, 1));
+    XCTAssertEqual(((float *)duplicate->mBuffers[1].mData)[9], 2.0f + 9.0f / kTestFrames);
+    ((float *)duplicate->mBuffers[0].mData)[0] = -1.0f;
+    XCTAssertEqual(((float *)AKKAAEBufferStackGet(stack, 1)->mBuffers[0].mData)[0], 1.0f);
+    AKKAAEBufferStackPop(stack, 1);
+    AKKAAEBufferStackDuplicate(stack);
+    ((float *)AKKAAEBufferStackGetMutable(stack, 1)->mBuffers[0].mData)[0] = -1.0f;
+    XCTAssertEqual(((float *)AKKAAEBufferStackGet(stack, 0)->mBuffers[0].mData)[0], 1.0f);
+
+    // Silencing or fading a shared duplicate leaves the original as it was
+    AKKAAEBufferStackPop(stack, 1);
+    AKKAAEBufferStackDuplicate(stack);
+    AKKAAEBufferStackSilence(stack);
+    XCTAssertEqual(((float *)AKKAAEBufferStackGet(stack, 0)->mBuffers[1].mData)[9], 0.0f);
+    XCTAssertEqual(((float *)AKKAAEBufferStackGet(stack, 1)->mBuffers[1].mData)[9], 2.0f + 9.0f / kTestFrames);
+    AKKAAEBufferStackPop(stack, 1);
+    AKKAAEBufferStackDuplicate(stack);
+    AKKAAEBufferStackApplyFaders(stack, 0.5f, NULL, 0.0f, NULL);
+    AKKAAEBufferStackMaterialize(stack, 0);
+    XCTAssertEqual(((float *)AKKAAEBufferStackGet(stack, 0)->mBuffers[1].mData)[9], 1.0f + 4.5f / kTestFrames);
+    XCTAssertEqual(((float *)AKKAAEBufferStackGet(stack, 1)->mBuffers[1].mData)[9], 2.0f + 9.0f / kTestFrames);
+    AKKAAEBufferStackPop(stack, 2);
+
+    // A send that is faded and mixed from a duplicate gives the same output as one made from a copy
+    AudioBufferList * outputs[2] = { AKKAAEAudioBufferListCreate(kTestFrames), AKKAAEAudioBufferListCreate(kTestFrames) };
+    for ( int mode=0; mode<2; mode++ ) {
+        AKKAAEAudioBufferListSilence(outputs[mode], 0, kTestFrames);
+        AKKAAEBufferStackTestFill(AKKAAEBufferStackPush(stack, 1), 1.0f);
+        for ( int s=0; s<4; s++ ) {
+            AKKAAEBufferStackDuplicate(stack);
+            if ( mode == 1 ) AKKAAEBufferStackGetMutable(stack, 0);
+            XCTAssertEqual(AKKAAEBufferStackIsShared(stack, 0), mode == 0);
+            AKKAAEBufferStackApplyFaders(stack, 0.25f * (s + 1), NULL, 0.0f, NULL);
+            AKKAAEBufferStackMixToBufferList(stack, 1, outputs[mode]);
+            AKKAAEBufferStackPop(stack, 1);
+        }
+        XCTAssertFalse(AKKAAEBufferStackIsShared(stack, 0));
+        AKKAAEBufferStackPop(stack, 1);
+    }
+    for ( int ch=0; ch<2; ch++ ) {
+        XCTAssertEqual(memcmp(outputs[0]->mBuffers[ch].mData, outputs[1]->mBuffers[ch].mData, sizeof(float) * kTestFrames), 0);
+        XCTAssertEqual(((float *)outputs[0]->mBuffers[ch].mData)[0], 2.5f * (1.0f + ch));
+    }
+    AKKAAEAudioBufferListFree(outputs[0]);
+    AKKAAEAudioBufferListFree(outputs[1]);
+    AKKAAEBufferStackFree(stack);
+
+    // The copy a write may need is reserved when duplicating: with four mono buffers in the pool, a stereo
+    // buffer can be duplicated once, and the write that follows always has somewhere to go
+    stack = AKKAAEBufferStackNewWithMaxFrames(4, 2, 4, kTestFrames);
+    AKKAAEBufferStackSetFrameCount(stack, kTestFrames);
+    AKKAAEBufferStackTestFill(AKKAAEBufferStackPush(stack, 1), 1.0f);
+    XCTAssert(AKKAAEBufferStackDuplicate(stack));
+    XCTAssertTrue(AKKAAEBufferStackDuplicate(stack) == NULL);
+    XCTAssertTrue(AKKAAEBufferStackPushWithChannels(stack, 1, 1) == NULL);
+    ((float *)AKKAAEBufferStackGetMutable(stack, 0)->mBuffers[0].mData)[0] = -1.0f;
+    XCTAssertEqual(((float *)AKKAAEBufferStackGet(stack, 1)->mBuffers[0].mData)[0], 1.0f);
+    AKKAAEBufferStackPop(stack, 1);
+    XCTAssert(AKKAAEBufferStackPushWithChannels(stack, 1, 2));
+
+    AKKAAEBufferStackFree(stack);
+}
+
+- (void)testMemoryBySliceSize {
+    // One stack per session at a 128-frame IO buffer, against the default 4096-frame sizing
+    const int poolSize = 16, channels = 2;
+    AKKAAEBufferStack * full = AKKAAEBufferStackNewWithOptions(poolSize, channels, 0);
+    AKKAAEBufferStack * sized = AKKAAEBufferStackNewWithMaxFrames(poolSize, channels, 0, 128);
+    size_t fullBytes = AKKAAEBufferStackGetMemoryUsage(full), sizedBytes = AKKAAEBufferStackGetMemoryUsage(sized);
+    XCTAssertEqual(AKKAAEBufferStackGetMaxFramesPerSlice(full), AKKAAEBufferStackMaxFramesPerSlice);
+    XCTAssertEqual(AKKAAEBufferStackGetFrameCount(sized), 128);
+    XCTAssertGreaterThanOrEqual(fullBytes, (size_t)poolSize * channels * AKKAAEBufferStackMaxFramesPerSlice * sizeof(float));
+    XCTAssertGreaterThanOrEqual(sizedBytes, (size_t)poolSize * channels * 128 * sizeof(float));
+    XCTAssertLessThan(sizedBytes * 20, fullBytes);
+
+    // Resizing follows the frame count at the maximum, and needs an empty stack
+    const AudioBufferList * abl = AKKAAEBufferStackPush(sized, 1);
+    XCTAssertEqual(abl->mBuffers[0].mDataByteSize, 128 * sizeof(float));
+    XCTAssertFalse(AKKAAEBufferStackSetMaxFramesPerSlice(sized, 256));
+    AKKAAEBufferStackPop(sized, 1);
+    XCTAssertTrue(AKKAAEBufferStackSetMaxFramesPerSlice(sized, 256));
+    XCTAssertEqual(AKKAAEBufferStackGetFrameCount(sized), 256);
+    abl = AKKAAEBufferStackPush(sized, poolSize);
+    XCTAssertNotEqual(abl, NULL);
+    for ( int i=0; i<poolSize; i++ ) {
+        AKKAAEAudioBufferListSilence(AKKAAEBufferStackGetMutable(sized, i), 0, 256);
+    }
+    AKKAAEBufferStackPop(sized, poolSize);
+    AKKAAEBufferStackSetFrameCount(sized, 64);
+    XCTAssertTrue(AKKAAEBufferStackSetMaxFramesPerSlice(sized, 32));
+    XCTAssertEqual(AKKAAEBufferStackGetFrameCount(sized), 32);
+
+    // Scheduler workers and task outputs shrink the same way
+    AKKAAERenderScheduler * scheduler = AKKAAERenderSchedulerNew(4, 32, channels, 0, channels);
+    size_t schedulerFullBytes = AKKAAERenderSchedulerGetMemoryUsage(scheduler);
+    AKKAAERenderSchedulerSetMaxFramesPerSlice(scheduler, 128);
+    size_t schedulerSizedBytes = AKKAAERenderSchedulerGetMemoryUsage(scheduler);
+    XCTAssertEqual(AKKAAERenderSchedulerGetMaxFramesPerSlice(scheduler), 128);
+    XCTAssertLessThan(schedulerSizedBytes * 20, schedulerFullBytes);
+
+    AKKAAERenderSchedulerFree(scheduler);
+    AKKAAEBufferStackFree(full);
+    AKKAAEBufferStackFree(sized);
+}
+
+@end
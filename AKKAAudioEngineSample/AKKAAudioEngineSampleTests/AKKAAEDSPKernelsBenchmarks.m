@@ -0,0 +1,158 @@
+//
+//  AKKAAEDSPKernelsBenchmarks.m
+//  AKKAAudioEngineSampleTests
+//
+//  Created by 张一鸣 on 2016/12/6.
+//  Copyright (c) 2016 AKKA. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "AKKAAEDSPKernels.h"
+#import "AKKAAEDSPUtilties.h"
+#import "AKKAAEAudioBufferListUtilities.h"
+#import "AKKAAEBenchmarkSupport.h"
+
+@interface AKKAAEDSPKernelsBenchmarks : XCTestCase
+@end
+
+@implementation AKKAAEDSPKernelsBenchmarks
+
+#pragma mark - Kernels
+
+- (void)testDSPKernelThroughput {
+    const UInt32 maxFrames = kBenchmarkFrameCounts[kBenchmarkFrameCountsCount-1];
+    float * a = malloc(sizeof(float) * maxFrames);
+    float * b = malloc(sizeof(float) * maxFrames);
+    float * output = malloc(sizeof(float) * maxFrames);
+    AKKAAEBenchmarkFillNoise(a, maxFrames);
+    AKKAAEBenchmarkFillNoise(b, maxFrames);
+
+    for ( int k=0; k<kKernelBackendsCount; k++ ) {
+        const AKKAAEDSPKernels * kernels = AKKAAEDSPKernelsGetForBackend(kKernelBackends[k]);
+        if ( !kernels ) continue;
+
+        for ( int f=0; f<kBenchmarkFrameCountsCount; f++ ) {
+            UInt32 frames = kBenchmarkFrameCounts[f];
+            double scale = AKKAAEBenchmarkFramesPerSecond(frames, ^{ kernels->scale(a, 0.5f, output, frames); });
+            double add = AKKAAEBenchmarkFramesPerSecond(frames, ^{ kernels->add(a, b, output, frames); });
+            double scaleAdd = AKKAAEBenchmarkFramesPerSecond(frames, ^{ kernels->scaleAdd(a, 0.5f, b, output, frames); });
+            double rampMul = AKKAAEBenchmarkFramesPerSecond(frames, ^{
+                float start = 0.0f;
+                kernels->rampMul(a, &start, 1.0f/frames, output, frames);
+            });
+            double rampMul2 = AKKAAEBenchmarkFramesPerSecond(frames, ^{
+                float start = 1.0f;
+                kernels->rampMul2(output, b, &start, 0.0f, frames);
+            });
+            printf("dsp-kernels backend=%s frames=%u scale=%.0f add=%.0f scaleAdd=%.0f rampMul=%.0f rampMul2=%.0f (frames/sec)\n",
+                   kernels->name, (unsigned int)frames, scale, add, scaleAdd, rampMul, rampMul2);
+        }
+    }
+
+    free(a);
+    free(b);
+    free(output);
+}
+
+- (void)testMultichannelRampThroughput {
+    // A gain ramp over 6/8/16-channel buses: one pass with rampMulN, against a rampMul per channel
+    const int channelCounts[] = { 6, 8, 16 };
+    const UInt32 frames = 256;
+    const AKKAAEDSPKernels * kernels = AKKAAEDSPKernelsGet();
+    for ( int n=0; n<3; n++ ) {
+        int channels = channelCounts[n];
+        AudioBufferList * abl = AKKAAEAudioBufferListCreateWithFormat(AKKAAEAudioDescriptionWithChannelsAndRate(channels, 0), frames);
+        for ( int c=0; c<channels; c++ ) AKKAAEBenchmarkFillNoise(abl->mBuffers[c].mData, frames);
+
+        // Gain stays at 1, so the samples don't decay into denormals over the run
+        double onePass = AKKAAEBenchmarkFramesPerSecond(frames, ^{
+            float start = 1.0f;
+            AKKAAEDSPApplyRamp(abl, &start, 0.0f, frames);
+        });
+        double perChannel = AKKAAEBenchmarkFramesPerSecond(frames, ^{
+            for ( int c=0; c<channels; c++ ) {
+                float start = 1.0f;
+                kernels->rampMul(abl->mBuffers[c].mData, &start, 0.0f, abl->mBuffers[c].mData, frames);
+            }
+        });
+        __block float gain = 0.0f;
+        __block float target = 1.0f;
+        double gainRamp = AKKAAEBenchmarkFramesPerSecond(frames, ^{
+            if ( fabsf(gain - target) < 1.0e-3f ) target = 1.0f - target;
+            AKKAAEDSPApplyGainWithRamp(abl, target, &gain, frames, 16384);
+        });
+        printf("multichannel-ramp backend=%s channels=%d frames=%u one-pass=%.0f per-channel=%.0f (%.2fx) gain-with-ramp=%.0f (frames/sec)\n",
+               kernels->name, channels, (unsigned int)frames, onePass, perChannel, onePass / perChannel, gainRamp);
+        AKKAAEAudioBufferListFree(abl);
+    }
+}
+
+#pragma mark - Mixing
+
+- (void)testMixMultipleThroughput {
+    const int inputCounts[] = { 8, 32, 128 };
+    const UInt32 frames = 1024;
+
+    for ( int n=0; n<sizeof(inputCounts)/sizeof(int); n++ ) {
+        int count = inputCounts[n];
+        const AudioBufferList ** inputs = malloc(sizeof(AudioBufferList*) * count);
+        float * gains = malloc(sizeof(float) * count);
+        for ( int i=0; i<count; i++ ) {
+            AudioBufferList * input = AKKAAEAudioBufferListCreate(frames);
+            for ( int j=0; j<input->mNumberBuffers; j++ ) AKKAAEBenchmarkFillNoise(input->mBuffers[j].mData, frames);
+            inputs[i] = input;
+            gains[i] = 0.5f;
+        }
+        AudioBufferList * output = AKKAAEAudioBufferListCreate(frames);
+
+        // The pairwise path, as the stack used to mix: gain the first, then fold each following buffer in
+        double pairwise = AKKAAEBenchmarkFramesPerSecond(frames * count, ^{
+            AKKAAEDSPApplyGain(inputs[0], gains[0], frames);
+            for ( int i=1; i<count; i++ ) {
+                AKKAAEDSPMix(inputs[i-1], inputs[i], 1, gains[i], YES, frames, inputs[i]);
+            }
+        });
+        double fused = AKKAAEBenchmarkFramesPerSecond(frames * count, ^{
+            AKKAAEDSPMixMultiple(inputs, gains, count, YES, frames, output);
+        });
+        printf("mix inputs=%d frames=%u pairwise=%.0f fused=%.0f (input frames/sec) speedup=%.2fx\n",
+               count, (unsigned int)frames, pairwise, fused, fused / pairwise);
+
+        for ( int i=0; i<count; i++ ) AKKAAEAudioBufferListFree((AudioBufferList*)inputs[i]);
+        AKKAAEAudioBufferListFree(output);
+        free(inputs);
+        free(gains);
+    }
+}
+
+#pragma mark - Fades
+
+- (void)testEqualPowerCrossfadeOnAllCores {
+    // Many clips fading at once across every core, as a session full of crossfades renders them
+    const UInt32 frames = 4096;
+    const int clips = 256;
+    float * noise = malloc(sizeof(float) * frames);
+    AKKAAEBenchmarkFillNoise(noise, frames);
+    AudioBufferList ** buffers = malloc(sizeof(AudioBufferList *) * clips);
+    for ( int i=0; i<clips; i++ ) buffers[i] = AKKAAEAudioBufferListCreate(frames);
+
+    double throughput = AKKAAEBenchmarkFramesPerSecond(frames * clips, ^{
+        dispatch_apply(clips, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^(size_t i) {
+            // Fresh audio each time, or repeated fades would take it down to denormals
+            for ( int c=0; c<2; c++ ) memcpy(buffers[i]->mBuffers[c].mData, noise, sizeof(float) * frames);
+            float position = 0.0f;
+            for ( UInt32 offset=0; offset<frames; offset += 256 ) {
+                AKKAAEAudioBufferListCopyOnStack(slice, buffers[i], offset);
+                AKKAAEDSPApplyEqualPowerRamp(slice, &position, 1.0f / (frames - 1), 256, NULL);
+            }
+        });
+    });
+    printf("equal-power crossfade backend=%s: %d stereo clips of %u frames on all cores, %.0f frames/sec\n",
+           AKKAAEDSPKernelsGet()->name, clips, (unsigned int)frames, throughput);
+
+    for ( int i=0; i<clips; i++ ) AKKAAEAudioBufferListFree(buffers[i]);
+    free(buffers);
+    free(noise);
+}
+
+@end
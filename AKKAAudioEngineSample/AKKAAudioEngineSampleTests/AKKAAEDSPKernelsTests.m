@@ -0,0 +1,199 @@
+//
+//  AKKAAEDSPKernelsTests.m
+//  AKKAAudioEngineSampleTests
+//
+//  Created by 张一鸣 on 2016/12/6.
+//  Copyright (c) 2016 AKKA. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "AKKAAEDSPKernels.h"
+#import "AKKAAEDSPUtilties.h"
+#import "AKKAAEAudioBufferListUtilities.h"
+#import "AKKAAEBenchmarkSupport.h"
+
+static const float kKernelTolerance = 1.0e-5;
+
+@interface AKKAAEDSPKernelsTests : XCTestCase
+@end
+
+@implementation AKKAAEDSPKernelsTests
+
+- (void)testDSPKernelBackendsMatchReference {
+    const AKKAAEDSPKernels * reference = AKKAAEDSPKernelsGetForBackend(AKKAAEDSPKernelBackendAccelerate);
+    if ( !reference ) reference = AKKAAEDSPKernelsGetForBackend(AKKAAEDSPKernelBackendScalar);
+
+    const UInt32 frames = 4093; // Deliberately not a multiple of any vector width
+    float * a = malloc(sizeof(float) * frames);
+    float * b = malloc(sizeof(float) * frames);
+    float * expected = malloc(sizeof(float) * frames);
+    float * actual = malloc(sizeof(float) * frames);
+    float * expected2 = malloc(sizeof(float) * frames);
+    float * actual2 = malloc(sizeof(float) * frames);
+    AKKAAEBenchmarkFillNoise(a, frames);
+    AKKAAEBenchmarkFillNoise(b, frames);
+
+    for ( int k=0; k<kKernelBackendsCount; k++ ) {
+        const AKKAAEDSPKernels * kernels = AKKAAEDSPKernelsGetForBackend(kKernelBackends[k]);
+        if ( !kernels || kernels == reference ) continue;
+
+        reference->scale(a, 0.7f, expected, frames);
+        kernels->scale(a, 0.7f, actual, frames);
+        [self assertBuffer:actual matches:expected frames:frames kernel:"scale" backend:kernels];
+
+        reference->add(a, b, expected, frames);
+        kernels->add(a, b, actual, frames);
+        [self assertBuffer:actual matches:expected frames:frames kernel:"add" backend:kernels];
+
+        reference->scaleAdd(a, 0.3f, b, expected, frames);
+        kernels->scaleAdd(a, 0.3f, b, actual, frames);
+        [self assertBuffer:actual matches:expected frames:frames kernel:"scaleAdd" backend:kernels];
+
+        float referenceStart = 0.0f, start = 0.0f;
+        reference->rampMul(a, &referenceStart, 1.0f/frames, expected, frames);
+        kernels->rampMul(a, &start, 1.0f/frames, actual, frames);
+        [self assertBuffer:actual matches:expected frames:frames kernel:"rampMul" backend:kernels];
+        XCTAssertEqualWithAccuracy(start, referenceStart, kKernelTolerance);
+
+        memcpy(expected, b, sizeof(float) * frames);
+        memcpy(actual, b, sizeof(float) * frames);
+        referenceStart = start = 0.25f;
+        reference->rampMulAdd(a, &referenceStart, 0.5f/frames, expected, frames);
+        kernels->rampMulAdd(a, &start, 0.5f/frames, actual, frames);
+        [self assertBuffer:actual matches:expected frames:frames kernel:"rampMulAdd" backend:kernels];
+        XCTAssertEqualWithAccuracy(start, referenceStart, kKernelTolerance);
+
+        memcpy(expected, a, sizeof(float) * frames);
+        memcpy(expected2, b, sizeof(float) * frames);
+        memcpy(actual, a, sizeof(float) * frames);
+        memcpy(actual2, b, sizeof(float) * frames);
+        referenceStart = start = 1.0f;
+        reference->rampMul2(expected, expected2, &referenceStart, -1.0f/frames, frames);
+        kernels->rampMul2(actual, actual2, &start, -1.0f/frames, frames);
+        [self assertBuffer:actual matches:expected frames:frames kernel:"rampMul2" backend:kernels];
+        [self assertBuffer:actual2 matches:expected2 frames:frames kernel:"rampMul2" backend:kernels];
+        XCTAssertEqualWithAccuracy(start, referenceStart, kKernelTolerance);
+
+        // The multichannel ramp against the reference's per-channel ramp, at a bus width with no fast path
+        float * expectedChannels[6], * actualChannels[6];
+        for ( int c=0; c<6; c++ ) {
+            expectedChannels[c] = malloc(sizeof(float) * frames);
+            actualChannels[c] = malloc(sizeof(float) * frames);
+            memcpy(expectedChannels[c], c % 2 ? a : b, sizeof(float) * frames);
+            memcpy(actualChannels[c], c % 2 ? a : b, sizeof(float) * frames);
+            referenceStart = 0.25f;
+            reference->rampMul(expectedChannels[c], &referenceStart, 0.5f/frames, expectedChannels[c], frames);
+        }
+        start = 0.25f;
+        kernels->rampMulN(actualChannels, 6, &start, 0.5f/frames, frames);
+        XCTAssertEqualWithAccuracy(start, referenceStart, kKernelTolerance);
+        for ( int c=0; c<6; c++ ) {
+            [self assertBuffer:actualChannels[c] matches:expectedChannels[c] frames:frames kernel:"rampMulN" backend:kernels];
+        }
+
+        // The equal-power envelope, over a ramp that overshoots both ends
+        for ( int c=0; c<6; c++ ) {
+            memcpy(expectedChannels[c], c % 2 ? a : b, sizeof(float) * frames);
+            memcpy(actualChannels[c], c % 2 ? a : b, sizeof(float) * frames);
+        }
+        referenceStart = start = -0.1f;
+        reference->equalPowerRampMulN(expectedChannels, 6, &referenceStart, 1.2f/frames, frames);
+        kernels->equalPowerRampMulN(actualChannels, 6, &start, 1.2f/frames, frames);
+        XCTAssertEqualWithAccuracy(start, referenceStart, kKernelTolerance);
+        for ( int c=0; c<6; c++ ) {
+            [self assertBuffer:actualChannels[c] matches:expectedChannels[c] frames:frames kernel:"equalPowerRampMulN" backend:kernels];
+            free(expectedChannels[c]);
+            free(actualChannels[c]);
+        }
+
+        // Resampler-sized dot products: a filter row, and one long enough to leave a tail
+        for ( UInt32 length=64; length<=67; length+=3 ) {
+            float expectedDot = reference->interpolatedDot(a, b, b + length, 0.375f, length);
+            float actualDot = kernels->interpolatedDot(a, b, b + length, 0.375f, length);
+            XCTAssertEqualWithAccuracy(actualDot, expectedDot, 1.0e-4, @"interpolatedDot kernel on %s backend", kernels->name);
+        }
+
+        // Silence detection is exact: -0 is silent, but one denormal or NaN anywhere, vector body or tail, is not
+        memset(actual, 0, sizeof(float) * frames);
+        actual[frames/2] = -0.0f;
+        XCTAssertTrue(kernels->isSilent(actual, frames), @"isSilent kernel on %s backend", kernels->name);
+        const UInt32 positions[] = { 0, 100, frames-1 };
+        for ( int i=0; i<3; i++ ) {
+            actual[positions[i]] = 1.0e-40f;
+            XCTAssertFalse(kernels->isSilent(actual, frames), @"isSilent kernel on %s backend", kernels->name);
+            actual[positions[i]] = NAN;
+            XCTAssertFalse(kernels->isSilent(actual, frames), @"isSilent kernel on %s backend", kernels->name);
+            actual[positions[i]] = 0.0f;
+        }
+    }
+
+    free(a);
+    free(b);
+    free(expected);
+    free(actual);
+    free(expected2);
+    free(actual2);
+}
+
+- (void)testEqualPowerCrossfade {
+    const UInt32 frames = 4096;
+    const int clips = 256;
+
+    // A fade in and a fade out with opposite steps keep the power constant, and end exactly at 1 and 0
+    AudioBufferList * fadeIn = AKKAAEAudioBufferListCreate(frames);
+    AudioBufferList * fadeOut = AKKAAEAudioBufferListCreate(frames);
+    for ( int c=0; c<2; c++ ) {
+        for ( UInt32 i=0; i<frames; i++ ) {
+            ((float *)fadeIn->mBuffers[c].mData)[i] = ((float *)fadeOut->mBuffers[c].mData)[i] = 1.0f;
+        }
+    }
+    float inPosition = 0.0f, outPosition = 1.0f;
+    AKKAAEDSPApplyEqualPowerRamp(fadeIn, &inPosition, 1.0f / (frames - 1), frames, NULL);
+    AKKAAEDSPApplyEqualPowerRamp(fadeOut, &outPosition, -1.0f / (frames - 1), frames, NULL);
+    float maxPowerError = 0;
+    for ( UInt32 i=0; i<frames; i++ ) {
+        float a = ((float *)fadeIn->mBuffers[1].mData)[i], b = ((float *)fadeOut->mBuffers[1].mData)[i];
+        maxPowerError = MAX(maxPowerError, fabsf(a * a + b * b - 1.0f));
+    }
+    XCTAssertLessThan(maxPowerError, 1.0e-5);
+    XCTAssertEqual(((float *)fadeIn->mBuffers[0].mData)[frames-1], 1.0f);
+    XCTAssertEqual(((float *)fadeOut->mBuffers[0].mData)[frames-1], 0.0f);
+
+    // Many clips crossfading at once on every core: no shared state, so every fade comes out the same
+    AudioBufferList ** buffers = malloc(sizeof(AudioBufferList *) * clips);
+    for ( int i=0; i<clips; i++ ) {
+        buffers[i] = AKKAAEAudioBufferListCreate(frames);
+        for ( int c=0; c<2; c++ ) memcpy(buffers[i]->mBuffers[c].mData, fadeOut->mBuffers[c].mData, sizeof(float) * frames);
+    }
+    dispatch_apply(clips, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^(size_t i) {
+        float position = 0.0f;
+        for ( UInt32 offset=0; offset<frames; offset += 256 ) {
+            AKKAAEAudioBufferListCopyOnStack(slice, buffers[i], offset);
+            AKKAAEDSPApplyEqualPowerRamp(slice, &position, 1.0f / (frames - 1), 256, NULL);
+        }
+    });
+    int mismatches = 0;
+    for ( int i=0; i<clips; i++ ) {
+        for ( UInt32 f=0; f<frames; f++ ) {
+            float expected = ((float *)fadeOut->mBuffers[0].mData)[f] * ((float *)fadeIn->mBuffers[0].mData)[f];
+            if ( fabsf(((float *)buffers[i]->mBuffers[0].mData)[f] - expected) > 1.0e-6f ) mismatches++;
+        }
+        AKKAAEAudioBufferListFree(buffers[i]);
+    }
+    XCTAssertEqual(mismatches, 0);
+
+    free(buffers);
+    AKKAAEAudioBufferListFree(fadeIn);
+    AKKAAEAudioBufferListFree(fadeOut);
+}
+
+#pragma mark - Helpers
+
+- (void)assertBuffer:(const float *)actual matches:(const float *)expected frames:(UInt32)frames
+              kernel:(const char *)kernel backend:(const AKKAAEDSPKernels *)backend {
+    float maxError = 0;
+    for ( UInt32 i=0; i<frames; i++ ) maxError = MAX(maxError, fabsf(actual[i] - expected[i]));
+    XCTAssertLessThanOrEqual(maxError, kKernelTolerance, @"%s kernel on %s backend", kernel, backend->name);
+}
+
+@end
@@ -0,0 +1,396 @@
+//
+//  AKKAAEFileBenchmarks.m
+//  AKKAAudioEngineSampleTests
+//
+//  Created by 张一鸣 on 2016/12/6.
+//  Copyright (c) 2016 AKKA. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "AKKAAETime.h"
+#import "AKKAAEBufferStack.h"
+#import "AKKAAEAudioFormatConverter.h"
+#import "AKKAAEAudioBufferListUtilities.h"
+#import "AKKAAEAudioFile.h"
+#import "AKKAAEMappedSample.h"
+#import "AKKAAEStreamingFilePlayer.h"
+#import "AKKAAERecorder.h"
+#import "AKKAAEUtilities.h"
+#import "AKKAAEBenchmarkSupport.h"
+
+@interface AKKAAEFileBenchmarks : XCTestCase
+@end
+
+@implementation AKKAAEFileBenchmarks
+
+#pragma mark - Format conversion
+
+- (void)testFormatConverterThroughput {
+    // The conversions file I/O and device I/O actually do
+    const struct { AudioStreamBasicDescription source, destination; } pairs[] = {
+        { AKKAAEBenchmarkPCMFormat(16, NO, NO, YES, 2), AKKAAEBenchmarkPCMFormat(32, YES, NO, NO, 2) },
+        { AKKAAEBenchmarkPCMFormat(32, YES, NO, NO, 2), AKKAAEBenchmarkPCMFormat(16, NO, NO, YES, 2) },
+        { AKKAAEBenchmarkPCMFormat(24, NO, NO, YES, 2), AKKAAEBenchmarkPCMFormat(32, YES, NO, NO, 2) },
+        { AKKAAEBenchmarkPCMFormat(32, YES, NO, NO, 2), AKKAAEBenchmarkPCMFormat(24, NO, NO, YES, 2) },
+        { AKKAAEBenchmarkPCMFormat(16, NO, YES, YES, 2), AKKAAEBenchmarkPCMFormat(32, YES, NO, NO, 2) },
+        { AKKAAEBenchmarkPCMFormat(32, NO, NO, YES, 2), AKKAAEBenchmarkPCMFormat(32, YES, NO, NO, 2) },
+        { AKKAAEBenchmarkPCMFormat(32, YES, NO, YES, 2), AKKAAEBenchmarkPCMFormat(32, YES, NO, NO, 2) },
+        { AKKAAEBenchmarkPCMFormat(64, YES, NO, NO, 2), AKKAAEBenchmarkPCMFormat(32, YES, NO, NO, 2) },
+    };
+    const UInt32 frames = 4096;
+    for ( int p=0; p<sizeof(pairs)/sizeof(pairs[0]); p++ ) {
+        AKKAAEAudioFormatConverter * converter = AKKAAEAudioFormatConverterNew(pairs[p].source, pairs[p].destination);
+        AudioBufferList * source = AKKAAEAudioBufferListCreateWithFormat(pairs[p].source, frames);
+        AudioBufferList * destination = AKKAAEAudioBufferListCreateWithFormat(pairs[p].destination, frames);
+        for ( int b=0; b<source->mNumberBuffers; b++ ) arc4random_buf(source->mBuffers[b].mData, source->mBuffers[b].mDataByteSize);
+
+        double framesPerSecond = AKKAAEBenchmarkFramesPerSecond(frames, ^{
+            AKKAAEAudioFormatConverterConvert(converter, source, destination, frames);
+        });
+        double bytesPerFrame = pairs[p].source.mBytesPerFrame
+            * (pairs[p].source.mFormatFlags & kAudioFormatFlagIsNonInterleaved ? pairs[p].source.mChannelsPerFrame : 1);
+        printf("convert %-28s %8.2f GB/s (source bytes)\n",
+               AKKAAEAudioFormatConverterGetDescription(converter), framesPerSecond * bytesPerFrame / 1.0e9);
+
+        AKKAAEAudioBufferListFree(source);
+        AKKAAEAudioBufferListFree(destination);
+        AKKAAEAudioFormatConverterFree(converter);
+    }
+}
+
+#pragma mark - File I/O
+
+- (void)testAudioFileVersusExtAudioFile {
+    // One hour of stereo at 44.1kHz, written and read back through both paths
+    const double sampleRate = 44100.0;
+    const UInt64 totalFrames = (UInt64)(sampleRate * 60 * 60);
+    const UInt32 frames = 4096;
+    const AKKAAEAudioFileType fileTypes[] = { AKKAAEAudioFileTypeWAVInt16, AKKAAEAudioFileTypeAIFFInt16, AKKAAEAudioFileTypeAIFFFloat32 };
+    const char * fileTypeNames[] = { "wav-int16", "aiff-int16", "aifc-float32" };
+
+    AudioStreamBasicDescription clientFormat = AKKAAEAudioDescriptionWithChannelsAndRate(2, sampleRate);
+    AudioBufferList * buffer = AKKAAEAudioBufferListCreateWithFormat(clientFormat, frames);
+    for ( int c=0; c<2; c++ ) AKKAAEBenchmarkFillNoise((float *)buffer->mBuffers[c].mData, frames);
+    NSURL * url = [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:@"AKKAAEAudioFileBenchmark"]];
+
+    for ( int t=0; t<sizeof(fileTypes)/sizeof(fileTypes[0]); t++ ) {
+        NSError * error = nil;
+
+        // Native writer
+        AKKAAEHostTicks start = AKKAAECurrentTimeInHostTicks();
+        AKKAAEAudioFile * file = AKKAAEAudioFileCreate(url, fileTypes[t], sampleRate, 2, &error);
+        XCTAssertTrue(file != NULL, @"%@", error);
+        for ( UInt64 written = 0; written < totalFrames; written += frames ) {
+            AKKAAEAudioBufferListSetLength(buffer, (UInt32)MIN(frames, totalFrames - written));
+            XCTAssertTrue(AKKAAEAudioFileWrite(file, buffer, (UInt32)MIN(frames, totalFrames - written)));
+        }
+        XCTAssertTrue(AKKAAEAudioFileClose(file, &error), @"%@", error);
+        AKKAAESeconds nativeWrite = AKKAAESecondsFromHostTicks(AKKAAECurrentTimeInHostTicks() - start);
+
+        // Native reader
+        start = AKKAAECurrentTimeInHostTicks();
+        UInt64 length = 0, read = 0;
+        file = AKKAAEAudioFileOpen(url, NULL, &length, &error);
+        XCTAssertTrue(file != NULL, @"%@", error);
+        XCTAssertEqual(length, totalFrames);
+        AKKAAEAudioBufferListSetLength(buffer, frames);
+        for ( UInt32 count; (count = AKKAAEAudioFileRead(file, buffer, frames)) > 0; ) read += count;
+        AKKAAEAudioFileClose(file, NULL);
+        AKKAAESeconds nativeRead = AKKAAESecondsFromHostTicks(AKKAAECurrentTimeInHostTicks() - start);
+        XCTAssertEqual(read, totalFrames);
+
+        // ExtAudioFile writer
+        start = AKKAAECurrentTimeInHostTicks();
+        ExtAudioFileRef extFile = AKKAAEExtAudioFileCreate(url, fileTypes[t], sampleRate, 2, &error);
+        XCTAssertTrue(extFile != NULL, @"%@", error);
+        for ( UInt64 written = 0; written < totalFrames; written += frames ) {
+            AKKAAEAudioBufferListSetLength(buffer, (UInt32)MIN(frames, totalFrames - written));
+            XCTAssertEqual(ExtAudioFileWrite(extFile, (UInt32)MIN(frames, totalFrames - written), buffer), noErr);
+        }
+        ExtAudioFileDispose(extFile);
+        AKKAAESeconds extWrite = AKKAAESecondsFromHostTicks(AKKAAECurrentTimeInHostTicks() - start);
+
+        // ExtAudioFile reader
+        start = AKKAAECurrentTimeInHostTicks();
+        XCTAssertEqual(ExtAudioFileOpenURL((__bridge CFURLRef)url, &extFile), noErr);
+        XCTAssertEqual(ExtAudioFileSetProperty(extFile, kExtAudioFileProperty_ClientDataFormat, sizeof(clientFormat), &clientFormat), noErr);
+        read = 0;
+        while ( 1 ) {
+            UInt32 count = frames;
+            AKKAAEAudioBufferListSetLength(buffer, frames);
+            if ( ExtAudioFileRead(extFile, &count, buffer) != noErr || count == 0 ) break;
+            read += count;
+        }
+        ExtAudioFileDispose(extFile);
+        AKKAAESeconds extRead = AKKAAESecondsFromHostTicks(AKKAAECurrentTimeInHostTicks() - start);
+        XCTAssertEqual(read, totalFrames);
+
+        printf("file %-12s write: native %6.2fs ExtAudioFile %6.2fs | read: native %6.2fs ExtAudioFile %6.2fs\n",
+               fileTypeNames[t], nativeWrite, extWrite, nativeRead, extRead);
+    }
+
+    [[NSFileManager defaultManager] removeItemAtURL:url error:NULL];
+    AKKAAEAudioBufferListFree(buffer);
+}
+
+#pragma mark - Mapped samples
+
+- (void)testMappedSampleVersusHeapBuffers {
+    // A library of ten one-minute stereo samples: decode everything to the heap, versus map the caches
+    const int sampleCount = 10;
+    const double sampleRate = 44100.0;
+    const UInt64 sampleFrames = (UInt64)(sampleRate * 60);
+    const UInt32 frames = 256;
+    NSString * directory = [NSTemporaryDirectory() stringByAppendingPathComponent:@"AKKAAEMappedSampleBenchmark"];
+    [[NSFileManager defaultManager] createDirectoryAtPath:directory withIntermediateDirectories:YES attributes:nil error:NULL];
+
+    AudioBufferList * noise = AKKAAEAudioBufferListCreateWithFormat(AKKAAEAudioDescriptionWithChannelsAndRate(2, sampleRate), 4096);
+    for ( int c=0; c<2; c++ ) AKKAAEBenchmarkFillNoise((float *)noise->mBuffers[c].mData, 4096);
+    NSMutableArray * sourceURLs = [NSMutableArray array], * cacheURLs = [NSMutableArray array];
+    for ( int i=0; i<sampleCount; i++ ) {
+        NSURL * url = [NSURL fileURLWithPath:[directory stringByAppendingPathComponent:[NSString stringWithFormat:@"%d.wav", i]]];
+        AKKAAEAudioFile * file = AKKAAEAudioFileCreate(url, AKKAAEAudioFileTypeWAVInt16, sampleRate, 2, NULL);
+        for ( UInt64 written = 0; written < sampleFrames; written += 4096 ) {
+            AKKAAEAudioFileWrite(file, noise, (UInt32)MIN((UInt64)4096, sampleFrames - written));
+        }
+        AKKAAEAudioFileClose(file, NULL);
+        [sourceURLs addObject:url];
+        [cacheURLs addObject:[url URLByAppendingPathExtension:@"cache"]];
+    }
+    AKKAAEAudioBufferListFree(noise);
+
+    // Heap: the whole library decoded up front
+    AKKAAEHostTicks start = AKKAAECurrentTimeInHostTicks();
+    AudioBufferList * heapBuffers[sampleCount];
+    for ( int i=0; i<sampleCount; i++ ) {
+        AudioStreamBasicDescription format;
+        UInt64 length;
+        AKKAAEAudioFile * file = AKKAAEAudioFileOpen(sourceURLs[i], &format, &length, NULL);
+        heapBuffers[i] = AKKAAEAudioBufferListCreateWithFormat(format, (int)length);
+        XCTAssertEqual(AKKAAEAudioFileRead(file, heapBuffers[i], (UInt32)length), length);
+        AKKAAEAudioFileClose(file, NULL);
+    }
+    AKKAAESeconds heapLoad = AKKAAESecondsFromHostTicks(AKKAAECurrentTimeInHostTicks() - start);
+
+    // Mapped: first run writes the caches, later runs just map them
+    for ( int i=0; i<sampleCount; i++ ) AKKAAEMappedSampleWriteCache(sourceURLs[i], cacheURLs[i], NULL);
+    start = AKKAAECurrentTimeInHostTicks();
+    AKKAAEMappedSample * mappedSamples[sampleCount];
+    for ( int i=0; i<sampleCount; i++ ) {
+        NSError * error = nil;
+        mappedSamples[i] = AKKAAEMappedSampleOpenWithCache(sourceURLs[i], cacheURLs[i], &error);
+        XCTAssertTrue(mappedSamples[i] != NULL, @"%@", error);
+        AKKAAEMappedSamplePin(mappedSamples[i], 0, (UInt64)(sampleRate * 0.1));
+    }
+    AKKAAESeconds mappedLoad = AKKAAESecondsFromHostTicks(AKKAAECurrentTimeInHostTicks() - start);
+
+    // Play one sample through, cycle by cycle, checking against the heap copy and timing the worst cycle
+    AKKAAEBufferStack * stack = AKKAAEBufferStackNew(0);
+    AKKAAEBufferStackSetFrameCount(stack, frames);
+    AKKAAEAudioBufferListCreateOnStackWithFormat(mapped, AKKAAEMappedSampleGetAudioDescription(mappedSamples[0]));
+    AKKAAESeconds worstCycle = 0;
+    for ( UInt64 position = 0; position < sampleFrames; position += frames ) {
+        AKKAAEHostTicks cycleStart = AKKAAECurrentTimeInHostTicks();
+        AKKAAEBufferStackReset(stack);
+        UInt32 count = AKKAAEMappedSampleGetAudio(mappedSamples[0], mapped, position, frames);
+        AKKAAEMappedSampleSetPlayhead(mappedSamples[0], position);
+        const AudioBufferList * top = AKKAAEBufferStackPushExternal(stack, mapped);
+        float sum = 0;
+        for ( UInt32 f=0; f<count; f++ ) sum += ((const float *)top->mBuffers[0].mData)[f];
+        worstCycle = MAX(worstCycle, AKKAAESecondsFromHostTicks(AKKAAECurrentTimeInHostTicks() - cycleStart));
+        XCTAssertTrue(memcmp(top->mBuffers[1].mData, (float *)heapBuffers[0]->mBuffers[1].mData + position, count * sizeof(float)) == 0);
+        XCTAssertFalse(isnan(sum));
+    }
+
+    // The mapping is read-only: writing through the stack works on a copy and leaves the file's audio alone
+    AKKAAEBufferStackReset(stack);
+    UInt32 count = AKKAAEMappedSampleGetAudio(mappedSamples[0], mapped, 0, frames);
+    AKKAAEBufferStackPushExternal(stack, mapped);
+    AKKAAEBufferStackPushExternal(stack, mapped);
+    const AudioBufferList * mix = AKKAAEBufferStackMix(stack, 2);
+    XCTAssertNotEqual(mix->mBuffers[0].mData, mapped->mBuffers[0].mData);
+    XCTAssertEqual(((float *)mix->mBuffers[0].mData)[count - 1], 2.0f * ((float *)mapped->mBuffers[0].mData)[count - 1]);
+    AKKAAEBufferStackPushExternal(stack, mapped);
+    AKKAAEBufferStackSilence(stack);
+    XCTAssertTrue(memcmp(mapped->mBuffers[0].mData, heapBuffers[0]->mBuffers[0].mData, count * sizeof(float)) == 0);
+    AKKAAEBufferStackFree(stack);
+
+    printf("samples x%d: heap load %6.3fs (%5.1f MB) | mapped open %6.4fs, worst cycle %6.1fus\n", sampleCount,
+           heapLoad, sampleCount * sampleFrames * 2 * sizeof(float) / 1.0e6, mappedLoad, worstCycle * 1.0e6);
+
+    for ( int i=0; i<sampleCount; i++ ) {
+        AKKAAEAudioBufferListFree(heapBuffers[i]);
+        AKKAAEMappedSampleFree(mappedSamples[i]);
+    }
+    [[NSFileManager defaultManager] removeItemAtPath:directory error:NULL];
+}
+
+#pragma mark - Streaming
+
+- (void)testStreamingFilePlayerManyStreams {
+    // 200 streams from disk at once, rendered in real time: twenty files, each played by ten players at different points
+    const int fileCount = 20;
+    const int streamCount = 200;
+    const double sampleRate = 44100.0;
+    const UInt64 fileFrames = (UInt64)(sampleRate * 30);
+    const UInt32 frames = 256;
+    const AKKAAESeconds duration = 10.0;
+    NSString * directory = [NSTemporaryDirectory() stringByAppendingPathComponent:@"AKKAAEStreamingBenchmark"];
+    [[NSFileManager defaultManager] createDirectoryAtPath:directory withIntermediateDirectories:YES attributes:nil error:NULL];
+
+    AudioBufferList * noise = AKKAAEAudioBufferListCreateWithFormat(AKKAAEAudioDescriptionWithChannelsAndRate(2, sampleRate), 4096);
+    for ( int c=0; c<2; c++ ) AKKAAEBenchmarkFillNoise((float *)noise->mBuffers[c].mData, 4096);
+    NSMutableArray * urls = [NSMutableArray array];
+    for ( int i=0; i<fileCount; i++ ) {
+        NSURL * url = [NSURL fileURLWithPath:[directory stringByAppendingPathComponent:[NSString stringWithFormat:@"%d.wav", i]]];
+        AKKAAEAudioFile * file = AKKAAEAudioFileCreate(url, AKKAAEAudioFileTypeWAVInt16, sampleRate, 2, NULL);
+        for ( UInt64 written = 0; written < fileFrames; written += 4096 ) {
+            AKKAAEAudioFileWrite(file, noise, (UInt32)MIN((UInt64)4096, fileFrames - written));
+        }
+        AKKAAEAudioFileClose(file, NULL);
+        [urls addObject:url];
+    }
+    AKKAAEAudioBufferListFree(noise);
+
+    AKKAAEStreamingFilePlayer * players[streamCount];
+    for ( int i=0; i<streamCount; i++ ) {
+        NSError * error = nil;
+        players[i] = AKKAAEStreamingFilePlayerNew(urls[i % fileCount], 0, &error);
+        XCTAssertTrue(players[i] != NULL, @"%@", error);
+        AKKAAEStreamingFilePlayerSeek(players[i], (fileFrames / streamCount) * i);
+        AKKAAEStreamingFilePlayerSetLoop(players[i], YES, 0, 0);
+    }
+
+    // Let the I/O thread fill every lookahead, and the players take up their seeks, before starting
+    AKKAAEBufferStack * stack = AKKAAEBufferStackNew(streamCount);
+    AKKAAEBufferStackSetFrameCount(stack, frames);
+    AudioTimeStamp timestamp = { .mFlags = kAudioTimeStampSampleTimeValid };
+    AKKAAERenderContext context = { .frames = frames, .sampleRate = sampleRate, .timestamp = &timestamp, .stack = stack };
+    [NSThread sleepForTimeInterval:1.0];
+    for ( int i=0; i<streamCount; i++ ) {
+        AKKAAEStreamingFilePlayerRender(players[i], &context);
+        AKKAAEStreamingFilePlayerResetStatistics(players[i]);
+        AKKAAEStreamingFilePlayerSetPlaying(players[i], YES);
+    }
+
+    // Render against the clock, as the audio thread would
+    AKKAAESeconds cycleDuration = frames / sampleRate, worstCycle = 0;
+    AKKAAEHostTicks start = AKKAAECurrentTimeInHostTicks();
+    int cycles = (int)(duration / cycleDuration);
+    for ( int cycle=0; cycle<cycles; cycle++ ) {
+        AKKAAEHostTicks cycleStart = AKKAAECurrentTimeInHostTicks();
+        AKKAAEBufferStackReset(stack);
+        for ( int i=0; i<streamCount; i++ ) {
+            AKKAAEStreamingFilePlayerRender(players[i], &context);
+        }
+        worstCycle = MAX(worstCycle, AKKAAESecondsFromHostTicks(AKKAAECurrentTimeInHostTicks() - cycleStart));
+        timestamp.mSampleTime += frames;
+        AKKAAESeconds wait = (cycle + 1) * cycleDuration - AKKAAESecondsFromHostTicks(AKKAAECurrentTimeInHostTicks() - start);
+        if ( wait > 0 ) [NSThread sleepForTimeInterval:wait];
+    }
+
+    UInt64 underruns = 0, underrunFrames = 0;
+    UInt32 minimumLookahead = UINT32_MAX;
+    for ( int i=0; i<streamCount; i++ ) {
+        AKKAAEStreamingFilePlayerStatistics statistics = AKKAAEStreamingFilePlayerGetStatistics(players[i]);
+        underruns += statistics.underruns;
+        underrunFrames += statistics.underrunFrames;
+        minimumLookahead = MIN(minimumLookahead, statistics.minimumLookahead);
+        AKKAAEStreamingFilePlayerFree(players[i]);
+    }
+    AKKAAEBufferStackFree(stack);
+
+    printf("streams x%d: %d cycles, worst cycle %6.1fus, underruns %llu (%llu frames), lowest lookahead %6.3fs\n",
+           streamCount, cycles, worstCycle * 1.0e6, (unsigned long long)underruns, (unsigned long long)underrunFrames,
+           minimumLookahead / sampleRate);
+    // Underruns depend on the machine's disk and scheduling, so they're reported above rather than asserted
+
+    [[NSFileManager defaultManager] removeItemAtPath:directory error:NULL];
+}
+
+#pragma mark - Recording
+
+- (void)testRecorderStemsVersusDirectWrites {
+    // Eight stereo stems for a minute: writing each cycle straight to the files on the render thread, versus the recorder
+    const int stemCount = 8;
+    const double sampleRate = 44100.0;
+    const UInt32 frames = 256;
+    const int cycles = (int)(sampleRate * 60 / frames);
+    NSString * directory = [NSTemporaryDirectory() stringByAppendingPathComponent:@"AKKAAERecorderBenchmark"];
+    [[NSFileManager defaultManager] createDirectoryAtPath:directory withIntermediateDirectories:YES attributes:nil error:NULL];
+    NSURL * (^urlForStem)(NSString *, int) = ^NSURL * (NSString * prefix, int stem) {
+        return [NSURL fileURLWithPath:[directory stringByAppendingPathComponent:[NSString stringWithFormat:@"%@%d.wav", prefix, stem]]];
+    };
+
+    AKKAAEBufferStack * stack = AKKAAEBufferStackNew(stemCount);
+    AKKAAEBufferStackSetFrameCount(stack, frames);
+    AudioTimeStamp timestamp = { .mFlags = kAudioTimeStampSampleTimeValid };
+    AKKAAERenderContext context = { .frames = frames, .sampleRate = sampleRate, .timestamp = &timestamp, .stack = stack };
+    for ( int i=0; i<stemCount; i++ ) {
+        const AudioBufferList * abl = AKKAAEBufferStackPushWithChannels(stack, 1, 2);
+        for ( int c=0; c<2; c++ ) AKKAAEBenchmarkFillNoise((float *)abl->mBuffers[c].mData, frames);
+    }
+
+    // Direct: the blocking write inside the cycle
+    AKKAAEAudioFile * files[stemCount];
+    for ( int i=0; i<stemCount; i++ ) files[i] = AKKAAEAudioFileCreate(urlForStem(@"direct", i), AKKAAEAudioFileTypeWAVInt16, sampleRate, 2, NULL);
+    AKKAAESeconds directWorst = 0;
+    for ( int cycle=0; cycle<cycles; cycle++ ) {
+        AKKAAEHostTicks start = AKKAAECurrentTimeInHostTicks();
+        for ( int i=0; i<stemCount; i++ ) AKKAAEAudioFileWrite(files[i], AKKAAEBufferStackGet(stack, i), frames);
+        directWorst = MAX(directWorst, AKKAAESecondsFromHostTicks(AKKAAECurrentTimeInHostTicks() - start));
+    }
+    for ( int i=0; i<stemCount; i++ ) AKKAAEAudioFileClose(files[i], NULL);
+
+    // Recorder: the cycle only copies into the rings
+    AKKAAERecorder * recorders[stemCount];
+    for ( int i=0; i<stemCount; i++ ) {
+        NSError * error = nil;
+        recorders[i] = AKKAAERecorderNew(urlForStem(@"recorder", i), AKKAAEAudioFileTypeWAVInt16, sampleRate, 2, 0, &error);
+        XCTAssertTrue(recorders[i] != NULL, @"%@", error);
+    }
+    AKKAAESeconds recorderWorst = 0;
+    for ( int cycle=0; cycle<cycles; cycle++ ) {
+        AKKAAEHostTicks start = AKKAAECurrentTimeInHostTicks();
+        AKKAAERecorderRecordStackItems(recorders, stemCount, &context);
+        recorderWorst = MAX(recorderWorst, AKKAAESecondsFromHostTicks(AKKAAECurrentTimeInHostTicks() - start));
+        if ( cycle % 16 == 0 ) [NSThread sleepForTimeInterval:0.001]; // Give the writer a look in, as real cycles would
+    }
+    // How many frames are dropped depends on how the writer thread is scheduled, so it's reported rather than
+    // asserted. What doesn't: dropped frames are recorded as silence, so each stem is still as long as the direct
+    // one, and every frame is either the direct one's or silent.
+    UInt64 dropped = 0, mismatched = 0;
+    AudioBufferList * direct = AKKAAEAudioBufferListCreateWithFormat(AKKAAEAudioDescriptionWithChannelsAndRate(2, sampleRate), 4096);
+    AudioBufferList * recorded = AKKAAEAudioBufferListCreateWithFormat(AKKAAEAudioDescriptionWithChannelsAndRate(2, sampleRate), 4096);
+    for ( int i=0; i<stemCount; i++ ) {
+        dropped += AKKAAERecorderGetDroppedFrames(recorders[i]);
+        NSError * error = nil;
+        XCTAssertTrue(AKKAAERecorderClose(recorders[i], &error), @"%@", error);
+        UInt64 directLength = 0, recordedLength = 0;
+        AKKAAEAudioFile * directFile = AKKAAEAudioFileOpen(urlForStem(@"direct", i), NULL, &directLength, NULL);
+        AKKAAEAudioFile * recordedFile = AKKAAEAudioFileOpen(urlForStem(@"recorder", i), NULL, &recordedLength, NULL);
+        XCTAssertEqual(directLength, (UInt64)cycles * frames);
+        XCTAssertEqual(recordedLength, directLength);
+        for ( UInt32 count; (count = AKKAAEAudioFileRead(directFile, direct, 4096)) > 0; ) {
+            XCTAssertEqual(AKKAAEAudioFileRead(recordedFile, recorded, count), count);
+            for ( UInt32 f=0; f<count; f++ ) {
+                float * left = (float *)recorded->mBuffers[0].mData, * right = (float *)recorded->mBuffers[1].mData;
+                BOOL same = left[f] == ((float *)direct->mBuffers[0].mData)[f] && right[f] == ((float *)direct->mBuffers[1].mData)[f];
+                if ( !same && (left[f] != 0.0f || right[f] != 0.0f) ) mismatched++;
+            }
+        }
+        AKKAAEAudioFileClose(directFile, NULL);
+        AKKAAEAudioFileClose(recordedFile, NULL);
+    }
+    AKKAAEAudioBufferListFree(direct);
+    AKKAAEAudioBufferListFree(recorded);
+    AKKAAEBufferStackFree(stack);
+
+    printf("stems x%d: direct writes worst cycle %8.1fus | recorder worst cycle %6.1fus, %llu frames dropped\n",
+           stemCount, directWorst * 1.0e6, recorderWorst * 1.0e6, (unsigned long long)dropped);
+    XCTAssertEqual(mismatched, 0);
+
+    [[NSFileManager defaultManager] removeItemAtPath:directory error:NULL];
+}
+
+@end
@@ -0,0 +1,134 @@
+//
+//  AKKAAEManagedValueBenchmarks.m
+//  AKKAAudioEngineSampleTests
+//
+//  Created by 张一鸣 on 2016/12/6.
+//  Copyright (c) 2016 AKKA. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "AKKAAETime.h"
+#import "AKKAAEManagedValue.h"
+#import <stdatomic.h>
+
+@interface AKKAAEManagedValueBenchmarks : XCTestCase
+@end
+
+@implementation AKKAAEManagedValueBenchmarks
+
+- (void)testManagedValueReadContention {
+    const int valueCount = 256;
+    const AKKAAESeconds duration = 1.0;
+
+    NSMutableArray * values = [NSMutableArray array];
+    for ( int i=0; i<valueCount; i++ ) {
+        AKKAAEManagedValue * value = [AKKAAEManagedValue new];
+        value.pointerValue = calloc(1, sizeof(int));
+        [values addObject:value];
+    }
+    __unsafe_unretained AKKAAEManagedValue ** valuePointers =
+        (__unsafe_unretained AKKAAEManagedValue **)calloc(valueCount, sizeof(void*));
+    for ( int i=0; i<valueCount; i++ ) valuePointers[i] = values[i];
+
+    for ( int contended=0; contended<2; contended++ ) {
+        __block _Atomic(BOOL) finished = NO;
+        __block UInt64 reads = 0;
+        __block int batches = 0;
+
+        // Reader: a render-loop-like thread that commits, then reads every value, as fast as it can
+        dispatch_semaphore_t done = dispatch_semaphore_create(0);
+        dispatch_async(dispatch_get_global_queue(QOS_CLASS_USER_INTERACTIVE, 0), ^{
+            uintptr_t sink = 0;
+            while ( !atomic_load(&finished) ) {
+                AKKAAEManagedValueCommitPendingUpdates();
+                for ( int i=0; i<valueCount; i++ ) sink += (uintptr_t)AKKAAEManagedValueGetValue(valuePointers[i]);
+                reads += valueCount;
+            }
+            XCTAssertNotEqual(sink, 0);
+            dispatch_semaphore_signal(done);
+        });
+
+        // Writer: back-to-back batch updates on this thread, when contended
+        AKKAAESeconds end = AKKAAECurrentTimeInSeconds() + duration;
+        while ( AKKAAECurrentTimeInSeconds() < end ) {
+            if ( contended ) {
+                [AKKAAEManagedValue performAtomicBatchUpdate:^{
+                    for ( int i=0; i<8; i++ ) {
+                        ((AKKAAEManagedValue *)values[(batches * 8 + i) % valueCount]).pointerValue = calloc(1, sizeof(int));
+                    }
+                }];
+                batches++;
+            }
+            [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:contended ? 0.0001 : 0.01]];
+        }
+        atomic_store(&finished, YES);
+        dispatch_semaphore_wait(done, DISPATCH_TIME_FOREVER);
+
+        printf("managed-value values=%d writer=%s batches=%d reads=%.1fM/sec\n",
+               valueCount, contended ? "batch-updating" : "idle", batches, reads / duration / 1.0e6);
+    }
+
+    free(valuePointers);
+}
+
+- (void)testManagedValueReclaimUnderUpdateTraffic {
+    const int valueCount = 16;
+    const int updateCount = 200000;
+
+    NSMutableArray * values = [NSMutableArray array];
+    for ( int i=0; i<valueCount; i++ ) {
+        AKKAAEManagedValue * value = [AKKAAEManagedValue new];
+        value.pointerValue = calloc(1, sizeof(int));
+        [values addObject:value];
+    }
+    __unsafe_unretained AKKAAEManagedValue ** valuePointers =
+        (__unsafe_unretained AKKAAEManagedValue **)calloc(valueCount, sizeof(void*));
+    for ( int i=0; i<valueCount; i++ ) valuePointers[i] = values[i];
+
+    AKKAAEManagedValueReclaimStatistics before = [AKKAAEManagedValue reclaimStatistics];
+
+    // Render thread: commit and read every value, once per 256 frames at 44.1kHz
+    __block _Atomic(BOOL) finished = NO;
+    dispatch_semaphore_t done = dispatch_semaphore_create(0);
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_USER_INTERACTIVE, 0), ^{
+        while ( !atomic_load(&finished) ) {
+            AKKAAEManagedValueCommitPendingUpdates();
+            for ( int i=0; i<valueCount; i++ ) AKKAAEManagedValueGetValue(valuePointers[i]);
+            usleep(256.0 / 44100.0 * 1.0e6);
+        }
+        dispatch_semaphore_signal(done);
+    });
+
+    // Heavy automation traffic from this thread. Nothing here runs the run loop: the reclaimer
+    // thread has to keep up on its own.
+    AKKAAEHostTicks start = AKKAAECurrentTimeInHostTicks();
+    for ( int i=0; i<updateCount; i++ ) {
+        ((AKKAAEManagedValue *)values[i % valueCount]).pointerValue = calloc(1, sizeof(int));
+    }
+    AKKAAESeconds updateDuration = AKKAAESecondsFromHostTicks(AKKAAECurrentTimeInHostTicks() - start);
+
+    // Give the render thread a couple of cycles to acknowledge the last values, then stop it
+    AKKAAESeconds end = AKKAAECurrentTimeInSeconds() + 1.0;
+    while ( [AKKAAEManagedValue reclaimStatistics].outstandingValues > 0 && AKKAAECurrentTimeInSeconds() < end ) {
+        usleep(1000);
+    }
+    atomic_store(&finished, YES);
+    dispatch_semaphore_wait(done, DISPATCH_TIME_FOREVER);
+
+    AKKAAEManagedValueReclaimStatistics after = [AKKAAEManagedValue reclaimStatistics];
+    printf("managed-value updates=%d updates/sec=%.0fk retired=%llu reclaimed=%llu peak-outstanding=%d "
+           "pool=%d throttled=%llu longest-latency=%.1fms\n",
+           updateCount, updateCount / updateDuration / 1000.0,
+           after.retiredValues - before.retiredValues, after.reclaimedValues - before.reclaimedValues,
+           after.peakOutstandingValues, after.releaseNodePoolSize, after.throttledUpdates - before.throttledUpdates,
+           after.longestReclaimLatency * 1000.0);
+
+    XCTAssertEqual(after.retiredValues - before.retiredValues, (UInt64)updateCount);
+    XCTAssertEqual(after.outstandingValues, 0, @"Old values should be released without a run loop");
+    XCTAssertLessThanOrEqual(after.releaseNodePoolSize, after.peakOutstandingValues + 64 * 4,
+                             @"Release node pool should only grow to cover the values outstanding at once");
+
+    free(valuePointers);
+}
+
+@end
@@ -0,0 +1,279 @@
+//
+//  AKKAAERenderingBenchmarks.m
+//  AKKAAudioEngineSampleTests
+//
+//  Created by 张一鸣 on 2016/12/6.
+//  Copyright (c) 2016 AKKA. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "AKKAAETime.h"
+#import "AKKAAEBufferStack.h"
+#import "AKKAAEDSPUtilties.h"
+#import "AKKAAEOfflineRenderer.h"
+#import "AKKAAERenderScheduler.h"
+#import "AKKAAEAudioBufferListUtilities.h"
+#import "AKKAAERenderProfiler.h"
+#import "AKKAAEIOAudioUnit.h"
+
+// A render task heavy enough to be worth spreading: an oscillator bank on one track
+static void AKKAAEBenchmarkOscillatorTask(void * userInfo, const AKKAAERenderContext * context) {
+    float * positions = (float *)userInfo;
+    const AudioBufferList * abl = AKKAAEBufferStackPushWithChannels(context->stack, 1, 1);
+    if ( !abl ) return;
+    float * samples = (float *)abl->mBuffers[0].mData;
+    memset(samples, 0, sizeof(float) * context->frames);
+    for ( int partial=0; partial<16; partial++ ) {
+        float rate = (110.0f * (partial + 1)) / context->sampleRate;
+        for ( UInt32 f=0; f<context->frames; f++ ) {
+            samples[f] += AKKAAEDSPGenerateOscillator(rate, &positions[partial]) / (partial + 1);
+        }
+    }
+    AKKAAEBufferStackApplyFaders(context->stack, 0.5f, NULL, 0.0f, NULL);
+    AKKAAERenderContextOutput(context, 1);
+}
+
+@interface AKKAAERenderingBenchmarks : XCTestCase
+@end
+
+@implementation AKKAAERenderingBenchmarks
+
+#pragma mark - Offline rendering
+
+- (void)testOfflineRenderRealtimeFactor {
+    const int trackCount = 32;
+    const double sampleRate = 44100.0;
+    const UInt64 frames = 60 * sampleRate;
+    const UInt32 framesPerCycle[] = { 256, 1024, 4096 };
+
+    for ( int i=0; i<sizeof(framesPerCycle)/sizeof(UInt32); i++ ) {
+        float * positions = calloc(trackCount, sizeof(float));
+
+        // 32 oscillator tracks, each with its own gain, mixed to a stereo output
+        AKKAAEOfflineRenderer * renderer =
+            [[AKKAAEOfflineRenderer alloc] initWithSampleRate:sampleRate numberOfChannels:2 framesPerCycle:framesPerCycle[i]
+                                                        block:^(const AKKAAERenderContext * context) {
+            for ( int track=0; track<trackCount; track++ ) {
+                const AudioBufferList * abl = AKKAAEBufferStackPushWithChannels(context->stack, 1, 1);
+                if ( !abl ) break;
+                float * samples = (float *)abl->mBuffers[0].mData;
+                float rate = (110.0f * (track + 1)) / context->sampleRate;
+                for ( UInt32 f=0; f<context->frames; f++ ) {
+                    samples[f] = AKKAAEDSPGenerateOscillator(rate, &positions[track]) - 0.5f;
+                }
+                AKKAAEBufferStackApplyFaders(context->stack, 1.0f / trackCount, NULL, 0, NULL);
+                AKKAAERenderContextOutput(context, 1);
+                AKKAAEBufferStackPop(context->stack, 1);
+            }
+        }];
+
+        AudioBufferList * output = AKKAAEAudioBufferListCreate((int)frames);
+        [renderer renderFrames:(UInt32)frames toBufferList:output];
+        AKKAAEOfflineRendererStatistics statistics = renderer.statistics;
+
+        XCTAssertEqual(statistics.frames, frames);
+        XCTAssertEqual(renderer.sampleTime, (Float64)frames);
+        printf("offline-render tracks=%d frames-per-cycle=%u audio=%.1fs render=%.3fs longest-cycle=%.1fus realtime-factor=%.1fx\n",
+               trackCount, (unsigned int)framesPerCycle[i], statistics.audioDuration, statistics.totalDuration,
+               statistics.longestCycle * 1.0e6, statistics.realtimeFactor);
+
+        AKKAAEAudioBufferListFree(output);
+        free(positions);
+    }
+}
+
+#pragma mark - Parallel rendering
+
+- (void)testRenderSchedulerScaling {
+    const int trackCount = 128;
+    const UInt32 frames = 512;
+    const int cycles = 200;
+    const int workerCounts[] = { 1, 2, 4, 8 };
+
+    float * positions = calloc(trackCount * 16, sizeof(float));
+    AKKAAERenderSchedulerTask * tasks = malloc(sizeof(AKKAAERenderSchedulerTask) * trackCount);
+    for ( int i=0; i<trackCount; i++ ) {
+        tasks[i] = (AKKAAERenderSchedulerTask){ .render = AKKAAEBenchmarkOscillatorTask, .userInfo = &positions[i * 16] };
+    }
+
+    AKKAAEBufferStack * stack = AKKAAEBufferStackNew(trackCount + 1);
+    AudioBufferList * output = AKKAAEAudioBufferListCreate(frames);
+    AudioTimeStamp timestamp = AKKAAETimeStampWithSamples(0);
+
+    double singleWorkerCycle = 0;
+    for ( int w=0; w<sizeof(workerCounts)/sizeof(int); w++ ) {
+        AKKAAERenderScheduler * scheduler = AKKAAERenderSchedulerNew(workerCounts[w], trackCount, 2, 0, 2);
+
+        AKKAAEHostTicks start = AKKAAECurrentTimeInHostTicks();
+        for ( int c=0; c<cycles; c++ ) {
+            AKKAAEBufferStackReset(stack);
+            AKKAAEBufferStackSetFrameCount(stack, frames);
+            AKKAAEBufferStackSetTimeStamp(stack, &timestamp);
+            AKKAAERenderContext context = {
+                .output = output, .frames = frames, .sampleRate = 44100.0, .timestamp = &timestamp, .stack = stack
+            };
+            int count = AKKAAERenderSchedulerRun(scheduler, &context, tasks, trackCount);
+            XCTAssertEqual(count, trackCount);
+            AKKAAEBufferStackMix(stack, count);
+            AKKAAERenderContextOutput(&context, 1);
+            timestamp.mSampleTime += frames;
+        }
+        double cycle = AKKAAESecondsFromHostTicks(AKKAAECurrentTimeInHostTicks() - start) / cycles;
+        if ( w == 0 ) singleWorkerCycle = cycle;
+
+        printf("render-scheduler tracks=%d frames=%u workers=%d cycle=%.1fus speedup=%.2fx\n",
+               trackCount, (unsigned int)frames, workerCounts[w], cycle * 1.0e6, singleWorkerCycle / cycle);
+
+        AKKAAERenderSchedulerFree(scheduler);
+    }
+
+    AKKAAEBufferStackFree(stack);
+    AKKAAEAudioBufferListFree(output);
+    free(tasks);
+    free(positions);
+}
+
+#pragma mark - Profiling
+
+- (void)testRenderProfilerOverhead {
+    const double sampleRate = 44100.0;
+    const UInt32 frames = 64;
+    const int cycles = 1000000;
+
+    // The bare cost of profiling a cycle with one timed section, against the smallest usual cycle budget
+    AKKAAERenderProfiler * profiler = AKKAAERenderProfilerNew();
+    int section = AKKAAERenderProfilerAddSection(profiler, "mix");
+    AudioTimeStamp timestamp = { .mFlags = kAudioTimeStampSampleTimeValid };
+    AKKAAERenderContext context = { .frames = frames, .sampleRate = sampleRate, .timestamp = &timestamp };
+    AKKAAEHostTicks start = AKKAAECurrentTimeInHostTicks();
+    for ( int cycle=0; cycle<cycles; cycle++ ) {
+        AKKAAERenderProfilerBeginCycle(profiler, &context);
+        AKKAAERenderProfilerTimeSection(profiler, section, timestamp.mSampleTime += frames);
+        AKKAAERenderProfilerEndCycle(profiler);
+    }
+    AKKAAESeconds costPerCycle = AKKAAESecondsFromHostTicks(AKKAAECurrentTimeInHostTicks() - start) / cycles;
+    AKKAAESeconds budget = frames / sampleRate;
+
+    AKKAAERenderProfilerSnapshot snapshot;
+    AKKAAERenderProfilerGetSnapshot(profiler, &snapshot);
+    XCTAssertEqual(snapshot.cycles, (UInt64)cycles);
+    XCTAssertEqual(snapshot.frames, (UInt64)cycles * frames);
+    XCTAssertEqual(snapshot.sectionCount, 1);
+    XCTAssertEqual(snapshot.sections[0].calls, (UInt64)cycles);
+    UInt64 binned = 0;
+    for ( int i=0; i<AKKAAERenderProfilerTimeBins; i++ ) binned += snapshot.timeHistogram[i];
+    XCTAssertEqual(binned, (UInt64)cycles);
+    printf("profiler cost per cycle %.1fns = %.4f%% of a %u-frame budget\n", costPerCycle * 1.0e9, costPerCycle / budget * 100.0, (unsigned int)frames);
+
+    // A realistic render: 32 tracks mixed to stereo, profiled by the offline renderer, with the mixes timed
+    AKKAAERenderProfilerReset(profiler);
+    const int trackCount = 32;
+    float * positions = calloc(trackCount, sizeof(float));
+    AKKAAEOfflineRenderer * renderer =
+        [[AKKAAEOfflineRenderer alloc] initWithSampleRate:sampleRate numberOfChannels:2 framesPerCycle:256
+                                                    block:^(const AKKAAERenderContext * context) {
+        for ( int track=0; track<trackCount; track++ ) {
+            const AudioBufferList * abl = AKKAAEBufferStackPushWithChannels(context->stack, 1, 1);
+            float * samples = (float *)abl->mBuffers[0].mData;
+            float rate = (110.0f * (track + 1)) / context->sampleRate;
+            for ( UInt32 f=0; f<context->frames; f++ ) {
+                samples[f] = AKKAAEDSPGenerateOscillator(rate, &positions[track]) - 0.5f;
+            }
+            if ( track > 0 ) AKKAAERenderProfilerTimeSection(profiler, section, AKKAAEBufferStackMix(context->stack, 2));
+        }
+        AKKAAERenderContextOutput(context, 1);
+        AKKAAEBufferStackPop(context->stack, 1);
+    }];
+    renderer.profiler = profiler;
+    AudioBufferList * output = AKKAAEAudioBufferListCreate((int)(sampleRate * 10));
+    [renderer renderFrames:(UInt32)(sampleRate * 10) toBufferList:output];
+
+    AKKAAERenderProfilerGetSnapshot(profiler, &snapshot);
+    XCTAssertEqual(snapshot.cycles, renderer.statistics.cycles);
+    XCTAssertEqual(snapshot.sections[0].calls, snapshot.cycles * (trackCount - 1));
+    NSData * json = [NSJSONSerialization dataWithJSONObject:AKKAAERenderProfilerSnapshotDictionary(&snapshot) options:0 error:NULL];
+    XCTAssertNotNil(json);
+    printf("profiled render: average load %.2f%%, peak load %.2f%%, mix %.1f%% of render time, %llu overruns\n",
+           snapshot.averageLoad * 100.0, snapshot.peakLoad * 100.0, snapshot.sections[0].totalTime / snapshot.totalTime * 100.0,
+           (unsigned long long)snapshot.overruns);
+
+    AKKAAEAudioBufferListFree(output);
+    free(positions);
+    AKKAAERenderProfilerFree(profiler);
+}
+
+#pragma mark - Virtual device
+
+- (void)testVirtualDeviceSoak {
+    // 32 tracks through the virtual device, free-running then paced to the wall clock, with generated input
+    const int trackCount = 32;
+    float * positions = calloc(trackCount, sizeof(float));
+    AKKAAEBufferStack * stack = AKKAAEBufferStackNew(4);
+    AudioBufferList * input = AKKAAEAudioBufferListCreate(AKKAAEBufferStackMaxFramesPerSlice);
+    __block Float64 expectedSampleTime = 0;
+    __block int discontinuities = 0;
+    __block int inputMismatches = 0;
+
+    AKKAAEIOAudioUnit * unit = [AKKAAEIOAudioUnit new];
+    unit.virtualDevice = YES;
+    unit.inputEnabled = YES;
+    unit.virtualInputChannels = 1;
+    unit.IOBufferDuration = 256.0 / 44100.0;
+    unit.virtualInputGenerator = ^(const AudioBufferList * buffer, UInt32 frames, const AudioTimeStamp * timestamp) {
+        ((float *)buffer->mBuffers[0].mData)[0] = (float)timestamp->mSampleTime;
+    };
+    __unsafe_unretained AKKAAEIOAudioUnit * weakUnit = unit;
+    unit.renderBlock = ^(AudioBufferList * ioData, UInt32 frames, const AudioTimeStamp * timestamp) {
+        if ( timestamp->mSampleTime != expectedSampleTime ) discontinuities++;
+        expectedSampleTime = timestamp->mSampleTime + frames;
+
+        AKKAAEIOAudioUnitRenderInput(weakUnit, input, frames);
+        if ( ((float *)input->mBuffers[0].mData)[0] != (float)timestamp->mSampleTime ) inputMismatches++;
+
+        AKKAAEBufferStackReset(stack);
+        AKKAAEBufferStackSetFrameCount(stack, frames);
+        AKKAAERenderContext context = { .output = ioData, .frames = frames, .sampleRate = 44100.0,
+                                        .timestamp = timestamp, .stack = stack };
+        for ( int track=0; track<trackCount; track++ ) {
+            const AudioBufferList * abl = AKKAAEBufferStackPushWithChannels(stack, 1, 1);
+            float * samples = (float *)abl->mBuffers[0].mData;
+            float rate = (110.0f * (track + 1)) / 44100.0f;
+            for ( UInt32 f=0; f<frames; f++ ) samples[f] = AKKAAEDSPGenerateOscillator(rate, &positions[track]) - 0.5f;
+            AKKAAEBufferStackApplyFaders(stack, 1.0f / trackCount, NULL, 0, NULL);
+            AKKAAERenderContextOutput(&context, 1);
+            AKKAAEBufferStackPop(stack, 1);
+        }
+    };
+
+    const AKKAAEIOAudioUnitVirtualClock clocks[] = { AKKAAEIOAudioUnitVirtualClockFreeRunning, AKKAAEIOAudioUnitVirtualClockRealtime };
+    const char * clockNames[] = { "free-running", "realtime" };
+    for ( int i=0; i<2; i++ ) {
+        NSError * error = nil;
+        unit.virtualClock = clocks[i];
+        XCTAssertTrue([unit setup:&error], @"%@", error);
+        expectedSampleTime = 0;
+        XCTAssertTrue([unit start:&error], @"%@", error);
+        [NSThread sleepForTimeInterval:2.0];
+        [unit stop];
+
+        AKKAAEIOAudioUnitVirtualDeviceStatistics statistics = AKKAAEIOAudioUnitGetVirtualDeviceStatistics(unit);
+        AKKAAESeconds audio = statistics.cycles * unit.IOBufferDuration;
+        printf("virtual-device %s: %llu cycles = %.1fs of audio in 2s, %llu deadline misses, longest render %.1fus\n",
+               clockNames[i], (unsigned long long)statistics.cycles, audio, (unsigned long long)statistics.deadlineMisses,
+               statistics.longestRender * 1.0e6);
+        XCTAssertEqual(inputMismatches, 0);
+        if ( statistics.skippedFrames == 0 ) XCTAssertEqual(discontinuities, 0);
+        if ( clocks[i] == AKKAAEIOAudioUnitVirtualClockRealtime ) {
+            XCTAssertEqualWithAccuracy(audio, 2.0, 0.1);
+        } else {
+            XCTAssertGreaterThan(audio, 2.0);
+        }
+        discontinuities = 0;
+    }
+
+    AKKAAEAudioBufferListFree(input);
+    AKKAAEBufferStackFree(stack);
+    free(positions);
+}
+
+@end
@@ -0,0 +1,85 @@
+//
+//  AKKAAEResamplerBenchmarks.m
+//  AKKAAudioEngineSampleTests
+//
+//  Created by 张一鸣 on 2016/12/6.
+//  Copyright (c) 2016 AKKA. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "AKKAAEAudioBufferListUtilities.h"
+#import "AKKAAEResampler.h"
+#import "AKKAAEBenchmarkSupport.h"
+
+@interface AKKAAEResamplerBenchmarks : XCTestCase
+@end
+
+@implementation AKKAAEResamplerBenchmarks
+
+- (void)testResamplerQualityAndThroughput {
+    const double rates[][2] = { { 44100, 48000 }, { 48000, 44100 }, { 96000, 48000 } };
+    const double attenuations[] = { 50, 70, 90, 110 };
+    const char * names[] = { "low", "medium", "high", "mastering" };
+    const UInt32 block = 512;
+
+    for ( int quality=AKKAAEResamplerQualityLow; quality<=AKKAAEResamplerQualityMastering; quality++ ) {
+        for ( int r=0; r<3; r++ ) {
+            double inputRate = rates[r][0], outputRate = rates[r][1];
+            UInt32 inputFrames = (UInt32)inputRate;
+            AudioBufferList * input = AKKAAEAudioBufferListCreate(inputFrames);
+            AudioBufferList * output = AKKAAEAudioBufferListCreate((int)outputRate + block);
+            for ( UInt32 i=0; i<inputFrames; i++ ) {
+                ((float *)input->mBuffers[0].mData)[i] = sin(2.0 * M_PI * 1000.0 * i / inputRate);
+            }
+            memcpy(input->mBuffers[1].mData, input->mBuffers[0].mData, sizeof(float) * inputFrames);
+
+            // One second of a 1 kHz sine in one go: exact frame counts, and the error against the ideal output
+            AKKAAEResampler * resampler = AKKAAEResamplerNew(inputRate, outputRate, 2, quality);
+            UInt32 expectedFrames = AKKAAEResamplerGetOutputFramesForInput(resampler, inputFrames);
+            UInt32 taken = inputFrames;
+            UInt32 produced = AKKAAEResamplerProcess(resampler, input, &taken, output, (UInt32)outputRate + block);
+            XCTAssertEqual(taken, inputFrames);
+            XCTAssertEqual(produced, expectedFrames);
+            double signal = 0, noise = 0;
+            const float * samples = (const float *)output->mBuffers[1].mData;
+            for ( UInt32 i=2000; i<produced-100; i++ ) {
+                double ideal = sin(2.0 * M_PI * 1000.0 * i / outputRate);
+                signal += ideal * ideal;
+                noise += (samples[i] - ideal) * (samples[i] - ideal);
+            }
+            double snr = 10.0 * log10(signal / noise);
+            XCTAssertGreaterThan(snr, attenuations[quality] - 3.0, @"%s %g -> %g", names[quality], inputRate, outputRate);
+
+            // The same audio in uneven blocks gives the same output
+            AudioBufferList * chunked = AKKAAEAudioBufferListCreate((int)outputRate + block);
+            AKKAAEResamplerReset(resampler);
+            UInt32 chunkedFrames = 0;
+            for ( UInt32 offset=0; offset<inputFrames; ) {
+                UInt32 frames = MIN(inputFrames - offset, 100 + arc4random_uniform(900));
+                AKKAAEAudioBufferListCopyOnStack(inputChunk, input, offset);
+                AKKAAEAudioBufferListCopyOnStack(outputChunk, chunked, chunkedFrames);
+                chunkedFrames += AKKAAEResamplerProcess(resampler, inputChunk, &frames, outputChunk, (UInt32)outputRate + block - chunkedFrames);
+                offset += frames;
+            }
+            XCTAssertEqual(chunkedFrames, produced);
+            XCTAssertEqual(memcmp(chunked->mBuffers[0].mData, output->mBuffers[0].mData, sizeof(float) * produced), 0);
+
+            // Throughput in channels per core: realtime output channels one core could keep up with
+            AKKAAEResamplerReset(resampler);
+            double framesPerSecond = AKKAAEBenchmarkFramesPerSecond(block, ^{
+                UInt32 frames = MIN(AKKAAEResamplerGetInputFramesForOutput(resampler, block), inputFrames);
+                AKKAAEResamplerProcess(resampler, input, &frames, output, block);
+            });
+            printf("resample %-9s %6.0f -> %6.0f: %5.1f dB, latency %5.1f frames, %7.1f channels per core\n",
+                   names[quality], inputRate, outputRate, snr, AKKAAEResamplerGetLatency(resampler),
+                   framesPerSecond * 2.0 / outputRate);
+
+            AKKAAEResamplerFree(resampler);
+            AKKAAEAudioBufferListFree(input);
+            AKKAAEAudioBufferListFree(output);
+            AKKAAEAudioBufferListFree(chunked);
+        }
+    }
+}
+
+@end
@@ -0,0 +1,110 @@
+//
+//  AKKAAEResamplerTests.m
+//  AKKAAudioEngineSampleTests
+//
+//  Created by 张一鸣 on 2016/12/6.
+//  Copyright (c) 2016 AKKA. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "AKKAAEResampler.h"
+#import "AKKAAEBufferStack.h"
+#import "AKKAAEOfflineRenderer.h"
+#import "AKKAAEAudioBufferListUtilities.h"
+
+// A resampler source: a 1 kHz sine on the input timeline, one mono buffer per call
+static void AKKAAEResamplerTestSineSource(void * userInfo, const AKKAAERenderContext * context) {
+    int * calls = (int *)userInfo;
+    (*calls)++;
+    const AudioBufferList * abl = AKKAAEBufferStackPushWithChannels(context->stack, 1, 1);
+    if ( !abl ) return;
+    for ( UInt32 f=0; f<context->frames; f++ ) {
+        ((float *)abl->mBuffers[0].mData)[f] = sin(2.0 * M_PI * 1000.0 * (context->timestamp->mSampleTime + f) / context->sampleRate);
+    }
+}
+
+@interface AKKAAEResamplerTests : XCTestCase
+@end
+
+@implementation AKKAAEResamplerTests
+
+- (void)testRenderDownsamplingOnCycleSizedStack {
+    // The offline renderer and the virtual device size their stacks to one cycle; downsampling needs
+    // more input than that per cycle, so the source is pulled in slices, and the output has no gaps
+    const double rates[][2] = { { 96000, 44100 }, { 192000, 44100 }, { 48000, 44100 } };
+    const UInt32 framesPerCycle = 256;
+    const int cycles = 400;
+    for ( int r=0; r<3; r++ ) {
+        double inputRate = rates[r][0], outputRate = rates[r][1];
+        AKKAAEBufferStack * stack = AKKAAEBufferStackNewWithMaxFrames(4, 2, 0, framesPerCycle);
+        AKKAAEBufferStackSetFrameCount(stack, framesPerCycle);
+        AKKAAEResampler * resampler = AKKAAEResamplerNew(inputRate, outputRate, 2, AKKAAEResamplerQualityHigh);
+        AudioTimeStamp timestamp = { .mFlags = kAudioTimeStampSampleTimeValid };
+        AKKAAERenderContext context = { .frames = framesPerCycle, .sampleRate = outputRate, .timestamp = &timestamp, .stack = stack };
+        double signal = 0, noise = 0;
+        int calls = 0;
+        for ( int cycle=0; cycle<cycles; cycle++ ) {
+            const AudioBufferList * abl = AKKAAEResamplerRender(resampler, &context, AKKAAEResamplerTestSineSource, &calls);
+            XCTAssertTrue(abl != NULL);
+            XCTAssertEqual(AKKAAEBufferStackCount(stack), 1);
+            if ( !abl ) break;
+            for ( int ch=0; ch<2; ch++ ) {
+                const float * samples = (const float *)abl->mBuffers[ch].mData;
+                for ( UInt32 f=0; f<framesPerCycle; f++ ) {
+                    UInt64 t = (UInt64)timestamp.mSampleTime + f;
+                    if ( t < 1000 ) continue;
+                    double ideal = sin(2.0 * M_PI * 1000.0 * t / outputRate);
+                    signal += ideal * ideal;
+                    noise += (samples[f] - ideal) * (samples[f] - ideal);
+                }
+            }
+            AKKAAEBufferStackPop(stack, 1);
+            timestamp.mSampleTime += framesPerCycle;
+        }
+        double snr = 10.0 * log10(signal / noise);
+        XCTAssertGreaterThan(snr, 87.0, @"%g -> %g", inputRate, outputRate);
+        XCTAssertGreaterThan(calls, cycles, @"The source should be pulled more than once per cycle");
+        XCTAssertLessThanOrEqual(calls, cycles * (int)ceil(inputRate / outputRate),
+                                 @"%g -> %g: the source should be pulled no more than a cycle's input needs", inputRate, outputRate);
+        AKKAAEResamplerFree(resampler);
+        AKKAAEBufferStackFree(stack);
+    }
+}
+
+- (void)testOfflineRenderDownsampledSource {
+    // The renderer's stack holds one cycle; a 96 kHz source resampled into it needs more than twice that per cycle
+    const double sampleRate = 44100.0;
+    const UInt32 framesPerCycle = 256;
+    const UInt64 frames = 2 * sampleRate;
+    AKKAAEResampler * resampler = AKKAAEResamplerNew(96000.0, sampleRate, 2, AKKAAEResamplerQualityHigh);
+    __block int calls = 0;
+    AKKAAEOfflineRenderer * renderer =
+        [[AKKAAEOfflineRenderer alloc] initWithSampleRate:sampleRate numberOfChannels:2 framesPerCycle:framesPerCycle
+                                                    block:^(const AKKAAERenderContext * context) {
+        if ( AKKAAEResamplerRender(resampler, context, AKKAAEResamplerTestSineSource, &calls) ) {
+            AKKAAERenderContextOutput(context, 1);
+        }
+    }];
+
+    AudioBufferList * output = AKKAAEAudioBufferListCreate((int)frames);
+    [renderer renderFrames:(UInt32)frames toBufferList:output];
+    double signal = 0, noise = 0;
+    for ( int ch=0; ch<2; ch++ ) {
+        const float * samples = (const float *)output->mBuffers[ch].mData;
+        for ( UInt64 f=1000; f<frames; f++ ) {
+            double ideal = sin(2.0 * M_PI * 1000.0 * f / sampleRate);
+            signal += ideal * ideal;
+            noise += (samples[f] - ideal) * (samples[f] - ideal);
+        }
+    }
+    double snr = 10.0 * log10(signal / noise);
+    XCTAssertGreaterThan(snr, 87.0, @"Downsampled output should have no silent gaps");
+    int cycles = (int)((frames + framesPerCycle - 1) / framesPerCycle);
+    XCTAssertGreaterThan(calls, cycles, @"The source should be pulled more than once per cycle");
+    XCTAssertLessThanOrEqual(calls, cycles * (int)ceil(96000.0 / sampleRate));
+
+    AKKAAEAudioBufferListFree(output);
+    AKKAAEResamplerFree(resampler);
+}
+
+@end
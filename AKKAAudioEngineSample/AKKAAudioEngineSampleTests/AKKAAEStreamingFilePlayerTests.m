@@ -0,0 +1,85 @@
+//
+//  AKKAAEStreamingFilePlayerTests.m
+//  AKKAAudioEngineSampleTests
+//
+//  Created by 张一鸣 on 2016/12/6.
+//  Copyright (c) 2016 AKKA. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "AKKAAEStreamingFilePlayer.h"
+#import "AKKAAEAudioFile.h"
+#import "AKKAAEBufferStack.h"
+#import "AKKAAEAudioBufferListUtilities.h"
+#import <unistd.h>
+
+@interface AKKAAEStreamingFilePlayerTests : XCTestCase
+@end
+
+@implementation AKKAAEStreamingFilePlayerTests
+
+- (void)testTruncatedLoopingFile {
+    // A looping file cut short on disk: the player ends where the audio runs out, and the I/O thread carries on serving others
+    const double sampleRate = 44100.0;
+    const UInt64 fileFrames = (UInt64)sampleRate;
+    const UInt32 frames = 256;
+    NSString * directory = [NSTemporaryDirectory() stringByAppendingPathComponent:@"AKKAAEStreamingTruncated"];
+    [[NSFileManager defaultManager] createDirectoryAtPath:directory withIntermediateDirectories:YES attributes:nil error:NULL];
+
+    AudioBufferList * noise = AKKAAEAudioBufferListCreateWithFormat(AKKAAEAudioDescriptionWithChannelsAndRate(2, sampleRate), 4096);
+    for ( int c=0; c<2; c++ ) {
+        for ( UInt32 f=0; f<4096; f++ ) ((float *)noise->mBuffers[c].mData)[f] = ((float)arc4random_uniform(20001) / 10000.0f) - 1.0f;
+    }
+    NSURL * urls[2];
+    for ( int i=0; i<2; i++ ) {
+        urls[i] = [NSURL fileURLWithPath:[directory stringByAppendingPathComponent:[NSString stringWithFormat:@"%d.wav", i]]];
+        AKKAAEAudioFile * file = AKKAAEAudioFileCreate(urls[i], AKKAAEAudioFileTypeWAVInt16, sampleRate, 2, NULL);
+        for ( UInt64 written = 0; written < fileFrames; written += 4096 ) {
+            AKKAAEAudioFileWrite(file, noise, (UInt32)MIN((UInt64)4096, fileFrames - written));
+        }
+        AKKAAEAudioFileClose(file, NULL);
+    }
+    AKKAAEAudioBufferListFree(noise);
+
+    // The header still says a second; only half of that is there
+    const UInt64 truncatedSize = [[[NSFileManager defaultManager] attributesOfItemAtPath:urls[0].path error:NULL] fileSize]
+        - (fileFrames / 2) * 2 * sizeof(SInt16);
+    XCTAssertEqual(truncate(urls[0].fileSystemRepresentation, (off_t)truncatedSize), 0);
+
+    AKKAAEStreamingFilePlayer * players[2];
+    for ( int i=0; i<2; i++ ) {
+        players[i] = AKKAAEStreamingFilePlayerNew(urls[i], 0, NULL);
+        XCTAssertTrue(players[i] != NULL);
+        AKKAAEStreamingFilePlayerSetLoop(players[i], YES, 0, 0);
+        AKKAAEStreamingFilePlayerSetPlaying(players[i], YES);
+    }
+
+    AKKAAEBufferStack * stack = AKKAAEBufferStackNew(0);
+    AKKAAEBufferStackSetFrameCount(stack, frames);
+    AudioTimeStamp timestamp = { .mFlags = kAudioTimeStampSampleTimeValid };
+    AKKAAERenderContext context = { .frames = frames, .sampleRate = sampleRate, .timestamp = &timestamp, .stack = stack };
+    int cycles = (int)(2 * fileFrames / frames);
+    for ( int cycle=0; cycle<cycles; cycle++ ) {
+        AKKAAEBufferStackReset(stack);
+        for ( int i=0; i<2; i++ ) AKKAAEStreamingFilePlayerRender(players[i], &context);
+        timestamp.mSampleTime += frames;
+        [NSThread sleepForTimeInterval:0.001];
+    }
+
+    XCTAssertTrue(AKKAAEStreamingFilePlayerGetStatistics(players[0]).readFailed);
+    XCTAssertTrue(AKKAAEStreamingFilePlayerGetFinished(players[0]));
+    XCTAssertLessThanOrEqual(AKKAAEStreamingFilePlayerGetPlayhead(players[0]), fileFrames / 2);
+    XCTAssertFalse(AKKAAEStreamingFilePlayerGetStatistics(players[1]).readFailed);
+    XCTAssertFalse(AKKAAEStreamingFilePlayerGetFinished(players[1]));
+
+    // A seek retries the file; it fails the same way
+    AKKAAEStreamingFilePlayerSeek(players[0], 0);
+    [NSThread sleepForTimeInterval:0.2];
+    XCTAssertTrue(AKKAAEStreamingFilePlayerGetStatistics(players[0]).readFailed);
+
+    for ( int i=0; i<2; i++ ) AKKAAEStreamingFilePlayerFree(players[i]);
+    AKKAAEBufferStackFree(stack);
+    [[NSFileManager defaultManager] removeItemAtPath:directory error:NULL];
+}
+
+@end
@@ -0,0 +1,280 @@
+//
+//  AKKAAudioEngineBenchmarks.m
+//  AKKAAudioEngineSampleTests
+//
+//  Created by 张一鸣 on 2016/12/6.
+//  Copyright (c) 2016 AKKA. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "AKKAAETime.h"
+#import "AKKAAEDSPKernels.h"
+#import "AKKAAEBufferStack.h"
+#import "AKKAAEDSPUtilties.h"
+#import "AKKAAEManagedValue.h"
+#import "AKKAAEArray.h"
+#import "AKKAAEAudioBufferListUtilities.h"
+#import "AKKAAEBenchmarkSupport.h"
+
+/*!
+ * Time a block for the microbenchmark suite, and add the result to a list
+ *
+ *  The iteration count is doubled until a run takes 20 ms; the best of three such runs is kept,
+ *  which is the figure least disturbed by other activity on the machine.
+ *
+ * @param results Array to add the result dictionary to
+ * @param name Benchmark name
+ * @param parameters The sweep parameters (frames, channels, depth) the block was run with
+ * @param frames Frames processed by one invocation of the block, or 0 if it doesn't process audio
+ * @param block The work to time
+ */
+static void AKKAAEBenchmarkRecord(NSMutableArray * results, NSString * name, NSDictionary * parameters,
+                                  UInt32 frames, void (^block)(void)) {
+    const AKKAAEHostTicks minimumRun = AKKAAEHostTicksFromSeconds(0.02);
+    UInt64 iterations = 1;
+    AKKAAEHostTicks best = 0;
+    for ( int run=0; run<3; ) {
+        AKKAAEHostTicks start = AKKAAECurrentTimeInHostTicks();
+        for ( UInt64 i=0; i<iterations; i++ ) block();
+        AKKAAEHostTicks elapsed = AKKAAECurrentTimeInHostTicks() - start;
+        if ( elapsed < minimumRun && run == 0 ) {
+            iterations *= 2;
+            continue;
+        }
+        best = run == 0 ? elapsed : MIN(best, elapsed);
+        run++;
+    }
+
+    double nanoseconds = AKKAAESecondsFromHostTicks(best) * 1.0e9 / iterations;
+    NSMutableDictionary * result = [NSMutableDictionary dictionaryWithDictionary:parameters];
+    result[@"name"] = name;
+    result[@"nsPerCall"] = @(nanoseconds);
+    if ( frames > 0 ) result[@"framesPerSecond"] = @(frames / (nanoseconds * 1.0e-9));
+    [results addObject:result];
+
+    NSMutableArray * descriptions = [NSMutableArray array];
+    for ( NSString * key in [parameters.allKeys sortedArrayUsingSelector:@selector(compare:)] ) {
+        [descriptions addObject:[NSString stringWithFormat:@"%@=%@", key, parameters[key]]];
+    }
+    printf("bench %-32s %-32s %12.1f ns/call\n", name.UTF8String,
+           [descriptions componentsJoinedByString:@" "].UTF8String, nanoseconds);
+}
+
+/*!
+ * The key a microbenchmark result is matched by between runs
+ */
+static NSString * AKKAAEBenchmarkResultKey(NSDictionary * result) {
+    return [NSString stringWithFormat:@"%@ frames=%@ channels=%@ depth=%@",
+            result[@"name"], result[@"frames"], result[@"channels"], result[@"depth"]];
+}
+
+@interface AKKAAudioEngineBenchmarks : XCTestCase
+@end
+
+@implementation AKKAAudioEngineBenchmarks
+
+#pragma mark - Microbenchmark suite
+
+- (void)testMicrobenchmarkSuite {
+    // Sweeps the buffer stack, the DSP utilities, managed values and arrays, and writes the results as JSON:
+    // to $AKKAAE_BENCHMARK_OUTPUT, or AKKAAEBenchmarks.json in the temporary directory. If
+    // $AKKAAE_BENCHMARK_BASELINE names the results of an earlier run, anything 20% slower fails.
+    const int channelCounts[] = { 1, 2, 8 };
+    const int depths[] = { 1, 8, 32 };
+    const int channelCountsCount = sizeof(channelCounts) / sizeof(int);
+    const int depthsCount = sizeof(depths) / sizeof(int);
+    NSMutableArray * results = [NSMutableArray array];
+
+    // Buffer stack
+    for ( int d=0; d<depthsCount; d++ ) {
+        for ( int c=0; c<channelCountsCount; c++ ) {
+            for ( int f=0; f<kBenchmarkFrameCountsCount; f++ ) {
+                int depth = depths[d], channels = channelCounts[c];
+                UInt32 frames = kBenchmarkFrameCounts[f];
+                NSDictionary * parameters = @{ @"depth": @(depth), @"channels": @(channels), @"frames": @(frames) };
+                AKKAAEBufferStack * stack = AKKAAEBufferStackNewWithOptions(depth + 1, channels, 0);
+                AKKAAEBufferStackSetFrameCount(stack, frames);
+
+                AKKAAEBenchmarkRecord(results, @"bufferStack.pushPop", parameters, 0, ^{
+                    AKKAAEBufferStackPushWithChannels(stack, depth, channels);
+                    AKKAAEBufferStackPop(stack, depth);
+                });
+
+                AKKAAEBufferStackPushWithChannels(stack, depth, channels);
+                for ( int i=0; i<depth; i++ ) {
+                    const AudioBufferList * abl = AKKAAEBufferStackGetMutable(stack, i);
+                    for ( int j=0; j<abl->mNumberBuffers; j++ ) AKKAAEBenchmarkFillNoise(abl->mBuffers[j].mData, frames);
+                }
+                AKKAAEBenchmarkRecord(results, @"bufferStack.duplicatePop", parameters, frames, ^{
+                    AKKAAEBufferStackDuplicate(stack);
+                    AKKAAEBufferStackPop(stack, 1);
+                });
+                float volume = 1.0f, balance = 0.0f;
+                float * volumeRef = &volume, * balanceRef = &balance;
+                AKKAAEBenchmarkRecord(results, @"bufferStack.applyFaders", parameters, frames, ^{
+                    *volumeRef = 1.0f; // Always ramping, the expensive path
+                    AKKAAEBufferStackApplyFaders(stack, 0.5f, volumeRef, 0.0f, balanceRef);
+                });
+                AKKAAEBufferStackPop(stack, depth);
+
+                if ( depth > 1 ) {
+                    // Mixing consumes the buffers, so each call pushes them again
+                    AKKAAEBenchmarkRecord(results, @"bufferStack.pushMixPop", parameters, frames * depth, ^{
+                        AKKAAEBufferStackPushWithChannels(stack, depth, channels);
+                        AKKAAEBufferStackMix(stack, depth);
+                        AKKAAEBufferStackPop(stack, 1);
+                    });
+                }
+
+                AKKAAEBufferStackFree(stack);
+            }
+        }
+    }
+
+    // DSP utilities
+    const UInt32 maxFrames = kBenchmarkFrameCounts[kBenchmarkFrameCountsCount-1];
+    const int mixInputCount = 8;
+    float * scratch = malloc(sizeof(float) * maxFrames);
+    float * mono1 = malloc(sizeof(float) * maxFrames);
+    float * mono2 = malloc(sizeof(float) * maxFrames);
+    AKKAAEBenchmarkFillNoise(mono1, maxFrames);
+    AKKAAEBenchmarkFillNoise(mono2, maxFrames);
+    for ( int c=0; c<channelCountsCount; c++ ) {
+        int channels = channelCounts[c];
+        AudioStreamBasicDescription format = AKKAAEAudioDescriptionWithChannelsAndRate(channels, 44100.0);
+        AudioBufferList * inputs[mixInputCount];
+        for ( int i=0; i<mixInputCount; i++ ) {
+            inputs[i] = AKKAAEAudioBufferListCreateWithFormat(format, maxFrames);
+            for ( int j=0; j<inputs[i]->mNumberBuffers; j++ ) AKKAAEBenchmarkFillNoise(inputs[i]->mBuffers[j].mData, maxFrames);
+        }
+        AudioBufferList * buffer = AKKAAEAudioBufferListCreateWithFormat(format, maxFrames);
+        AudioBufferList * output = AKKAAEAudioBufferListCreateWithFormat(format, maxFrames);
+        float gains[mixInputCount];
+        for ( int i=0; i<mixInputCount; i++ ) gains[i] = 1.0f / mixInputCount;
+
+        for ( int f=0; f<kBenchmarkFrameCountsCount; f++ ) {
+            UInt32 frames = kBenchmarkFrameCounts[f];
+            NSDictionary * parameters = @{ @"channels": @(channels), @"frames": @(frames) };
+            for ( int j=0; j<buffer->mNumberBuffers; j++ ) AKKAAEBenchmarkFillNoise(buffer->mBuffers[j].mData, frames);
+
+            AKKAAEBenchmarkRecord(results, @"dsp.applyGain", parameters, frames, ^{
+                AKKAAEDSPApplyGain(buffer, 0.999f, frames);
+            });
+            AKKAAEBenchmarkRecord(results, @"dsp.applyRamp", parameters, frames, ^{
+                float start = 1.0f;
+                AKKAAEDSPApplyRamp(buffer, &start, -0.5f / frames, frames);
+            });
+            AKKAAEBenchmarkRecord(results, @"dsp.applyEqualPowerRamp", parameters, frames, ^{
+                float start = 1.0f;
+                AKKAAEDSPApplyEqualPowerRamp(buffer, &start, -0.5f / frames, frames, scratch);
+            });
+            AKKAAEBenchmarkRecord(results, @"dsp.applyGainSmoothed", parameters, frames, ^{
+                float current = 1.0f;
+                AKKAAEDSPApplyGainSmoothed(buffer, 0.5f, &current, frames);
+            });
+            AKKAAEBenchmarkRecord(results, @"dsp.applyGainWithRamp", parameters, frames, ^{
+                float current = 1.0f;
+                AKKAAEDSPApplyGainWithRamp(buffer, 0.5f, &current, frames, frames);
+            });
+            AKKAAEBenchmarkRecord(results, @"dsp.applyVolumeAndBalance", parameters, frames, ^{
+                float volume = 1.0f, balance = 0.0f;
+                AKKAAEDSPApplyVolumeAndBalance(buffer, 0.5f, &volume, 0.0f, &balance, frames);
+            });
+            AKKAAEBenchmarkRecord(results, @"dsp.mix", parameters, frames, ^{
+                AKKAAEDSPMix(inputs[0], inputs[1], 0.5f, 0.5f, NO, frames, output);
+            });
+            AKKAAEBenchmarkRecord(results, @"dsp.mixMultiple", @{ @"channels": @(channels), @"frames": @(frames), @"depth": @(mixInputCount) },
+                                  frames * mixInputCount, ^{
+                AKKAAEDSPMixMultiple((const AudioBufferList * const *)inputs, gains, mixInputCount, NO, frames, output);
+            });
+            AKKAAEBenchmarkRecord(results, @"dsp.silence", parameters, frames, ^{
+                AKKAAEDSPSilence(output, 0, frames);
+            });
+
+            if ( channels == 1 ) {
+                AKKAAEBenchmarkRecord(results, @"dsp.applyGainSmoothedMono", parameters, frames, ^{
+                    float current = 1.0f;
+                    AKKAAEDSPApplyGainSmoothedMono(scratch, 0.5f, &current, frames);
+                });
+                AKKAAEBenchmarkRecord(results, @"dsp.mixMono", parameters, frames, ^{
+                    AKKAAEDSPMixMono(mono1, mono2, 0.5f, 0.5f, frames, scratch);
+                });
+                AKKAAEBenchmarkRecord(results, @"dsp.generateOscillator", parameters, frames, ^{
+                    float position = 0.0f;
+                    for ( UInt32 i=0; i<frames; i++ ) scratch[i] = AKKAAEDSPGenerateOscillator(440.0f / 44100.0f, &position);
+                });
+            }
+        }
+
+        for ( int i=0; i<mixInputCount; i++ ) AKKAAEAudioBufferListFree(inputs[i]);
+        AKKAAEAudioBufferListFree(buffer);
+        AKKAAEAudioBufferListFree(output);
+    }
+    free(scratch);
+    free(mono1);
+    free(mono2);
+
+    // Managed values and arrays, as the render thread reads them
+    const int readsPerCall = 1024;
+    AKKAAEManagedValue * value = [AKKAAEManagedValue new];
+    value.pointerValue = calloc(1, sizeof(int));
+    __unsafe_unretained AKKAAEManagedValue * unretainedValue = value;
+    __block uintptr_t sink = 0;
+    AKKAAEManagedValueCommitPendingUpdates();
+    AKKAAEBenchmarkRecord(results, @"managedValue.getValue", @{ @"depth": @(readsPerCall) }, 0, ^{
+        for ( int i=0; i<readsPerCall; i++ ) sink += (uintptr_t)AKKAAEManagedValueGetValue(unretainedValue);
+    });
+
+    for ( int d=0; d<depthsCount; d++ ) {
+        NSMutableArray * objects = [NSMutableArray array];
+        for ( int i=0; i<depths[d]; i++ ) [objects addObject:[NSObject new]];
+        AKKAAEArray * array = [AKKAAEArray new];
+        [array updateWithContentsOfArray:objects];
+        __unsafe_unretained AKKAAEArray * unretainedArray = array;
+        AKKAAEManagedValueCommitPendingUpdates();
+        AKKAAEBenchmarkRecord(results, @"array.getTokenAndIterate", @{ @"depth": @(depths[d]) }, 0, ^{
+            AKKAAEArrayToken token = AKKAAEArrayGetToken(unretainedArray);
+            int count = AKKAAEArrayGetCount(token);
+            for ( int i=0; i<count; i++ ) sink += (uintptr_t)AKKAAEArrayGetItem(token, i);
+        });
+    }
+    XCTAssertNotEqual(sink, 0);
+
+    // Machine-readable results
+    NSDictionary * environment = [NSProcessInfo processInfo].environment;
+    NSDictionary * report = @{
+        @"date": @([NSDate date].timeIntervalSince1970),
+        @"operatingSystem": [NSProcessInfo processInfo].operatingSystemVersionString,
+        @"processorCount": @([NSProcessInfo processInfo].activeProcessorCount),
+        @"dspBackend": @(AKKAAEDSPKernelsGet()->name),
+        @"results": results,
+    };
+    NSString * path = environment[@"AKKAAE_BENCHMARK_OUTPUT"]
+        ?: [NSTemporaryDirectory() stringByAppendingPathComponent:@"AKKAAEBenchmarks.json"];
+    NSError * error = nil;
+    NSData * json = [NSJSONSerialization dataWithJSONObject:report options:NSJSONWritingPrettyPrinted error:&error];
+    XCTAssertTrue(json && [json writeToFile:path options:NSDataWritingAtomic error:&error], @"%@", error);
+    printf("bench %d results written to %s\n", (int)results.count, path.UTF8String);
+
+    // Compare with an earlier run
+    NSString * baselinePath = environment[@"AKKAAE_BENCHMARK_BASELINE"];
+    if ( baselinePath ) {
+        NSData * baselineData = [NSData dataWithContentsOfFile:baselinePath];
+        NSDictionary * baseline = baselineData ? [NSJSONSerialization JSONObjectWithData:baselineData options:0 error:NULL] : nil;
+        XCTAssertNotNil(baseline, @"Couldn't read the baseline at %@", baselinePath);
+        NSMutableDictionary * baselineResults = [NSMutableDictionary dictionary];
+        for ( NSDictionary * result in baseline[@"results"] ) {
+            baselineResults[AKKAAEBenchmarkResultKey(result)] = result;
+        }
+        for ( NSDictionary * result in results ) {
+            NSString * key = AKKAAEBenchmarkResultKey(result);
+            double before = [baselineResults[key][@"nsPerCall"] doubleValue];
+            double after = [result[@"nsPerCall"] doubleValue];
+            if ( before <= 0 ) continue;
+            printf("bench %-80s %+6.1f%%\n", key.UTF8String, (after / before - 1.0) * 100.0);
+            XCTAssertLessThan(after, before * 1.2, @"%@ regressed from %.1f to %.1f ns/call", key, before, after);
+        }
+    }
+}
+
+@end